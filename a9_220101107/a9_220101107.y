@@ -47,37 +47,69 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <sys/resource.h>
 #include "quad.h"
+#include "irfile.h"
+#include "vm.h"
+#include "cfg.h"
+#include "opt.h"
+#include "x86.h"
+#include "jit.h"
+#include "cgen.h"
 
 // Function declarations
 void yyerror(char *s);
 int yylex(void);
 void updateOffsets(SymbolTable *table);
 char* getConstantValue(int ival, float fval, char cval, char *sval, int valueType);
+void addPendingParam(const char *name, Type type, int isPtr);
+void insertPendingParams(SymbolEntry *func);
+void declareVariable(SymbolEntry *entry, Type type, int isPtr, int isArray, int arraySize);
+Type returnType(SymbolEntry *func);
+struct Expr;
+void materialize(struct Expr *e);
+void toCondition(struct Expr *e);
+void discard(struct Expr *e);
+void compareAndBranch(struct Expr *result, OpCode jump, struct Expr *left, struct Expr *right);
 
 // Global variables
 SymbolEntry *currentFunctionEntry = NULL; // To keep track of current function during parsing
-int currentOffset = 0;
 int inLoop = 0;
 QuadList *breakList = NULL;
 QuadList *continueList = NULL;
+Type declType = INT_T;  // Base type of the declaration being parsed
+
+// Parameters of the declarator being parsed; they are inserted once the
+// function they belong to has its own table
+typedef struct PendingParam {
+    const char *name;
+    Type type;
+    int isPtr;
+} PendingParam;
+PendingParam *pendingParams = NULL;
+int pendingParamCount = 0;
+int pendingParamCapacity = 0;
 %}
 
 %union {
     int ival;
     float fval;
     char cval;
-    char *sval;
+    const char *sval;
     Type type;
     
-    struct {
-        char *place;         // Name of the result
+    struct Expr {
+        SymbolEntry *place;  // Symbol holding the result; NULL for a condition
         Type type;           // Type of expression
         QuadList *truelist;  // List of quads to patch for true condition
         QuadList *falselist; // List of quads to patch for false condition
         QuadList *nextlist;  // List of quads to patch for next statement
         int arrayFlag;       // Whether this is an array or not
         int ptrFlag;         // Whether this is a pointer or not
+        SymbolEntry *base;   // Array or pointer an element lvalue goes through
+        SymbolEntry *index;  // Byte offset of an array element within base
+        int count;           // Number of arguments in an argument list
 
                 // ✅ Add these:
         int isConstant;
@@ -95,12 +127,12 @@ QuadList *continueList = NULL;
         int isPtr;          // Whether it's a pointer
         int isArray;        // Whether it's an array
         int arraySize;      // Size of array
-        char *name;
+        const char *name;
     } decl;
     
     struct {
         int paramCount;     // Number of parameters
-        char *name;         // Function name
+        const char *name;   // Function name
     } func;
 }
 
@@ -142,7 +174,8 @@ QuadList *continueList = NULL;
 %type <expr> relational_expression additive_expression multiplicative_expression
 %type <expr> unary_expression postfix_expression primary_expression
 %type <expr> expression_opt initializer argument_expression_list_opt argument_expression_list
-%type <expr> unary_operator
+%type <expr> condition condition_opt
+%type <ival> unary_operator
 
 %type <stmt> statement compound_statement expression_statement selection_statement func_statement
 %type <stmt> iteration_statement jump_statement block_item block_item_list block_item_list_opt
@@ -169,7 +202,7 @@ M: /* empty */ {
 
 N: /* empty */ {
     $<stmt>$.nextlist = makelist(nextquad());
-    emitQuad("goto", NULL, NULL, "");
+    emitQuad(OP_GOTO, noOperand(), noOperand(), noOperand());
 };
 
 /* 1. Expressions */
@@ -194,30 +227,24 @@ assignment_expression
         $$.ptrFlag = $1.ptrFlag;
     }
     | unary_expression ASSIGN assignment_expression {
+        materialize(&$3);
+        
         // Type checking
         if ($1.type != $3.type) {
             // Need type conversion
-            if ($1.type == FLOAT_T && $3.type == INT_T) {
-                $3.place = convInt2Float($3.place);
-            } else if ($1.type == INT_T && $3.type == FLOAT_T) {
-                $3.place = convFloat2Int($3.place);
-            } else if ($1.type == INT_T && $3.type == CHAR_T) {
-                $3.place = convChar2Int($3.place);
-            } else if ($1.type == CHAR_T && $3.type == INT_T) {
-                $3.place = convInt2Char($3.place);
-            }
+            $3.place = convertType($3.place, $1.type);
         }
         
         // Generate assignment quad
-        if ($1.arrayFlag) {
-            // Array assignment needs indexed copy
-            emitQuad("[]=", $1.place, "", $3.place);
-        } else if ($1.ptrFlag) {
-            // Pointer assignment
-            emitQuad("*=", $1.place, "", $3.place);
+        if ($1.arrayFlag && $1.base) {
+            // Array element: store through the base and byte offset
+            emitQuad(OP_ARRAY_STORE, symOperand($1.index), symOperand($3.place), symOperand($1.base));
+        } else if ($1.ptrFlag && $1.base) {
+            // Dereferenced pointer: store through the pointer
+            emitQuad(OP_PTR_STORE, symOperand($3.place), noOperand(), symOperand($1.base));
         } else {
             // Regular assignment
-            emitQuad("=", $3.place, NULL, $1.place);
+            emitQuad(OP_ASSIGN, symOperand($3.place), noOperand(), symOperand($1.place));
         }
         
         // Result of assignment is the left operand
@@ -237,30 +264,32 @@ conditional_expression
         $$.arrayFlag = $1.arrayFlag;
         $$.ptrFlag = $1.ptrFlag;
     }
-    | logical_OR_expression QUESTION_MARK M expression COLON M conditional_expression {
-        // Create a temporary for result
-        SymbolEntry *temp = gentemp(currentTable, typecheck($4.type, $7.type));
-        
+    | logical_OR_expression QUESTION_MARK { toCondition(&$1); } M expression N COLON M conditional_expression {
         // Backpatch the truelist of logical_OR_expression to the first M
-        backpatch($1.truelist, $3);
+        backpatch($1.truelist, $4);
         
         // Backpatch the falselist of logical_OR_expression to the second M
-        backpatch($1.falselist, $6);
-        
-        // Generate quads for the assignments
-        emitQuad("=", $4.place, NULL, temp->name);
-        int quad1 = nextquad();
-        emitQuad("goto", NULL, NULL, "");
-        
-        emitQuad("=", $7.place, NULL, temp->name);
-        int quad2 = nextquad();
+        backpatch($1.falselist, $8);
+        
+        // The false branch falls through into its assignment
+        materialize(&$9);
+        Type resultType = typecheck($5.place ? $5.type : INT_T, $9.type);
+        if (resultType == VOID_T) {
+            yyerror("incompatible operand types");
+            YYABORT;
+        }
+        SymbolEntry *temp = gentemp(currentTable, resultType);
+        emitQuad(OP_ASSIGN, symOperand(convertType($9.place, resultType)), noOperand(), symOperand(temp));
+        int skip = nextquad();
+        emitQuad(OP_GOTO, noOperand(), noOperand(), noOperand());
         
-        // Backpatch the first goto to skip the second assignment
-        char target[10];
-        sprintf(target, "%d", quad2);
-        quads[quad1].result = strdup(target);
+        // The true branch jumps over it to its own assignment
+        backpatch($6.nextlist, nextquad());
+        materialize(&$5);
+        emitQuad(OP_ASSIGN, symOperand(convertType($5.place, resultType)), noOperand(), symOperand(temp));
+        backpatch(makelist(skip), nextquad());
         
-        $$.place = temp->name;
+        $$.place = temp;
         $$.type = temp->type;
         $$.truelist = NULL;
         $$.falselist = NULL;
@@ -278,21 +307,19 @@ logical_OR_expression
         $$.arrayFlag = $1.arrayFlag;
         $$.ptrFlag = $1.ptrFlag;
     }
-    | logical_OR_expression LOGICAL_OR M logical_AND_expression {
+    | logical_OR_expression LOGICAL_OR { toCondition(&$1); } M logical_AND_expression {
+        toCondition(&$5);
+        
         // Backpatch the falselist of logical_OR_expression to the M
-        backpatch($1.falselist, $3);
+        backpatch($1.falselist, $4);
         
         // Result of logical OR is merged truelists
-        $$.truelist = merge($1.truelist, $4.truelist);
-        $$.falselist = $4.falselist;
+        $$.truelist = merge($1.truelist, $5.truelist);
+        $$.falselist = $5.falselist;
+        $$.place = NULL;
         $$.type = BOOL_T;
-        
-        // If this is not a boolean expression, create a temporary
-        if ($1.place && $4.place) {
-            SymbolEntry *temp = gentemp(currentTable, INT_T);
-            emitQuad("||", $1.place, $4.place, temp->name);
-            $$.place = temp->name;
-        }
+        $$.arrayFlag = 0;
+        $$.ptrFlag = 0;
     }
     ;
 
@@ -305,21 +332,19 @@ logical_AND_expression
         $$.arrayFlag = $1.arrayFlag;
         $$.ptrFlag = $1.ptrFlag;
     }
-    | logical_AND_expression LOGICAL_AND M equality_expression {
+    | logical_AND_expression LOGICAL_AND { toCondition(&$1); } M equality_expression {
+        toCondition(&$5);
+        
         // Backpatch the truelist of logical_AND_expression to the M
-        backpatch($1.truelist, $3);
+        backpatch($1.truelist, $4);
         
         // Result of logical AND is merged falselists
-        $$.falselist = merge($1.falselist, $4.falselist);
-        $$.truelist = $4.truelist;
+        $$.falselist = merge($1.falselist, $5.falselist);
+        $$.truelist = $5.truelist;
+        $$.place = NULL;
         $$.type = BOOL_T;
-        
-        // If this is not a boolean expression, create a temporary
-        if ($1.place && $4.place) {
-            SymbolEntry *temp = gentemp(currentTable, INT_T);
-            emitQuad("&&", $1.place, $4.place, temp->name);
-            $$.place = temp->name;
-        }
+        $$.arrayFlag = 0;
+        $$.ptrFlag = 0;
     }
     ;
 
@@ -332,45 +357,13 @@ equality_expression
         $$.arrayFlag = $1.arrayFlag;
         $$.ptrFlag = $1.ptrFlag;
     }
-    | equality_expression EQUAL_EQUAL relational_expression {
-        Type resultType = typecheck($1.type, $3.type);
-        
-        // Create temporary for result
-        SymbolEntry *temp = gentemp(currentTable, INT_T);
-        
-        // Generate quad for equality comparison
-        emitQuad("==", $1.place, $3.place, temp->name);
-        
-        // For boolean expressions, create truelist and falselist
-        $$.truelist = makelist(nextquad());
-        emitQuad("if", temp->name, NULL, "");
-        $$.falselist = makelist(nextquad());
-        emitQuad("goto", NULL, NULL, "");
-        
-        $$.place = temp->name;
-        $$.type = BOOL_T;
-        $$.arrayFlag = 0;
-        $$.ptrFlag = 0;
+    | equality_expression EQUAL_EQUAL { materialize(&$1); } relational_expression {
+        // if left == right goto true; goto false
+        compareAndBranch(&$$, OP_IFEQ, &$1, &$4);
     }
-    | equality_expression NOT_EQUAL relational_expression {
-        Type resultType = typecheck($1.type, $3.type);
-        
-        // Create temporary for result
-        SymbolEntry *temp = gentemp(currentTable, INT_T);
-        
-        // Generate quad for inequality comparison
-        emitQuad("!=", $1.place, $3.place, temp->name);
-        
-        // For boolean expressions, create truelist and falselist
-        $$.truelist = makelist(nextquad());
-        emitQuad("if", temp->name, NULL, "");
-        $$.falselist = makelist(nextquad());
-        emitQuad("goto", NULL, NULL, "");
-        
-        $$.place = temp->name;
-        $$.type = BOOL_T;
-        $$.arrayFlag = 0;
-        $$.ptrFlag = 0;
+    | equality_expression NOT_EQUAL { materialize(&$1); } relational_expression {
+        // if left != right goto true; goto false
+        compareAndBranch(&$$, OP_IFNE, &$1, &$4);
     }
     ;
 
@@ -383,85 +376,21 @@ relational_expression
         $$.arrayFlag = $1.arrayFlag;
         $$.ptrFlag = $1.ptrFlag;
     }
-    | relational_expression LESS_THAN additive_expression {
-        Type resultType = typecheck($1.type, $3.type);
-        
-        // Create temporary for result
-        SymbolEntry *temp = gentemp(currentTable, INT_T);
-        
-        // Generate quad for less than comparison
-        emitQuad("<", $1.place, $3.place, temp->name);
-        
-        // For boolean expressions, create truelist and falselist
-        $$.truelist = makelist(nextquad());
-        emitQuad("if", temp->name, NULL, "");
-        $$.falselist = makelist(nextquad());
-        emitQuad("goto", NULL, NULL, "");
-        
-        $$.place = temp->name;
-        $$.type = BOOL_T;
-        $$.arrayFlag = 0;
-        $$.ptrFlag = 0;
+    | relational_expression LESS_THAN { materialize(&$1); } additive_expression {
+        // if left < right goto true; goto false
+        compareAndBranch(&$$, OP_IFLT, &$1, &$4);
     }
-    | relational_expression GREATER_THAN additive_expression {
-        Type resultType = typecheck($1.type, $3.type);
-        
-        // Create temporary for result
-        SymbolEntry *temp = gentemp(currentTable, INT_T);
-        
-        // Generate quad for greater than comparison
-        emitQuad(">", $1.place, $3.place, temp->name);
-        
-        // For boolean expressions, create truelist and falselist
-        $$.truelist = makelist(nextquad());
-        emitQuad("if", temp->name, NULL, "");
-        $$.falselist = makelist(nextquad());
-        emitQuad("goto", NULL, NULL, "");
-        
-        $$.place = temp->name;
-        $$.type = BOOL_T;
-        $$.arrayFlag = 0;
-        $$.ptrFlag = 0;
+    | relational_expression GREATER_THAN { materialize(&$1); } additive_expression {
+        // if left > right goto true; goto false
+        compareAndBranch(&$$, OP_IFGT, &$1, &$4);
     }
-    | relational_expression LESS_THAN_EQUAL additive_expression {
-        Type resultType = typecheck($1.type, $3.type);
-        
-        // Create temporary for result
-        SymbolEntry *temp = gentemp(currentTable, INT_T);
-        
-        // Generate quad for less than or equal comparison
-        emitQuad("<=", $1.place, $3.place, temp->name);
-        
-        // For boolean expressions, create truelist and falselist
-        $$.truelist = makelist(nextquad());
-        emitQuad("if", temp->name, NULL, "");
-        $$.falselist = makelist(nextquad());
-        emitQuad("goto", NULL, NULL, "");
-        
-        $$.place = temp->name;
-        $$.type = BOOL_T;
-        $$.arrayFlag = 0;
-        $$.ptrFlag = 0;
+    | relational_expression LESS_THAN_EQUAL { materialize(&$1); } additive_expression {
+        // if left <= right goto true; goto false
+        compareAndBranch(&$$, OP_IFLE, &$1, &$4);
     }
-    | relational_expression GREATER_THAN_EQUAL additive_expression {
-        Type resultType = typecheck($1.type, $3.type);
-        
-        // Create temporary for result
-        SymbolEntry *temp = gentemp(currentTable, INT_T);
-        
-        // Generate quad for greater than or equal comparison
-        emitQuad(">=", $1.place, $3.place, temp->name);
-        
-        // For boolean expressions, create truelist and falselist
-        $$.truelist = makelist(nextquad());
-        emitQuad("if", temp->name, NULL, "");
-        $$.falselist = makelist(nextquad());
-        emitQuad("goto", NULL, NULL, "");
-        
-        $$.place = temp->name;
-        $$.type = BOOL_T;
-        $$.arrayFlag = 0;
-        $$.ptrFlag = 0;
+    | relational_expression GREATER_THAN_EQUAL { materialize(&$1); } additive_expression {
+        // if left >= right goto true; goto false
+        compareAndBranch(&$$, OP_IFGE, &$1, &$4);
     }
     ;
 
@@ -474,30 +403,42 @@ additive_expression
         $$.arrayFlag = $1.arrayFlag;
         $$.ptrFlag = $1.ptrFlag;
     }
-    | additive_expression PLUS multiplicative_expression {
-        Type resultType = typecheck($1.type, $3.type);
+    | additive_expression PLUS { materialize(&$1); } multiplicative_expression {
+        materialize(&$4);
+        
+        Type resultType = typecheck($1.type, $4.type);
+        if (resultType == VOID_T) {
+            yyerror("incompatible operand types");
+            YYABORT;
+        }
         
         // Create temporary for result
         SymbolEntry *temp = gentemp(currentTable, resultType);
         
         // Generate quad for addition
-        emitQuad("+", $1.place, $3.place, temp->name);
+        emitQuad(OP_ADD, symOperand($1.place), symOperand($4.place), symOperand(temp));
         
-        $$.place = temp->name;
+        $$.place = temp;
         $$.type = resultType;
         $$.arrayFlag = 0;
         $$.ptrFlag = 0;
     }
-    | additive_expression MINUS multiplicative_expression {
-        Type resultType = typecheck($1.type, $3.type);
+    | additive_expression MINUS { materialize(&$1); } multiplicative_expression {
+        materialize(&$4);
+        
+        Type resultType = typecheck($1.type, $4.type);
+        if (resultType == VOID_T) {
+            yyerror("incompatible operand types");
+            YYABORT;
+        }
         
         // Create temporary for result
         SymbolEntry *temp = gentemp(currentTable, resultType);
         
         // Generate quad for subtraction
-        emitQuad("-", $1.place, $3.place, temp->name);
+        emitQuad(OP_SUB, symOperand($1.place), symOperand($4.place), symOperand(temp));
         
-        $$.place = temp->name;
+        $$.place = temp;
         $$.type = resultType;
         $$.arrayFlag = 0;
         $$.ptrFlag = 0;
@@ -513,44 +454,62 @@ multiplicative_expression
         $$.arrayFlag = $1.arrayFlag;
         $$.ptrFlag = $1.ptrFlag;
     }
-    | multiplicative_expression ASTERISK unary_expression {
-        Type resultType = typecheck($1.type, $3.type);
+    | multiplicative_expression ASTERISK { materialize(&$1); } unary_expression {
+        materialize(&$4);
+        
+        Type resultType = typecheck($1.type, $4.type);
+        if (resultType == VOID_T) {
+            yyerror("incompatible operand types");
+            YYABORT;
+        }
         
         // Create temporary for result
         SymbolEntry *temp = gentemp(currentTable, resultType);
         
         // Generate quad for multiplication
-        emitQuad("*", $1.place, $3.place, temp->name);
+        emitQuad(OP_MUL, symOperand($1.place), symOperand($4.place), symOperand(temp));
         
-        $$.place = temp->name;
+        $$.place = temp;
         $$.type = resultType;
         $$.arrayFlag = 0;
         $$.ptrFlag = 0;
     }
-    | multiplicative_expression FORWARD_SLASH unary_expression {
-        Type resultType = typecheck($1.type, $3.type);
+    | multiplicative_expression FORWARD_SLASH { materialize(&$1); } unary_expression {
+        materialize(&$4);
+        
+        Type resultType = typecheck($1.type, $4.type);
+        if (resultType == VOID_T) {
+            yyerror("incompatible operand types");
+            YYABORT;
+        }
         
         // Create temporary for result
         SymbolEntry *temp = gentemp(currentTable, resultType);
         
         // Generate quad for division
-        emitQuad("/", $1.place, $3.place, temp->name);
+        emitQuad(OP_DIV, symOperand($1.place), symOperand($4.place), symOperand(temp));
         
-        $$.place = temp->name;
+        $$.place = temp;
         $$.type = resultType;
         $$.arrayFlag = 0;
         $$.ptrFlag = 0;
     }
-    | multiplicative_expression PERCENT unary_expression {
-        Type resultType = typecheck($1.type, $3.type);
+    | multiplicative_expression PERCENT { materialize(&$1); } unary_expression {
+        materialize(&$4);
+        
+        Type resultType = typecheck($1.type, $4.type);
+        if (resultType == VOID_T) {
+            yyerror("incompatible operand types");
+            YYABORT;
+        }
         
         // Create temporary for result
         SymbolEntry *temp = gentemp(currentTable, resultType);
         
         // Generate quad for modulo
-        emitQuad("%", $1.place, $3.place, temp->name);
+        emitQuad(OP_MOD, symOperand($1.place), symOperand($4.place), symOperand(temp));
         
-        $$.place = temp->name;
+        $$.place = temp;
         $$.type = resultType;
         $$.arrayFlag = 0;
         $$.ptrFlag = 0;
@@ -559,24 +518,19 @@ multiplicative_expression
 
 unary_operator
     : AMPERSAND {
-        $$.type = PTR_T;
-        $$.place = "address";
+        $$ = OP_ADDR;
     }
     | ASTERISK {
-        $$.type = PTR_T;
-        $$.place = "deref";
+        $$ = OP_DEREF;
     }
     | PLUS {
-        $$.type = INT_T;
-        $$.place = "uplus";
+        $$ = OP_NOP;    // Unary plus generates no code
     }
     | MINUS {
-        $$.type = INT_T;
-        $$.place = "uminus";
+        $$ = OP_UMINUS;
     }
     | EXCLAMATION {
-        $$.type = BOOL_T;
-        $$.place = "not";
+        $$ = OP_NOT;
     }
     ;
 
@@ -590,44 +544,64 @@ unary_expression
         $$.ptrFlag = $1.ptrFlag;
     }
     | unary_operator unary_expression {
-        if (strcmp($1.place, "address") == 0) {
+        if ($1 != OP_NOT)
+            materialize(&$2);
+        
+        if ($1 == OP_ADDR && $2.arrayFlag && $2.base) {
+            // Address of an element: the array's address, or the pointer
+            // indexed, plus the element's byte offset
+            SymbolEntry *start = $2.base;
+            if (start->type == ARRAY_T) {
+                start = gentemp(currentTable, PTR_T);
+                emitQuad(OP_ADDR, symOperand($2.base), noOperand(), symOperand(start));
+            }
+            SymbolEntry *temp = gentemp(currentTable, PTR_T);
+            updateSymbolElementType(temp, $2.type);
+            emitQuad(OP_ADD, symOperand(start), symOperand($2.index), symOperand(temp));
+            $$.place = temp;
+            $$.type = PTR_T;
+            $$.ptrFlag = 0;
+        } else if ($1 == OP_ADDR && $2.ptrFlag && $2.base) {
+            // &*p is p itself
+            $$.place = $2.base;
+            $$.type = PTR_T;
+            $$.ptrFlag = 0;
+        } else if ($1 == OP_ADDR) {
             // Address operator
             SymbolEntry *temp = gentemp(currentTable, PTR_T);
-            emitQuad("&", $2.place, NULL, temp->name);
-            $$.place = temp->name;
+            updateSymbolElementType(temp, $2.type);
+            emitQuad(OP_ADDR, symOperand($2.place), noOperand(), symOperand(temp));
+            $$.place = temp;
             $$.type = PTR_T;
-            $$.ptrFlag = 1;
-        } else if (strcmp($1.place, "deref") == 0) {
-            // Dereference operator
-            SymbolEntry *temp = gentemp(currentTable, INT_T); // Assuming int for now
-            emitQuad("*", $2.place, NULL, temp->name);
-            $$.place = temp->name;
-            $$.type = INT_T;
             $$.ptrFlag = 0;
-        } else if (strcmp($1.place, "uminus") == 0) {
+        } else if ($1 == OP_DEREF) {
+            // Dereference operator; the pointer is kept so the result can be assigned
+            Type eleType = $2.type == PTR_T ? $2.place->eleType : INT_T;
+            SymbolEntry *temp = gentemp(currentTable, eleType);
+            emitQuad(OP_DEREF, symOperand($2.place), noOperand(), symOperand(temp));
+            $$.place = temp;
+            $$.type = eleType;
+            $$.ptrFlag = 1;
+            $$.base = $2.place;
+        } else if ($1 == OP_UMINUS) {
             // Unary minus
             SymbolEntry *temp = gentemp(currentTable, $2.type);
-            emitQuad("uminus", $2.place, NULL, temp->name);
-            $$.place = temp->name;
+            emitQuad(OP_UMINUS, symOperand($2.place), noOperand(), symOperand(temp));
+            $$.place = temp;
             $$.type = $2.type;
-        } else if (strcmp($1.place, "not") == 0) {
-            // Logical not
-            $$.truelist = $2.falselist;
-            $$.falselist = $2.truelist;
-            $$.type = BOOL_T;
-            
-            // If not already a boolean expression
-            if (!$2.truelist && !$2.falselist) {
-                SymbolEntry *temp = gentemp(currentTable, INT_T);
-                emitQuad("!", $2.place, NULL, temp->name);
-                $$.place = temp->name;
+        } else if ($1 == OP_NOT) {
+            // Logical not: a condition swaps its exits, a value jumps when zero
+            if ($2.place) {
                 $$.truelist = makelist(nextquad());
-                emitQuad("if", temp->name, NULL, "");
+                emitQuad(OP_IFFALSE, symOperand($2.place), noOperand(), noOperand());
                 $$.falselist = makelist(nextquad());
-                emitQuad("goto", NULL, NULL, "");
+                emitQuad(OP_GOTO, noOperand(), noOperand(), noOperand());
             } else {
-                $$.place = NULL;
+                $$.truelist = $2.falselist;
+                $$.falselist = $2.truelist;
             }
+            $$.place = NULL;
+            $$.type = BOOL_T;
         } else {
             // Unary plus (no operation needed)
             $$.place = $2.place;
@@ -635,19 +609,21 @@ unary_expression
         }
         
         $$.arrayFlag = 0;
+        if ($1 != OP_DEREF)
+            $$.ptrFlag = 0;
     }
     | INCREMENT unary_expression {
         // Generate temporary for the original value
         SymbolEntry *temp = gentemp(currentTable, $2.type);
         
         // Save the original value
-        emitQuad("=", $2.place, NULL, temp->name);
+        emitQuad(OP_ASSIGN, symOperand($2.place), noOperand(), symOperand(temp));
         
         // Increment the value
-        emitQuad("+", $2.place, "1", $2.place);
+        emitQuad(OP_ADD, symOperand($2.place), intOperand(1), symOperand($2.place));
         
         // Result is the original value
-        $$.place = temp->name;
+        $$.place = temp;
         $$.type = $2.type;
         $$.arrayFlag = 0;
         $$.ptrFlag = 0;
@@ -657,13 +633,13 @@ unary_expression
         SymbolEntry *temp = gentemp(currentTable, $2.type);
         
         // Save the original value
-        emitQuad("=", $2.place, NULL, temp->name);
+        emitQuad(OP_ASSIGN, symOperand($2.place), noOperand(), symOperand(temp));
         
         // Decrement the value
-        emitQuad("-", $2.place, "1", $2.place);
+        emitQuad(OP_SUB, symOperand($2.place), intOperand(1), symOperand($2.place));
         
         // Result is the original value
-        $$.place = temp->name;
+        $$.place = temp;
         $$.type = $2.type;
         $$.arrayFlag = 0;
         $$.ptrFlag = 0;
@@ -673,13 +649,13 @@ unary_expression
         SymbolEntry *temp = gentemp(currentTable, $1.type);
         
         // Save the original value
-        emitQuad("=", $1.place, NULL, temp->name);
+        emitQuad(OP_ASSIGN, symOperand($1.place), noOperand(), symOperand(temp));
         
         // Increment the value
-        emitQuad("+", $1.place, "1", $1.place);
+        emitQuad(OP_ADD, symOperand($1.place), intOperand(1), symOperand($1.place));
         
         // Result is the original value
-        $$.place = temp->name;
+        $$.place = temp;
         $$.type = $1.type;
         $$.arrayFlag = 0;
         $$.ptrFlag = 0;
@@ -689,13 +665,13 @@ unary_expression
         SymbolEntry *temp = gentemp(currentTable, $1.type);
         
         // Save the original value
-        emitQuad("=", $1.place, NULL, temp->name);
+        emitQuad(OP_ASSIGN, symOperand($1.place), noOperand(), symOperand(temp));
         
         // Decrement the value
-        emitQuad("-", $1.place, "1", $1.place);
+        emitQuad(OP_SUB, symOperand($1.place), intOperand(1), symOperand($1.place));
         
         // Result is the original value
-        $$.place = temp->name;
+        $$.place = temp;
         $$.type = $1.type;
         $$.arrayFlag = 0;
         $$.ptrFlag = 0;
@@ -706,27 +682,33 @@ argument_expression_list_opt
     : argument_expression_list {
         $$.place = $1.place;
         $$.type = $1.type;
+        $$.count = $1.count;
     }
     | /* empty */ {
         $$.place = NULL;
         $$.type = VOID_T;
+        $$.count = 0;
     }
     ;
 
 argument_expression_list
     : assignment_expression {
         // Generate quad for parameter
-        emitQuad("param", $1.place, NULL, NULL);
+        materialize(&$1);
+        emitQuad(OP_PARAM, symOperand($1.place), noOperand(), noOperand());
         
         $$.place = $1.place;
         $$.type = $1.type;
+        $$.count = 1;
     }
     | argument_expression_list COMMA assignment_expression {
         // Generate quad for parameter
-        emitQuad("param", $3.place, NULL, NULL);
+        materialize(&$3);
+        emitQuad(OP_PARAM, symOperand($3.place), noOperand(), noOperand());
         
         $$.place = $1.place;
         $$.type = $1.type;
+        $$.count = $1.count + 1;
     }
     ;
 
@@ -740,38 +722,42 @@ postfix_expression
         $$.ptrFlag = $1.ptrFlag;
     }
     | postfix_expression '[' expression ']' {
-        // Handling array access
+        materialize(&$3);
+        
+        // Handling array access; arrays and pointers know their element type
+        Type eleType = INT_T;
+        if ($1.type == ARRAY_T || $1.type == PTR_T)
+            eleType = $1.place->eleType;
         SymbolEntry *temp = gentemp(currentTable, INT_T);
         
         // Calculate offset (expression * size of element)
         SymbolEntry *size = gentemp(currentTable, INT_T);
-        char sizeStr[10];
-        sprintf(sizeStr, "%d", sizeOfType(INT_T)); // Assuming INT_T elements
-        emitQuad("=", sizeStr, NULL, size->name);
+        emitQuad(OP_ASSIGN, intOperand(sizeOfType(eleType)), noOperand(), symOperand(size));
         
-        emitQuad("*", $3.place, size->name, temp->name);
+        emitQuad(OP_MUL, symOperand($3.place), symOperand(size), symOperand(temp));
         
         // Get the value from array
-        SymbolEntry *value = gentemp(currentTable, INT_T);
-        emitQuad("=[]", $1.place, temp->name, value->name);
+        SymbolEntry *value = gentemp(currentTable, eleType);
+        emitQuad(OP_ARRAY_LOAD, symOperand($1.place), symOperand(temp), symOperand(value));
         
-        $$.place = value->name;
-        $$.type = INT_T;
+        $$.place = value;
+        $$.type = eleType;
         $$.arrayFlag = 1;
         $$.ptrFlag = 0;
+        $$.base = $1.place;
+        $$.index = temp;
     }
     | postfix_expression LP argument_expression_list_opt RP {
         // Function call
         // Create a temporary for the return value
-        SymbolEntry *temp = gentemp(currentTable, INT_T); // Assuming int return type
+        Type resultType = returnType($1.place);
+        SymbolEntry *temp = gentemp(currentTable, resultType);
         
         // Generate quad for function call
-        char paramCount[10];
-        sprintf(paramCount, "%d", 0); // Number of parameters
-        emitQuad("call", $1.place, paramCount, temp->name);
+        emitQuad(OP_CALL, symOperand($1.place), intOperand($3.count), symOperand(temp)); // Number of parameters
         
-        $$.place = temp->name;
-        $$.type = INT_T;
+        $$.place = temp;
+        $$.type = resultType;
         $$.arrayFlag = 0;
         $$.ptrFlag = 0;
     }
@@ -786,10 +772,11 @@ primary_expression
             entry = insert(currentTable, $1, INT_T); // Assuming int by default
         }
         
-        $$.place = entry->name;
+        $$.place = entry;
         $$.type = entry->type;
         $$.arrayFlag = (entry->type == ARRAY_T);
         $$.ptrFlag = (entry->type == PTR_T);
+        $$.base = NULL;
         $$.truelist = NULL;
         $$.falselist = NULL;
     }
@@ -797,14 +784,10 @@ primary_expression
         // Create a temporary for the constant
         SymbolEntry *temp = gentemp(currentTable, INT_T);
         
-        // Convert integer to string
-        char valueStr[20];
-        sprintf(valueStr, "%d", $1);
-        
         // Assign the constant value
-        emitQuad("=", valueStr, NULL, temp->name);
+        emitQuad(OP_ASSIGN, intOperand($1), noOperand(), symOperand(temp));
         
-        $$.place = temp->name;
+        $$.place = temp;
         $$.type = INT_T;
         $$.arrayFlag = 0;
         $$.ptrFlag = 0;
@@ -820,14 +803,10 @@ primary_expression
         // Create a temporary for the constant
         SymbolEntry *temp = gentemp(currentTable, FLOAT_T);
         
-        // Convert float to string
-        char valueStr[20];
-        sprintf(valueStr, "%f", $1);
-        
         // Assign the constant value
-        emitQuad("=", valueStr, NULL, temp->name);
+        emitQuad(OP_ASSIGN, floatOperand($1), noOperand(), symOperand(temp));
         
-        $$.place = temp->name;
+        $$.place = temp;
         $$.type = FLOAT_T;
         $$.arrayFlag = 0;
         $$.ptrFlag = 0;
@@ -843,14 +822,10 @@ primary_expression
         // Create a temporary for the constant
         SymbolEntry *temp = gentemp(currentTable, CHAR_T);
         
-        // Convert character to string
-        char valueStr[20];
-        sprintf(valueStr, "%d", (int)$1);
-        
         // Assign the constant value
-        emitQuad("=", valueStr, NULL, temp->name);
+        emitQuad(OP_ASSIGN, intOperand($1), noOperand(), symOperand(temp));
         
-        $$.place = temp->name;
+        $$.place = temp;
         $$.type = CHAR_T;
         $$.arrayFlag = 0;
         $$.ptrFlag = 0;
@@ -867,12 +842,13 @@ primary_expression
         SymbolEntry *temp = gentemp(currentTable, PTR_T);
         
         // Assign the string literal
-        emitQuad("=", $1, NULL, temp->name);
+        emitQuad(OP_ASSIGN, strOperand($1), noOperand(), symOperand(temp));
         
-        $$.place = temp->name;
+        $$.place = temp;
         $$.type = PTR_T;
         $$.arrayFlag = 0;
         $$.ptrFlag = 1;
+        $$.base = NULL;
         $$.truelist = NULL;
         $$.falselist = NULL;
         
@@ -884,29 +860,20 @@ primary_expression
         $$.falselist = $2.falselist;
         $$.arrayFlag = $2.arrayFlag;
         $$.ptrFlag = $2.ptrFlag;
+        $$.base = $2.base;
+        $$.index = $2.index;
     }
     ;
 
 /* 2. Declarations */
 declaration
     : type_specifier init_declarator_list SEMICOLON {
-        // Update the type of the declared variable
+        // Variables were typed and sized by direct_declarator while each was
+        // still the last entry, so only function prototypes are typed here;
+        // resizing a variable now would shift every entry declared after it
         SymbolEntry *entry = lookup(currentTable, $2.name);
-        if (entry) {
+        if (entry && entry->nestedTable) {
             updateSymbolType(entry, $1);
-            
-            // Update size based on type
-            updateSymbolSize(entry, sizeOfType($1));
-            
-            // For arrays, multiply by array size
-            if ($2.isArray) {
-                updateSymbolSize(entry, sizeOfType($1) * $2.arraySize);
-                updateSymbolType(entry, ARRAY_T);
-                updateSymbolArraySize(entry, $2.arraySize);
-                updateSymbolElementType(entry, $1);
-            }
-            
-            // For pointers
             if ($2.isPtr) {
                 updateSymbolType(entry, PTR_T);
                 updateSymbolElementType(entry, $1);
@@ -934,31 +901,7 @@ init_declarator
         //     updateSymbolOffset(entry, currentOffset);
         //     currentOffset += entry->size;
         // }
-         // ✅ Insert variable into current scope
-        SymbolEntry *entry = insert(currentTable, $1.name, $1.type);
-        //SymbolEntry *entry = lookup(currentTable, $1.name);
-
-        if (entry) {
-                updateSymbolOffset(entry, currentOffset);
-                updateSymbolSize(entry, sizeOfType($1.type));  // base type size
-                currentOffset += entry->size;
-
-                if ($1.isArray) {
-                    updateSymbolType(entry, ARRAY_T);                       // mark as array
-                    updateSymbolArraySize(entry, $1.arraySize);             // save array length
-                    updateSymbolElementType(entry, $1.type);                // what type it stores
-
-                    int fullSize = sizeOfType($1.type) * $1.arraySize;
-                    updateSymbolSize(entry, fullSize);                      // ✅ set full size
-                    currentOffset += fullSize-sizeOfType($1.type); // update offset
-                }
-
-            if ($1.isPtr) {
-                updateSymbolType(entry, PTR_T);
-                updateSymbolElementType(entry, $1.type);
-            }
-
-        }
+        // direct_declarator inserted and typed the variable
 
         $$.type = $1.type;
         $$.size = $1.size;
@@ -978,28 +921,13 @@ init_declarator
 
         // // Generate assignment quad
         // emitQuad("=", $3.place, NULL, $1.name);
-                // ✅ Insert variable into current scope
-        SymbolEntry *entry = insert(currentTable, $1.name, $1.type);
+        // direct_declarator inserted and typed the variable
+        SymbolEntry *entry = lookupInCurrentScope(currentTable, $1.name);
 
         if (entry) {
-            updateSymbolOffset(entry, currentOffset);
-            updateSymbolSize(entry, sizeOfType($1.type));
-            currentOffset += entry->size;
-
-            if ($1.isArray) {
-                updateSymbolSize(entry, entry->size * $1.arraySize);
-                updateSymbolType(entry, ARRAY_T);
-                updateSymbolArraySize(entry, $1.arraySize);
-                updateSymbolElementType(entry, $1.type);
-            }
-
-            if ($1.isPtr) {
-                updateSymbolType(entry, PTR_T);
-                updateSymbolElementType(entry, $1.type);
-            }
-
             // ✅ Generate assignment quad
-            emitQuad("=", $3.place, NULL, $1.name);
+            SymbolEntry *value = convertType($3.place, entry->type);
+            emitQuad(OP_ASSIGN, symOperand(value), noOperand(), symOperand(entry));
 
              // ✅ Store the constant value if it's known
             if ($3.isConstant) {
@@ -1017,11 +945,11 @@ init_declarator
     ;
 
 type_specifier
-    : VOID { $$ = VOID_T; }
-    | CHAR { $$ = CHAR_T; }
-    | INTEGER { $$ = INT_T; }
-    | FLOAT { $$ = FLOAT_T; }
-    | BOOL { $$ = BOOL_T; }
+    : VOID { $$ = declType = VOID_T; }
+    | CHAR { $$ = declType = CHAR_T; }
+    | INTEGER { $$ = declType = INT_T; }
+    | FLOAT { $$ = declType = FLOAT_T; }
+    | BOOL { $$ = declType = BOOL_T; }
     ;
 
 declarator
@@ -1050,8 +978,9 @@ pointer_opt
 
 direct_declarator
     : IDENTIFIER {
-        // Add identifier to symbol table
-        SymbolEntry *entry = insert(currentTable, $1, INT_T); // Default type, will be updated later
+        // Add identifier to symbol table; $0 is the pointer_opt before it
+        SymbolEntry *entry = insert(currentTable, $1, declType);
+        declareVariable(entry, declType, $<decl>0.isPtr, 0, 0);
         
         $$.name = entry->name;
         $$.type = entry->type;
@@ -1061,9 +990,8 @@ direct_declarator
     }
     | IDENTIFIER '[' INTEGER_CONSTANT ']' {
         // Add array to symbol table
-        SymbolEntry *entry = insert(currentTable, $1, ARRAY_T);
-        updateSymbolArraySize(entry, $3); // Assuming int elements
-        updateSymbolElementType(entry, INT_T); // Default element type
+        SymbolEntry *entry = insert(currentTable, $1, declType);
+        declareVariable(entry, declType, $<decl>0.isPtr, 1, $3);
         
         $$.name = entry->name;
         $$.type = entry->type;
@@ -1079,6 +1007,10 @@ direct_declarator
         // Add function to current table
         SymbolEntry *entry = insert(currentTable, $1, FUNC_T);
         entry->nestedTable = functionTable;
+        entry->paramCount = $3.paramCount;
+
+        // A prototype's parameter names are not kept; the definition inserts its own
+        pendingParamCount = 0;
         
         $$.name = entry->name;
         $$.type = entry->type;
@@ -1123,28 +1055,18 @@ parameter_declaration
         // Add parameter to current function's symbol table
        // SymbolEntry *entry = insert(currentTable, $3, $1);
 
-       // Make sure we're adding to the function's symbol table, not current context
-        SymbolTable *targetTable = currentFunctionEntry ? currentFunctionEntry->nestedTable : currentTable;
-        
-        // Add parameter to function's symbol table
-        SymbolEntry *entry = insert(targetTable, $3, $1);
+       // The function's table is not known until its declarator is reduced,
+       // so the parameter is held until then
+        addPendingParam($3, $1, $2.isPtr);
 
       //  printf(">> Inserting param '%s' into scope: %s\n", $3, currentTable->name);
-
         
-        if ($2.isPtr) {
-            updateSymbolType(entry, PTR_T);
-            updateSymbolElementType(entry, $1);
-        }
-        
-        updateSymbolOffset(entry, currentOffset);
-        currentOffset += entry->size;
-        
-        $$.name = entry->name;
+        $$.name = $3;
        // $$.type = $1;
         
     }
     | type_specifier pointer_opt {
+        addPendingParam(NULL, $1, $2.isPtr);
         $$.name = NULL;
          //$$.type = $1;
         
@@ -1153,6 +1075,7 @@ parameter_declaration
 
 initializer
     : assignment_expression {
+        materialize(&$1);
         $$.place = $1.place;
         $$.type = $1.type;
         $$.isConstant = $1.isConstant;  // Must be set somewhere in expr rules
@@ -1259,6 +1182,7 @@ block_item
 
 expression_statement
     : expression_opt SEMICOLON {
+        discard(&$1);
         $$.nextlist = $1.nextlist;
     }
     ;
@@ -1267,8 +1191,8 @@ expression_opt
     : expression {
         $$.place = $1.place;
         $$.type = $1.type;
-        $$.truelist = $1.truelist;
-        $$.falselist = $1.falselist;
+        $$.truelist = $1.place ? NULL : $1.truelist;   // Only a condition has jumps
+        $$.falselist = $1.place ? NULL : $1.falselist;
          $$.nextlist = NULL;
         //$$.nextlist=$1.nextlist;
     }
@@ -1280,15 +1204,36 @@ expression_opt
     }
     ;
 
+// Expressions tested by if, while, do and for jump to their true and false lists
+condition
+    : expression {
+        $$ = $1;
+        toCondition(&$$);
+    }
+    ;
+
+condition_opt
+    : condition {
+        $$ = $1;
+    }
+    | /* empty */ {
+        // A missing loop condition is always true
+        $$.place = NULL;
+        $$.truelist = makelist(nextquad());
+        emitQuad(OP_GOTO, noOperand(), noOperand(), noOperand());
+        $$.falselist = NULL;
+    }
+    ;
+
 selection_statement
-    : IF LP expression RP M statement {
+    : IF LP condition RP M statement {
         // Backpatch the truelist of the expression to the beginning of the statement
         backpatch($3.truelist, $5);
         
         // The nextlist is the merge of the falselist and the nextlist of the statement
         $$.nextlist = merge($3.falselist, $6.nextlist);
     }
-    | IF LP expression RP M statement ELSE N M statement {
+    | IF LP condition RP M statement ELSE N M statement {
         // Backpatch the truelist of the expression to the first statement
         backpatch($3.truelist, $5);
         
@@ -1301,9 +1246,15 @@ selection_statement
     ;
 
 iteration_statement
-    : FOR LP expression_opt SEMICOLON M expression_opt SEMICOLON M expression_opt RP M statement {
+    : FOR LP expression_opt SEMICOLON M condition_opt SEMICOLON M expression_opt N RP M statement {
         // This is for loop: for(expr1; expr2; expr3) stmt
         
+        // expr1 and expr3 are evaluated for their effects only
+        backpatch($3.truelist, $5);
+        backpatch($3.falselist, $5);
+        backpatch($9.truelist, $5);
+        backpatch($9.falselist, $5);
+        
         // Save old loop info
         QuadList *oldBreak = breakList;
         QuadList *oldContinue = continueList;
@@ -1315,15 +1266,16 @@ iteration_statement
         continueList = NULL;
         
         // Backpatch the truelist of expr2 to the beginning of the statement
-        backpatch($6.truelist, $11);
+        backpatch($6.truelist, $12);
+        
+        // After expr3, jump back to the evaluation of expr2
+        backpatch($10.nextlist, $5);
         
         // Backpatch the nextlist of the statement to the beginning of expr3
-        backpatch($12.nextlist, $8);
+        backpatch($13.nextlist, $8);
         
-        // Generate a jump back to the evaluation of expr2
-        char labelStr[10];
-        sprintf(labelStr, "%d", $5);
-        emitQuad("goto", NULL, NULL, labelStr);
+        // Generate a jump from the end of the statement to expr3
+        emitQuad(OP_GOTO, noOperand(), noOperand(), targetOperand($8));
         
         // The nextlist is the falselist of expr2
         $$.nextlist = merge($6.falselist, breakList);
@@ -1336,7 +1288,7 @@ iteration_statement
         breakList = oldBreak;
         continueList = oldContinue;
     }
-    | WHILE M LP expression RP M statement {
+    | WHILE M LP condition RP M statement {
         // Save old loop info
         QuadList *oldBreak = breakList;
         QuadList *oldContinue = continueList;
@@ -1357,9 +1309,7 @@ iteration_statement
         backpatch(continueList, $2);
         
         // Generate a jump back to the expression
-        char labelStr[10];
-        sprintf(labelStr, "%d", $2);
-        emitQuad("goto", NULL, NULL, labelStr);
+        emitQuad(OP_GOTO, noOperand(), noOperand(), targetOperand($2));
         
         // The nextlist is the falselist of the expression merged with break statements
         $$.nextlist = merge($4.falselist, breakList);
@@ -1369,7 +1319,7 @@ iteration_statement
         breakList = oldBreak;
         continueList = oldContinue;
     }
-    | DO M statement WHILE M LP expression RP SEMICOLON {
+    | DO M statement WHILE M LP condition RP SEMICOLON {
         // Save old loop info
         QuadList *oldBreak = breakList;
         QuadList *oldContinue = continueList;
@@ -1401,11 +1351,14 @@ iteration_statement
 
 jump_statement
     : RETURN expression_opt SEMICOLON {
-        // Generate return statement
+        // Generate return statement, converting to the function's return type
+        materialize(&$2);
         if ($2.place) {
-            emitQuad("return", $2.place, NULL, NULL);
+            SymbolEntry *retVal = lookupInCurrentScope(currentTable, "retVal");
+            SymbolEntry *value = retVal ? convertType($2.place, retVal->type) : $2.place;
+            emitQuad(OP_RETURN, symOperand(value), noOperand(), noOperand());
         } else {
-            emitQuad("return", NULL, NULL, NULL);
+            emitQuad(OP_RETURN, noOperand(), noOperand(), noOperand());
         }
         
         $$.nextlist = NULL;
@@ -1431,24 +1384,23 @@ function_definition
         SymbolEntry *funcEntry = lookup(globalTable, $2.name);
         if (funcEntry && funcEntry->nestedTable) {
             currentTable = funcEntry->nestedTable;
-            currentOffset = 0;
 
             // Add return value entry
-            SymbolEntry *retVal = insert(currentTable, "retVal", $1);
-            updateSymbolOffset(retVal, currentOffset);
-            currentOffset += retVal->size;
+            insert(currentTable, "retVal", $1);
 
             // Emit function start
-            emitQuad("func_begin", funcEntry->name, NULL, NULL);
+            emitQuad(OP_FUNC_BEGIN, symOperand(funcEntry), noOperand(), noOperand());
         }
     } func_statement {
+        // Falling off the end of the body reaches the function end
+        backpatch($4.nextlist, nextquad());
+
         // Emit function end
-        emitQuad("func_end", NULL, NULL, NULL);
+        emitQuad(OP_FUNC_END, noOperand(), noOperand(), noOperand());
 
         // Restore global context
         currentTable = globalTable;
         currentFunctionEntry = NULL;
-        currentOffset = 0;
     };
 
 
@@ -1470,6 +1422,11 @@ function_declarator
             entry->nestedTable = funcTable;
         }
 
+        // Parameters come first in the function's table, in order
+        if (entry->nestedTable->count == 0)
+            insertPendingParams(entry);
+        pendingParamCount = 0;
+
         // Store parameter count in function entry
         entry->paramCount = $4.paramCount;
 
@@ -1489,35 +1446,335 @@ void yyerror(char *s) {
     fprintf(stderr, "Error: %s\n", s);
 }
 
+/* Parameters are buffered until their function's table exists */
+void addPendingParam(const char *name, Type type, int isPtr) {
+    if (pendingParamCount == pendingParamCapacity) {
+        pendingParamCapacity = pendingParamCapacity ? pendingParamCapacity * 2 : 8;
+        pendingParams = (PendingParam*)realloc(pendingParams,
+                                               pendingParamCapacity * sizeof(PendingParam));
+    }
+    pendingParams[pendingParamCount].name = name;
+    pendingParams[pendingParamCount].type = type;
+    pendingParams[pendingParamCount].isPtr = isPtr;
+    pendingParamCount++;
+}
+
+void insertPendingParams(SymbolEntry *func) {
+    for (int i = 0; i < pendingParamCount; i++) {
+        PendingParam *p = &pendingParams[i];
+        if (!p->name)
+            continue;
+        SymbolEntry *entry = insert(func->nestedTable, p->name, p->type);
+        if (p->isPtr) {
+            updateSymbolType(entry, PTR_T);
+            updateSymbolElementType(entry, p->type);
+        }
+    }
+}
+
+// Give a declared variable its final type and size. Called as soon as the
+// variable is inserted, while it is still the last entry of its table, so
+// the resize is O(1) and entries for its initializer are placed after it.
+void declareVariable(SymbolEntry *entry, Type type, int isPtr, int isArray, int arraySize) {
+    if (entry->nestedTable)
+        return;
+    if (isPtr || isArray)
+        updateSymbolElementType(entry, type);
+    if (isArray)
+        updateSymbolArraySize(entry, arraySize);
+    if (isPtr) {
+        updateSymbolType(entry, PTR_T);
+    } else if (isArray) {
+        updateSymbolType(entry, ARRAY_T);
+        updateSymbolSize(entry, sizeOfType(type) * arraySize);
+    } else {
+        updateSymbolType(entry, type);
+    }
+}
+
+/* Return type of a function: definitions record it in retVal, prototypes on the entry */
+Type returnType(SymbolEntry *func) {
+    if (func->nestedTable) {
+        SymbolEntry *retVal = lookupInCurrentScope(func->nestedTable, "retVal");
+        if (retVal)
+            return retVal->type;
+    }
+    if (func->type != FUNC_T)
+        return func->type;
+    return INT_T;
+}
+
+/* Comparisons and logical operators leave their result as jumps (a
+   truelist and falselist, with no place); give one a value where it is
+   used as one: t = 1 on the true exits, t = 0 on the false ones */
+void materialize(struct Expr *e) {
+    if (e->place || (!e->truelist && !e->falselist))
+        return;
+    SymbolEntry *temp = gentemp(currentTable, INT_T);
+    backpatch(e->truelist, nextquad());
+    emitQuad(OP_ASSIGN, intOperand(1), noOperand(), symOperand(temp));
+    emitQuad(OP_GOTO, noOperand(), noOperand(), targetOperand(nextquad() + 2));
+    backpatch(e->falselist, nextquad());
+    emitQuad(OP_ASSIGN, intOperand(0), noOperand(), symOperand(temp));
+    
+    e->place = temp;
+    e->type = INT_T;
+    e->truelist = NULL;
+    e->falselist = NULL;
+    e->arrayFlag = 0;
+    e->ptrFlag = 0;
+    e->isConstant = 0;
+}
+
+/* Test a value where a condition is expected: true when non-zero */
+void toCondition(struct Expr *e) {
+    if (!e->place)
+        return;
+    e->truelist = makelist(nextquad());
+    emitQuad(OP_IF, symOperand(e->place), noOperand(), noOperand());
+    e->falselist = makelist(nextquad());
+    emitQuad(OP_GOTO, noOperand(), noOperand(), noOperand());
+    e->place = NULL;
+    e->type = BOOL_T;
+}
+
+/* A condition evaluated only for its effects continues at the next quad */
+void discard(struct Expr *e) {
+    if (e->place)
+        return;
+    backpatch(e->truelist, nextquad());
+    backpatch(e->falselist, nextquad());
+}
+
+/* One fused quad per comparison: if left relop right goto true; goto false */
+void compareAndBranch(struct Expr *result, OpCode jump, struct Expr *left, struct Expr *right) {
+    materialize(right);
+    result->truelist = makelist(nextquad());
+    emitQuad(jump, symOperand(left->place), symOperand(right->place), noOperand());
+    result->falselist = makelist(nextquad());
+    emitQuad(OP_GOTO, noOperand(), noOperand(), noOperand());
+    result->place = NULL;
+    result->type = BOOL_T;
+    result->arrayFlag = 0;
+    result->ptrFlag = 0;
+}
+
+static double nowSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Peak resident set size in KB */
+static long peakRSS() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
 /* Main function */
-int main() {
+int main(int argc, char *argv[]) {
+    int listing = 1;
+    int run = 0;
+    int jit = 0;
+    int cc = 0;
+    int stats = 0;
+    int lexOnly = 0;
+    int cfgListing = 0;
+    int optimize = 0;
+    const char *irPath = NULL;
+    const char *asmPath = NULL;
+    const char *cPath = NULL;
+    
+    // Command line options
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--no-listing") == 0) {
+            listing = 0;
+        } else if (strcmp(argv[i], "--run") == 0) {
+            run = 1;
+        } else if (strcmp(argv[i], "--jit") == 0) {
+            jit = 1;
+        } else if (strcmp(argv[i], "--cc") == 0) {
+            cc = 1;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            stats = 1;
+        } else if (strcmp(argv[i], "--lex-only") == 0) {
+            lexOnly = 1;
+        } else if (strcmp(argv[i], "--cfg") == 0) {
+            cfgListing = 1;
+        } else if (strcmp(argv[i], "-O") == 0) {
+            optimize = 1;
+        } else if (strcmp(argv[i], "--inline-limit") == 0 && i + 1 < argc) {
+            inlineLimit = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            irPath = argv[++i];
+        } else if (strcmp(argv[i], "-S") == 0 && i + 1 < argc) {
+            asmPath = argv[++i];
+        } else if (strcmp(argv[i], "-C") == 0 && i + 1 < argc) {
+            cPath = argv[++i];
+        } else {
+            fprintf(stderr, "Usage: %s [--no-listing] [--run] [--jit] [--cc] [--stats] [--lex-only] "
+                            "[--cfg] [-O] [--inline-limit n] [-o file.mcir] [-S file.s] [-C file.c] < input.mc\n", argv[0]);
+            return 1;
+        }
+    }
+    
     // Initialize global symbol table
     globalTable = createSymbolTable("global", NULL);
     currentTable = globalTable;
     
-    // Initialize quad array (if needed)
-    // Note: quad.c doesn't show an initQuads() function, 
-    // so we'll assume quadIndex = 0 is sufficient initialization
+    // Quad store starts empty; chunks are allocated on first emitQuad
     quadIndex = 0;
     
+    // Tokenize only, to time the scanner on its own
+    if (lexOnly) {
+        double start = nowSeconds();
+        long tokens = 0;
+        while (yylex())
+            tokens++;
+        if (stats) {
+            fprintf(stderr, "lex        : %.6f s (%ld tokens)\n", nowSeconds() - start, tokens);
+            fprintf(stderr, "peak RSS   : %ld KB\n", peakRSS());
+        }
+        return 0;
+    }
+    
     // Parse input
-    yyparse();
+    double start = nowSeconds();
+    int parseFailed = yyparse() != 0;
+    // Backpatch lists are dead once the parse is done
+    freeQuadLists();
+    // A program that did not parse has half-built quads; don't go on
+    if (parseFailed)
+        return 1;
+    double parseTime = nowSeconds() - start;
+    int parsedQuads = quadIndex;
     
-    printQuads();
+    // Machine independent optimizations
+    double optTime = 0;
+    if (optimize) {
+        start = nowSeconds();
+        optimizeQuads();
+        optTime = nowSeconds() - start;
+    }
+    
+    start = nowSeconds();
+    if (listing) {
+        printQuads();
 
-    printQuadsinstruction();
-    // Print results
-    printSymbolTable(globalTable);
+        printQuadsinstruction();
+        // Print results
+        printSymbolTable(globalTable);
 
         // Print all nested symbol tables
-    SymbolEntry *entry = globalTable->entries;
-    while (entry) {
-        if (entry->nestedTable) {
-            printSymbolTable(entry->nestedTable);
+        SymbolEntry *entry = globalTable->entries;
+        while (entry) {
+            if (entry->nestedTable) {
+                printSymbolTable(entry->nestedTable);
+            }
+            entry = entry->next;
+        }
+    }
+    
+    // Basic blocks, dominators and loops of every function
+    if (cfgListing) {
+        for (int i = 0; i < quadIndex; i++) {
+            if (quadAt(i)->op != OP_FUNC_BEGIN)
+                continue;
+            CFG *cfg = buildCFG(i);
+            if (cfg) {
+                printCFG(cfg, &stdoutBuf);
+                i = cfg->end;
+                freeCFG(cfg);
+            }
         }
-        entry = entry->next;
     }
-    // printQuads();
+    if (outClose(&stdoutBuf) != 0)
+        return 1;
+    double printTime = nowSeconds() - start;
     
+    if (stats) {
+        fprintf(stderr, "parse+emit : %.6f s (%d quads, %.0f quads/s)\n", parseTime, parsedQuads,
+                parseTime > 0 ? parsedQuads / parseTime : 0.0);
+        if (optimize)
+            fprintf(stderr, "optimize   : %.6f s (%d quads left)\n", optTime, quadIndex);
+        fprintf(stderr, "print      : %.6f s\n", printTime);
+    }
+    
+    // Binary IR for downstream tools
+    if (irPath && writeIRFile(irPath) != 0)
+        return 1;
+    
+    // x86-64 assembly for gcc to link
+    if (asmPath && writeAssembly(asmPath, stats) != 0)
+        return 1;
+    
+    // C source for the system C compiler
+    if (cPath && writeCSource(cPath) != 0)
+        return 1;
+    
+    // Execute the generated code
+    if (run) {
+        VMValue result;
+        start = nowSeconds();
+        if (vmRun("main", &result) != 0)
+            return 1;
+        if (stats)
+            fprintf(stderr, "run        : %.6f s\n", nowSeconds() - start);
+        if (result.type == FLOAT_T)
+            printf("main returned %f\n", result.fval);
+        else
+            printf("main returned %lld\n", result.ival);
+    }
+    
+    // Compile to machine code in memory and run that
+    if (jit) {
+        VMValue result;
+        start = nowSeconds();
+        JIT *code = jitCompile(stats);
+        if (!code)
+            return 1;
+        if (stats)
+            fprintf(stderr, "jit        : %.6f s\n", nowSeconds() - start);
+        start = nowSeconds();
+        int status = jitRun(code, "main", &result);
+        jitFree(code);
+        if (status != 0)
+            return 1;
+        if (stats)
+            fprintf(stderr, "run        : %.6f s\n", nowSeconds() - start);
+        if (result.type == FLOAT_T)
+            printf("main returned %f\n", result.fval);
+        else
+            printf("main returned %lld\n", result.ival);
+    }
+    
+    // Compile the C source with the system C compiler, load it and run that
+    if (cc) {
+        VMValue result;
+        start = nowSeconds();
+        CModule *module = cCompile();
+        if (!module)
+            return 1;
+        if (stats)
+            fprintf(stderr, "cc         : %.6f s\n", nowSeconds() - start);
+        start = nowSeconds();
+        int status = cRun(module, "main", &result);
+        cFree(module);
+        if (status != 0)
+            return 1;
+        if (stats)
+            fprintf(stderr, "run        : %.6f s\n", nowSeconds() - start);
+        if (result.type == FLOAT_T)
+            printf("main returned %f\n", result.fval);
+        else
+            printf("main returned %lld\n", result.ival);
+    }
+    
+    if (stats)
+        fprintf(stderr, "peak RSS   : %ld KB\n", peakRSS());
+    
+    freeQuads();
+    freeInternPool();
     return 0;
-}
\ No newline at end of file
+}
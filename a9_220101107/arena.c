@@ -0,0 +1,61 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+#define ARENA_MIN_BLOCK (64 * 1024)
+#define ARENA_MAX_BLOCK (16 * 1024 * 1024)
+
+void* arenaAlloc(Arena *arena, size_t size) {
+    // Keep every allocation 8-byte aligned
+    size = (size + 7) & ~(size_t)7;
+
+    ArenaBlock *block = arena->head;
+    if (!block || block->used + size > block->size) {
+        // Blocks grow geometrically so large programs need few mallocs
+        size_t blockSize = arena->blockSize ? arena->blockSize : ARENA_MIN_BLOCK;
+        while (blockSize < size)
+            blockSize *= 2;
+
+        block = (ArenaBlock*)malloc(sizeof(ArenaBlock) + blockSize);
+        if (!block) {
+            fprintf(stderr, "Error: out of memory\n");
+            exit(1);
+        }
+        block->next = arena->head;
+        block->size = blockSize;
+        block->used = 0;
+        arena->head = block;
+        arena->totalBytes += sizeof(ArenaBlock) + blockSize;
+
+        if (blockSize < ARENA_MAX_BLOCK)
+            arena->blockSize = blockSize * 2;
+    }
+
+    void *p = block->data + block->used;
+    block->used += size;
+    return p;
+}
+
+char* arenaStrndup(Arena *arena, const char *s, size_t len) {
+    char *copy = (char*)arenaAlloc(arena, len + 1);
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+char* arenaStrdup(Arena *arena, const char *s) {
+    return arenaStrndup(arena, s, strlen(s));
+}
+
+void arenaFree(Arena *arena) {
+    ArenaBlock *block = arena->head;
+    while (block) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->head = NULL;
+    arena->blockSize = 0;
+    arena->totalBytes = 0;
+}
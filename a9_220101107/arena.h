@@ -0,0 +1,25 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// Bump allocator: memory is carved out of large blocks and released all at once
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;  // Previously filled block
+    size_t size;              // Usable bytes in this block
+    size_t used;              // Bytes handed out so far
+    char data[];              // Block payload
+} ArenaBlock;
+
+typedef struct Arena {
+    ArenaBlock *head;         // Block currently being filled
+    size_t blockSize;         // Minimum size of the next block
+    size_t totalBytes;        // Bytes reserved from malloc (for statistics)
+} Arena;
+
+void* arenaAlloc(Arena *arena, size_t size);
+char* arenaStrdup(Arena *arena, const char *s);
+char* arenaStrndup(Arena *arena, const char *s, size_t len);
+void arenaFree(Arena *arena);
+
+#endif
@@ -0,0 +1,56 @@
+#!/bin/sh
+# Per-phase compile benchmark over generated microC programs of growing size.
+# A flat ns/quad column means the compiler scales linearly; a jump between
+# two sizes points at a scaling cliff.
+#
+#   ./bench_compile.sh [size ...]     (default: 1K 10K 100K 1M 10M 100M 1G)
+#
+# BENCH_MAX caps the sizes run (e.g. BENCH_MAX=100M on small machines) and
+# BENCH_DIR is where the generated programs go (default /tmp).
+
+PROG=./a9_220101107
+GEN=./mcgen
+DIR=${BENCH_DIR:-/tmp}
+SIZES=${*:-"1K 10K 100K 1M 10M 100M 1G"}
+
+bytes() {
+    case $1 in
+        *K) echo $(( ${1%K} * 1024 )) ;;
+        *M) echo $(( ${1%M} * 1024 * 1024 )) ;;
+        *G) echo $(( ${1%G} * 1024 * 1024 * 1024 )) ;;
+        *)  echo $1 ;;
+    esac
+}
+
+MAX=$(bytes ${BENCH_MAX:-1G})
+
+printf "%-6s %8s %10s %10s %10s %10s %12s %8s\n" \
+    size tokens "lex s" "parse s" "print s" "RSS KB" "quads/s" "ns/quad"
+for size in $SIZES; do
+    if [ "$(bytes $size)" -gt "$MAX" ]; then
+        echo "$size: skipped (BENCH_MAX=${BENCH_MAX:-1G})"
+        continue
+    fi
+    src=$DIR/bench_$size.mc
+    $GEN -s $size > $src || exit 1
+
+    lex=$($PROG --lex-only --stats < $src 2>&1 >/dev/null)
+    full=$($PROG --stats < $src 2>&1 >/dev/null)
+
+    echo "$lex
+$full" | awk -v size=$size '
+        /^lex/        { lex = $3; tokens = substr($5, 2) }
+        /^parse\+emit/ { parse = $3; quads = substr($5, 2) }
+        /^print/      { print_s = $3 }
+        /^peak RSS/ && parse != "" { rss = $4 }
+        END {
+            qps = 0; ns = 0
+            if (parse + 0 > 0 && quads + 0 > 0) {
+                qps = quads / parse
+                ns = parse * 1e9 / quads
+            }
+            printf "%-6s %8d %10.3f %10.3f %10.3f %10d %12.0f %8.0f\n", size, tokens,
+                   lex, parse, print_s, rss, qps, ns
+        }'
+    rm -f $src
+done
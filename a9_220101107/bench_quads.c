@@ -0,0 +1,47 @@
+// Benchmark for the quad store: emits N quads (default 10M) and reports
+// the cost per quad in time and memory.
+//
+//   make bench_quads && ./bench_quads [count]
+
+#include <time.h>
+#include "quad.h"
+
+static double nowSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char *argv[]) {
+    long count = argc > 1 ? atol(argv[1]) : 10000000L;
+
+    // Operands come from a small pool of symbols, like a real function
+    SymbolTable *table = createSymbolTable("bench", NULL);
+    SymbolEntry *a = insert(table, "a", INT_T);
+    SymbolEntry *temps[1024];
+    for (int i = 0; i < 1024; i++)
+        temps[i] = gentemp(table, INT_T);
+
+    double start = nowSeconds();
+    for (long i = 0; i < count; i++) {
+        // Typical shape of a generated arithmetic quad
+        SymbolEntry *t = temps[i & 1023];
+        emitQuad(OP_ADD, symOperand(a), symOperand(t), symOperand(t));
+    }
+    double elapsed = nowSeconds() - start;
+
+    // Touch the store through quadAt so the lookup path is measured too
+    long checksum = 0;
+    start = nowSeconds();
+    for (long i = 0; i < count; i++)
+        checksum += quadAt(i)->result.sym->offset;
+    double scan = nowSeconds() - start;
+
+    printf("quads emitted : %ld\n", count);
+    printf("emit          : %.2f ns/quad\n", elapsed * 1e9 / count);
+    printf("scan          : %.2f ns/quad (checksum %ld)\n", scan * 1e9 / count, checksum);
+    printf("memory        : %.2f bytes/quad\n", (double)quadStoreBytes() / count);
+
+    freeQuads();
+    return 0;
+}
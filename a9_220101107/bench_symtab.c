@@ -0,0 +1,69 @@
+// Benchmark for symbol table lookup: grows one function's table to 50k
+// locals/temporaries and reports the lookup cost at several sizes. With the
+// hash index the cost per lookup should stay flat as the table grows.
+//
+//   make bench_symtab && ./bench_symtab [entries]
+
+#include <time.h>
+#include "quad.h"
+
+#define LOOKUPS 1000000
+
+static double nowSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char *argv[]) {
+    int total = argc > 1 ? atoi(argv[1]) : 50000;
+
+    globalTable = createSymbolTable("global", NULL);
+    insert(globalTable, "g", INT_T);
+    SymbolTable *func = createSymbolTable("bench", globalTable);
+
+    // Names are prepared up front so only lookup is timed
+    char (*names)[16] = malloc(sizeof(*names) * total);
+    for (int i = 0; i < total; i++)
+        sprintf(names[i], "v%d", i);
+
+    printf("%10s %12s %14s %14s\n", "entries", "insert ns", "local ns", "global ns");
+    int size = 0;
+    for (int step = 1000; size < total; step = step < total / 2 ? step * 2 : total) {
+        int target = step < total ? step : total;
+
+        // Half locals, half temporaries, as in a large generated function
+        double start = nowSeconds();
+        int added = target - size;
+        for (; size < target; size++) {
+            if (size % 2)
+                gentemp(func, INT_T);
+            else
+                insert(func, names[size], INT_T);
+        }
+        double insertTime = nowSeconds() - start;
+
+        // Hit one of the first locals declared in this scope; the working set
+        // stays the same at every size so only the algorithmic cost shows
+        long found = 0;
+        start = nowSeconds();
+        for (int i = 0; i < LOOKUPS; i++)
+            found += lookup(func, names[(i * 17) % 1000 & ~1]) != NULL;
+        double localTime = nowSeconds() - start;
+
+        // Walk the scope chain out to the global table
+        start = nowSeconds();
+        for (int i = 0; i < LOOKUPS; i++)
+            found += lookup(func, "g") != NULL;
+        double globalTime = nowSeconds() - start;
+
+        printf("%10d %12.1f %14.1f %14.1f%s\n", size,
+               insertTime * 1e9 / added,
+               localTime * 1e9 / LOOKUPS,
+               globalTime * 1e9 / LOOKUPS,
+               found == 2 * LOOKUPS ? "" : "  (lookup failed)");
+    }
+
+    free(names);
+    return 0;
+}
@@ -0,0 +1,399 @@
+#include "cfg.h"
+
+// Index of the func_end that closes the function opened at begin, or -1
+int functionEnd(int begin) {
+    for (int i = begin + 1; i < quadIndex; i++) {
+        OpCode op = quadAt(i)->op;
+        if (op == OP_FUNC_END)
+            return i;
+        if (op == OP_FUNC_BEGIN)
+            break;
+    }
+    return -1;
+}
+
+// Quad a jump goes to; unpatched jumps fall through, and targets outside
+// the function go to its exit
+static int jumpTarget(CFG *cfg, int i) {
+    Quad *q = quadAt(i);
+    int target = q->result.kind == OPD_TARGET ? q->result.target : i + 1;
+    if (target <= cfg->begin || target > cfg->end)
+        target = cfg->end;
+    return target;
+}
+
+static void addSucc(CFG *cfg, int b, int s) {
+    BasicBlock *block = &cfg->blocks[b];
+    if (block->succCount == 1 && block->succ[0] == s)
+        return;
+    block->succ[block->succCount++] = s;
+}
+
+// Depth-first search from the entry, numbering blocks in reverse postorder
+static void computeOrder(CFG *cfg) {
+    int n = cfg->blockCount;
+    int *stack = (int*)malloc(n * sizeof(int));
+    int *nextSucc = (int*)calloc(n, sizeof(int));
+    int *post = (int*)malloc(n * sizeof(int));
+    char *seen = (char*)calloc(n, 1);
+    int top = 0, postCount = 0;
+
+    stack[top++] = 0;
+    seen[0] = 1;
+    while (top > 0) {
+        int b = stack[top - 1];
+        BasicBlock *block = &cfg->blocks[b];
+        if (nextSucc[b] < block->succCount) {
+            int s = block->succ[nextSucc[b]++];
+            if (!seen[s]) {
+                seen[s] = 1;
+                stack[top++] = s;
+            }
+        } else {
+            post[postCount++] = b;
+            top--;
+        }
+    }
+
+    cfg->order = (int*)malloc((postCount ? postCount : 1) * sizeof(int));
+    cfg->orderCount = postCount;
+    for (int i = 0; i < postCount; i++) {
+        int b = post[postCount - 1 - i];
+        cfg->order[i] = b;
+        cfg->blocks[b].rpo = i;
+    }
+
+    free(stack);
+    free(nextSucc);
+    free(post);
+    free(seen);
+}
+
+static int intersect(CFG *cfg, int a, int b) {
+    while (a != b) {
+        while (cfg->blocks[a].rpo > cfg->blocks[b].rpo)
+            a = cfg->blocks[a].idom;
+        while (cfg->blocks[b].rpo > cfg->blocks[a].rpo)
+            b = cfg->blocks[b].idom;
+    }
+    return a;
+}
+
+// Cooper, Harvey and Kennedy, "A Simple, Fast Dominance Algorithm"
+static void computeDominators(CFG *cfg) {
+    cfg->blocks[0].idom = 0;
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int i = 1; i < cfg->orderCount; i++) {
+            int b = cfg->order[i];
+            BasicBlock *block = &cfg->blocks[b];
+            int newIdom = -1;
+            for (int k = 0; k < block->predCount; k++) {
+                int p = block->pred[k];
+                if (cfg->blocks[p].idom < 0)
+                    continue;   // Unreachable or not processed yet
+                newIdom = newIdom < 0 ? p : intersect(cfg, p, newIdom);
+            }
+            if (newIdom != block->idom) {
+                block->idom = newIdom;
+                changed = 1;
+            }
+        }
+    }
+    cfg->blocks[0].idom = -1;
+
+    // Number the dominator tree so dominance is an interval test
+    int n = cfg->blockCount;
+    int *childStart = (int*)calloc(n + 1, sizeof(int));
+    int *children = (int*)malloc((n ? n : 1) * sizeof(int));
+    for (int b = 0; b < n; b++)
+        if (cfg->blocks[b].idom >= 0)
+            childStart[cfg->blocks[b].idom + 1]++;
+    for (int b = 0; b < n; b++)
+        childStart[b + 1] += childStart[b];
+    int *fill = (int*)malloc((n ? n : 1) * sizeof(int));
+    memcpy(fill, childStart, n * sizeof(int));
+    for (int b = 0; b < n; b++)
+        if (cfg->blocks[b].idom >= 0)
+            children[fill[cfg->blocks[b].idom]++] = b;
+
+    int *stack = fill;      // Reused: at most n blocks are on the stack
+    int *nextChild = (int*)malloc((n ? n : 1) * sizeof(int));
+    int top = 0, counter = 0;
+    stack[top++] = 0;
+    nextChild[0] = childStart[0];
+    cfg->blocks[0].domPre = counter++;
+    while (top > 0) {
+        int b = stack[top - 1];
+        if (nextChild[b] < childStart[b + 1]) {
+            int c = children[nextChild[b]++];
+            nextChild[c] = childStart[c];
+            cfg->blocks[c].domPre = counter++;
+            stack[top++] = c;
+        } else {
+            cfg->blocks[b].domPost = counter++;
+            top--;
+        }
+    }
+
+    free(childStart);
+    free(children);
+    free(fill);
+    free(nextChild);
+}
+
+// Natural loops, innermost first: headers are visited in decreasing
+// reverse postorder, and a walk that meets a block of an inner loop jumps
+// to that loop's header, making this loop its parent
+static void computeLoops(CFG *cfg) {
+    int n = cfg->blockCount;
+    int capacity = 0;
+    int workCap = 2 * n + 2;
+    int *work = (int*)malloc(workCap * sizeof(int));
+
+    for (int i = cfg->orderCount - 1; i >= 0; i--) {
+        int h = cfg->order[i];
+        BasicBlock *header = &cfg->blocks[h];
+        int top = 0;
+        for (int k = 0; k < header->predCount; k++) {
+            int p = header->pred[k];
+            if (cfg->blocks[p].rpo >= 0 && dominates(cfg, h, p)) {
+                if (top == workCap) {
+                    workCap *= 2;
+                    work = (int*)realloc(work, workCap * sizeof(int));
+                }
+                work[top++] = p;
+            }
+        }
+        if (top == 0)
+            continue;
+
+        if (cfg->loopCount == capacity) {
+            capacity = capacity ? capacity * 2 : 8;
+            cfg->loops = (Loop*)realloc(cfg->loops, capacity * sizeof(Loop));
+        }
+        int l = cfg->loopCount++;
+        cfg->loops[l].header = h;
+        cfg->loops[l].parent = -1;
+        cfg->loops[l].depth = 0;
+        cfg->loops[l].blockCount = 0;
+        header->loop = l;
+
+        while (top > 0) {
+            int b = work[--top];
+            BasicBlock *block = &cfg->blocks[b];
+            int next;
+            if (block->loop < 0) {
+                block->loop = l;
+                next = b;
+            } else {
+                // Climb to the outermost loop found so far
+                int inner = block->loop;
+                while (cfg->loops[inner].parent >= 0)
+                    inner = cfg->loops[inner].parent;
+                if (inner == l)
+                    continue;
+                cfg->loops[inner].parent = l;
+                next = cfg->loops[inner].header;
+            }
+            BasicBlock *from = &cfg->blocks[next];
+            for (int k = 0; k < from->predCount; k++) {
+                int p = from->pred[k];
+                if (cfg->blocks[p].rpo < 0)
+                    continue;
+                if (top == workCap) {
+                    workCap *= 2;
+                    work = (int*)realloc(work, workCap * sizeof(int));
+                }
+                work[top++] = p;
+            }
+        }
+    }
+    free(work);
+
+    // Parents are created after their children
+    for (int l = cfg->loopCount - 1; l >= 0; l--) {
+        Loop *loop = &cfg->loops[l];
+        loop->depth = loop->parent < 0 ? 1 : cfg->loops[loop->parent].depth + 1;
+    }
+    for (int b = 0; b < n; b++)
+        for (int l = cfg->blocks[b].loop; l >= 0; l = cfg->loops[l].parent)
+            cfg->loops[l].blockCount++;
+}
+
+// Build the CFG of the function whose func_begin is at begin
+CFG* buildCFG(int begin) {
+    int end = functionEnd(begin);
+    if (end < 0)
+        return NULL;
+
+    CFG *cfg = (CFG*)calloc(1, sizeof(CFG));
+    Quad *first = quadAt(begin);
+    cfg->function = first->arg1.kind == OPD_SYM ? first->arg1.sym : NULL;
+    cfg->begin = begin;
+    cfg->end = end;
+
+    // Leaders: the first quad, jump targets, quads after jumps, and func_end
+    int n = end - begin;
+    char *leader = (char*)calloc(n, 1);
+    leader[0] = 1;
+    leader[n - 1] = 1;
+    for (int i = begin + 1; i < end; i++) {
+        OpCode op = quadAt(i)->op;
+        if (!isJump(op))
+            continue;
+        if (op != OP_RETURN)
+            leader[jumpTarget(cfg, i) - begin - 1] = 1;
+        leader[i + 1 - begin - 1] = 1;
+    }
+
+    cfg->blockOf = (int*)malloc(n * sizeof(int));
+    int count = 0;
+    for (int k = 0; k < n; k++) {
+        if (leader[k])
+            count++;
+        cfg->blockOf[k] = count - 1;
+    }
+    free(leader);
+
+    cfg->blockCount = count;
+    cfg->blocks = (BasicBlock*)calloc(count, sizeof(BasicBlock));
+    for (int b = 0; b < count; b++) {
+        cfg->blocks[b].first = -1;
+        cfg->blocks[b].rpo = -1;
+        cfg->blocks[b].idom = -2;
+        cfg->blocks[b].domPre = 1;     // Empty interval until numbered
+        cfg->blocks[b].domPost = 0;
+        cfg->blocks[b].loop = -1;
+    }
+    for (int k = 0; k < n; k++) {
+        BasicBlock *block = &cfg->blocks[cfg->blockOf[k]];
+        if (block->first < 0)
+            block->first = begin + 1 + k;
+        block->last = begin + 1 + k;
+    }
+
+    // Every block has at most two successors; predecessors share the pool
+    int exit = count - 1;
+    cfg->edges = (int*)malloc(4 * count * sizeof(int));
+    for (int b = 0; b < count; b++)
+        cfg->blocks[b].succ = cfg->edges + 2 * b;
+    for (int b = 0; b < exit; b++) {
+        int last = cfg->blocks[b].last;
+        OpCode op = quadAt(last)->op;
+        if (op == OP_RETURN) {
+            addSucc(cfg, b, exit);
+        } else if (op == OP_GOTO) {
+            addSucc(cfg, b, blockOfQuad(cfg, jumpTarget(cfg, last)));
+        } else if (isConditionalJump(op)) {
+            addSucc(cfg, b, blockOfQuad(cfg, jumpTarget(cfg, last)));
+            addSucc(cfg, b, b + 1);
+        } else {
+            addSucc(cfg, b, b + 1);
+        }
+    }
+
+    int *predStart = cfg->edges + 2 * count;
+    int offset = 0;
+    for (int b = 0; b < count; b++)
+        for (int k = 0; k < cfg->blocks[b].succCount; k++)
+            cfg->blocks[cfg->blocks[b].succ[k]].predCount++;
+    for (int b = 0; b < count; b++) {
+        cfg->blocks[b].pred = predStart + offset;
+        offset += cfg->blocks[b].predCount;
+        cfg->blocks[b].predCount = 0;
+    }
+    for (int b = 0; b < count; b++)
+        for (int k = 0; k < cfg->blocks[b].succCount; k++) {
+            BasicBlock *s = &cfg->blocks[cfg->blocks[b].succ[k]];
+            s->pred[s->predCount++] = b;
+        }
+
+    computeOrder(cfg);
+    for (int b = 0; b < count; b++)
+        if (cfg->blocks[b].rpo < 0)
+            cfg->blocks[b].idom = -1;
+    computeDominators(cfg);
+    computeLoops(cfg);
+    return cfg;
+}
+
+void freeCFG(CFG *cfg) {
+    if (!cfg) return;
+    free(cfg->blocks);
+    free(cfg->blockOf);
+    free(cfg->edges);
+    free(cfg->order);
+    free(cfg->loops);
+    free(cfg);
+}
+
+static void printBlockList(OutBuf *out, const int *list, int count) {
+    if (count == 0)
+        outPuts(out, " -");
+    for (int k = 0; k < count; k++) {
+        outPuts(out, " B");
+        outInt(out, list[k]);
+    }
+}
+
+void printCFG(CFG *cfg, OutBuf *out) {
+    outPuts(out, "\n### CFG: ");
+    outPuts(out, cfg->function ? cfg->function->name : "?");
+    outPuts(out, " (");
+    outInt(out, cfg->blockCount);
+    outPuts(out, " blocks, ");
+    outInt(out, cfg->loopCount);
+    outPuts(out, " loops)\n");
+
+    for (int b = 0; b < cfg->blockCount; b++) {
+        BasicBlock *block = &cfg->blocks[b];
+        outPuts(out, "B");
+        outInt(out, b);
+        outPuts(out, " [");
+        outInt(out, block->first);
+        outPuts(out, "..");
+        outInt(out, block->last);
+        outPuts(out, "] succ:");
+        printBlockList(out, block->succ, block->succCount);
+        outPuts(out, "  pred:");
+        printBlockList(out, block->pred, block->predCount);
+        if (block->rpo < 0) {
+            outPuts(out, "  unreachable\n");
+            continue;
+        }
+        outPuts(out, "  idom: ");
+        if (block->idom < 0) {
+            outPuts(out, "-");
+        } else {
+            outChar(out, 'B');
+            outInt(out, block->idom);
+        }
+        if (block->loop >= 0) {
+            outPuts(out, "  loop: L");
+            outInt(out, block->loop);
+        }
+        outChar(out, '\n');
+    }
+
+    for (int l = 0; l < cfg->loopCount; l++) {
+        Loop *loop = &cfg->loops[l];
+        outPuts(out, "L");
+        outInt(out, l);
+        outPuts(out, " header B");
+        outInt(out, loop->header);
+        outPuts(out, ", depth ");
+        outInt(out, loop->depth);
+        outPuts(out, ", ");
+        outInt(out, loop->blockCount);
+        outPuts(out, " blocks, parent ");
+        if (loop->parent < 0) {
+            outPuts(out, "-");
+        } else {
+            outChar(out, 'L');
+            outInt(out, loop->parent);
+        }
+        outChar(out, '\n');
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef CFG_H
+#define CFG_H
+
+#include "quad.h"
+
+// Control-flow graph of one function: the quads strictly between its
+// func_begin and func_end are split into basic blocks, and the func_end
+// quad forms a block of its own that every return flows to.
+//
+// Blocks, edges and the dominator tree are built in time linear in the
+// number of quads; dominators use the Cooper-Harvey-Kennedy iteration,
+// which settles in two passes on the reducible graphs microC produces.
+
+typedef struct BasicBlock {
+    int first, last;        // Quad range, inclusive
+    int *succ;              // Successor block indices (into CFG.edges)
+    int succCount;
+    int *pred;              // Predecessor block indices (into CFG.edges)
+    int predCount;
+    int rpo;                // Reverse postorder number, -1 if unreachable
+    int idom;               // Immediate dominator, -1 for entry and unreachable blocks
+    int domPre, domPost;    // Dominator tree interval, for O(1) dominance tests
+    int loop;               // Innermost loop containing the block, -1 if none
+} BasicBlock;
+
+typedef struct Loop {
+    int header;             // Block every iteration starts in
+    int parent;             // Enclosing loop, -1 for outermost loops
+    int depth;              // 1 for outermost loops
+    int blockCount;         // Blocks in the loop, including nested loops
+} Loop;
+
+typedef struct CFG {
+    SymbolEntry *function;  // Function entry named by func_begin
+    int begin, end;         // Quad indices of func_begin and func_end
+    BasicBlock *blocks;     // blocks[0] is the entry, the last is the exit
+    int blockCount;
+    int *blockOf;           // Block of each quad in begin+1..end, by quad - begin - 1
+    int *edges;             // Storage for all successor and predecessor lists
+    int *order;             // Reachable blocks in reverse postorder
+    int orderCount;
+    Loop *loops;            // Inner loops come before the loops enclosing them
+    int loopCount;
+} CFG;
+
+int functionEnd(int begin);
+CFG* buildCFG(int begin);
+void freeCFG(CFG *cfg);
+void printCFG(CFG *cfg, OutBuf *out);
+
+static inline int blockOfQuad(const CFG *cfg, int quad) {
+    return cfg->blockOf[quad - cfg->begin - 1];
+}
+
+// Whether block a dominates block b (both reachable)
+static inline int dominates(const CFG *cfg, int a, int b) {
+    return cfg->blocks[a].domPre <= cfg->blocks[b].domPre &&
+           cfg->blocks[b].domPost <= cfg->blocks[a].domPost;
+}
+
+// Whether a block lies in a loop, directly or in a loop nested in it
+static inline int blockInLoop(const CFG *cfg, int block, int loop) {
+    for (int l = cfg->blocks[block].loop; l >= 0; l = cfg->loops[l].parent)
+        if (l == loop)
+            return 1;
+    return 0;
+}
+
+// Whether a quad ends its block by transferring control
+static inline int isJump(OpCode op) {
+    return op == OP_GOTO || op == OP_IF || op == OP_IFFALSE ||
+           (op >= OP_IFLT && op <= OP_IFNE) || op == OP_RETURN;
+}
+
+static inline int isConditionalJump(OpCode op) {
+    return op == OP_IF || op == OP_IFFALSE || (op >= OP_IFLT && op <= OP_IFNE);
+}
+
+#endif
@@ -0,0 +1,1109 @@
+#include <ctype.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include "cgen.h"
+#include "opt.h"
+#include "outbuf.h"
+
+// Each quad becomes one C statement. Operands are read as the VM's
+// loadInt/loadFloat would (long long or double expressions), combined, and
+// converted to the result's type on the way into its C variable or memory
+// slot. Jump targets become labels, so the control flow is left for the C
+// compiler to structure.
+//
+// Values passed by param are held in C variables numbered by their
+// position among the values not yet consumed, as in x86.c; a call passes
+// the last ones as arguments, converted to the parameter types.
+//
+// Every call still takes a frame of its function's size from the VM stack
+// in __mc_mem and counts its depth, so stack overflow is reported where
+// the VM reports it; only functions that keep variables in memory zero
+// their frame.
+
+// Memory layout as in the VM: a null area, the globals, the string
+// literals, then the call stack
+#define CGEN_NULL_BYTES 16
+
+// Machine stack of the thread cRun() runs the program on: compiled frames
+// are small, but calls may nest VM_MAX_DEPTH deep
+#define CGEN_THREAD_STACK (1 << 30)
+
+// Longest expression built for one operand or operation
+#define CGEN_TEXT 512
+
+typedef struct Value {
+    char text[CGEN_TEXT];
+    int isFloat;            // double, rather than long long
+} Value;
+
+typedef struct CEmitter {
+    OutBuf out;
+    int begin, end;         // func_begin and func_end being emitted; begin is -1 for the global code
+    Type returnType;
+    int *beginOf;           // func_begin of the function each quad is in, -1 outside
+    char *isTarget;         // Quads that need a label
+    char *pushedFloat;      // Class of each value passed by param and not yet consumed
+    int pushed, pushedCapacity;
+    char *argClasses;       // Classes each param position takes in the code being emitted: 1 int, 2 float
+    int argCapacity;
+    const char **strings;   // String literals in the pool, interned, by hash
+    int *stringAddress;
+    int stringCapacity;
+    int poolSize;
+} CEmitter;
+
+// snprintf for generated text; expressions longer than CGEN_TEXT are cut
+static void formatText(char *text, size_t size, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    vsnprintf(text, size, format, args);
+    va_end(args);
+}
+
+static void line(CEmitter *e, const char *format, ...) {
+    char buffer[CGEN_TEXT];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (n < (int)sizeof(buffer)) {
+        outPuts(&e->out, buffer);
+    } else {
+        char *text = (char*)malloc(n + 1);
+        va_start(args, format);
+        vsnprintf(text, n + 1, format, args);
+        va_end(args);
+        outPuts(&e->out, text);
+        free(text);
+    }
+    outChar(&e->out, '\n');
+}
+
+static Type typeOf(Operand o) {
+    switch (o.kind) {
+        case OPD_SYM:
+        case OPD_TEMP:  return o.sym->type;
+        case OPD_INT:   return INT_T;
+        case OPD_FLOAT: return FLOAT_T;
+        case OPD_STR:   return PTR_T;
+        default:        return VOID_T;
+    }
+}
+
+static int isFloatValue(Operand o) {
+    return typeOf(o) == FLOAT_T;
+}
+
+static int isScalar(Type type) {
+    return type == CHAR_T || type == BOOL_T || type == INT_T || type == PTR_T || type == FLOAT_T;
+}
+
+// C type of a variable, parameter or return value
+static const char *cType(Type type) {
+    switch (type) {
+        case CHAR_T:  return "signed char";
+        case BOOL_T:  return "unsigned char";
+        case FLOAT_T: return "double";
+        case VOID_T:  return "void";
+        default:      return "int";
+    }
+}
+
+static Type returnTypeOf(const SymbolEntry *func) {
+    SymbolEntry *retVal = lookupInCurrentScope(func->nestedTable, "retVal");
+    return retVal ? retVal->type : INT_T;
+}
+
+// Locals kept in C variables carry their number in id while their
+// function is emitted
+static int inVariable(const SymbolEntry *sym) {
+    return sym->table != globalTable && sym->id >= 0;
+}
+
+static void nameOf(const SymbolEntry *sym, char *text, size_t size) {
+    int n = snprintf(text, size, "%s_%d", sym->name, sym->id);
+    for (int k = 0; k < n && k < (int)size - 1; k++)
+        if (!isalnum((unsigned char)text[k]) && text[k] != '_')
+            text[k] = '_';
+}
+
+// Address in __mc_mem of a variable kept in memory
+static void addressOf(const SymbolEntry *sym, char *text, size_t size) {
+    if (sym->table == globalTable)
+        formatText(text, size, "%d", CGEN_NULL_BYTES + sym->offset);
+    else
+        formatText(text, size, "__mc_fp + %d", sym->offset);
+}
+
+// The value of the given type stored at address
+static Value loadFrom(const char *address, Type type) {
+    Value v;
+    const char *load = type == CHAR_T ? "ldc" : type == BOOL_T ? "ldb" : type == FLOAT_T ? "ldf" : "ldi";
+    formatText(v.text, sizeof(v.text), "__mc_%s(%s)", load, address);
+    v.isFloat = type == FLOAT_T;
+    return v;
+}
+
+// Address of the string literal in the pool
+static int stringAddress(CEmitter *e, const char *s) {
+    const char *atom = intern(s);
+    unsigned slot = internHash(atom) & (e->stringCapacity - 1);
+    while (e->strings[slot] != atom)
+        slot = (slot + 1) & (e->stringCapacity - 1);
+    return e->stringAddress[slot];
+}
+
+static void intLiteral(long long v, char *text, size_t size) {
+    if (v == (-9223372036854775807LL - 1))
+        formatText(text, size, "(-9223372036854775807LL - 1)");
+    else if (v < 0)
+        formatText(text, size, "(%lldLL)", v);
+    else
+        formatText(text, size, "%lldLL", v);
+}
+
+static void floatLiteral(double d, char *text, size_t size) {
+    if (isnan(d)) {
+        formatText(text, size, "(0.0 / 0.0)");
+    } else if (isinf(d)) {
+        formatText(text, size, d > 0 ? "(1.0 / 0.0)" : "(-1.0 / 0.0)");
+    } else {
+        char number[40];
+        formatText(number, sizeof(number), "%.17g", d);
+        int plain = strpbrk(number, ".e") == NULL;
+        formatText(text, size, signbit(d) ? "(%s%s)" : "%s%s", number, plain ? ".0" : "");
+    }
+}
+
+// Operand o as the VM's loadInt gives it, a long long
+static Value intOf(CEmitter *e, Operand o) {
+    Value v;
+    char name[64];
+    v.isFloat = 0;
+    switch (o.kind) {
+        case OPD_SYM:
+        case OPD_TEMP:
+            if (inVariable(o.sym)) {
+                nameOf(o.sym, name, sizeof(name));
+                formatText(v.text, sizeof(v.text), "(long long)%s", name);
+            } else {
+                addressOf(o.sym, name, sizeof(name));
+                Value m = loadFrom(name, o.sym->type);
+                formatText(v.text, sizeof(v.text), "(long long)%s", m.text);
+            }
+            break;
+        case OPD_INT:
+            intLiteral(o.ival, v.text, sizeof(v.text));
+            break;
+        case OPD_FLOAT:
+            intLiteral((long long)o.fval, v.text, sizeof(v.text));
+            break;
+        case OPD_STR:
+            intLiteral(stringAddress(e, o.str), v.text, sizeof(v.text));
+            break;
+        default:
+            formatText(v.text, sizeof(v.text), "0LL");
+            break;
+    }
+    return v;
+}
+
+// Operand o as the VM's loadFloat gives it, a double
+static Value floatOf(CEmitter *e, Operand o) {
+    Value v;
+    char name[64];
+    v.isFloat = 1;
+    if (o.kind == OPD_FLOAT) {
+        floatLiteral(o.fval, v.text, sizeof(v.text));
+    } else if (o.kind == OPD_INT) {
+        floatLiteral((double)o.ival, v.text, sizeof(v.text));
+    } else if (isFloatValue(o) && inVariable(o.sym)) {
+        nameOf(o.sym, v.text, sizeof(v.text));
+    } else if (isFloatValue(o)) {
+        addressOf(o.sym, name, sizeof(name));
+        v = loadFrom(name, FLOAT_T);
+    } else {
+        Value i = intOf(e, o);
+        formatText(v.text, sizeof(v.text), "(double)%s", i.text);
+    }
+    return v;
+}
+
+static Value valueOf(CEmitter *e, Operand o) {
+    return isFloatValue(o) ? floatOf(e, o) : intOf(e, o);
+}
+
+// Whether o is nonzero, as an int 0 or 1; NaN is
+static Value truthOf(CEmitter *e, Operand o) {
+    Value a = valueOf(e, o), v;
+    formatText(v.text, sizeof(v.text), "(%s != 0)", a.text);
+    v.isFloat = 0;
+    return v;
+}
+
+// v converted to type as the VM's storeValue does
+static void convert(Value v, Type type, char *text, size_t size) {
+    switch (type) {
+        case FLOAT_T:
+            formatText(text, size, v.isFloat ? "%s" : "(double)(%s)", v.text);
+            break;
+        case BOOL_T:
+            formatText(text, size, "(%s) != 0", v.text);
+            break;
+        case CHAR_T:
+            formatText(text, size, v.isFloat ? "(signed char)(long long)(%s)" : "(signed char)(%s)", v.text);
+            break;
+        default:
+            formatText(text, size, v.isFloat ? "(int)(long long)(%s)" : "(int)(%s)", v.text);
+            break;
+    }
+}
+
+// Store v at address as a value of the given type
+static void storeAt(CEmitter *e, const char *address, Type type, Value v) {
+    char text[CGEN_TEXT];
+    if (!isScalar(type))
+        return;
+    convert(v, type, text, sizeof(text));
+    const char *store = type == CHAR_T ? "stc" : type == BOOL_T ? "stb" : type == FLOAT_T ? "stf" : "sti";
+    line(e, "    __mc_%s(%s, %s);", store, address, text);
+}
+
+// result = v, converting as the VM's storeValue does
+static void store(CEmitter *e, Operand result, Value v) {
+    char text[CGEN_TEXT], name[64];
+    if (!isVariable(result))
+        return;
+    if (inVariable(result.sym)) {
+        nameOf(result.sym, name, sizeof(name));
+        convert(v, result.sym->type, text, sizeof(text));
+        line(e, "    %s = %s;", name, text);
+    } else {
+        addressOf(result.sym, name, sizeof(name));
+        storeAt(e, name, result.sym->type, v);
+    }
+}
+
+// Base address of an array operand, or the value of a pointer
+static Value baseOf(CEmitter *e, Operand o) {
+    Value v;
+    if (isVariable(o) && o.sym->type == ARRAY_T && !inVariable(o.sym)) {
+        addressOf(o.sym, v.text, sizeof(v.text));
+        v.isFloat = 0;
+        return v;
+    }
+    return intOf(e, o);
+}
+
+// Type a store through result writes, as the VM decodes it
+static Type storedType(Operand result) {
+    return isVariable(result) && result.sym->eleType != VOID_T ? result.sym->eleType : INT_T;
+}
+
+// Label a jump from quad i goes to: unpatched jumps fall through, and
+// targets outside the code being emitted go to its end
+static int targetOf(const CEmitter *e, int i) {
+    const Quad *q = quadAt(i);
+    int t = q->result.kind == OPD_TARGET ? q->result.target : i + 1;
+    if (e->begin >= 0)
+        return t <= e->begin || t > e->end ? e->end : t;
+    if (t < 0 || t > quadIndex)
+        return quadIndex;
+    return e->beginOf[t] >= 0 ? e->beginOf[t] : t;
+}
+
+static void notePush(CEmitter *e, int isFloat) {
+    if (e->pushed == e->pushedCapacity) {
+        e->pushedCapacity = e->pushedCapacity ? e->pushedCapacity * 2 : 16;
+        e->pushedFloat = (char*)realloc(e->pushedFloat, e->pushedCapacity);
+    }
+    e->pushedFloat[e->pushed++] = isFloat;
+}
+
+// Values passed by param and consumed by call in quads from..to, as they
+// are emitted, in argClasses; returns the positions used
+static int scanArgs(CEmitter *e, int from, int to) {
+    int pushed = 0, used = 0;
+    for (int i = from; i <= to && i < quadIndex; i++) {
+        Quad *q = quadAt(i);
+        if (e->begin < 0 && q->op == OP_FUNC_BEGIN && e->beginOf[i + 1] == i) {
+            i = functionEnd(i);
+        } else if (q->op == OP_PARAM) {
+            if (pushed == e->argCapacity) {
+                e->argCapacity = e->argCapacity ? e->argCapacity * 2 : 16;
+                e->argClasses = (char*)realloc(e->argClasses, e->argCapacity);
+            }
+            if (pushed == used)
+                e->argClasses[used++] = 0;
+            e->argClasses[pushed++] |= isFloatValue(q->arg1) ? 2 : 1;
+        } else if (q->op == OP_CALL) {
+            int argc = q->arg2.kind == OPD_INT ? q->arg2.ival : 0;
+            pushed -= argc < pushed ? (argc > 0 ? argc : 0) : pushed;
+        }
+    }
+    return used;
+}
+
+static void declareArgs(CEmitter *e, int used) {
+    for (int k = 0; k < used; k++) {
+        if (e->argClasses[k] & 1)
+            line(e, "    long long __mc_a%d = 0;", k);
+        if (e->argClasses[k] & 2)
+            line(e, "    double __mc_d%d = 0;", k);
+    }
+}
+
+// A call of func with the last argc values passed by param
+static void callText(CEmitter *e, SymbolEntry *func, int argc, char **text) {
+    SymbolTable *table = func->nestedTable;
+    int params = func->paramCount < table->count ? func->paramCount : table->count;
+    if (argc > e->pushed)
+        argc = e->pushed;
+    if (argc < 0)
+        argc = 0;
+    size_t size = 64 + strlen(func->name) + (size_t)params * 64, at;
+    *text = (char*)malloc(size);
+    at = snprintf(*text, size, "mc_%s(", func->name);
+    SymbolEntry *p = table->entries;
+    for (int k = 0; k < params; k++, p = p->next) {
+        char arg[64] = "0";
+        if (k < argc) {
+            int slot = e->pushed - argc + k;
+            Value v;
+            v.isFloat = e->pushedFloat[slot];
+            formatText(v.text, sizeof(v.text), v.isFloat ? "__mc_d%d" : "__mc_a%d", slot);
+            convert(v, p->type, arg, sizeof(arg));
+        }
+        at += snprintf(*text + at, size - at, "%s%s", k ? ", " : "", arg);
+    }
+    formatText(*text + at, size - at, ")");
+    e->pushed -= argc;
+}
+
+// Leave the function with the value of o, or zero without one
+static void emitReturn(CEmitter *e, Operand o) {
+    char text[CGEN_TEXT];
+    if (e->begin < 0) {
+        // A return outside any function ends the program
+        line(e, "    return 1;");
+        return;
+    }
+    line(e, "    __mc_leave(__mc_fp);");
+    if (e->returnType == VOID_T) {
+        line(e, "    return;");
+        return;
+    }
+    Value v = valueOf(e, o);
+    convert(v, e->returnType, text, sizeof(text));
+    line(e, "    return %s;", text);
+}
+
+static const char *const intOps[] = { "+", "-", "*" };
+static const char *const floatOps[] = { "+", "-", "*", "/" };
+static const char *const bitOps[] = { "&", "|", "^" };
+static const char *const relOps[] = { "<", ">", "<=", ">=", "==", "!=" };
+
+// Emit quad i; returns 0 after reporting an error
+static int translateQuad(CEmitter *e, int i) {
+    Quad *q = quadAt(i);
+    Value a, b, v;
+    char address[CGEN_TEXT];
+    v.isFloat = 0;
+
+    switch (q->op) {
+        case OP_NOP:
+        case OP_FUNC_BEGIN:
+            break;
+        case OP_ASSIGN:
+        case OP_INT2REAL: case OP_REAL2INT:
+        case OP_CHAR2INT: case OP_INT2CHAR:
+        case OP_BOOL2INT: case OP_INT2BOOL:
+            store(e, q->result, valueOf(e, q->arg1));
+            break;
+
+        case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_MOD:
+            if (typeOf(q->result) == FLOAT_T) {
+                a = floatOf(e, q->arg1);
+                b = floatOf(e, q->arg2);
+                if (q->op == OP_MOD)
+                    formatText(v.text, sizeof(v.text), "fmod(%s, %s)", a.text, b.text);
+                else
+                    formatText(v.text, sizeof(v.text), "(%s %s %s)", a.text, floatOps[q->op - OP_ADD], b.text);
+                v.isFloat = 1;
+            } else {
+                a = intOf(e, q->arg1);
+                b = intOf(e, q->arg2);
+                // Wrapping arithmetic, as the machine does it
+                if (q->op == OP_DIV || q->op == OP_MOD)
+                    formatText(v.text, sizeof(v.text), "__mc_%s(%s, %s)", q->op == OP_DIV ? "div" : "mod",
+                             a.text, b.text);
+                else
+                    formatText(v.text, sizeof(v.text), "(long long)((unsigned long long)%s %s (unsigned long long)%s)",
+                             a.text, intOps[q->op - OP_ADD], b.text);
+            }
+            store(e, q->result, v);
+            break;
+
+        case OP_BITAND: case OP_BITOR: case OP_BITXOR:
+            a = intOf(e, q->arg1);
+            b = intOf(e, q->arg2);
+            formatText(v.text, sizeof(v.text), "(%s %s %s)", a.text, bitOps[q->op - OP_BITAND], b.text);
+            store(e, q->result, v);
+            break;
+        case OP_SHL:
+            a = intOf(e, q->arg1);
+            b = intOf(e, q->arg2);
+            formatText(v.text, sizeof(v.text), "(long long)((unsigned long long)%s << (%s & 31))", a.text, b.text);
+            store(e, q->result, v);
+            break;
+        case OP_SHR:
+            // An arithmetic shift of the low 32 bits
+            a = intOf(e, q->arg1);
+            b = intOf(e, q->arg2);
+            formatText(v.text, sizeof(v.text), "(long long)((int)%s >> (%s & 31))", a.text, b.text);
+            store(e, q->result, v);
+            break;
+
+        case OP_LT: case OP_GT: case OP_LE: case OP_GE: case OP_EQ: case OP_NE:
+            if (isFloatValue(q->arg1) || isFloatValue(q->arg2)) {
+                a = floatOf(e, q->arg1);
+                b = floatOf(e, q->arg2);
+            } else {
+                a = intOf(e, q->arg1);
+                b = intOf(e, q->arg2);
+            }
+            formatText(v.text, sizeof(v.text), "(%s %s %s)", a.text, relOps[q->op - OP_LT], b.text);
+            store(e, q->result, v);
+            break;
+
+        case OP_LOGAND:
+        case OP_LOGOR:
+            a = truthOf(e, q->arg1);
+            b = truthOf(e, q->arg2);
+            formatText(v.text, sizeof(v.text), "(%s %s %s)", a.text, q->op == OP_LOGAND ? "&" : "|", b.text);
+            store(e, q->result, v);
+            break;
+        case OP_NOT:
+            a = valueOf(e, q->arg1);
+            formatText(v.text, sizeof(v.text), "(%s == 0)", a.text);
+            store(e, q->result, v);
+            break;
+        case OP_UMINUS:
+            if (typeOf(q->result) == FLOAT_T) {
+                a = floatOf(e, q->arg1);
+                formatText(v.text, sizeof(v.text), "(-%s)", a.text);
+                v.isFloat = 1;
+            } else {
+                a = intOf(e, q->arg1);
+                formatText(v.text, sizeof(v.text), "(long long)(0ULL - (unsigned long long)%s)", a.text);
+            }
+            store(e, q->result, v);
+            break;
+
+        case OP_ADDR:
+            if (isVariable(q->arg1)) {
+                addressOf(q->arg1.sym, address, sizeof(address));
+                formatText(v.text, sizeof(v.text), "(long long)(%s)", address);
+            } else {
+                formatText(v.text, sizeof(v.text), "0LL");
+            }
+            store(e, q->result, v);
+            break;
+        case OP_DEREF:
+            a = intOf(e, q->arg1);
+            if (isVariable(q->result))
+                store(e, q->result, loadFrom(a.text, typeOf(q->result)));
+            break;
+        case OP_ARRAY_LOAD:
+            a = baseOf(e, q->arg1);
+            b = intOf(e, q->arg2);
+            formatText(address, sizeof(address), "%s + %s", a.text, b.text);
+            if (isVariable(q->result))
+                store(e, q->result, loadFrom(address, typeOf(q->result)));
+            break;
+        case OP_ARRAY_STORE:
+            a = baseOf(e, q->result);
+            b = intOf(e, q->arg1);
+            formatText(address, sizeof(address), "%s + %s", a.text, b.text);
+            storeAt(e, address, storedType(q->result), valueOf(e, q->arg2));
+            break;
+        case OP_PTR_STORE:
+            a = intOf(e, q->result);
+            storeAt(e, a.text, storedType(q->result), valueOf(e, q->arg1));
+            break;
+
+        case OP_GOTO:
+            line(e, "    goto L%d;", targetOf(e, i));
+            break;
+        case OP_IF:
+        case OP_IFFALSE:
+            a = valueOf(e, q->arg1);
+            line(e, "    if (%s %s 0) goto L%d;", a.text, q->op == OP_IF ? "!=" : "==", targetOf(e, i));
+            break;
+        case OP_IFLT: case OP_IFGT: case OP_IFLE: case OP_IFGE: case OP_IFEQ: case OP_IFNE:
+            if (isFloatValue(q->arg1) || isFloatValue(q->arg2)) {
+                a = floatOf(e, q->arg1);
+                b = floatOf(e, q->arg2);
+            } else {
+                a = intOf(e, q->arg1);
+                b = intOf(e, q->arg2);
+            }
+            line(e, "    if (%s %s %s) goto L%d;", a.text, relOps[q->op - OP_IFLT], b.text, targetOf(e, i));
+            break;
+
+        case OP_PARAM:
+            a = valueOf(e, q->arg1);
+            line(e, "    __mc_%c%d = %s;", a.isFloat ? 'd' : 'a', e->pushed, a.text);
+            notePush(e, a.isFloat);
+            break;
+        case OP_CALL: {
+            // Defined functions carry a scratch id while emitting
+            if (q->arg1.kind != OPD_SYM || !q->arg1.sym->nestedTable || q->arg1.sym->id < 0) {
+                fprintf(stderr, "Error: %s is called but never defined\n",
+                        q->arg1.kind == OPD_SYM ? q->arg1.sym->name : "?");
+                return 0;
+            }
+            char *call;
+            callText(e, q->arg1.sym, q->arg2.kind == OPD_INT ? q->arg2.ival : 0, &call);
+            Type type = returnTypeOf(q->arg1.sym);
+            int stored = isVariable(q->result) && isScalar(q->result.sym->type);
+            if (type == VOID_T || !stored)
+                line(e, "    %s;", call);
+            if (stored) {
+                // Void functions leave zero
+                if (type == VOID_T)
+                    formatText(v.text, sizeof(v.text), "0LL");
+                else
+                    formatText(v.text, sizeof(v.text), "%s", call);
+                v.isFloat = type == FLOAT_T;
+                if (type != VOID_T && strlen(call) >= sizeof(v.text)) {
+                    line(e, "    { %s __mc_r = %s;", cType(type), call);
+                    formatText(v.text, sizeof(v.text), "__mc_r");
+                    store(e, q->result, v);
+                    line(e, "    }");
+                } else {
+                    store(e, q->result, v);
+                }
+            }
+            free(call);
+            break;
+        }
+        case OP_RETURN:
+            emitReturn(e, q->arg1);
+            break;
+        case OP_FUNC_END:
+            emitReturn(e, noOperand());
+            break;
+        default:
+            break;
+    }
+    return 1;
+}
+
+static int emitRange(CEmitter *e, int from, int to) {
+    for (int i = from; i <= to; i++) {
+        if (e->isTarget[i])
+            line(e, "L%d: ;", i);
+        if (i < quadIndex && !translateQuad(e, i))
+            return 0;
+    }
+    return 1;
+}
+
+// Number the locals of func kept in C variables: scalars whose address is
+// never taken
+static void numberLocals(int begin, int end, SymbolTable *table) {
+    for (int i = begin + 1; i < end; i++) {
+        Quad *q = quadAt(i);
+        if (q->op == OP_ADDR && isVariable(q->arg1) && q->arg1.sym->table == table)
+            q->arg1.sym->id = -2;
+    }
+    int count = 0;
+    for (SymbolEntry *sym = table->entries; sym; sym = sym->next) {
+        if (sym->id == -1 && isScalar(sym->type))
+            sym->id = count++;
+        else
+            sym->id = -2;
+    }
+}
+
+static void prototype(CEmitter *e, SymbolEntry *func, const char *end) {
+    SymbolTable *table = func->nestedTable;
+    int params = func->paramCount < table->count ? func->paramCount : table->count;
+    char *text = (char*)malloc(64 + strlen(func->name) + (size_t)(params + 1) * 96);
+    int at = sprintf(text, "%s mc_%s(", cType(returnTypeOf(func)), func->name);
+    SymbolEntry *p = table->entries;
+    for (int k = 0; k < params; k++, p = p->next) {
+        char name[64];
+        if (inVariable(p))
+            nameOf(p, name, sizeof(name));
+        else
+            formatText(name, sizeof(name), "__mc_p%d", k);
+        at += sprintf(text + at, "%s%s %s", k ? ", " : "", cType(p->type), name);
+    }
+    sprintf(text + at, "%s)%s", params ? "" : "void", end);
+    line(e, "%s", text);
+    free(text);
+}
+
+static int emitFunction(CEmitter *e, int begin, int end) {
+    SymbolEntry *func = quadAt(begin)->arg1.sym;
+    SymbolTable *table = func->nestedTable;
+    int params = func->paramCount < table->count ? func->paramCount : table->count;
+    e->begin = begin;
+    e->end = end;
+    e->returnType = returnTypeOf(func);
+    e->pushed = 0;
+    numberLocals(begin, end, table);
+
+    line(e, "");
+    prototype(e, func, "");
+    line(e, "{");
+    int k = 0, inMemory = 0;
+    for (SymbolEntry *sym = table->entries; sym; sym = sym->next, k++) {
+        char name[64];
+        if (!inVariable(sym)) {
+            inMemory |= sym->size > 0;
+        } else if (k >= params) {
+            nameOf(sym, name, sizeof(name));
+            line(e, "    %s %s = 0;", cType(sym->type), name);
+        }
+    }
+    declareArgs(e, scanArgs(e, begin + 1, end));
+    line(e, "    int __mc_fp = __mc_enter(%d);", (table->frameSize + 7) & ~7);
+    if (inMemory)
+        line(e, "    memset(__mc_mem + __mc_fp, 0, %d);", (table->frameSize + 7) & ~7);
+    SymbolEntry *p = table->entries;
+    for (k = 0; k < params; k++, p = p->next) {
+        if (!inVariable(p)) {
+            char address[64];
+            Value v;
+            addressOf(p, address, sizeof(address));
+            formatText(v.text, sizeof(v.text), "__mc_p%d", k);
+            v.isFloat = p->type == FLOAT_T;
+            storeAt(e, address, p->type, v);
+        }
+    }
+    int ok = emitRange(e, begin + 1, end);
+    line(e, "}");
+
+    for (SymbolEntry *sym = table->entries; sym; sym = sym->next)
+        sym->id = -1;
+    return ok;
+}
+
+// The quads outside functions, which initialise the globals; returns 1
+// if they end the program with a return
+static int emitGlobalCode(CEmitter *e) {
+    e->begin = e->end = -1;
+    e->returnType = INT_T;
+    e->pushed = 0;
+    line(e, "");
+    line(e, "int __mc_init(void)");
+    line(e, "{");
+    declareArgs(e, scanArgs(e, 0, quadIndex - 1));
+    for (int i = 0; i < quadIndex; i++) {
+        Quad *q = quadAt(i);
+        if (e->isTarget[i])
+            line(e, "L%d: ;", i);
+        if (q->op == OP_FUNC_BEGIN && e->beginOf[i + 1] == i) {
+            i = functionEnd(i);
+            continue;
+        }
+        if (!translateQuad(e, i))
+            return 0;
+    }
+    if (e->isTarget[quadIndex])
+        line(e, "L%d: ;", quadIndex);
+    line(e, "    return 0;");
+    line(e, "}");
+    return 1;
+}
+
+// Put the string literals in the pool, each once, 8-byte aligned as in the VM
+static void collectStrings(CEmitter *e) {
+    int count = 0;
+    for (int i = 0; i < quadIndex; i++) {
+        Quad *q = quadAt(i);
+        count += (q->arg1.kind == OPD_STR) + (q->arg2.kind == OPD_STR) + (q->result.kind == OPD_STR);
+    }
+    e->stringCapacity = 16;
+    while (e->stringCapacity < 2 * count)
+        e->stringCapacity *= 2;
+    e->strings = (const char**)calloc(e->stringCapacity, sizeof(const char*));
+    e->stringAddress = (int*)malloc(e->stringCapacity * sizeof(int));
+
+    int poolBase = (CGEN_NULL_BYTES + globalTable->frameSize + 7) & ~7;
+    for (int i = 0; i < quadIndex; i++) {
+        Quad *q = quadAt(i);
+        for (int slot = 1; slot <= 3; slot++) {
+            Operand *o = operandOf(q, slot);
+            if (o->kind != OPD_STR)
+                continue;
+            const char *atom = intern(o->str);
+            unsigned at = internHash(atom) & (e->stringCapacity - 1);
+            while (e->strings[at] && e->strings[at] != atom)
+                at = (at + 1) & (e->stringCapacity - 1);
+            if (e->strings[at])
+                continue;
+            size_t len = strlen(atom);
+            if (len >= 2 && atom[0] == '"')
+                len -= 2;
+            e->strings[at] = atom;
+            e->stringAddress[at] = poolBase + e->poolSize;
+            e->poolSize = (e->poolSize + (int)len + 1 + 7) & ~7;
+        }
+    }
+}
+
+// The bytes of the pool, between the quotes of each literal
+static void emitPool(CEmitter *e, int poolBase) {
+    unsigned char *pool = (unsigned char*)calloc(e->poolSize ? e->poolSize : 1, 1);
+    for (int k = 0; k < e->stringCapacity; k++) {
+        const char *s = e->strings[k];
+        if (!s)
+            continue;
+        size_t len = strlen(s);
+        if (len >= 2 && s[0] == '"') {
+            s++;
+            len -= 2;
+        }
+        memcpy(pool + e->stringAddress[k] - poolBase, s, len);
+    }
+    line(e, "");
+    line(e, "static const unsigned char __mc_pool[%d] = {", e->poolSize ? e->poolSize : 1);
+    for (int k = 0; k < (e->poolSize ? e->poolSize : 1); k += 16) {
+        char text[128];
+        int at = sprintf(text, "   ");
+        for (int j = k; j < k + 16 && j < (e->poolSize ? e->poolSize : 1); j++)
+            at += sprintf(text + at, " %d,", pool[j]);
+        line(e, "%s", text);
+    }
+    line(e, "};");
+    free(pool);
+}
+
+static const char *const prelude[] = {
+    "",
+    "unsigned char __mc_mem[MC_MEM_BYTES];",
+    "void (*__mc_fail)(const char *message);   // Error handler of a loader; must not return",
+    "static int __mc_sp = MC_STACK_BASE, __mc_depth;",
+    "",
+    "static void __mc_error(const char *message)",
+    "{",
+    "    if (__mc_fail)",
+    "        __mc_fail(message);",
+    "    fputs(message, stderr);",
+    "    exit(1);",
+    "}",
+    "",
+    "static inline long long __mc_div(long long a, long long b)",
+    "{",
+    "    if (b == 0)",
+    "        __mc_error(\"Error: division by zero\\n\");",
+    "    return b == -1 ? (long long)(0ULL - (unsigned long long)a) : a / b;",
+    "}",
+    "",
+    "static inline long long __mc_mod(long long a, long long b)",
+    "{",
+    "    if (b == 0)",
+    "        __mc_error(\"Error: division by zero\\n\");",
+    "    return b == -1 ? 0 : a % b;",
+    "}",
+    "",
+    "static inline signed char __mc_ldc(long long a) { return (signed char)__mc_mem[a]; }",
+    "static inline unsigned char __mc_ldb(long long a) { return __mc_mem[a]; }",
+    "static inline int __mc_ldi(long long a) { int v; memcpy(&v, __mc_mem + a, 4); return v; }",
+    "static inline double __mc_ldf(long long a) { double v; memcpy(&v, __mc_mem + a, 8); return v; }",
+    "static inline void __mc_stc(long long a, signed char v) { __mc_mem[a] = (unsigned char)v; }",
+    "static inline void __mc_stb(long long a, unsigned char v) { __mc_mem[a] = v; }",
+    "static inline void __mc_sti(long long a, int v) { memcpy(__mc_mem + a, &v, 4); }",
+    "static inline void __mc_stf(long long a, double v) { memcpy(__mc_mem + a, &v, 8); }",
+    "",
+    "// A frame of size bytes on the VM stack",
+    "static inline int __mc_enter(int size)",
+    "{",
+    "    int fp = __mc_sp;",
+    "    if (fp + size > MC_MEM_BYTES || __mc_depth >= MC_MAX_DEPTH)",
+    "        __mc_error(\"Error: call stack overflow\\n\");",
+    "    __mc_sp = fp + size;",
+    "    __mc_depth++;",
+    "    return fp;",
+    "}",
+    "",
+    "static inline void __mc_leave(int fp)",
+    "{",
+    "    __mc_sp = fp;",
+    "    __mc_depth--;",
+    "}",
+};
+
+// main for -DMC_MAIN: run the global code, call the microC main and print
+// its result as --run does
+static void emitMain(CEmitter *e, SymbolEntry *entry) {
+    Type type = returnTypeOf(entry);
+    line(e, "");
+    line(e, "#ifdef MC_MAIN");
+    line(e, "int main(void)");
+    line(e, "{");
+    line(e, "    __mc_reset();");
+    if (type == VOID_T) {
+        line(e, "    if (!__mc_init())");
+        line(e, "        mc_%s();", entry->name);
+        line(e, "    printf(\"main returned 0\\n\");");
+    } else {
+        line(e, "    %s result = 0;", cType(type));
+        line(e, "    if (!__mc_init())");
+        line(e, "        result = mc_%s();", entry->name);
+        if (type == FLOAT_T)
+            line(e, "    printf(\"main returned %%f\\n\", result);");
+        else
+            line(e, "    printf(\"main returned %%lld\\n\", (long long)result);");
+    }
+    line(e, "    return 0;");
+    line(e, "}");
+    line(e, "#endif");
+}
+
+// Write the C file for the current quads; returns 1, or 0 after reporting an error
+static int emitProgram(CEmitter *e) {
+    e->beginOf = (int*)malloc((quadIndex + 1) * sizeof(int));
+    e->isTarget = (char*)calloc(quadIndex + 1, 1);
+    for (int i = 0; i <= quadIndex; i++)
+        e->beginOf[i] = -1;
+    for (int i = 0; i < quadIndex; i++) {
+        int end = quadAt(i)->op == OP_FUNC_BEGIN && quadAt(i)->arg1.kind == OPD_SYM &&
+                  quadAt(i)->arg1.sym->nestedTable ? functionEnd(i) : -1;
+        if (end < 0)
+            continue;
+        for (int k = i + 1; k <= end; k++)
+            e->beginOf[k] = i;
+        quadAt(i)->arg1.sym->id = 0;
+        i = end;
+    }
+
+    // Mark the labels jumps need, each in the code it belongs to
+    for (int i = 0; i < quadIndex; i++) {
+        OpCode op = quadAt(i)->op;
+        if (op != OP_GOTO && !isConditionalJump(op))
+            continue;
+        e->begin = e->beginOf[i];
+        e->end = e->begin >= 0 ? functionEnd(e->begin) : -1;
+        e->isTarget[targetOf(e, i)] = 1;
+    }
+
+    collectStrings(e);
+    int poolBase = (CGEN_NULL_BYTES + globalTable->frameSize + 7) & ~7;
+    int stackBase = (poolBase + e->poolSize + 7) & ~7;
+    line(e, "// microC program compiled to C by a9_220101107");
+    line(e, "#include <math.h>");
+    line(e, "#include <stdio.h>");
+    line(e, "#include <stdlib.h>");
+    line(e, "#include <string.h>");
+    line(e, "");
+    line(e, "#define MC_GLOBALS %d", CGEN_NULL_BYTES);
+    line(e, "#define MC_GLOBAL_BYTES %d", globalTable->frameSize);
+    line(e, "#define MC_POOL %d", poolBase);
+    line(e, "#define MC_STACK_BASE %d", stackBase);
+    line(e, "#define MC_MEM_BYTES %d", stackBase + VM_STACK_BYTES);
+    line(e, "#define MC_MAX_DEPTH %d", VM_MAX_DEPTH);
+    for (size_t k = 0; k < sizeof(prelude) / sizeof(prelude[0]); k++)
+        line(e, "%s", prelude[k]);
+    emitPool(e, poolBase);
+
+    line(e, "");
+    line(e, "void __mc_reset(void)");
+    line(e, "{");
+    line(e, "    memset(__mc_mem, 0, MC_STACK_BASE);");
+    line(e, "    memcpy(__mc_mem + MC_POOL, __mc_pool, %d);", e->poolSize);
+    line(e, "    __mc_sp = MC_STACK_BASE;");
+    line(e, "    __mc_depth = 0;");
+    line(e, "}");
+
+    // Prototypes, so calls may come before definitions
+    line(e, "");
+    for (int i = 0; i < quadIndex; i++) {
+        if (e->beginOf[i + 1] == i && quadAt(i)->op == OP_FUNC_BEGIN) {
+            SymbolEntry *func = quadAt(i)->arg1.sym;
+            numberLocals(i, functionEnd(i), func->nestedTable);
+            prototype(e, func, ";");
+            for (SymbolEntry *sym = func->nestedTable->entries; sym; sym = sym->next)
+                sym->id = -1;
+            i = functionEnd(i);
+        }
+    }
+
+    int ok = emitGlobalCode(e);
+    for (int i = 0; i < quadIndex && ok; i++) {
+        if (e->beginOf[i + 1] == i && quadAt(i)->op == OP_FUNC_BEGIN) {
+            int end = functionEnd(i);
+            ok = emitFunction(e, i, end);
+            i = end;
+        }
+    }
+    SymbolEntry *entry = lookupInCurrentScope(globalTable, "main");
+    if (ok && entry && entry->nestedTable && entry->id >= 0)
+        emitMain(e, entry);
+
+    free(e->beginOf);
+    free(e->isTarget);
+    free(e->pushedFloat);
+    free(e->argClasses);
+    free(e->strings);
+    free(e->stringAddress);
+    for (SymbolEntry *sym = globalTable->entries; sym; sym = sym->next)
+        sym->id = -1;
+    return ok;
+}
+
+int writeCSource(const char *path) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    CEmitter e;
+    memset(&e, 0, sizeof(e));
+    outOpen(&e.out, fd);
+    int ok = emitProgram(&e);
+    if (outClose(&e.out) != 0)
+        ok = 0;
+    if (close(fd) != 0) {
+        perror(path);
+        ok = 0;
+    }
+    return ok ? 0 : -1;
+}
+
+// ---- Loading ----
+
+struct CModule {
+    void *handle;
+};
+
+static jmp_buf *failJump;   // cRun() in progress
+
+// Run time errors of the loaded code
+static void cFail(const char *message) {
+    fputs(message, stderr);
+    longjmp(*failJump, 1);
+}
+
+CModule* cCompile(void) {
+    const char *tmp = getenv("TMPDIR");
+    const char *cc = getenv("CC");
+    char dir[512], source[600], object[600];
+    snprintf(dir, sizeof(dir), "%s/mcXXXXXX", tmp && *tmp ? tmp : "/tmp");
+    if (!mkdtemp(dir)) {
+        perror(dir);
+        return NULL;
+    }
+    snprintf(source, sizeof(source), "%s/program.c", dir);
+    snprintf(object, sizeof(object), "%s/program.so", dir);
+
+    CModule *module = NULL;
+    if (writeCSource(source) == 0) {
+        // Calls between the exported functions may still be inlined
+        char command[2048];
+        snprintf(command, sizeof(command),
+                 "%s -O2 -shared -fPIC -fno-semantic-interposition -o '%s' '%s' -lm",
+                 cc && *cc ? cc : "gcc", object, source);
+        int status = system(command);
+        void *handle = status == 0 ? dlopen(object, RTLD_NOW | RTLD_LOCAL) : NULL;
+        if (status != 0)
+            fprintf(stderr, "Error: %s failed\n", command);
+        else if (!handle)
+            fprintf(stderr, "Error: %s\n", dlerror());
+        if (handle) {
+            module = (CModule*)calloc(1, sizeof(CModule));
+            module->handle = handle;
+        }
+    }
+    unlink(source);
+    unlink(object);
+    rmdir(dir);
+    return module;
+}
+
+void* cFunction(CModule *module, const char *name) {
+    char symbol[256];
+    snprintf(symbol, sizeof(symbol), "mc_%s", name);
+    return dlsym(module->handle, symbol);
+}
+
+typedef struct CCall {
+    CModule *module;
+    void *code;
+    Type type;
+    VMValue *result;
+    int status;
+} CCall;
+
+static void* runCall(void *argument) {
+    CCall *call = (CCall*)argument;
+    void (*reset)(void) = (void (*)(void))dlsym(call->module->handle, "__mc_reset");
+    int (*init)(void) = (int (*)(void))dlsym(call->module->handle, "__mc_init");
+    jmp_buf failure;
+    failJump = &failure;
+    if (setjmp(failure)) {
+        call->status = -1;
+        return NULL;
+    }
+    reset();
+    int halted = init();
+    VMValue *result = call->result;
+    result->type = call->type;
+    result->ival = 0;
+    if (!halted) {
+        switch (call->type) {
+            case FLOAT_T: result->fval = ((double (*)(void))call->code)(); break;
+            case CHAR_T:  result->ival = ((signed char (*)(void))call->code)(); break;
+            case BOOL_T:  result->ival = ((unsigned char (*)(void))call->code)(); break;
+            case VOID_T:  ((void (*)(void))call->code)(); break;
+            default:      result->ival = ((int (*)(void))call->code)(); break;
+        }
+    }
+    call->status = 0;
+    return NULL;
+}
+
+int cRun(CModule *module, const char *entry, VMValue *result) {
+    SymbolEntry *func = lookupInCurrentScope(globalTable, entry);
+    if (!func || !func->nestedTable) {
+        fprintf(stderr, "Error: no function %s to run\n", entry);
+        return -1;
+    }
+    CCall call = { module, cFunction(module, entry), returnTypeOf(func), result, -1 };
+    if (!call.code) {
+        fprintf(stderr, "Error: %s is declared but never defined\n", entry);
+        return -1;
+    }
+
+    // Errors come back here rather than ending the process
+    void (**fail)(const char*) = (void (**)(const char*))dlsym(module->handle, "__mc_fail");
+    *fail = cFail;
+    pthread_attr_t attributes;
+    pthread_t thread;
+    pthread_attr_init(&attributes);
+    pthread_attr_setstacksize(&attributes, CGEN_THREAD_STACK);
+    if (pthread_create(&thread, &attributes, runCall, &call) == 0)
+        pthread_join(thread, NULL);
+    else
+        runCall(&call);
+    pthread_attr_destroy(&attributes);
+    *fail = NULL;
+    failJump = NULL;
+    return call.status;
+}
+
+void cFree(CModule *module) {
+    if (!module)
+        return;
+    dlclose(module->handle);
+    free(module);
+}
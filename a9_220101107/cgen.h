@@ -0,0 +1,38 @@
+#ifndef CGEN_H
+#define CGEN_H
+
+#include "vm.h"
+
+// C source for the quads, so the system C compiler can optimize them.
+// Each function becomes a C function whose scalar locals and temporaries
+// are C variables; arrays and variables whose address is taken live in a
+// byte array laid out as the VM's memory, where pointers are offsets.
+// Integer arithmetic is done in 64 bits and narrowed to the result type
+// exactly as in the VM, so the output needs no compiler flags.
+//
+// The file defines mc_<name> for every function, taking its parameters
+// as C arguments, and __mc_reset() and __mc_init() to clear the memory
+// and run the global code. Built with -DMC_MAIN it also gets a main that
+// runs the microC main and prints its result as --run does.
+
+int writeCSource(const char *path);
+
+// The same source compiled with $CC (gcc by default) at -O2 as a shared
+// object and loaded with dlopen
+typedef struct CModule CModule;
+
+// Compile the current quads; returns NULL after reporting an error
+CModule* cCompile(void);
+
+// Entry point of a microC function, NULL if it is not defined; cast it to
+// the function's C type, with double for float
+void* cFunction(CModule *module, const char *name);
+
+// Run the global initialisers, then the function named entry, as vmRun()
+// does. Returns 0 and the function's return value in result, or -1 after
+// reporting a run time error.
+int cRun(CModule *module, const char *entry, VMValue *result);
+
+void cFree(CModule *module);
+
+#endif
@@ -0,0 +1,47 @@
+#!/bin/sh
+# Regression check: compiles and runs every program in tests/ with the
+# given options and compares what it prints with its .out file, which
+# holds the output of --run. The quad number in run time errors is
+# dropped, as it depends on the mode.
+#
+#   ./check.sh --run
+#   ./check.sh -S [options]     (assembly linked with $CC -no-pie)
+#   CHECK_TESTS=tests/cfg ./check.sh --cfg
+#
+# CHECK_DIR is where the output goes (default /tmp). CHECK_TESTS is the
+# directory of programs (default tests); tests/cfg holds --cfg listings.
+
+PROG=./a9_220101107
+CC=${CC:-gcc}
+DIR=${CHECK_DIR:-/tmp}
+TESTS=${CHECK_TESTS:-tests}
+OUT=$DIR/check_$$
+
+asm=0
+mode="$*"
+if [ "$1" = "-S" ]; then
+    asm=1
+    shift
+fi
+
+run() {
+    if [ $asm -eq 1 ]; then
+        $PROG --no-listing "$@" -S "$OUT.s" < "$src" &&
+            $CC -no-pie "$OUT.s" -o "$OUT" && "$OUT"
+    else
+        $PROG --no-listing "$@" < "$src"
+    fi
+}
+
+status=0
+for src in $TESTS/*.mc; do
+    run "$@" 2>&1 | sed 's/ at quad [0-9]*$//' > "$OUT.txt"
+    if ! cmp -s "${src%.mc}.out" "$OUT.txt"; then
+        echo "FAIL: $src ($mode)"
+        diff "${src%.mc}.out" "$OUT.txt" | head -5
+        status=1
+    fi
+done
+rm -f "$OUT.txt" "$OUT.s" "$OUT"
+[ $status -eq 0 ] && echo "check $mode: all passed"
+exit $status
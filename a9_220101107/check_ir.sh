@@ -0,0 +1,39 @@
+#!/bin/sh
+# IR file check: writes every program in tests/ with -o, reads it back with
+# irdump, then corrupts a jump target and expects irdump to refuse the file.
+#
+#   ./check_ir.sh
+#
+# CHECK_DIR is where the files go (default /tmp).
+
+PROG=./a9_220101107
+DIR=${CHECK_DIR:-/tmp}
+OUT=$DIR/check_ir_$$
+
+# Programs that are meant not to compile are left to check.sh
+status=0
+for src in tests/*.mc; do
+    $PROG --no-listing -o "$OUT.mcir" < "$src" > /dev/null 2>&1 || continue
+    if ! ./irdump "$OUT.mcir" > /dev/null; then
+        echo "FAIL: $src (IR round trip)"
+        status=1
+    fi
+done
+
+# Point the first quad's result past the end of the program: kind 5
+# (OPD_TARGET) with target 1000000000, little endian. The quads start at
+# the offset stored 48 bytes into the header; a result operand starts
+# 40 bytes into its quad.
+$PROG --no-listing -o "$OUT.mcir" < tests/basic.mc > /dev/null
+quads=$(od -An -t u8 -j 48 -N 8 "$OUT.mcir" | tr -d ' ')
+printf '\005\000\000\000\000\000\000\000\000\312\232\073\000\000\000\000' |
+    dd of="$OUT.mcir" bs=1 seek=$((quads + 40)) conv=notrunc 2> /dev/null
+if ./irdump "$OUT.mcir" > "$OUT.txt" 2>&1 ||
+   ! grep -q "^Error: " "$OUT.txt"; then
+    echo "FAIL: corrupt jump target accepted"
+    status=1
+fi
+
+rm -f "$OUT.mcir" "$OUT.txt"
+[ $status -eq 0 ] && echo "check IR: all passed"
+exit $status
@@ -0,0 +1,109 @@
+#include "opt.h"
+
+// Frame slot sharing for temporaries. gentemp() gives every temporary a
+// frame slot of its own, though most live for a quad or two. Liveness gives
+// each temporary an interval, from the first to the last quad it is live
+// at, and a linear scan over the intervals lets temporaries of the same
+// type whose intervals do not overlap share a slot, so a shared slot always
+// holds one kind of value. The function's table is then laid out again, so
+// the listing shows the shared offsets.
+//
+// The VM zeroes a frame on entry, so a temporary that may be read before
+// it is assigned keeps a slot of its own.
+
+typedef struct Interval {
+    int start, end;
+    SymbolEntry *temp;
+} Interval;
+
+static int byStart(const void *a, const void *b) {
+    const Interval *x = (const Interval*)a, *y = (const Interval*)b;
+    return x->start != y->start ? (x->start > y->start) - (x->start < y->start)
+                                : (x->end > y->end) - (x->end < y->end);
+}
+
+static int byEnd(const void *a, const void *b) {
+    const Interval *x = (const Interval*)a, *y = (const Interval*)b;
+    return (x->end > y->end) - (x->end < y->end);
+}
+
+// Give each interval a slot, reusing the slots of the same type whose
+// intervals ended before it starts. Each temp->id is set to its slot;
+// returns the number of slots
+static int assignSlots(Interval *intervals, int n) {
+    Interval *ending = (Interval*)malloc((n ? n : 1) * sizeof(Interval));
+    memcpy(ending, intervals, n * sizeof(Interval));
+    qsort(intervals, n, sizeof(Interval), byStart);
+    qsort(ending, n, sizeof(Interval), byEnd);
+
+    // Free slots by type
+    int *freeSlots[BOOL_T + 1] = {0}, freeCount[BOOL_T + 1] = {0};
+    int slots = 0, expired = 0;
+    for (int i = 0; i < n; i++) {
+        for (; expired < n && ending[expired].end < intervals[i].start; expired++) {
+            SymbolEntry *done = ending[expired].temp;
+            if (!freeSlots[done->type])
+                freeSlots[done->type] = (int*)malloc(n * sizeof(int));
+            freeSlots[done->type][freeCount[done->type]++] = done->id;
+        }
+        SymbolEntry *temp = intervals[i].temp;
+        temp->id = freeCount[temp->type] ? freeSlots[temp->type][--freeCount[temp->type]] : slots++;
+    }
+
+    for (int t = 0; t <= BOOL_T; t++)
+        free(freeSlots[t]);
+    free(ending);
+    return slots;
+}
+
+void coalesceTemps(CFG *cfg) {
+    SymbolTable *table = cfg->function->nestedTable;
+    if (!table)
+        return;
+    int shared;
+    int count = numberVariables(cfg, &shared);
+    LiveIntervals live;
+    liveIntervals(cfg, count, shared, &live);
+
+    // Named variables, void temporaries, and temporaries that are flagged or
+    // never referenced keep slots of their own
+    Interval *intervals = (Interval*)malloc(varSlots(count) * sizeof(Interval));
+    int candidates = 0;
+    for (SymbolEntry *e = table->entries; e; e = e->next) {
+        int id = e->id;
+        if (id >= 0 && e->isTemp && e->type != VOID_T && !live.flags[id] && live.end[id] >= 0) {
+            intervals[candidates].start = live.start[id];
+            intervals[candidates].end = live.end[id];
+            intervals[candidates].temp = e;
+            candidates++;
+        }
+    }
+    resetVariables(cfg);
+    int slots = assignSlots(intervals, candidates);
+
+    // Lay the frame out again in declaration order, a shared slot at the
+    // place of the first temporary in it
+    int *slotOffset = (int*)malloc((slots ? slots : 1) * sizeof(int));
+    for (int s = 0; s < slots; s++)
+        slotOffset[s] = -1;
+    int frameSize = 0;
+    for (SymbolEntry *e = table->entries; e; e = e->next) {
+        if (e->id >= 0) {
+            int s = e->id;
+            e->id = -1;
+            if (slotOffset[s] < 0) {
+                slotOffset[s] = frameSize;
+                frameSize += e->size;
+            }
+            e->offset = slotOffset[s];
+            continue;
+        }
+        e->offset = frameSize;
+        frameSize += e->size;
+    }
+    table->frameSize = frameSize;
+
+    free(slotOffset);
+    free(intervals);
+    freeLiveIntervals(&live);
+}
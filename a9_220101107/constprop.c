@@ -0,0 +1,394 @@
+#include <math.h>
+#include <stdint.h>
+#include "opt.h"
+#include "ssa.h"
+
+// Sparse conditional constant propagation (Wegman and Zadeck) over the SSA
+// form of a function. Each SSA value starts out undefined and only ever
+// falls to a constant and then to varying, while the blocks are found
+// executable one edge at a time: a conditional jump on a constant makes
+// only the edge it takes executable, so a phi after an if or at a loop
+// header ignores the values arriving from branches that never run. The
+// results are then put back into the quads: constants become immediates,
+// quads on constants fold into copies, jumps on constants become gotos or
+// go, and the quads of blocks that never execute are deleted.
+//
+// Only scalar locals and temporaries whose address is never taken are
+// tracked, so stores through pointers and calls cannot change them unseen.
+// Folding computes exactly what the VM would, narrowing to char and bool.
+
+enum { CP_UNDEF, CP_CONST, CP_VARYING };
+
+typedef struct ConstValue {
+    unsigned char state;   // CP_UNDEF until a definition reaches
+    unsigned char isFloat;
+    union {
+        long long ival;
+        double fval;
+    };
+} ConstValue;
+
+static ConstValue intConst(long long v) {
+    ConstValue c = { .state = CP_CONST, .isFloat = 0, .ival = v };
+    return c;
+}
+
+static ConstValue floatConst(double v) {
+    ConstValue c = { .state = CP_CONST, .isFloat = 1, .fval = v };
+    return c;
+}
+
+static long long asInt(ConstValue v) {
+    return v.isFloat ? (long long)v.fval : v.ival;
+}
+
+static double asFloat(ConstValue v) {
+    return v.isFloat ? v.fval : (double)v.ival;
+}
+
+static int truthOf(ConstValue v) {
+    return v.isFloat ? v.fval != 0 : v.ival != 0;
+}
+
+static Operand immediate(ConstValue v) {
+    return v.isFloat ? floatOperand(v.fval) : intOperand((int)v.ival);
+}
+
+// The value a variable of the given type holds after v is stored in it;
+// 0 for types the pass does not track
+static int narrow(ConstValue v, Type type, ConstValue *out) {
+    switch (type) {
+        case INT_T:   *out = intConst((int32_t)asInt(v)); return 1;
+        case CHAR_T:  *out = intConst((signed char)asInt(v)); return 1;
+        case BOOL_T:  *out = intConst(truthOf(v)); return 1;
+        case FLOAT_T: *out = floatConst(asFloat(v)); return 1;
+        default:      return 0;
+    }
+}
+
+// Result of op on constants a and b stored into a variable of the given
+// type; 0 if the quad cannot be folded. Division by zero is left for the
+// VM to report.
+static int evaluate(OpCode op, ConstValue a, ConstValue b, Type type, ConstValue *out) {
+    int floatResult = type == FLOAT_T;
+    int floatArgs = a.isFloat || b.isFloat;
+    long long x = asInt(a), y = asInt(b);
+    unsigned long long ux = (unsigned long long)x, uy = (unsigned long long)y;
+    double fx = asFloat(a), fy = asFloat(b);
+    ConstValue v;
+
+    switch (op) {
+        case OP_ASSIGN:
+        case OP_INT2REAL: case OP_REAL2INT:
+        case OP_CHAR2INT: case OP_INT2CHAR:
+        case OP_BOOL2INT: case OP_INT2BOOL:
+            v = a;
+            break;
+        case OP_ADD: v = floatResult ? floatConst(fx + fy) : intConst((long long)(ux + uy)); break;
+        case OP_SUB: v = floatResult ? floatConst(fx - fy) : intConst((long long)(ux - uy)); break;
+        case OP_MUL: v = floatResult ? floatConst(fx * fy) : intConst((long long)(ux * uy)); break;
+        case OP_DIV:
+            if (floatResult)
+                v = floatConst(fx / fy);
+            else if (y == 0)
+                return 0;
+            else
+                v = intConst(y == -1 ? (long long)(0 - ux) : x / y);
+            break;
+        case OP_MOD:
+            if (floatResult)
+                v = floatConst(fmod(fx, fy));
+            else if (y == 0)
+                return 0;
+            else
+                v = intConst(y == -1 ? 0 : x % y);
+            break;
+        case OP_BITAND: v = intConst(x & y); break;
+        case OP_BITOR:  v = intConst(x | y); break;
+        case OP_BITXOR: v = intConst(x ^ y); break;
+        case OP_SHL:    v = intConst((long long)(ux << (y & 31))); break;
+        case OP_SHR:    v = intConst((int32_t)x >> (y & 31)); break;
+        case OP_LT: v = intConst(floatArgs ? fx < fy : x < y); break;
+        case OP_GT: v = intConst(floatArgs ? fx > fy : x > y); break;
+        case OP_LE: v = intConst(floatArgs ? fx <= fy : x <= y); break;
+        case OP_GE: v = intConst(floatArgs ? fx >= fy : x >= y); break;
+        case OP_EQ: v = intConst(floatArgs ? fx == fy : x == y); break;
+        case OP_NE: v = intConst(floatArgs ? fx != fy : x != y); break;
+        case OP_LOGAND: v = intConst(truthOf(a) && truthOf(b)); break;
+        case OP_LOGOR:  v = intConst(truthOf(a) || truthOf(b)); break;
+        case OP_UMINUS: v = floatResult ? floatConst(-fx) : intConst((long long)(0 - ux)); break;
+        case OP_NOT:    v = intConst(!truthOf(a)); break;
+        default:
+            return 0;
+    }
+    return narrow(v, type, out);
+}
+
+// Whether operand slot 1 or 2 of a quad is read as a value (and so may
+// become an immediate); the address operand of & is not
+static int readsValue(const Quad *q, int slot) {
+    switch (q->op) {
+        case OP_ADDR:
+        case OP_CALL:
+        case OP_FUNC_BEGIN:
+            return 0;
+        case OP_ARRAY_LOAD:
+            return slot == 2;
+        default:
+            return 1;
+    }
+}
+
+static int binaryFormat(OpCode op) {
+    OpFormat format = opInfo[op].format;
+    return format == FMT_BINARY || format == FMT_IFREL;
+}
+
+// Whether a conditional jump on constant operands is taken
+static int isTaken(const Quad *q, ConstValue a, ConstValue b) {
+    if (q->op == OP_IF || q->op == OP_IFFALSE)
+        return truthOf(a) == (q->op == OP_IF);
+    // The relational quads are in the same order as the jumps
+    ConstValue r;
+    evaluate(OP_LT + (q->op - OP_IFLT), a, b, INT_T, &r);
+    return (int)r.ival;
+}
+
+static ConstValue varying() {
+    ConstValue c = { .state = CP_VARYING };
+    return c;
+}
+
+// Merge src into dst; returns whether dst changed
+static int meet(ConstValue *dst, const ConstValue *src) {
+    if (src->state == CP_UNDEF || dst->state == CP_VARYING)
+        return 0;
+    if (dst->state == CP_UNDEF) {
+        *dst = *src;
+        return 1;
+    }
+    if (src->state == CP_VARYING || src->isFloat != dst->isFloat || src->ival != dst->ival) {
+        dst->state = CP_VARYING;
+        return 1;
+    }
+    return 0;
+}
+
+typedef struct Propagation {
+    SSA *ssa;
+    ConstValue *values;     // Lattice value of each SSA value
+    char *executable;       // By block
+    char *edgeQueued;       // By 2 * block + succ slot; once queued, an edge is executable
+    int *edgeWork, edgeCount;
+    int *valueWork, valueCount;
+} Propagation;
+
+static ConstValue operandValue(const Propagation *cp, int quad, int slot) {
+    Quad *q = quadAt(quad);
+    Operand o = *operandOf(q, slot);
+    if (!readsValue(q, slot))
+        return varying();
+    if (o.kind == OPD_INT)
+        return intConst(o.ival);
+    if (o.kind == OPD_FLOAT)
+        return floatConst(o.fval);
+    int v = ssaUse(cp->ssa, quad, slot);
+    return v >= 0 ? cp->values[v] : varying();
+}
+
+// What quad i computes: the value of its result, or for a conditional
+// jump whether it is taken
+static ConstValue evaluateQuad(const Propagation *cp, int i) {
+    Quad *q = quadAt(i);
+    ConstValue a = operandValue(cp, i, 1);
+    ConstValue b = binaryFormat(q->op) ? operandValue(cp, i, 2) : intConst(0);
+    ConstValue r = varying();
+    if (a.state == CP_VARYING || b.state == CP_VARYING)
+        return r;
+    if (a.state == CP_UNDEF || b.state == CP_UNDEF) {
+        r.state = CP_UNDEF;
+        return r;
+    }
+    if (isConditionalJump(q->op))
+        return intConst(isTaken(q, a, b));
+    if (!definesResult(q->op) || !isVariable(q->result) ||
+        !evaluate(q->op, a, b, q->result.sym->type, &r))
+        return varying();
+    return r;
+}
+
+static void lower(Propagation *cp, int v, ConstValue c) {
+    if (meet(&cp->values[v], &c))
+        cp->valueWork[cp->valueCount++] = v;
+}
+
+static void queueEdge(Propagation *cp, int block, int slot) {
+    int e = 2 * block + slot;
+    if (cp->edgeQueued[e])
+        return;
+    cp->edgeQueued[e] = 1;
+    cp->edgeWork[cp->edgeCount++] = e;
+}
+
+static void visitPhi(Propagation *cp, int p) {
+    CFG *cfg = cp->ssa->cfg;
+    Phi *phi = &cp->ssa->phis[p];
+    BasicBlock *block = &cfg->blocks[phi->block];
+    if (phi->block == 0) {
+        lower(cp, phi->value, varying());
+        return;
+    }
+    ConstValue c = { .state = CP_UNDEF };
+    for (int k = 0; k < block->predCount; k++) {
+        int pred = block->pred[k];
+        BasicBlock *from = &cfg->blocks[pred];
+        int slot = from->succ[0] == phi->block ? 0 : 1;
+        if (cp->edgeQueued[2 * pred + slot] && phi->args[k] >= 0)
+            meet(&c, &cp->values[phi->args[k]]);
+    }
+    lower(cp, phi->value, c);
+}
+
+static void visitQuad(Propagation *cp, int i) {
+    CFG *cfg = cp->ssa->cfg;
+    Quad *q = quadAt(i);
+    ConstValue c = evaluateQuad(cp, i);
+    if (isConditionalJump(q->op)) {
+        // The taken edge comes first; a jump to the next block has one
+        int b = blockOfQuad(cfg, i);
+        int last = cfg->blocks[b].succCount - 1;
+        if (c.state == CP_VARYING) {
+            queueEdge(cp, b, 0);
+            queueEdge(cp, b, last);
+        } else if (c.state == CP_CONST) {
+            queueEdge(cp, b, c.ival ? 0 : last);
+        }
+        return;
+    }
+    int v = cp->ssa->quadValue[i - cfg->begin - 1];
+    if (v >= 0)
+        lower(cp, v, c);
+}
+
+static void visitBlock(Propagation *cp, int b) {
+    BasicBlock *block = &cp->ssa->cfg->blocks[b];
+    cp->executable[b] = 1;
+    for (int i = block->first; i <= block->last && i < cp->ssa->cfg->end; i++)
+        visitQuad(cp, i);
+    if (block->succCount > 0 && !isConditionalJump(quadAt(block->last)->op))
+        queueEdge(cp, b, 0);
+}
+
+static void propagate(Propagation *cp) {
+    SSA *ssa = cp->ssa;
+    CFG *cfg = ssa->cfg;
+    for (int p = ssa->phiHead[0]; p >= 0; p = ssa->phis[p].next)
+        visitPhi(cp, p);
+    visitBlock(cp, 0);
+    int edgeNext = 0, valueNext = 0;
+    while (edgeNext < cp->edgeCount || valueNext < cp->valueCount) {
+        if (edgeNext < cp->edgeCount) {
+            int e = cp->edgeWork[edgeNext++];
+            int s = cfg->blocks[e / 2].succ[e % 2];
+            for (int p = ssa->phiHead[s]; p >= 0; p = ssa->phis[p].next)
+                visitPhi(cp, p);
+            if (!cp->executable[s])
+                visitBlock(cp, s);
+            continue;
+        }
+        int v = cp->valueWork[valueNext++];
+        for (int u = ssa->userStart[v]; u < ssa->userStart[v + 1]; u++) {
+            int user = ssa->users[u];
+            if (user >= 0) {
+                if (cp->executable[blockOfQuad(cfg, user)])
+                    visitQuad(cp, user);
+            } else if (cp->executable[ssa->phis[-1 - user].block]) {
+                visitPhi(cp, -1 - user);
+            }
+        }
+    }
+}
+
+// Put the lattice values back into the quads of executable block b;
+// returns OPT_* flags, and sets *undecided for a jump whose way is unknown
+static int rewriteBlock(Propagation *cp, int b, int *undecided) {
+    BasicBlock *block = &cp->ssa->cfg->blocks[b];
+    int result = 0;
+    for (int i = block->first; i <= block->last && i < cp->ssa->cfg->end; i++) {
+        Quad *q = quadAt(i);
+        ConstValue c = evaluateQuad(cp, i);
+        for (int slot = 1; slot <= 2; slot++) {
+            ConstValue a = operandValue(cp, i, slot);
+            Operand *o = operandOf(q, slot);
+            if (a.state == CP_CONST && isVariable(*o)) {
+                *o = immediate(a);
+                result |= OPT_CHANGED;
+            }
+        }
+
+        if (isConditionalJump(q->op)) {
+            if (c.state == CP_CONST) {
+                if (c.ival) {
+                    q->op = OP_GOTO;
+                    q->arg1 = q->arg2 = noOperand();
+                } else {
+                    deleteQuad(q);
+                }
+                result |= OPT_CHANGED | OPT_CFG_CHANGED;
+            } else if (c.state == CP_UNDEF) {
+                *undecided = 1;
+            }
+        } else if (c.state == CP_CONST && q->op != OP_ASSIGN) {
+            q->op = OP_ASSIGN;
+            q->arg1 = immediate(c);
+            q->arg2 = noOperand();
+            result |= OPT_CHANGED;
+        }
+    }
+    return result;
+}
+
+int propagateConstants(CFG *cfg) {
+    int shared;
+    int count = numberVariables(cfg, &shared);
+    Propagation cp;
+    cp.ssa = buildSSA(cfg, count);
+    int values = cp.ssa->valueCount ? cp.ssa->valueCount : 1;
+    cp.values = (ConstValue*)calloc(values, sizeof(ConstValue));
+    for (int v = 0; v < count; v++)
+        cp.values[v].state = CP_VARYING;   // Entry values, parameters among them
+    cp.executable = (char*)calloc(cfg->blockCount, 1);
+    cp.edgeQueued = (char*)calloc(2 * cfg->blockCount, 1);
+    cp.edgeWork = (int*)malloc(2 * cfg->blockCount * sizeof(int));
+    cp.valueWork = (int*)malloc(2 * values * sizeof(int));   // A value falls at most twice
+    cp.edgeCount = cp.valueCount = 0;
+    propagate(&cp);
+
+    int result = 0, undecided = 0;
+    for (int b = 0; b < cfg->blockCount; b++)
+        if (cp.executable[b])
+            result |= rewriteBlock(&cp, b, &undecided);
+
+    // Blocks that never execute are unreachable once the jumps on constants
+    // are folded, unless some jump was left undecided
+    for (int b = 0; b < cfg->blockCount && !undecided; b++) {
+        BasicBlock *block = &cfg->blocks[b];
+        if (cp.executable[b])
+            continue;
+        for (int i = block->first; i <= block->last && i < cfg->end; i++) {
+            if (quadAt(i)->op != OP_NOP) {
+                deleteQuad(quadAt(i));
+                result |= OPT_CHANGED | OPT_CFG_CHANGED;
+            }
+        }
+    }
+
+    freeSSA(cp.ssa);
+    free(cp.values);
+    free(cp.executable);
+    free(cp.edgeQueued);
+    free(cp.edgeWork);
+    free(cp.valueWork);
+    resetVariables(cfg);
+    return result;
+}
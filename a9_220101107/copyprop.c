@@ -0,0 +1,98 @@
+#include "opt.h"
+
+// Copy propagation within basic blocks. After a copy x = y, reads of x
+// read y instead until either is assigned again, so chains like
+// t3 = a; t4 = t3 + t2 lose the copy. A copy out of a temporary that
+// is read nowhere else, as in t4 = a + t2; x = t4, is folded into the quad
+// that computed the temporary. The copies left without readers are then
+// removed by dead code elimination.
+//
+// Copies between variables of different types convert, so only copies
+// between equal types are propagated.
+
+// Copies out of single-use temporaries: t = ...; x = t becomes x = ...
+static int forwardResults(CFG *cfg, int count) {
+    int *uses = (int*)calloc(varSlots(count), sizeof(int));
+    for (int i = cfg->begin + 1; i < cfg->end; i++) {
+        Quad *q = quadAt(i);
+        for (int slot = 1; slot <= 3; slot++) {
+            Operand *o = operandOf(q, slot);
+            if (readsOperand(q, slot) && isVariable(*o) && o->sym->id >= 0)
+                uses[o->sym->id]++;
+        }
+    }
+
+    int changed = 0;
+    for (int b = 0; b < cfg->blockCount; b++) {
+        BasicBlock *block = &cfg->blocks[b];
+        Quad *prev = NULL;
+        for (int i = block->first; i <= block->last; i++) {
+            Quad *q = quadAt(i);
+            if (q->op == OP_NOP)
+                continue;
+            if (q->op == OP_ASSIGN && prev && q->arg1.kind == OPD_TEMP && q->arg1.sym->id >= 0 &&
+                uses[q->arg1.sym->id] == 1 && definesResult(prev->op) &&
+                isVariable(prev->result) && prev->result.sym == q->arg1.sym &&
+                q->result.sym->type == q->arg1.sym->type) {
+                prev->result = q->result;
+                deleteQuad(q);
+                changed = 1;
+                continue;
+            }
+            prev = q;
+        }
+    }
+    free(uses);
+    return changed;
+}
+
+int propagateCopies(CFG *cfg) {
+    int shared;
+    int count = numberVariables(cfg, &shared);
+    size_t n = varSlots(count);
+    SymbolEntry **source = (SymbolEntry**)malloc(n * sizeof(SymbolEntry*));
+    int *sourceVersion = (int*)malloc(n * sizeof(int));
+    int *copyBlock = (int*)malloc(n * sizeof(int));   // Block the copy was made in
+    int *version = (int*)calloc(n, sizeof(int));      // Bumped on every assignment
+    for (int v = 0; v < count; v++)
+        copyBlock[v] = -1;
+
+    int changed = 0;
+    for (int b = 0; b < cfg->blockCount; b++) {
+        BasicBlock *block = &cfg->blocks[b];
+        for (int i = block->first; i <= block->last; i++) {
+            Quad *q = quadAt(i);
+            for (int slot = 1; slot <= 3; slot++) {
+                Operand *o = operandOf(q, slot);
+                if (q->op == OP_ADDR || !readsOperand(q, slot) || !isVariable(*o) || o->sym->id < 0)
+                    continue;
+                int id = o->sym->id;
+                if (copyBlock[id] == b && version[source[id]->id] == sourceVersion[id]) {
+                    *o = symOperand(source[id]);
+                    changed = 1;
+                }
+            }
+
+            if (!definesResult(q->op) || !isVariable(q->result) || q->result.sym->id < 0)
+                continue;
+            int id = q->result.sym->id;
+            version[id]++;
+            copyBlock[id] = -1;
+            if (q->op == OP_ASSIGN && isVariable(q->arg1) && q->arg1.sym->id >= 0 &&
+                q->arg1.sym != q->result.sym && q->arg1.sym->type == q->result.sym->type) {
+                source[id] = q->arg1.sym;
+                sourceVersion[id] = version[q->arg1.sym->id];
+                copyBlock[id] = b;
+            }
+        }
+    }
+
+    changed |= forwardResults(cfg, count);
+
+    free(source);
+    free(sourceVersion);
+    free(copyBlock);
+    free(version);
+    resetVariables(cfg);
+    return changed ? OPT_CHANGED : 0;
+}
@@ -0,0 +1,203 @@
+#include <stdint.h>
+#include "opt.h"
+
+// Common subexpression elimination by local value numbering. Within a
+// basic block every value gets a number, such that quads computing equal
+// numbers compute equal values. A quad recomputing a value that some
+// variable still holds becomes a copy of that variable, which copy
+// propagation and dead code elimination then clean up; repeated a[i] in
+// one expression thus share the offset arithmetic and the load.
+//
+// Operands of commutative operators are ordered, and a > b is numbered as
+// b < a. Array loads, dereferences and the variables no pass tracks
+// (globals, and locals whose address is taken) can change behind the
+// quads' backs, so their numbers only hold until the next store or call.
+
+enum { LEAF_VAR = -1, LEAF_INT = -2, LEAF_FLOAT = -3 };
+
+typedef struct ValueEntry {
+    int stamp;              // Block + 1 the entry belongs to; others are free
+    int op;                 // Operator, or LEAF_* for variables and constants
+    int type;               // Result type of an operator
+    long long a, b;         // Operand value numbers, or the leaf itself
+    int value;              // Value number, -1 if none yet
+    int epoch;              // Memory epoch the value was read in
+    SymbolEntry *holder;    // Variable the value was last assigned to
+} ValueEntry;
+
+typedef struct ValueTable {
+    ValueEntry *entries;
+    size_t mask;
+    int stamp;              // Current block + 1
+    int epoch;              // Bumped by every store and call
+    int next;               // Next fresh value number
+} ValueTable;
+
+static ValueEntry* findValue(ValueTable *t, int op, int type, long long a, long long b) {
+    uint64_t h = (uint64_t)(op * 31 + type) * 0x9E3779B97F4A7C15ULL;
+    h ^= (uint64_t)a * 0xC2B2AE3D27D4EB4FULL;
+    h ^= (uint64_t)b * 0x165667B19E3779F9ULL;
+    h ^= h >> 29;
+    for (size_t i = h & t->mask; ; i = (i + 1) & t->mask) {
+        ValueEntry *e = &t->entries[i];
+        if (e->stamp != t->stamp) {
+            e->stamp = t->stamp;
+            e->op = op;
+            e->type = type;
+            e->a = a;
+            e->b = b;
+            e->value = -1;
+            e->epoch = t->epoch;
+            e->holder = NULL;
+            return e;
+        }
+        if (e->op == op && e->type == type && e->a == a && e->b == b)
+            return e;
+    }
+}
+
+// Tracked variables only change by being assigned
+static int isStable(const SymbolEntry *sym) {
+    return sym->id >= 0;
+}
+
+static ValueEntry* variableEntry(ValueTable *t, SymbolEntry *sym) {
+    return findValue(t, LEAF_VAR, 0, (long long)(intptr_t)sym, 0);
+}
+
+static int holds(ValueTable *t, SymbolEntry *sym, int value) {
+    ValueEntry *e = variableEntry(t, sym);
+    return e->value == value && (isStable(sym) || e->epoch == t->epoch);
+}
+
+static void assign(ValueTable *t, SymbolEntry *sym, int value) {
+    ValueEntry *e = variableEntry(t, sym);
+    e->value = value;
+    e->epoch = t->epoch;
+}
+
+// The value number of an operand, numbering it afresh if unknown; -1 for none
+static int valueOf(ValueTable *t, Operand o) {
+    ValueEntry *e;
+    long long bits;
+    switch (o.kind) {
+        case OPD_SYM:
+        case OPD_TEMP:
+            e = variableEntry(t, o.sym);
+            if (e->value >= 0 && !isStable(o.sym) && e->epoch != t->epoch)
+                e->value = -1;
+            break;
+        case OPD_INT:
+            e = findValue(t, LEAF_INT, 0, o.ival, 0);
+            break;
+        case OPD_FLOAT:
+            memcpy(&bits, &o.fval, sizeof(bits));
+            e = findValue(t, LEAF_FLOAT, 0, bits, 0);
+            break;
+        default:
+            return -1;
+    }
+    if (e->value < 0) {
+        e->value = t->next++;
+        e->epoch = t->epoch;
+    }
+    return e->value;
+}
+
+static int isNumbered(OpCode op) {
+    return (op >= OP_ASSIGN && op <= OP_ARRAY_LOAD) || (op >= OP_INT2REAL && op <= OP_INT2BOOL);
+}
+
+static int isCommutative(OpCode op) {
+    return op == OP_ADD || op == OP_MUL || op == OP_BITAND || op == OP_BITOR ||
+           op == OP_BITXOR || op == OP_EQ || op == OP_NE || op == OP_LOGAND || op == OP_LOGOR;
+}
+
+// Number one quad's result; returns whether the quad was rewritten
+static int numberQuad(ValueTable *t, Quad *q) {
+    if (q->op == OP_ARRAY_STORE || q->op == OP_PTR_STORE || q->op == OP_CALL)
+        t->epoch++;
+    if (!definesResult(q->op) || !isVariable(q->result))
+        return 0;
+    SymbolEntry *x = q->result.sym;
+    if (!isNumbered(q->op)) {
+        assign(t, x, t->next++);
+        return 0;
+    }
+
+    // The address of a variable depends on which variable it is, not its value
+    long long a = q->op == OP_ADDR ? (long long)(intptr_t)q->arg1.sym : valueOf(t, q->arg1);
+    long long b = valueOf(t, q->arg2);
+    if (q->op == OP_ASSIGN && isVariable(q->arg1) && q->arg1.sym->type == x->type) {
+        assign(t, x, (int)a);
+        return 0;
+    }
+    int op = q->op;
+    if (op == OP_GT || op == OP_GE) {
+        op = op == OP_GT ? OP_LT : OP_LE;
+        long long swap = a; a = b; b = swap;
+    } else if (isCommutative(q->op) && a > b) {
+        long long swap = a; a = b; b = swap;
+    }
+
+    ValueEntry *e = findValue(t, op, x->type, a, b);
+    int fromMemory = q->op == OP_ARRAY_LOAD || q->op == OP_DEREF;
+    int changed = 0;
+    if (e->value >= 0 && (!fromMemory || e->epoch == t->epoch)) {
+        // Copies of constants stay as they are: they are as cheap as a copy
+        if (q->op != OP_ASSIGN && e->holder && holds(t, e->holder, e->value)) {
+            if (e->holder == x) {
+                deleteQuad(q);
+            } else {
+                q->op = OP_ASSIGN;
+                q->arg1 = symOperand(e->holder);
+                q->arg2 = noOperand();
+            }
+            changed = 1;
+        }
+    } else {
+        e->value = t->next++;
+        e->epoch = t->epoch;
+        e->holder = NULL;
+    }
+    assign(t, x, e->value);
+    if (!e->holder || !holds(t, e->holder, e->value))
+        e->holder = x;
+    return changed;
+}
+
+int eliminateCommonSubexpressions(CFG *cfg) {
+    int shared;
+    numberVariables(cfg, &shared);
+
+    // A quad adds at most four entries: two operands, an expression and its result
+    int longest = 0;
+    for (int b = 0; b < cfg->blockCount; b++) {
+        int length = cfg->blocks[b].last - cfg->blocks[b].first + 1;
+        if (length > longest)
+            longest = length;
+    }
+    size_t capacity = 16;
+    while (capacity < (size_t)longest * 8)
+        capacity <<= 1;
+
+    ValueTable t;
+    t.entries = (ValueEntry*)calloc(capacity, sizeof(ValueEntry));
+    t.mask = capacity - 1;
+    t.epoch = t.next = 0;
+
+    int changed = 0;
+    for (int b = 0; b < cfg->blockCount; b++) {
+        BasicBlock *block = &cfg->blocks[b];
+        t.stamp = b + 1;
+        for (int i = block->first; i <= block->last; i++) {
+            Quad *q = quadAt(i);
+            if (q->op != OP_NOP)
+                changed |= numberQuad(&t, q);
+        }
+    }
+
+    free(t.entries);
+    resetVariables(cfg);
+    return changed ? OPT_CHANGED : 0;
+}
@@ -0,0 +1,194 @@
+#include "opt.h"
+
+// Dead code elimination. Blocks that cannot be reached are deleted, then a
+// backward liveness analysis deletes every quad whose only effect is to
+// assign a tracked variable that is never read afterwards. Calls are kept
+// for their side effects. Deleting a quad can make the quads feeding it
+// dead, so the analysis repeats until nothing more goes.
+//
+// Liveness at block boundaries is a bit vector dataflow over the variables
+// read in more than one block. A variable referenced in a single block is
+// live on leaving it only if the block reads it before assigning it, which
+// can then be a value carried around a loop.
+
+// Beyond this many variable-block pairs, shared variables are assumed live
+// at every block boundary
+#define DCE_MAX_GLOBAL_CELLS (1 << 26)
+
+typedef struct Liveness {
+    int count, shared;      // Tracked variables, and those in more than one block
+    int words;              // 64-bit words per block bit vector
+    uint64_t *use;          // Read before assigned in the block
+    uint64_t *def;          // Assigned in the block
+    uint64_t *liveOut;
+    char *exposed;          // Single-block variables read before assigned
+    int *seen;              // Sweep state: block+1 once the variable is seen
+    char *live;
+} Liveness;
+
+static int trackedId(Operand o) {
+    return isVariable(o) ? o.sym->id : -1;
+}
+
+// Block-local summaries: upward exposed reads and assignments
+static void summarize(CFG *cfg, Liveness *lv) {
+    int *state = lv->seen;  // 1 + block when read, -(1 + block) when assigned first
+    for (int v = 0; v < lv->count; v++)
+        state[v] = 0;
+    for (int b = 0; b < cfg->blockCount; b++) {
+        BasicBlock *block = &cfg->blocks[b];
+        uint64_t *use = lv->use ? lv->use + (size_t)b * lv->words : NULL;
+        uint64_t *def = lv->def ? lv->def + (size_t)b * lv->words : NULL;
+        for (int i = block->first; i <= block->last; i++) {
+            Quad *q = quadAt(i);
+            for (int slot = 1; slot <= 3; slot++) {
+                int id = readsOperand(q, slot) ? trackedId(*operandOf(q, slot)) : -1;
+                if (id < 0 || state[id] == b + 1 || state[id] == -(b + 1))
+                    continue;
+                state[id] = b + 1;
+                if (id >= lv->shared)
+                    lv->exposed[id] = 1;
+                else if (use)
+                    setBit(use, id);
+            }
+            int id = definesResult(q->op) ? trackedId(q->result) : -1;
+            if (id >= 0 && state[id] != b + 1 && state[id] != -(b + 1)) {
+                state[id] = -(b + 1);
+                if (id < lv->shared && def)
+                    setBit(def, id);
+            }
+        }
+    }
+}
+
+// liveOut(b) = union of liveIn(s) over successors s, where
+// liveIn(s) = use(s) | (liveOut(s) & ~def(s)); iterated in postorder
+static void solve(CFG *cfg, Liveness *lv) {
+    int w = lv->words;
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int k = cfg->orderCount - 1; k >= 0; k--) {
+            int b = cfg->order[k];
+            BasicBlock *block = &cfg->blocks[b];
+            uint64_t *out = lv->liveOut + (size_t)b * w;
+            for (int s = 0; s < block->succCount; s++) {
+                int succ = block->succ[s];
+                const uint64_t *use = lv->use + (size_t)succ * w;
+                const uint64_t *def = lv->def + (size_t)succ * w;
+                const uint64_t *succOut = lv->liveOut + (size_t)succ * w;
+                for (int j = 0; j < w; j++) {
+                    uint64_t bits = out[j] | use[j] | (succOut[j] & ~def[j]);
+                    if (bits != out[j]) {
+                        out[j] = bits;
+                        changed = 1;
+                    }
+                }
+            }
+        }
+    }
+}
+
+static int isLive(Liveness *lv, int b, int id) {
+    if (lv->seen[id] == b + 1)
+        return lv->live[id];
+    if (id >= lv->shared)
+        return lv->exposed[id];
+    return lv->liveOut ? testBit(lv->liveOut + (size_t)b * lv->words, id) : 1;
+}
+
+static void setLive(Liveness *lv, int b, int id, int live) {
+    lv->seen[id] = b + 1;
+    lv->live[id] = live;
+}
+
+// One backward sweep over every reachable block; returns whether any quad went
+static int sweep(CFG *cfg, Liveness *lv) {
+    int changed = 0;
+    for (int v = 0; v < lv->count; v++)
+        lv->seen[v] = 0;
+    for (int k = 0; k < cfg->orderCount; k++) {
+        int b = cfg->order[k];
+        BasicBlock *block = &cfg->blocks[b];
+        for (int i = block->last; i >= block->first; i--) {
+            Quad *q = quadAt(i);
+            if (q->op == OP_NOP)
+                continue;
+            int id = definesResult(q->op) ? trackedId(q->result) : -1;
+            if (id >= 0) {
+                if (!isLive(lv, b, id) && q->op != OP_CALL && !mayTrap(q)) {
+                    deleteQuad(q);
+                    changed = 1;
+                    continue;
+                }
+                setLive(lv, b, id, 0);
+            }
+            for (int slot = 1; slot <= 3; slot++) {
+                int use = readsOperand(q, slot) ? trackedId(*operandOf(q, slot)) : -1;
+                if (use >= 0)
+                    setLive(lv, b, use, 1);
+            }
+        }
+    }
+    return changed;
+}
+
+// Delete the quads of unreachable blocks; the exit block always stays
+static int removeUnreachable(CFG *cfg) {
+    int changed = 0;
+    for (int b = 0; b < cfg->blockCount - 1; b++) {
+        BasicBlock *block = &cfg->blocks[b];
+        if (block->rpo >= 0)
+            continue;
+        for (int i = block->first; i <= block->last; i++) {
+            Quad *q = quadAt(i);
+            if (q->op != OP_NOP) {
+                deleteQuad(q);
+                changed = 1;
+            }
+        }
+    }
+    return changed;
+}
+
+int eliminateDeadCode(CFG *cfg) {
+    int changed = removeUnreachable(cfg);
+
+    Liveness lv;
+    lv.count = numberVariables(cfg, &lv.shared);
+    size_t n = varSlots(lv.count);
+    lv.exposed = (char*)calloc(n, 1);
+    lv.seen = (int*)malloc(n * sizeof(int));
+    lv.live = (char*)malloc(n);
+    lv.words = (lv.shared + 63) / 64;
+    lv.use = lv.def = lv.liveOut = NULL;
+    int global = lv.shared > 0 && (long long)lv.shared * cfg->blockCount <= DCE_MAX_GLOBAL_CELLS;
+    size_t bits = (size_t)lv.words * cfg->blockCount;
+
+    int swept = 1;
+    while (swept) {
+        if (global) {
+            free(lv.use);
+            free(lv.def);
+            free(lv.liveOut);
+            lv.use = (uint64_t*)calloc(bits, sizeof(uint64_t));
+            lv.def = (uint64_t*)calloc(bits, sizeof(uint64_t));
+            lv.liveOut = (uint64_t*)calloc(bits, sizeof(uint64_t));
+        }
+        memset(lv.exposed, 0, n);
+        summarize(cfg, &lv);
+        if (global)
+            solve(cfg, &lv);
+        swept = sweep(cfg, &lv);
+        changed |= swept;
+    }
+
+    free(lv.use);
+    free(lv.def);
+    free(lv.liveOut);
+    free(lv.exposed);
+    free(lv.seen);
+    free(lv.live);
+    resetVariables(cfg);
+    return changed ? OPT_CHANGED : 0;
+}
@@ -0,0 +1,431 @@
+#include "opt.h"
+
+// Inlining of small functions. The call graph is walked bottom up, so a
+// function has taken in the calls it makes before it is considered for
+// inlining itself. A call is replaced by the callee's quads when the
+// callee calls nothing and has at most inlineLimit quads: each variable
+// of the callee gets a temporary in the caller's symbol table, the param
+// quads of the call become assignments to the temporaries of the
+// parameters, and a return becomes an assignment to the call's result and
+// a goto past the inlined quads. The other temporaries are zeroed first,
+// as the VM zeroes a frame on a call. Callees with local arrays are left
+// as calls.
+//
+// Functions grow, so unlike the passes in opt.c this lays the whole quad
+// store out again and renumbers every jump target. Nothing is deleted;
+// the passes that follow clean up the copies and zeroing.
+
+int inlineLimit = INLINE_LIMIT;
+
+// One function, copied out of the quad store while calls are inlined
+typedef struct Body {
+    SymbolEntry *func;
+    Quad *quads;        // func_begin to func_end; targets are relative to func_begin
+    int count;
+    int begin;          // Index of func_begin in the quad store
+    int span;           // Quads the function had there
+    int *moved;         // New place of each of those quads, NULL if none moved
+    int calls;          // Param and call quads
+    int size;           // Quads other than nops, func_begin and func_end
+    int hasArrays;
+    int duplicate;      // The function is defined more than once
+} Body;
+
+// A call being inlined
+typedef struct Site {
+    Body *callee;
+    SymbolEntry **copy; // Caller's temporary for each callee entry, NULL if unused
+} Site;
+
+static int paramsOf(SymbolEntry *func) {
+    SymbolTable *table = func->nestedTable;
+    return func->paramCount < table->count ? func->paramCount : table->count;
+}
+
+static void numberEntries(SymbolTable *table) {
+    int n = 0;
+    for (SymbolEntry *e = table->entries; e; e = e->next)
+        e->id = n++;
+}
+
+static void resetEntries(SymbolTable *table) {
+    for (SymbolEntry *e = table->entries; e; e = e->next)
+        e->id = -1;
+}
+
+// Body called by the quad, -1 if it is not a call of a defined function
+static int calleeOf(const Quad *q) {
+    if (q->op != OP_CALL || q->arg1.kind != OPD_SYM || !q->arg1.sym->nestedTable)
+        return -1;
+    return q->arg1.sym->id;
+}
+
+static void summarize(Body *b) {
+    b->calls = b->size = b->hasArrays = 0;
+    for (int k = 1; k < b->count - 1; k++) {
+        OpCode op = b->quads[k].op;
+        if (op == OP_PARAM || op == OP_CALL)
+            b->calls++;
+        if (op != OP_NOP)
+            b->size++;
+    }
+    for (SymbolEntry *e = b->func->nestedTable->entries; e; e = e->next)
+        if (e->type == ARRAY_T)
+            b->hasArrays = 1;
+}
+
+static int inlinable(const Body *b, int limit) {
+    return !b->duplicate && !b->calls && !b->hasArrays && b->size <= limit;
+}
+
+// Copy every function out of the quad store, numbering the functions
+// through the scratch id of their entries
+static Body* loadBodies(int *count) {
+    Body *bodies = NULL;
+    int n = 0, capacity = 0;
+    for (int i = 0; i < quadIndex; i++) {
+        Quad *q = quadAt(i);
+        if (q->op == OP_FUNC_BEGIN && q->arg1.kind == OPD_SYM)
+            q->arg1.sym->id = -1;
+    }
+    for (int i = 0; i < quadIndex; i++) {
+        Quad *q = quadAt(i);
+        if (q->op != OP_FUNC_BEGIN || q->arg1.kind != OPD_SYM || !q->arg1.sym->nestedTable)
+            continue;
+        int end = functionEnd(i);
+        if (end < 0)
+            continue;
+        if (n == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            bodies = (Body*)realloc(bodies, capacity * sizeof(Body));
+        }
+        Body *b = &bodies[n];
+        b->func = q->arg1.sym;
+        b->begin = i;
+        b->count = b->span = end - i + 1;
+        b->moved = NULL;
+        b->duplicate = 0;
+        if (b->func->id >= 0)
+            bodies[b->func->id].duplicate = b->duplicate = 1;
+        else
+            b->func->id = n;
+
+        // Targets outside the function go to its exit, as in the CFG
+        b->quads = (Quad*)malloc(b->count * sizeof(Quad));
+        for (int k = 0; k < b->count; k++) {
+            Quad c = *quadAt(i + k);
+            if (c.result.kind == OPD_TARGET) {
+                int t = c.result.target;
+                c.result.target = t > i && t <= end ? t - i : end - i;
+            }
+            b->quads[k] = c;
+        }
+        summarize(b);
+        n++;
+        i = end;
+    }
+    *count = n;
+    return bodies;
+}
+
+// Bodies in postorder of the call graph, callees before their callers
+static int* bottomUp(Body *bodies, int count) {
+    int *order = (int*)malloc(varSlots(count) * sizeof(int));
+    int *stack = (int*)malloc(varSlots(count) * sizeof(int));
+    int *next = (int*)calloc(varSlots(count), sizeof(int));
+    char *seen = (char*)calloc(varSlots(count), 1);
+    int done = 0;
+    for (int r = 0; r < count; r++) {
+        if (seen[r])
+            continue;
+        int depth = 0;
+        stack[depth++] = r;
+        seen[r] = 1;
+        while (depth > 0) {
+            Body *b = &bodies[stack[depth - 1]];
+            int *k = &next[stack[depth - 1]];
+            int callee = -1;
+            while (*k < b->count && callee < 0) {
+                int j = calleeOf(&b->quads[(*k)++]);
+                if (j >= 0 && !seen[j])
+                    callee = j;
+            }
+            if (callee >= 0) {
+                seen[callee] = 1;
+                stack[depth++] = callee;
+            } else {
+                order[done++] = stack[--depth];
+            }
+        }
+    }
+    free(stack);
+    free(next);
+    free(seen);
+    return order;
+}
+
+// Temporaries of the caller for the parameters of the callee and the
+// variables its quads use
+static SymbolEntry** copyEntries(SymbolTable *caller, Body *callee) {
+    SymbolTable *table = callee->func->nestedTable;
+    SymbolEntry **copy = (SymbolEntry**)calloc(varSlots(table->count), sizeof(SymbolEntry*));
+    char *used = (char*)calloc(varSlots(table->count), 1);
+    numberEntries(table);
+    for (int p = 0; p < paramsOf(callee->func); p++)
+        used[p] = 1;
+    for (int k = 1; k < callee->count - 1; k++)
+        for (int slot = 1; slot <= 3; slot++) {
+            Operand *o = operandOf(&callee->quads[k], slot);
+            if (isVariable(*o) && o->sym->table == table)
+                used[o->sym->id] = 1;
+        }
+    for (SymbolEntry *e = table->entries; e; e = e->next) {
+        if (!used[e->id])
+            continue;
+        SymbolEntry *t = gentemp(caller, e->type);
+        updateSymbolElementType(t, e->eleType);
+        if (t->size != e->size)
+            updateSymbolSize(t, e->size);
+        copy[e->id] = t;
+    }
+    resetEntries(table);
+    free(used);
+    return copy;
+}
+
+// The callee's operands are numbered by numberEntries()
+static Operand renamed(const Site *s, Operand o) {
+    if (isVariable(o) && o.sym->table == s->callee->func->nestedTable)
+        return symOperand(s->copy[o.sym->id]);
+    return o;
+}
+
+static Operand zeroOf(Type type) {
+    return type == FLOAT_T ? floatOperand(0.0) : intOperand(0);
+}
+
+static int hasResult(const Quad *call) {
+    return isVariable(call->result) && call->result.sym->type != VOID_T;
+}
+
+// Quads the call at a site becomes
+static int expansionSize(const Site *s, const Quad *call) {
+    Body *callee = s->callee;
+    SymbolTable *table = callee->func->nestedTable;
+    int n = 0, p = 0;
+    for (SymbolEntry *e = table->entries; e; e = e->next, p++)
+        if (p >= paramsOf(callee->func) && s->copy[p])
+            n++;
+    for (int k = 1; k < callee->count - 1; k++)
+        n += callee->quads[k].op == OP_RETURN && hasResult(call) ? 2 : 1;
+    return n + 1;
+}
+
+// Lay out the quads of the call at a site from out[at] on
+static void expand(const Site *s, const Quad *call, Quad *out, int at) {
+    Body *callee = s->callee;
+    SymbolTable *table = callee->func->nestedTable;
+    int after = at + expansionSize(s, call);
+    int params = paramsOf(callee->func);
+    int p = 0;
+    for (SymbolEntry *e = table->entries; e; e = e->next, p++) {
+        if (p < params || !s->copy[p])
+            continue;
+        Quad z = { OP_ASSIGN, zeroOf(e->type), noOperand(), symOperand(s->copy[p]) };
+        out[at++] = z;
+    }
+
+    // Place of each callee quad; jumps to its func_end land on the last one
+    int *place = (int*)malloc(callee->count * sizeof(int));
+    int pos = at;
+    for (int k = 1; k < callee->count; k++) {
+        place[k] = pos;
+        pos += callee->quads[k].op == OP_RETURN && hasResult(call) ? 2 : 1;
+    }
+
+    numberEntries(table);
+    for (int k = 1; k < callee->count - 1; k++) {
+        Quad q = callee->quads[k];
+        if (q.op == OP_RETURN) {
+            if (hasResult(call)) {
+                Operand value = q.arg1.kind == OPD_NONE ? intOperand(0) : renamed(s, q.arg1);
+                Quad a = { OP_ASSIGN, value, noOperand(), call->result };
+                out[at++] = a;
+            }
+            Quad g = { OP_GOTO, noOperand(), noOperand(), targetOperand(after) };
+            out[at++] = g;
+            continue;
+        }
+        q.arg1 = renamed(s, q.arg1);
+        q.arg2 = renamed(s, q.arg2);
+        if (q.result.kind == OPD_TARGET)
+            q.result.target = place[q.result.target];
+        else
+            q.result = renamed(s, q.result);
+        out[at++] = q;
+    }
+    resetEntries(table);
+
+    // Falling off the end returns 0
+    Quad end = { OP_NOP, noOperand(), noOperand(), noOperand() };
+    if (hasResult(call)) {
+        end.op = OP_ASSIGN;
+        end.arg1 = intOperand(0);
+        end.result = call->result;
+    }
+    out[at] = end;
+    free(place);
+}
+
+// Inline the calls of one function; returns how many were inlined
+static int inlineInto(Body *b, Body *bodies, int limit) {
+    int *siteOf = (int*)malloc(b->count * sizeof(int));
+    int *argOf = (int*)malloc(b->count * sizeof(int));
+    int *pushed = (int*)malloc(b->count * sizeof(int));
+    Site *sites = NULL;
+    int siteCount = 0, capacity = 0, depth = 0;
+
+    // Param quads are matched to calls as the VM's param stack would
+    for (int k = 0; k < b->count; k++) {
+        Quad *q = &b->quads[k];
+        siteOf[k] = -1;
+        if (q->op == OP_PARAM) {
+            pushed[depth++] = k;
+        } else if (q->op == OP_CALL) {
+            int argc = q->arg2.kind == OPD_INT ? (int)q->arg2.ival : 0;
+            int take = argc < depth ? argc : depth;
+            int j = calleeOf(q);
+            if (j >= 0 && &bodies[j] != b && take == argc && inlinable(&bodies[j], limit) &&
+                argc == paramsOf(bodies[j].func)) {
+                if (siteCount == capacity) {
+                    capacity = capacity ? capacity * 2 : 8;
+                    sites = (Site*)realloc(sites, capacity * sizeof(Site));
+                }
+                sites[siteCount].callee = &bodies[j];
+                sites[siteCount].copy = copyEntries(b->func->nestedTable, &bodies[j]);
+                for (int p = 0; p < argc; p++) {
+                    siteOf[pushed[depth - argc + p]] = siteCount;
+                    argOf[pushed[depth - argc + p]] = p;
+                }
+                siteOf[k] = siteCount++;
+            }
+            depth -= take;
+        }
+    }
+
+    if (siteCount > 0) {
+        int *moved = (int*)malloc(b->count * sizeof(int));
+        int total = 0;
+        for (int k = 0; k < b->count; k++) {
+            moved[k] = total;
+            Quad *q = &b->quads[k];
+            total += q->op == OP_CALL && siteOf[k] >= 0 ? expansionSize(&sites[siteOf[k]], q) : 1;
+        }
+
+        Quad *out = (Quad*)malloc(total * sizeof(Quad));
+        for (int k = 0; k < b->count; k++) {
+            Quad q = b->quads[k];
+            int s = siteOf[k];
+            if (s >= 0 && q.op == OP_CALL) {
+                expand(&sites[s], &q, out, moved[k]);
+                continue;
+            }
+            if (s >= 0) {
+                // The argument is converted to the parameter's type
+                q.op = OP_ASSIGN;
+                q.arg2 = noOperand();
+                q.result = symOperand(sites[s].copy[argOf[k]]);
+            } else if (q.result.kind == OPD_TARGET) {
+                q.result.target = moved[q.result.target];
+            }
+            out[moved[k]] = q;
+        }
+
+        // Compose with the places the function's quads had in the store
+        if (b->moved)
+            for (int k = 0; k < b->span; k++)
+                b->moved[k] = moved[b->moved[k]];
+        else
+            b->moved = moved;
+        if (b->moved != moved)
+            free(moved);
+        free(b->quads);
+        b->quads = out;
+        b->count = total;
+        summarize(b);
+    }
+
+    for (int s = 0; s < siteCount; s++)
+        free(sites[s].copy);
+    free(sites);
+    free(siteOf);
+    free(argOf);
+    free(pushed);
+    return siteCount;
+}
+
+// Put the functions back among the global quads
+static void layOut(Body *bodies, int count) {
+    int *newIndex = (int*)malloc((quadIndex + 1) * sizeof(int));
+    int total = 0, next = 0;
+    for (int i = 0; i < quadIndex; i++) {
+        if (next < count && bodies[next].begin == i) {
+            Body *b = &bodies[next++];
+            for (int k = 0; k < b->span; k++)
+                newIndex[i + k] = total + (b->moved ? b->moved[k] : k);
+            total += b->count;
+            i += b->span - 1;
+        } else {
+            newIndex[i] = total++;
+        }
+    }
+    newIndex[quadIndex] = total;
+
+    Quad *out = (Quad*)malloc((total ? total : 1) * sizeof(Quad));
+    int at = 0;
+    next = 0;
+    for (int i = 0; i < quadIndex; i++) {
+        if (next < count && bodies[next].begin == i) {
+            Body *b = &bodies[next++];
+            for (int k = 0; k < b->count; k++) {
+                Quad q = b->quads[k];
+                if (q.result.kind == OPD_TARGET)
+                    q.result.target += at;
+                out[at + k] = q;
+            }
+            at += b->count;
+            i += b->span - 1;
+        } else {
+            Quad q = *quadAt(i);
+            if (q.result.kind == OPD_TARGET && q.result.target >= 0 && q.result.target <= quadIndex)
+                q.result.target = newIndex[q.result.target];
+            out[at++] = q;
+        }
+    }
+
+    quadIndex = 0;
+    for (int i = 0; i < total; i++)
+        emitQuad(out[i].op, out[i].arg1, out[i].arg2, out[i].result);
+    free(out);
+    free(newIndex);
+}
+
+int inlineCalls(int limit) {
+    int count;
+    Body *bodies = loadBodies(&count);
+    int *order = bottomUp(bodies, count);
+    int inlined = 0;
+    for (int n = 0; n < count; n++)
+        inlined += inlineInto(&bodies[order[n]], bodies, limit);
+    if (inlined > 0)
+        layOut(bodies, count);
+
+    for (int n = 0; n < count; n++) {
+        bodies[n].func->id = -1;
+        free(bodies[n].quads);
+        free(bodies[n].moved);
+    }
+    free(bodies);
+    free(order);
+    return inlined;
+}
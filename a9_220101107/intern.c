@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+#include "intern.h"
+
+// Each interned string is stored in the arena as [hash][bytes...\0];
+// the hash slot lets symbol tables reuse it without rehashing
+typedef struct InternPool {
+    const char **slots;   // Open addressing table of interned strings
+    size_t capacity;      // Always a power of two
+    size_t count;
+    Arena bytes;          // Storage for the strings themselves
+} InternPool;
+
+static InternPool pool;
+
+// FNV-1a hash of the name bytes
+static unsigned hashBytes(const char *s, size_t len) {
+    unsigned h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+unsigned internHash(const char *atom) {
+    return ((const unsigned*)atom)[-1];
+}
+
+static void growPool() {
+    size_t newCapacity = pool.capacity ? pool.capacity * 2 : 1024;
+    const char **slots = (const char**)calloc(newCapacity, sizeof(const char*));
+    if (!slots) {
+        fprintf(stderr, "Error: out of memory for intern pool\n");
+        exit(1);
+    }
+
+    for (size_t i = 0; i < pool.capacity; i++) {
+        const char *atom = pool.slots[i];
+        if (!atom) continue;
+        size_t j = internHash(atom) & (newCapacity - 1);
+        while (slots[j])
+            j = (j + 1) & (newCapacity - 1);
+        slots[j] = atom;
+    }
+
+    free(pool.slots);
+    pool.slots = slots;
+    pool.capacity = newCapacity;
+}
+
+const char* internLen(const char *s, size_t len) {
+    // Keep the load factor at or below one half
+    if ((pool.count + 1) * 2 > pool.capacity)
+        growPool();
+
+    unsigned h = hashBytes(s, len);
+    size_t i = h & (pool.capacity - 1);
+    while (pool.slots[i]) {
+        const char *atom = pool.slots[i];
+        if (internHash(atom) == h && strncmp(atom, s, len) == 0 && atom[len] == '\0')
+            return atom;
+        i = (i + 1) & (pool.capacity - 1);
+    }
+
+    unsigned *header = (unsigned*)arenaAlloc(&pool.bytes, sizeof(unsigned) + len + 1);
+    *header = h;
+    char *atom = (char*)(header + 1);
+    memcpy(atom, s, len);
+    atom[len] = '\0';
+
+    pool.slots[i] = atom;
+    pool.count++;
+    return atom;
+}
+
+const char* intern(const char *s) {
+    return internLen(s, strlen(s));
+}
+
+size_t internCount() {
+    return pool.count;
+}
+
+void freeInternPool() {
+    free(pool.slots);
+    arenaFree(&pool.bytes);
+    memset(&pool, 0, sizeof(pool));
+}
@@ -0,0 +1,14 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+
+// Global string interning pool. Every distinct name is stored once, so two
+// interned names are equal exactly when their pointers are equal.
+const char* intern(const char *s);
+const char* internLen(const char *s, size_t len);
+unsigned internHash(const char *atom);
+size_t internCount();
+void freeInternPool();
+
+#endif
@@ -0,0 +1,62 @@
+// Print the contents of a binary IR file written with `a9_220101107 -o`.
+// The file is used straight from the mapping, without deserialising.
+//
+//   ./irdump program.mcir
+
+#include "irfile.h"
+
+static void printIROperand(const IRFile *ir, const IROperand *o) {
+    switch (o->kind) {
+        case OPD_SYM:
+        case OPD_TEMP:   printf("%s", irString(ir, ir->entries[o->index].name)); break;
+        case OPD_INT:    printf("%lld", (long long)o->ival); break;
+        case OPD_FLOAT:  printf("%f", o->fval); break;
+        case OPD_TARGET: printf("L%lld", (long long)o->target); break;
+        case OPD_STR:    printf("%s", irString(ir, (uint32_t)o->index)); break;
+        default:         printf("-"); break;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s file.mcir\n", argv[0]);
+        return 1;
+    }
+
+    IRFile *ir = mapIRFile(argv[1]);
+    if (!ir)
+        return 1;
+
+    const IRHeader *h = ir->header;
+    printf("IR version %u: %u tables, %u entries, %u quads, %u string bytes\n",
+           h->version, h->tableCount, h->entryCount, h->quadCount, h->stringBytes);
+
+    for (uint32_t t = 0; t < h->tableCount; t++) {
+        const IRTable *table = &ir->tables[t];
+        printf("\nTable %u: %s (parent %d, frame %d bytes)\n", t,
+               irString(ir, table->name), table->parent, table->frameSize);
+        for (uint32_t i = 0; i < table->entryCount; i++) {
+            const IREntry *e = &ir->entries[table->firstEntry + i];
+            printf("  %-10s %-8s size %-4d offset %-6d", irString(ir, e->name),
+                   typeToString((Type)e->type), e->size, e->offset);
+            if (e->nestedTable != IR_NONE)
+                printf(" -> table %d", e->nestedTable);
+            printf("\n");
+        }
+    }
+
+    printf("\nQuads:\n");
+    for (uint32_t i = 0; i < h->quadCount; i++) {
+        const IRQuad *q = &ir->quads[i];
+        printf("%4u  %-10s ", i, q->op < OP_COUNT ? opInfo[q->op].name : "?");
+        printIROperand(ir, &q->arg1);
+        printf(" ");
+        printIROperand(ir, &q->arg2);
+        printf(" ");
+        printIROperand(ir, &q->result);
+        printf("\n");
+    }
+
+    unmapIRFile(ir);
+    return 0;
+}
@@ -0,0 +1,323 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "irfile.h"
+
+// String table under construction; names are interned, so identical
+// strings share one pointer and are stored once
+typedef struct StringTable {
+    char *data;
+    size_t len, cap;
+    const char **keys;      // Open addressing map: string pointer -> offset
+    uint32_t *offsets;
+    size_t slots;
+    size_t count;
+} StringTable;
+
+static void growStringMap(StringTable *st) {
+    size_t slots = st->slots ? st->slots * 2 : 256;
+    const char **keys = (const char**)calloc(slots, sizeof(const char*));
+    uint32_t *offsets = (uint32_t*)malloc(slots * sizeof(uint32_t));
+    for (size_t i = 0; i < st->slots; i++) {
+        if (!st->keys[i]) continue;
+        size_t j = ((uintptr_t)st->keys[i] >> 3) & (slots - 1);
+        while (keys[j])
+            j = (j + 1) & (slots - 1);
+        keys[j] = st->keys[i];
+        offsets[j] = st->offsets[i];
+    }
+    free(st->keys);
+    free(st->offsets);
+    st->keys = keys;
+    st->offsets = offsets;
+    st->slots = slots;
+}
+
+static uint32_t addString(StringTable *st, const char *s) {
+    if ((st->count + 1) * 2 > st->slots)
+        growStringMap(st);
+
+    size_t j = ((uintptr_t)s >> 3) & (st->slots - 1);
+    while (st->keys[j]) {
+        if (st->keys[j] == s)
+            return st->offsets[j];
+        j = (j + 1) & (st->slots - 1);
+    }
+
+    size_t len = strlen(s) + 1;
+    while (st->len + len > st->cap) {
+        st->cap = st->cap ? st->cap * 2 : 4096;
+        st->data = (char*)realloc(st->data, st->cap);
+    }
+    memcpy(st->data + st->len, s, len);
+
+    st->keys[j] = s;
+    st->offsets[j] = (uint32_t)st->len;
+    st->count++;
+    st->len += len;
+    return st->offsets[j];
+}
+
+// Number tables depth first (global first) and their entries in order
+static void numberTables(SymbolTable *table, SymbolTable ***tables, int *tableCount,
+                         int *tableCap, int *entryCount) {
+    if (*tableCount == *tableCap) {
+        *tableCap = *tableCap ? *tableCap * 2 : 16;
+        *tables = (SymbolTable**)realloc(*tables, *tableCap * sizeof(SymbolTable*));
+    }
+    table->id = (*tableCount)++;
+    (*tables)[table->id] = table;
+
+    for (SymbolEntry *e = table->entries; e; e = e->next)
+        e->id = (*entryCount)++;
+    for (SymbolEntry *e = table->entries; e; e = e->next)
+        if (e->nestedTable && e->nestedTable->id < 0)
+            numberTables(e->nestedTable, tables, tableCount, tableCap, entryCount);
+}
+
+static IROperand encodeOperand(Operand o, StringTable *st) {
+    IROperand r;
+    memset(&r, 0, sizeof(r));
+    r.kind = o.kind;
+    switch (o.kind) {
+        case OPD_SYM:
+        case OPD_TEMP:   r.index = o.sym->id; break;
+        case OPD_INT:    r.ival = o.ival; break;
+        case OPD_FLOAT:  r.fval = o.fval; break;
+        case OPD_TARGET: r.target = o.target; break;
+        case OPD_STR:    r.index = addString(st, o.str); break;
+        default:         break;
+    }
+    return r;
+}
+
+static uint64_t align8(uint64_t n) {
+    return (n + 7) & ~(uint64_t)7;
+}
+
+// Write the quads and all symbol tables reachable from globalTable
+int writeIRFile(const char *path) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+
+    SymbolTable **tables = NULL;
+    int tableCount = 0, tableCap = 0, entryCount = 0;
+    numberTables(globalTable, &tables, &tableCount, &tableCap, &entryCount);
+
+    StringTable st;
+    memset(&st, 0, sizeof(st));
+
+    IRTable *irTables = (IRTable*)calloc(tableCount, sizeof(IRTable));
+    IREntry *irEntries = (IREntry*)calloc(entryCount ? entryCount : 1, sizeof(IREntry));
+    for (int t = 0; t < tableCount; t++) {
+        SymbolTable *table = tables[t];
+        IRTable *it = &irTables[t];
+        it->name = addString(&st, table->name);
+        it->parent = table->parent ? table->parent->id : IR_NONE;
+        it->firstEntry = table->entries ? (uint32_t)table->entries->id : 0;
+        it->entryCount = table->count;
+        it->frameSize = table->frameSize;
+        it->tempCount = table->tempCount;
+
+        for (SymbolEntry *e = table->entries; e; e = e->next) {
+            IREntry *ie = &irEntries[e->id];
+            ie->name = addString(&st, e->name);
+            ie->type = e->type;
+            ie->eleType = e->eleType;
+            ie->isTemp = e->isTemp;
+            ie->size = e->size;
+            ie->offset = e->offset;
+            ie->arraySize = e->arraySize;
+            ie->paramCount = e->paramCount;
+            ie->table = t;
+            ie->nestedTable = e->nestedTable ? e->nestedTable->id : IR_NONE;
+            if (e->initialValue) {
+                ie->hasInitialValue = 1;
+                if (e->type == FLOAT_T)
+                    ie->initialValue.fval = *(float*)e->initialValue;
+                else if (e->type == CHAR_T)
+                    ie->initialValue.ival = *(char*)e->initialValue;
+                else
+                    ie->initialValue.ival = *(int*)e->initialValue;
+            }
+        }
+    }
+
+    IRHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, IR_MAGIC, 4);
+    header.version = IR_VERSION;
+    header.tableCount = tableCount;
+    header.entryCount = entryCount;
+    header.quadCount = quadIndex;
+
+    // Quads are encoded while streaming, but string literals in them must
+    // be in the string table before it is written
+    for (int i = 0; i < quadIndex; i++) {
+        Quad *q = quadAt(i);
+        if (q->arg1.kind == OPD_STR) addString(&st, q->arg1.str);
+        if (q->arg2.kind == OPD_STR) addString(&st, q->arg2.str);
+        if (q->result.kind == OPD_STR) addString(&st, q->result.str);
+    }
+
+    header.stringBytes = st.len;
+    header.stringOffset = align8(sizeof(IRHeader));
+    header.tableOffset = align8(header.stringOffset + st.len);
+    header.entryOffset = header.tableOffset + (uint64_t)tableCount * sizeof(IRTable);
+    header.quadOffset = header.entryOffset + (uint64_t)entryCount * sizeof(IREntry);
+
+    OutBuf out;
+    outOpen(&out, fd);
+    static const char zeros[8];
+    outWrite(&out, (const char*)&header, sizeof(header));
+    outWrite(&out, zeros, header.stringOffset - sizeof(header));
+    outWrite(&out, st.data, st.len);
+    outWrite(&out, zeros, header.tableOffset - header.stringOffset - st.len);
+    outWrite(&out, (const char*)irTables, (size_t)tableCount * sizeof(IRTable));
+    outWrite(&out, (const char*)irEntries, (size_t)entryCount * sizeof(IREntry));
+    for (int i = 0; i < quadIndex; i++) {
+        Quad *q = quadAt(i);
+        IRQuad iq;
+        memset(&iq, 0, sizeof(iq));
+        iq.op = q->op;
+        iq.arg1 = encodeOperand(q->arg1, &st);
+        iq.arg2 = encodeOperand(q->arg2, &st);
+        iq.result = encodeOperand(q->result, &st);
+        outWrite(&out, (const char*)&iq, sizeof(iq));
+    }
+    int failed = outClose(&out) != 0;
+    if (close(fd) != 0) {
+        perror(path);
+        failed = 1;
+    }
+
+    // Leave the scratch numbers clean for the next user
+    for (int t = 0; t < tableCount; t++) {
+        tables[t]->id = -1;
+        for (SymbolEntry *e = tables[t]->entries; e; e = e->next)
+            e->id = -1;
+    }
+
+    free(tables);
+    free(irTables);
+    free(irEntries);
+    free(st.data);
+    free(st.keys);
+    free(st.offsets);
+
+    if (failed) {
+        fprintf(stderr, "Error: could not write IR file %s\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+static int validString(const IRHeader *h, const char *strings, uint64_t offset) {
+    return offset < h->stringBytes && memchr(strings + offset, 0, h->stringBytes - offset);
+}
+
+static int validOperand(const IRHeader *h, const char *strings, const IROperand *o) {
+    switch (o->kind) {
+        case OPD_SYM:
+        case OPD_TEMP:
+            return o->index >= 0 && (uint64_t)o->index < h->entryCount;
+        case OPD_STR:
+            return o->index >= 0 && validString(h, strings, (uint64_t)o->index);
+        case OPD_TARGET:
+            // quadCount is the end of the program, a valid jump target
+            return o->target >= 0 && (uint64_t)o->target <= h->quadCount;
+        default:
+            return o->kind <= OPD_STR;
+    }
+}
+
+// Check every reference inside the sections, so readers can follow them
+// without bounds checks
+static int validContents(const IRHeader *h, const char *base) {
+    const char *strings = base + h->stringOffset;
+    const IRTable *tables = (const IRTable*)(base + h->tableOffset);
+    const IREntry *entries = (const IREntry*)(base + h->entryOffset);
+    const IRQuad *quads = (const IRQuad*)(base + h->quadOffset);
+
+    for (uint32_t t = 0; t < h->tableCount; t++) {
+        const IRTable *table = &tables[t];
+        if (!validString(h, strings, table->name) ||
+            (table->parent != IR_NONE && (table->parent < 0 || (uint32_t)table->parent >= h->tableCount)) ||
+            (uint64_t)table->firstEntry + table->entryCount > h->entryCount)
+            return 0;
+    }
+    for (uint32_t i = 0; i < h->entryCount; i++) {
+        const IREntry *e = &entries[i];
+        if (!validString(h, strings, e->name) ||
+            e->table < 0 || (uint32_t)e->table >= h->tableCount ||
+            (e->nestedTable != IR_NONE && (e->nestedTable < 0 || (uint32_t)e->nestedTable >= h->tableCount)))
+            return 0;
+    }
+    for (uint32_t i = 0; i < h->quadCount; i++) {
+        const IRQuad *q = &quads[i];
+        if (q->op >= OP_COUNT || !validOperand(h, strings, &q->arg1) ||
+            !validOperand(h, strings, &q->arg2) || !validOperand(h, strings, &q->result))
+            return 0;
+    }
+    return 1;
+}
+
+// Map an IR file read-only and check that its sections fit and that the
+// references in them stay inside the file
+IRFile* mapIRFile(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return NULL;
+    }
+
+    struct stat sb;
+    if (fstat(fd, &sb) < 0 || (size_t)sb.st_size < sizeof(IRHeader)) {
+        fprintf(stderr, "Error: %s is not an IR file\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    void *base = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        perror(path);
+        return NULL;
+    }
+
+    const IRHeader *h = (const IRHeader*)base;
+    size_t size = sb.st_size;
+    if (memcmp(h->magic, IR_MAGIC, 4) != 0 || h->version != IR_VERSION ||
+        h->stringOffset > size || h->tableOffset > size ||
+        h->entryOffset > size || h->quadOffset > size ||
+        h->stringOffset + h->stringBytes > size ||
+        h->tableOffset + (uint64_t)h->tableCount * sizeof(IRTable) > size ||
+        h->entryOffset + (uint64_t)h->entryCount * sizeof(IREntry) > size ||
+        h->quadOffset + (uint64_t)h->quadCount * sizeof(IRQuad) > size ||
+        h->tableOffset % 8 || h->entryOffset % 8 || h->quadOffset % 8 ||
+        !validContents(h, (const char*)base)) {
+        fprintf(stderr, "Error: %s is not a version %d IR file\n", path, IR_VERSION);
+        munmap(base, size);
+        return NULL;
+    }
+
+    IRFile *ir = (IRFile*)malloc(sizeof(IRFile));
+    ir->base = base;
+    ir->size = size;
+    ir->header = h;
+    ir->strings = (const char*)base + h->stringOffset;
+    ir->tables = (const IRTable*)((const char*)base + h->tableOffset);
+    ir->entries = (const IREntry*)((const char*)base + h->entryOffset);
+    ir->quads = (const IRQuad*)((const char*)base + h->quadOffset);
+    return ir;
+}
+
+void unmapIRFile(IRFile *ir) {
+    if (!ir) return;
+    munmap(ir->base, ir->size);
+    free(ir);
+}
@@ -0,0 +1,99 @@
+#ifndef IRFILE_H
+#define IRFILE_H
+
+#include <stdint.h>
+#include "quad.h"
+
+// Binary IR file: a fixed header followed by four sections, each 8-byte
+// aligned. Every record is fixed width and references other records by
+// index, so a reader can mmap the file and use it in place.
+//
+//   IRHeader | string table | IRTable[] | IREntry[] | IRQuad[]
+//
+// Strings are NUL terminated and referenced by their byte offset in the
+// string table. Table 0 is the global table.
+
+#define IR_MAGIC   "MCIR"
+#define IR_VERSION 1
+#define IR_NONE    (-1)   // Missing table reference
+
+typedef struct IRHeader {
+    char magic[4];          // IR_MAGIC
+    uint32_t version;       // IR_VERSION
+    uint32_t tableCount;
+    uint32_t entryCount;
+    uint32_t quadCount;
+    uint32_t stringBytes;   // Size of the string table
+    uint64_t stringOffset;  // File offsets of the sections
+    uint64_t tableOffset;
+    uint64_t entryOffset;
+    uint64_t quadOffset;
+} IRHeader;
+
+typedef struct IRTable {
+    uint32_t name;          // String offset
+    int32_t parent;         // Table index or IR_NONE
+    uint32_t firstEntry;    // Entries of a table are contiguous, in order
+    uint32_t entryCount;
+    int32_t frameSize;
+    int32_t tempCount;
+} IRTable;
+
+typedef struct IREntry {
+    uint32_t name;          // String offset
+    uint8_t type;           // Type
+    uint8_t eleType;
+    uint8_t isTemp;
+    uint8_t hasInitialValue;
+    int32_t size;
+    int32_t offset;
+    int32_t arraySize;
+    int32_t paramCount;
+    int32_t table;          // Owning table index
+    int32_t nestedTable;    // Table index or IR_NONE
+    int32_t pad;
+    union {
+        int64_t ival;       // INT_T and CHAR_T initial values
+        double fval;        // FLOAT_T initial values
+    } initialValue;
+} IREntry;
+
+typedef struct IROperand {
+    uint32_t kind;          // OperandKind
+    uint32_t pad;
+    union {
+        int64_t index;      // OPD_SYM, OPD_TEMP: entry index; OPD_STR: string offset
+        int64_t ival;       // OPD_INT
+        int64_t target;     // OPD_TARGET
+        double fval;        // OPD_FLOAT
+    };
+} IROperand;
+
+typedef struct IRQuad {
+    uint32_t op;            // OpCode
+    uint32_t pad;
+    IROperand arg1;
+    IROperand arg2;
+    IROperand result;
+} IRQuad;
+
+// A mapped IR file; all pointers refer into the mapping
+typedef struct IRFile {
+    void *base;
+    size_t size;
+    const IRHeader *header;
+    const char *strings;
+    const IRTable *tables;
+    const IREntry *entries;
+    const IRQuad *quads;
+} IRFile;
+
+int writeIRFile(const char *path);
+IRFile* mapIRFile(const char *path);
+void unmapIRFile(IRFile *ir);
+
+static inline const char* irString(const IRFile *ir, uint32_t offset) {
+    return ir->strings + offset;
+}
+
+#endif
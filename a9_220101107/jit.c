@@ -0,0 +1,863 @@
+#include <ctype.h>
+#include <setjmp.h>
+#include <sys/mman.h>
+#include "jit.h"
+#include "intern.h"
+#include "x86.h"
+
+// The assembler knows just the instructions x86.c emits, in AT&T syntax:
+// general register, immediate and base plus displacement or %rip relative
+// operands, SSE2 scalar doubles and the few x87 instructions of fmod.
+// Jumps and %rip relative operands always take 32-bit displacements, so
+// every instruction has its final size when it is encoded; the references
+// are patched once code and data have their addresses.
+
+enum { SECTION_TEXT, SECTION_DATA };
+
+enum { ARG_REG, ARG_XMM, ARG_ST, ARG_IMM, ARG_MEM, ARG_LABEL };
+
+typedef struct Arg {
+    int kind;
+    int reg;                // Register number; base of a memory operand, -1 for %rip
+    int size;               // Bytes of a general register
+    int needsRex;           // %spl, %bpl, %sil and %dil only exist with a REX prefix
+    int indirect;           // *%reg in call
+    long long value;        // Immediate, or displacement of a memory operand
+    const char *name;       // Symbol of an immediate, displacement or jump target
+} Arg;
+
+typedef struct Label {
+    const char *name;       // Interned; NULL for a free slot
+    int section;
+    size_t offset;
+} Label;
+
+typedef struct Fixup {
+    size_t at;              // Code offset of the 4 bytes to patch
+    size_t end;             // Code offset a relative displacement counts from; 0 for absolute
+    const char *name;       // Target, or NULL when section and offset are known
+    int section;
+    size_t offset;
+    long long addend;
+} Fixup;
+
+typedef struct Assembler {
+    int section;
+    unsigned char *code;
+    size_t codeLen, codeCap;
+    unsigned char *data;    // Initialised data; the rest of dataSize is zero
+    size_t dataLen, dataCap, dataSize;
+    Label *labels;
+    int labelCount, labelCap;
+    Fixup *fixups;
+    int fixupCount, fixupCap;
+    int *pending[10];       // Fixups waiting for the next definition of local label 0-9
+    int pendingCount[10], pendingCap[10];
+    int localSection[10];   // Last definition of each local label, for backward references
+    size_t localOffset[10];
+    char hasLocal[10];
+    int failed;
+} Assembler;
+
+struct JIT {
+    unsigned char *code;
+    size_t codeSize;
+    unsigned char *data;
+    size_t dataSize;
+    Label *labels;
+    int labelCap;
+};
+
+static jmp_buf *failJump;   // jitRun() in progress
+static int *failDepth;
+
+// Run time errors of compiled code; called with the stack aligned
+static void jitFail(const char *message) {
+    fputs(message, stderr);
+    if (failJump) {
+        *failDepth = 0;
+        longjmp(*failJump, 1);
+    }
+    exit(1);
+}
+
+static void invalid(Assembler *a, const char *line) {
+    if (!a->failed)
+        fprintf(stderr, "Error: the JIT cannot assemble \"%s\"\n", line);
+    a->failed = 1;
+}
+
+// ---- Output ----
+
+static void byte(Assembler *a, int b) {
+    if (a->codeLen == a->codeCap) {
+        a->codeCap = a->codeCap ? a->codeCap * 2 : 4096;
+        a->code = (unsigned char*)realloc(a->code, a->codeCap);
+    }
+    a->code[a->codeLen++] = (unsigned char)b;
+}
+
+static void bytes(Assembler *a, long long v, int n) {
+    for (int k = 0; k < n; k++)
+        byte(a, (int)((unsigned long long)v >> (8 * k)) & 0xff);
+}
+
+static void dataByte(Assembler *a, int b) {
+    if (a->section == SECTION_TEXT) {
+        byte(a, b);
+        return;
+    }
+    if (a->dataSize + 1 > a->dataCap) {
+        size_t cap = a->dataCap ? a->dataCap : 4096;
+        while (cap < a->dataSize + 1)
+            cap *= 2;
+        a->data = (unsigned char*)realloc(a->data, cap);
+        a->dataCap = cap;
+    }
+    if (a->dataLen < a->dataSize)
+        memset(a->data + a->dataLen, 0, a->dataSize - a->dataLen);
+    a->data[a->dataSize++] = (unsigned char)b;
+    a->dataLen = a->dataSize;
+}
+
+static size_t here(const Assembler *a) {
+    return a->section == SECTION_TEXT ? a->codeLen : a->dataSize;
+}
+
+// ---- Labels ----
+
+static Label* findLabel(Label *labels, int cap, const char *name) {
+    if (!cap)
+        return NULL;
+    unsigned slot = internHash(name) & (cap - 1);
+    while (labels[slot].name && labels[slot].name != name)
+        slot = (slot + 1) & (cap - 1);
+    return &labels[slot];
+}
+
+static void defineLabel(Assembler *a, const char *text, size_t len) {
+    if (len == 1 && isdigit((unsigned char)text[0])) {
+        int n = text[0] - '0';
+        a->hasLocal[n] = 1;
+        a->localSection[n] = a->section;
+        a->localOffset[n] = here(a);
+        for (int k = 0; k < a->pendingCount[n]; k++) {
+            Fixup *f = &a->fixups[a->pending[n][k]];
+            f->section = a->section;
+            f->offset = here(a);
+        }
+        a->pendingCount[n] = 0;
+        return;
+    }
+    if (2 * (a->labelCount + 1) > a->labelCap) {
+        int cap = a->labelCap ? a->labelCap * 2 : 256;
+        Label *labels = (Label*)calloc(cap, sizeof(Label));
+        for (int k = 0; k < a->labelCap; k++)
+            if (a->labels[k].name)
+                *findLabel(labels, cap, a->labels[k].name) = a->labels[k];
+        free(a->labels);
+        a->labels = labels;
+        a->labelCap = cap;
+    }
+    const char *name = internLen(text, len);
+    Label *l = findLabel(a->labels, a->labelCap, name);
+    if (!l->name)
+        a->labelCount++;
+    l->name = name;
+    l->section = a->section;
+    l->offset = here(a);
+}
+
+// Refer to a symbol plus addend from the 4 bytes about to be emitted;
+// relative references count from end bytes further on
+static void reference(Assembler *a, const char *name, long long addend, int relative, size_t end) {
+    if (a->fixupCount == a->fixupCap) {
+        a->fixupCap = a->fixupCap ? a->fixupCap * 2 : 256;
+        a->fixups = (Fixup*)realloc(a->fixups, a->fixupCap * sizeof(Fixup));
+    }
+    int index = a->fixupCount++;
+    Fixup *f = &a->fixups[index];
+    f->at = a->codeLen;
+    f->end = relative ? a->codeLen + end : 0;
+    f->name = NULL;
+    f->section = -1;
+    f->offset = 0;
+    f->addend = addend;
+
+    size_t len = strlen(name);
+    if (len == 2 && isdigit((unsigned char)name[0]) && (name[1] == 'f' || name[1] == 'b')) {
+        int n = name[0] - '0';
+        if (name[1] == 'b' && a->hasLocal[n]) {
+            f->section = a->localSection[n];
+            f->offset = a->localOffset[n];
+        } else if (name[1] == 'f') {
+            if (a->pendingCount[n] == a->pendingCap[n]) {
+                a->pendingCap[n] = a->pendingCap[n] ? a->pendingCap[n] * 2 : 8;
+                a->pending[n] = (int*)realloc(a->pending[n], a->pendingCap[n] * sizeof(int));
+            }
+            a->pending[n][a->pendingCount[n]++] = index;
+        }
+    } else {
+        f->name = intern(name);
+    }
+    bytes(a, 0, 4);
+}
+
+// ---- Operands ----
+
+typedef struct RegName {
+    const char *name;
+    int reg, size, needsRex;
+} RegName;
+
+static const RegName regNames[] = {
+    {"rax", 0, 8, 0}, {"rcx", 1, 8, 0}, {"rdx", 2, 8, 0}, {"rbx", 3, 8, 0},
+    {"rsp", 4, 8, 0}, {"rbp", 5, 8, 0}, {"rsi", 6, 8, 0}, {"rdi", 7, 8, 0},
+    {"eax", 0, 4, 0}, {"ecx", 1, 4, 0}, {"edx", 2, 4, 0}, {"ebx", 3, 4, 0},
+    {"esp", 4, 4, 0}, {"ebp", 5, 4, 0}, {"esi", 6, 4, 0}, {"edi", 7, 4, 0},
+    {"al", 0, 1, 0}, {"cl", 1, 1, 0}, {"dl", 2, 1, 0}, {"bl", 3, 1, 0},
+    {"ah", 4, 1, 0}, {"ch", 5, 1, 0}, {"dh", 6, 1, 0}, {"bh", 7, 1, 0},
+    {"spl", 4, 1, 1}, {"bpl", 5, 1, 1}, {"sil", 6, 1, 1}, {"dil", 7, 1, 1},
+    {"ax", 0, 2, 0},
+};
+
+static int parseRegister(const char *s, Arg *arg) {
+    memset(arg, 0, sizeof(*arg));
+    if (strncmp(s, "xmm", 3) == 0) {
+        arg->kind = ARG_XMM;
+        arg->reg = atoi(s + 3);
+        return 1;
+    }
+    if (strncmp(s, "st(", 3) == 0) {
+        arg->kind = ARG_ST;
+        arg->reg = atoi(s + 3);
+        return 1;
+    }
+    arg->kind = ARG_REG;
+    if (s[0] == 'r' && isdigit((unsigned char)s[1])) {
+        char *end;
+        arg->reg = (int)strtol(s + 1, &end, 10);
+        arg->size = *end == 'd' ? 4 : *end == 'b' ? 1 : *end == 'w' ? 2 : 8;
+        return arg->reg >= 8 && arg->reg < 16;
+    }
+    for (size_t k = 0; k < sizeof(regNames) / sizeof(regNames[0]); k++) {
+        if (strcmp(s, regNames[k].name) == 0) {
+            arg->reg = regNames[k].reg;
+            arg->size = regNames[k].size;
+            arg->needsRex = regNames[k].needsRex;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// A number, or a symbol with an optional offset
+static int parseValue(const char *s, size_t len, Arg *arg) {
+    char text[128];
+    if (len >= sizeof(text))
+        return 0;
+    memcpy(text, s, len);
+    text[len] = '\0';
+    char *end;
+    if (len == 0) {
+        arg->value = 0;
+        return 1;
+    }
+    if (isdigit((unsigned char)text[0]) || text[0] == '-') {
+        arg->value = strtoll(text, &end, 10);
+        return *end == '\0';
+    }
+    char *sign = text + 1;
+    while (*sign && *sign != '+' && *sign != '-')
+        sign++;
+    arg->value = *sign ? strtoll(sign, &end, 10) : 0;
+    if (*sign && *end)
+        return 0;
+    *sign = '\0';
+    arg->name = intern(text);
+    return 1;
+}
+
+static int parseArg(const char *s, Arg *arg) {
+    memset(arg, 0, sizeof(*arg));
+    if (s[0] == '*') {
+        int ok = s[1] == '%' && parseRegister(s + 2, arg);
+        arg->indirect = 1;
+        return ok;
+    }
+    if (s[0] == '%')
+        return parseRegister(s + 1, arg);
+    if (s[0] == '$') {
+        arg->kind = ARG_IMM;
+        return parseValue(s + 1, strlen(s + 1), arg);
+    }
+    const char *open = strchr(s, '(');
+    if (!open) {
+        arg->kind = ARG_LABEL;
+        arg->name = s;
+        return 1;
+    }
+    if (!parseValue(s, open - s, arg))
+        return 0;
+    arg->kind = ARG_MEM;
+    const char *base = open + 1;
+    if (strncmp(base, "%rip)", 5) == 0) {
+        arg->reg = -1;
+        return 1;
+    }
+    Arg reg;
+    char name[8];
+    size_t len = strcspn(base, ")");
+    if (base[0] != '%' || len < 2 || len - 1 >= sizeof(name))
+        return 0;
+    memcpy(name, base + 1, len - 1);
+    name[len - 1] = '\0';
+    if (!parseRegister(name, &reg) || reg.kind != ARG_REG || reg.size != 8 || arg->name)
+        return 0;
+    arg->reg = reg.reg;
+    return 1;
+}
+
+// ---- Encoding ----
+
+// [prefix] [REX] opcode ModRM [SIB] [displacement], with reg in the
+// ModRM reg field (a register or an opcode extension) and rm as operand;
+// immBytes of immediate follow
+static void encode(Assembler *a, int prefix, int w, const char *opcode, int reg,
+                   const Arg *rm, int immBytes, int forceRex) {
+    if (prefix)
+        byte(a, prefix);
+    int base = rm->reg;
+    int rex = 0x40 | (w ? 8 : 0) | ((reg >> 3) & 1) << 2 | (base >= 0 ? (base >> 3) & 1 : 0);
+    if (rex != 0x40 || forceRex || rm->needsRex)
+        byte(a, rex);
+    for (const char *op = opcode; *op; op++)
+        byte(a, (unsigned char)*op);
+
+    if (rm->kind != ARG_MEM) {
+        byte(a, 0xc0 | (reg & 7) << 3 | (rm->reg & 7));
+    } else if (rm->reg < 0) {
+        byte(a, 0x05 | (reg & 7) << 3);
+        reference(a, rm->name ? rm->name : "", rm->value, 1, 4 + immBytes);
+    } else {
+        long long disp = rm->value;
+        int mod = disp == 0 && (rm->reg & 7) != 5 ? 0 : disp >= -128 && disp < 128 ? 1 : 2;
+        byte(a, mod << 6 | (reg & 7) << 3 | (rm->reg & 7));
+        if ((rm->reg & 7) == 4)
+            byte(a, 0x24);
+        if (mod)
+            bytes(a, disp, mod == 1 ? 1 : 4);
+    }
+}
+
+// An immediate of n bytes; symbols become absolute addresses
+static void immediate(Assembler *a, const Arg *imm, int n) {
+    if (imm->name)
+        reference(a, imm->name, imm->value, 0, 0);
+    else
+        bytes(a, imm->value, n);
+}
+
+static int fitsByte(const Arg *imm) {
+    return !imm->name && imm->value >= -128 && imm->value < 128;
+}
+
+static int suffixSize(char c) {
+    return c == 'b' ? 1 : c == 'w' ? 2 : c == 'l' ? 4 : c == 'q' ? 8 : 0;
+}
+
+static const struct { const char *name; int code; } conditions[] = {
+    {"o", 0}, {"no", 1}, {"b", 2}, {"c", 2}, {"nae", 2}, {"ae", 3}, {"nb", 3}, {"nc", 3},
+    {"e", 4}, {"z", 4}, {"ne", 5}, {"nz", 5}, {"be", 6}, {"na", 6}, {"a", 7}, {"nbe", 7},
+    {"s", 8}, {"ns", 9}, {"p", 10}, {"pe", 10}, {"np", 11}, {"po", 11},
+    {"l", 12}, {"nge", 12}, {"ge", 13}, {"nl", 13}, {"le", 14}, {"ng", 14}, {"g", 15}, {"nle", 15},
+};
+
+static int conditionCode(const char *s) {
+    for (size_t k = 0; k < sizeof(conditions) / sizeof(conditions[0]); k++)
+        if (strcmp(s, conditions[k].name) == 0)
+            return conditions[k].code;
+    return -1;
+}
+
+static const struct { const char *name; int digit; } aluOps[] = {
+    {"add", 0}, {"or", 1}, {"and", 4}, {"sub", 5}, {"xor", 6}, {"cmp", 7},
+};
+
+static const struct { const char *name; int prefix; int opcode; } sseOps[] = {
+    {"movapd", 0x66, 0x28}, {"ucomisd", 0x66, 0x2e}, {"xorpd", 0x66, 0x57},
+    {"addsd", 0xf2, 0x58}, {"mulsd", 0xf2, 0x59}, {"subsd", 0xf2, 0x5c}, {"divsd", 0xf2, 0x5e},
+};
+
+// Encode one instruction with its operands, source first; returns 0 for
+// forms the assembler does not know
+static int instruction(Assembler *a, const char *m, Arg *args, int n) {
+    Arg *src = &args[0], *dst = &args[n - 1];
+    size_t len = strlen(m);
+    int size = len > 1 ? suffixSize(m[len - 1]) : 0;
+    char op[4] = {0};
+
+    if (n == 0) {
+        if (strcmp(m, "ret") == 0)        byte(a, 0xc3);
+        else if (strcmp(m, "cqto") == 0)  { byte(a, 0x48); byte(a, 0x99); }
+        else if (strcmp(m, "fprem") == 0) { byte(a, 0xd9); byte(a, 0xf8); }
+        else return 0;
+        return 1;
+    }
+
+    // Jumps and calls
+    if (m[0] == 'j' || strcmp(m, "call") == 0) {
+        if (n != 1)
+            return 0;
+        if (src->indirect) {
+            op[0] = (char)0xff;
+            encode(a, 0, 0, op, 2, src, 0, 0);
+            return 1;
+        }
+        if (src->kind != ARG_LABEL)
+            return 0;
+        if (strcmp(m, "call") == 0) {
+            byte(a, 0xe8);
+        } else if (strcmp(m, "jmp") == 0) {
+            byte(a, 0xe9);
+        } else {
+            int cc = conditionCode(m + 1);
+            if (cc < 0)
+                return 0;
+            byte(a, 0x0f);
+            byte(a, 0x80 + cc);
+        }
+        reference(a, src->name, 0, 1, 4);
+        return 1;
+    }
+    if (strncmp(m, "set", 3) == 0) {
+        int cc = conditionCode(m + 3);
+        if (cc < 0 || n != 1 || (src->kind == ARG_REG && src->size != 1))
+            return 0;
+        op[0] = 0x0f;
+        op[1] = (char)(0x90 + cc);
+        encode(a, 0, 0, op, 0, src, 0, 0);
+        return 1;
+    }
+
+    if (n == 1) {
+        if ((strcmp(m, "pushq") == 0 || strcmp(m, "popq") == 0) && src->kind == ARG_REG) {
+            if (src->reg >= 8)
+                byte(a, 0x41);
+            byte(a, (m[1] == 'u' ? 0x50 : 0x58) + (src->reg & 7));
+        } else if (strcmp(m, "idivq") == 0 || strcmp(m, "negq") == 0) {
+            op[0] = (char)0xf7;
+            encode(a, 0, 1, op, m[0] == 'i' ? 7 : 3, src, 0, 0);
+        } else if ((strcmp(m, "incl") == 0 || strcmp(m, "decl") == 0) && src->kind == ARG_MEM) {
+            op[0] = (char)0xff;
+            encode(a, 0, 0, op, m[0] == 'i' ? 0 : 1, src, 0, 0);
+        } else if ((strcmp(m, "fldl") == 0 || strcmp(m, "fstpl") == 0) && src->kind == ARG_MEM) {
+            op[0] = (char)0xdd;
+            encode(a, 0, 0, op, m[1] == 'l' ? 0 : 3, src, 0, 0);
+        } else if (strcmp(m, "fstp") == 0 && src->kind == ARG_ST) {
+            byte(a, 0xdd);
+            byte(a, 0xd8 + src->reg);
+        } else if (strcmp(m, "fnstsw") == 0 && src->kind == ARG_REG && src->size == 2) {
+            byte(a, 0xdf);
+            byte(a, 0xe0);
+        } else {
+            return 0;
+        }
+        return 1;
+    }
+    if (n != 2)
+        return 0;
+
+    // Scalar double instructions
+    for (size_t k = 0; k < sizeof(sseOps) / sizeof(sseOps[0]); k++) {
+        if (strcmp(m, sseOps[k].name) == 0 && dst->kind == ARG_XMM) {
+            op[0] = 0x0f;
+            op[1] = (char)sseOps[k].opcode;
+            encode(a, sseOps[k].prefix, 0, op, dst->reg, src, 0, 0);
+            return 1;
+        }
+    }
+    if (strcmp(m, "movsd") == 0) {
+        op[0] = 0x0f;
+        op[1] = dst->kind == ARG_XMM ? 0x10 : 0x11;
+        if (dst->kind == ARG_XMM)
+            encode(a, 0xf2, 0, op, dst->reg, src, 0, 0);
+        else if (src->kind == ARG_XMM)
+            encode(a, 0xf2, 0, op, src->reg, dst, 0, 0);
+        else
+            return 0;
+        return 1;
+    }
+    if (strcmp(m, "cvtsi2sdq") == 0 && dst->kind == ARG_XMM) {
+        op[0] = 0x0f;
+        op[1] = 0x2a;
+        encode(a, 0xf2, 1, op, dst->reg, src, 0, 0);
+        return 1;
+    }
+    if (strcmp(m, "cvttsd2siq") == 0 && dst->kind == ARG_REG) {
+        op[0] = 0x0f;
+        op[1] = 0x2c;
+        encode(a, 0xf2, 1, op, dst->reg, src, 0, 0);
+        return 1;
+    }
+    if (strcmp(m, "movq") == 0 && (src->kind == ARG_XMM || dst->kind == ARG_XMM)) {
+        op[0] = 0x0f;
+        op[1] = dst->kind == ARG_XMM ? 0x6e : 0x7e;
+        if (dst->kind == ARG_XMM && src->kind == ARG_REG)
+            encode(a, 0x66, 1, op, dst->reg, src, 0, 0);
+        else if (src->kind == ARG_XMM && dst->kind == ARG_REG)
+            encode(a, 0x66, 1, op, src->reg, dst, 0, 0);
+        else
+            return 0;
+        return 1;
+    }
+
+    // Moves with extension, and addresses
+    if (strcmp(m, "movabsq") == 0 && src->kind == ARG_IMM && dst->kind == ARG_REG && !src->name) {
+        byte(a, 0x48 | (dst->reg >> 3));
+        byte(a, 0xb8 + (dst->reg & 7));
+        bytes(a, src->value, 8);
+        return 1;
+    }
+    if (dst->kind == ARG_REG && src->kind != ARG_IMM) {
+        int w = -1;
+        if (strcmp(m, "movslq") == 0)      { op[0] = 0x63; w = 1; }
+        else if (strcmp(m, "leaq") == 0)   { op[0] = (char)0x8d; w = 1; }
+        else if (strcmp(m, "movsbq") == 0) { op[0] = 0x0f; op[1] = (char)0xbe; w = 1; }
+        else if (strcmp(m, "movzbq") == 0) { op[0] = 0x0f; op[1] = (char)0xb6; w = 1; }
+        else if (strcmp(m, "movzbl") == 0) { op[0] = 0x0f; op[1] = (char)0xb6; w = 0; }
+        if (w >= 0) {
+            encode(a, 0, w, op, dst->reg, src, 0, 0);
+            return 1;
+        }
+    }
+
+    if (!size)
+        return 0;
+    char base[8];
+    if (len - 1 >= sizeof(base))
+        return 0;
+    memcpy(base, m, len - 1);
+    base[len - 1] = '\0';
+    int w = size == 8;
+    int forceRex = (src->kind == ARG_REG && src->needsRex) || (dst->kind == ARG_REG && dst->needsRex);
+
+    // Arithmetic, logic and comparison
+    for (size_t k = 0; k < sizeof(aluOps) / sizeof(aluOps[0]); k++) {
+        if (strcmp(base, aluOps[k].name) != 0)
+            continue;
+        int digit = aluOps[k].digit;
+        if (src->kind == ARG_IMM) {
+            int immBytes = size == 1 || fitsByte(src) ? 1 : 4;
+            op[0] = (char)(size == 1 ? 0x80 : immBytes == 1 ? 0x83 : 0x81);
+            encode(a, 0, w, op, digit, dst, immBytes, forceRex);
+            immediate(a, src, immBytes);
+        } else if (src->kind == ARG_REG) {
+            op[0] = (char)(digit * 8 + (size == 1 ? 0 : 1));
+            encode(a, 0, w, op, src->reg, dst, 0, forceRex);
+        } else if (dst->kind == ARG_REG) {
+            op[0] = (char)(digit * 8 + (size == 1 ? 2 : 3));
+            encode(a, 0, w, op, dst->reg, src, 0, forceRex);
+        } else {
+            return 0;
+        }
+        return 1;
+    }
+    if (strcmp(base, "test") == 0) {
+        if (src->kind == ARG_IMM) {
+            op[0] = (char)(size == 1 ? 0xf6 : 0xf7);
+            encode(a, 0, w, op, 0, dst, size == 1 ? 1 : 4, forceRex);
+            immediate(a, src, size == 1 ? 1 : 4);
+        } else if (src->kind == ARG_REG) {
+            op[0] = (char)(size == 1 ? 0x84 : 0x85);
+            encode(a, 0, w, op, src->reg, dst, 0, forceRex);
+        } else {
+            return 0;
+        }
+        return 1;
+    }
+    if (strcmp(base, "mov") == 0) {
+        if (src->kind == ARG_IMM && dst->kind == ARG_REG && size == 4) {
+            if (dst->reg >= 8)
+                byte(a, 0x41);
+            byte(a, 0xb8 + (dst->reg & 7));
+            immediate(a, src, 4);
+        } else if (src->kind == ARG_IMM) {
+            op[0] = (char)(size == 1 ? 0xc6 : 0xc7);
+            encode(a, 0, w, op, 0, dst, size == 1 ? 1 : 4, forceRex);
+            immediate(a, src, size == 1 ? 1 : 4);
+        } else if (src->kind == ARG_REG) {
+            op[0] = (char)(size == 1 ? 0x88 : 0x89);
+            encode(a, 0, w, op, src->reg, dst, 0, forceRex);
+        } else if (dst->kind == ARG_REG) {
+            op[0] = (char)(size == 1 ? 0x8a : 0x8b);
+            encode(a, 0, w, op, dst->reg, src, 0, forceRex);
+        } else {
+            return 0;
+        }
+        return 1;
+    }
+    if (strcmp(base, "imul") == 0 && dst->kind == ARG_REG) {
+        if (src->kind == ARG_IMM) {
+            op[0] = (char)(fitsByte(src) ? 0x6b : 0x69);
+            encode(a, 0, w, op, dst->reg, dst, fitsByte(src) ? 1 : 4, 0);
+            immediate(a, src, fitsByte(src) ? 1 : 4);
+        } else {
+            op[0] = 0x0f;
+            op[1] = (char)0xaf;
+            encode(a, 0, w, op, dst->reg, src, 0, 0);
+        }
+        return 1;
+    }
+    if ((strcmp(base, "shl") == 0 || strcmp(base, "sar") == 0) &&
+        src->kind == ARG_REG && src->reg == 1 && src->size == 1) {
+        op[0] = (char)0xd3;
+        encode(a, 0, w, op, base[1] == 'h' ? 4 : 7, dst, 0, 0);
+        return 1;
+    }
+    return 0;
+}
+
+// ---- Directives ----
+
+static void directive(Assembler *a, const char *line) {
+    const char *arg = line + strcspn(line, " ");
+    while (*arg == ' ')
+        arg++;
+    if (strncmp(line, ".text", 5) == 0) {
+        a->section = SECTION_TEXT;
+    } else if (strncmp(line, ".section", 8) == 0) {
+        a->section = strncmp(arg, ".text", 5) == 0 ? SECTION_TEXT : SECTION_DATA;
+    } else if (strncmp(line, ".bss", 4) == 0 || strncmp(line, ".data", 5) == 0) {
+        a->section = SECTION_DATA;
+    } else if (strncmp(line, ".zero", 5) == 0) {
+        long n = atol(arg);
+        if (a->section == SECTION_TEXT)
+            bytes(a, 0, (int)n);
+        else
+            a->dataSize += n;
+    } else if (strncmp(line, ".align", 6) == 0) {
+        long n = atol(arg);
+        while (n > 0 && here(a) % n)
+            a->section == SECTION_TEXT ? byte(a, 0x90) : (void)a->dataSize++;
+    } else if (strncmp(line, ".byte", 5) == 0) {
+        for (const char *s = arg; *s; ) {
+            char *end;
+            dataByte(a, (int)strtol(s, &end, 10));
+            s = *end == ',' ? end + 1 : end;
+            if (end == s && *s)
+                break;
+        }
+    } else if (strncmp(line, ".string", 7) == 0 && *arg == '"') {
+        for (const char *s = arg + 1; *s && *s != '"'; s++) {
+            int c = (unsigned char)*s;
+            if (c == '\\' && s[1]) {
+                s++;
+                c = *s == 'n' ? '\n' : *s == 't' ? '\t' : (unsigned char)*s;
+            }
+            dataByte(a, c);
+        }
+        dataByte(a, 0);
+    } else if (strncmp(line, ".globl", 6) != 0) {
+        invalid(a, line);
+    }
+}
+
+// One line from x86.c
+static void assembleLine(void *context, const char *text) {
+    Assembler *a = (Assembler*)context;
+    while (*text == ' ')
+        text++;
+    size_t len = strlen(text);
+    if (len == 0 || a->failed)
+        return;
+    if (text[len - 1] == ':') {
+        defineLabel(a, text, len - 1);
+        return;
+    }
+    if (text[0] == '.') {
+        directive(a, text);
+        return;
+    }
+
+    // Mnemonic, then operands separated by ", "
+    char line[256];
+    if (len >= sizeof(line)) {
+        invalid(a, text);
+        return;
+    }
+    memcpy(line, text, len + 1);
+    if (strcmp(line, "rep stosq") == 0) {
+        byte(a, 0xf3);
+        byte(a, 0x48);
+        byte(a, 0xab);
+        return;
+    }
+    char *s = line + strcspn(line, " ");
+    Arg args[3];
+    int n = 0;
+    if (*s) {
+        *s++ = '\0';
+        while (*s && n < 3) {
+            char *comma = strstr(s, ", ");
+            if (comma)
+                *comma = '\0';
+            if (!parseArg(s, &args[n++])) {
+                invalid(a, text);
+                return;
+            }
+            s = comma ? comma + 2 : s + strlen(s);
+        }
+    }
+    if (!instruction(a, line, args, n))
+        invalid(a, text);
+}
+
+// ---- Loading ----
+
+static void* labelAddress(const JIT *jit, int section, size_t offset) {
+    return (section == SECTION_TEXT ? jit->code : jit->data) + offset;
+}
+
+static void* symbolAddress(const JIT *jit, const char *name) {
+    Label *l = findLabel(jit->labels, jit->labelCap, intern(name));
+    return l && l->name ? labelAddress(jit, l->section, l->offset) : NULL;
+}
+
+static void freeAssembler(Assembler *a) {
+    free(a->code);
+    free(a->data);
+    free(a->labels);
+    free(a->fixups);
+    for (int n = 0; n < 10; n++)
+        free(a->pending[n]);
+}
+
+// Map code and data, patch the references and make the code executable
+static int load(Assembler *a, JIT *jit) {
+#if defined(__x86_64__) && defined(MAP_32BIT)
+    jit->codeSize = a->codeLen ? a->codeLen : 1;
+    jit->dataSize = a->dataSize ? a->dataSize : 1;
+    jit->data = (unsigned char*)mmap(NULL, jit->dataSize, PROT_READ | PROT_WRITE,
+                                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT | MAP_NORESERVE, -1, 0);
+    jit->code = (unsigned char*)mmap(NULL, jit->codeSize, PROT_READ | PROT_WRITE,
+                                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+    if (jit->data == MAP_FAILED || jit->code == MAP_FAILED) {
+        perror("mmap");
+        return 0;
+    }
+    memcpy(jit->data, a->data, a->dataLen);
+    memcpy(jit->code, a->code, a->codeLen);
+
+    for (int k = 0; k < a->fixupCount; k++) {
+        Fixup *f = &a->fixups[k];
+        if (f->name) {
+            Label *l = findLabel(a->labels, a->labelCap, f->name);
+            if (!l || !l->name) {
+                fprintf(stderr, "Error: the JIT found no label %s\n", f->name);
+                return 0;
+            }
+            f->section = l->section;
+            f->offset = l->offset;
+        } else if (f->section < 0) {
+            fprintf(stderr, "Error: the JIT found a local label without its definition\n");
+            return 0;
+        }
+        long long target = (long long)(intptr_t)labelAddress(jit, f->section, f->offset) + f->addend;
+        long long value = f->end ? target - (long long)(intptr_t)(jit->code + f->end) : target;
+        if (value < INT32_MIN || value > INT32_MAX) {
+            fprintf(stderr, "Error: the JIT cannot reach %s\n", f->name ? f->name : "a local label");
+            return 0;
+        }
+        int32_t v = (int32_t)value;
+        memcpy(jit->code + f->at, &v, 4);
+    }
+    if (mprotect(jit->code, jit->codeSize, PROT_READ | PROT_EXEC) != 0) {
+        perror("mprotect");
+        return 0;
+    }
+    return 1;
+#else
+    (void)a;
+    (void)jit;
+    fprintf(stderr, "Error: the JIT needs x86-64 Linux\n");
+    return 0;
+#endif
+}
+
+JIT* jitCompile(int stats) {
+    Assembler a;
+    memset(&a, 0, sizeof(a));
+    AsmSink sink = { assembleLine, &a, jitFail };
+    JIT *jit = (JIT*)calloc(1, sizeof(JIT));
+    int ok = lowerToSink(&sink, stats) == 0 && !a.failed && load(&a, jit);
+    jit->labels = a.labels;
+    jit->labelCap = a.labelCap;
+    a.labels = NULL;
+    freeAssembler(&a);
+    if (!ok) {
+        jitFree(jit);
+        return NULL;
+    }
+    return jit;
+}
+
+void* jitFunction(JIT *jit, const char *name) {
+    char entry[256];
+    snprintf(entry, sizeof(entry), "mc_%s_entry", name);
+    return symbolAddress(jit, entry);
+}
+
+void* jitGlobal(JIT *jit, const char *name) {
+    SymbolEntry *sym = lookupInCurrentScope(globalTable, name);
+    unsigned char *globals = (unsigned char*)symbolAddress(jit, "__mc_globals");
+    if (!sym || sym->nestedTable || !globals)
+        return NULL;
+    return globals + sym->offset;
+}
+
+int jitRun(JIT *jit, const char *entry, VMValue *result) {
+    SymbolEntry *func = lookupInCurrentScope(globalTable, entry);
+    if (!func || !func->nestedTable) {
+        fprintf(stderr, "Error: no function %s to run\n", entry);
+        return -1;
+    }
+    void *code = jitFunction(jit, entry);
+    if (!code) {
+        fprintf(stderr, "Error: %s is declared but never defined\n", entry);
+        return -1;
+    }
+    SymbolEntry *retVal = lookupInCurrentScope(func->nestedTable, "retVal");
+    Type type = retVal ? retVal->type : INT_T;
+
+    // Globals start out zero, as in the VM
+    memset(symbolAddress(jit, "__mc_globals"), 0, globalTable->frameSize);
+    jmp_buf failure;
+    failJump = &failure;
+    failDepth = (int*)symbolAddress(jit, "__mc_depth");
+    if (setjmp(failure)) {
+        failJump = NULL;
+        return -1;
+    }
+    int (*init)(void) = (int (*)(void))symbolAddress(jit, "__mc_init_entry");
+    int halted = init();
+    result->type = type;
+    result->ival = 0;
+    if (!halted && type == FLOAT_T)
+        result->fval = ((double (*)(void))code)();
+    else if (!halted)
+        result->ival = ((long long (*)(void))code)();
+    failJump = NULL;
+    return 0;
+}
+
+void jitFree(JIT *jit) {
+    if (!jit)
+        return;
+    if (jit->code && jit->code != MAP_FAILED)
+        munmap(jit->code, jit->codeSize);
+    if (jit->data && jit->data != MAP_FAILED)
+        munmap(jit->data, jit->dataSize);
+    free(jit->labels);
+    free(jit);
+}
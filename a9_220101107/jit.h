@@ -0,0 +1,34 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "vm.h"
+
+// In-process compilation of the quads to x86-64 machine code. The program
+// is lowered as for -S (x86.c), and each line is assembled straight into
+// memory instead of going through a file and gcc. Code and data are mapped
+// in the low 2 GB, as pointers are 4 bytes.
+//
+// Every defined function gets a System V entry point taking its
+// parameters as C arguments, so it can be called through a plain function
+// pointer once the global code has run (jitRun() runs it).
+
+typedef struct JIT JIT;
+
+// Compile the current quads; returns NULL after reporting an error
+JIT* jitCompile(int stats);
+
+// Entry point of a microC function, NULL if it is not defined; cast it to
+// the function's C type, with double for float
+void* jitFunction(JIT *jit, const char *name);
+
+// Address of a global variable, NULL if there is none
+void* jitGlobal(JIT *jit, const char *name);
+
+// Run the global initialisers, then the function named entry, as vmRun()
+// does. Returns 0 and the function's return value in result, or -1 after
+// reporting a run time error.
+int jitRun(JIT *jit, const char *entry, VMValue *result);
+
+void jitFree(JIT *jit);
+
+#endif
@@ -0,0 +1,160 @@
+#include "opt.h"
+
+// Loop invariant code motion. A quad is hoisted out of its innermost loop
+// into a preheader placed just before the loop header when it cannot trap,
+// reads only constants and variables the loop does not change (or that
+// quads hoisted before it compute), and assigns a tracked variable that has
+// no other assignment and whose every read it dominates. Hoisting such a
+// quad cannot change what any read sees, even when the loop would not have
+// executed it.
+//
+// The quads hoisted out of a loop are inserted, in dominator order, in
+// front of the header's first quad as its preheader: jumps that enter the
+// loop from outside now land on them, while back edges and continues keep
+// going to the header. Every exit, break or otherwise, is an edge of the
+// CFG and needs no care.
+
+typedef struct Hoisting {
+    int *quads;             // Hoisted quads, grouped by loop in dominator order
+    int *start, *count;     // Group of each loop
+    int total;
+} Hoisting;
+
+// Pure operators that cannot fail at run time
+static int isHoistable(const Quad *q) {
+    switch (q->op) {
+        case OP_DIV:
+        case OP_MOD:
+            return !mayTrap(q);
+        case OP_ASSIGN: case OP_ADD: case OP_SUB: case OP_MUL:
+        case OP_BITAND: case OP_BITOR: case OP_BITXOR: case OP_SHL: case OP_SHR:
+        case OP_LT: case OP_GT: case OP_LE: case OP_GE: case OP_EQ: case OP_NE:
+        case OP_LOGAND: case OP_LOGOR: case OP_UMINUS: case OP_NOT:
+            return 1;
+        default:
+            return q->op >= OP_INT2REAL && q->op <= OP_INT2BOOL;
+    }
+}
+
+// Tracked variables with a single assignment that dominates all their reads
+static void findSingleDefs(CFG *cfg, int count, int *defQuad, char *single) {
+    int *defs = (int*)calloc(varSlots(count), sizeof(int));
+    for (int i = cfg->begin + 1; i < cfg->end; i++) {
+        Quad *q = quadAt(i);
+        if (definesResult(q->op) && isVariable(q->result) && q->result.sym->id >= 0) {
+            defs[q->result.sym->id]++;
+            defQuad[q->result.sym->id] = i;
+        }
+    }
+    for (int v = 0; v < count; v++)
+        single[v] = defs[v] == 1 && cfg->blocks[blockOfQuad(cfg, defQuad[v])].rpo >= 0;
+
+    for (int i = cfg->begin + 1; i < cfg->end; i++) {
+        Quad *q = quadAt(i);
+        for (int slot = 1; slot <= 3; slot++) {
+            Operand *o = operandOf(q, slot);
+            if (!readsOperand(q, slot) || !isVariable(*o) || o->sym->id < 0 || !single[o->sym->id])
+                continue;
+            int d = defQuad[o->sym->id];
+            int defBlock = blockOfQuad(cfg, d), useBlock = blockOfQuad(cfg, i);
+            if (cfg->blocks[useBlock].rpo < 0 ||
+                (defBlock == useBlock ? i <= d : !dominates(cfg, defBlock, useBlock)))
+                single[o->sym->id] = 0;
+        }
+    }
+    free(defs);
+}
+
+static int isInvariant(Operand o, int loop, const int *defLoop, const int *hoistedTo) {
+    if (o.kind == OPD_NONE || o.kind == OPD_INT || o.kind == OPD_FLOAT)
+        return 1;
+    if (!isVariable(o) || o.sym->id < 0)
+        return 0;
+    return defLoop[o.sym->id] != loop || hoistedTo[o.sym->id] == loop;
+}
+
+// Choose the quads to hoist out of every loop
+static void chooseHoists(CFG *cfg, int count, Hoisting *h) {
+    size_t n = varSlots(count);
+    int *defQuad = (int*)malloc(n * sizeof(int));
+    char *single = (char*)malloc(n);
+    int *defLoop = (int*)malloc(n * sizeof(int));    // Last loop marked as assigning it
+    int *hoistedTo = (int*)malloc(n * sizeof(int));
+    for (int v = 0; v < count; v++)
+        defLoop[v] = hoistedTo[v] = -1;
+    findSingleDefs(cfg, count, defQuad, single);
+
+    int *start;
+    int *blocks = loopBlocks(cfg, &start);
+    for (int l = 0; l < cfg->loopCount; l++) {
+        h->start[l] = h->total;
+        h->count[l] = 0;
+        if (fallsIntoHeader(cfg, l))
+            continue;
+        for (int k = start[l]; k < start[l + 1]; k++) {
+            BasicBlock *block = &cfg->blocks[blocks[k]];
+            for (int i = block->first; i <= block->last; i++) {
+                Quad *q = quadAt(i);
+                if (definesResult(q->op) && isVariable(q->result) && q->result.sym->id >= 0)
+                    defLoop[q->result.sym->id] = l;
+            }
+        }
+        for (int k = start[l]; k < start[l + 1]; k++) {
+            BasicBlock *block = &cfg->blocks[blocks[k]];
+            if (block->loop != l)
+                continue;
+            for (int i = block->first; i <= block->last; i++) {
+                Quad *q = quadAt(i);
+                if (!isHoistable(q) || !isVariable(q->result) || q->result.sym->id < 0 ||
+                    !single[q->result.sym->id] ||
+                    !isInvariant(q->arg1, l, defLoop, hoistedTo) ||
+                    !isInvariant(q->arg2, l, defLoop, hoistedTo))
+                    continue;
+                hoistedTo[q->result.sym->id] = l;
+                h->quads[h->total++] = i;
+                h->count[l]++;
+            }
+        }
+    }
+
+    free(blocks);
+    free(start);
+    free(defQuad);
+    free(single);
+    free(defLoop);
+    free(hoistedTo);
+}
+
+int hoistInvariants(CFG *cfg) {
+    if (cfg->loopCount == 0)
+        return 0;
+    int shared;
+    int count = numberVariables(cfg, &shared);
+    Hoisting h;
+    h.quads = (int*)malloc((cfg->end - cfg->begin) * sizeof(int));
+    h.start = (int*)malloc(cfg->loopCount * sizeof(int));
+    h.count = (int*)malloc(cfg->loopCount * sizeof(int));
+    h.total = 0;
+    chooseHoists(cfg, count, &h);
+    resetVariables(cfg);
+
+    // Each hoisted quad leaves a nop behind, so the rewrite has room
+    Insertion *insertions = (Insertion*)malloc((h.total ? h.total : 1) * sizeof(Insertion));
+    for (int l = 0; l < cfg->loopCount; l++) {
+        for (int k = h.start[l]; k < h.start[l] + h.count[l]; k++) {
+            Quad *q = quadAt(h.quads[k]);
+            insertions[k].before = cfg->blocks[cfg->loops[l].header].first;
+            insertions[k].loop = l;
+            insertions[k].quad = *q;
+            deleteQuad(q);
+        }
+    }
+    if (h.total)
+        rewriteFunction(cfg, insertions, h.total);
+    free(insertions);
+
+    free(h.quads);
+    free(h.start);
+    free(h.count);
+    return h.total ? OPT_CHANGED | OPT_CFG_CHANGED : 0;
+}
@@ -0,0 +1,148 @@
+#include <limits.h>
+#include "opt.h"
+
+// Live intervals over the quads of one function. Variables referenced in
+// a single block are live from their first to their last reference, unless
+// they are read before being assigned there, which is only understood in
+// an entry block no loop returns to; the others get block-level liveness,
+// and their intervals stretch over the boundaries of every block they are
+// live at.
+
+// Beyond this many variable-block pairs, variables live in more than one
+// block are left untracked
+#define LIVENESS_MAX_GLOBAL_CELLS (1 << 26)
+
+typedef struct Ranges {
+    int shared, words;
+    uint64_t *use, *def, *liveOut;
+    LiveIntervals *live;
+} Ranges;
+
+static void extend(LiveIntervals *live, int id, int at) {
+    if (at < live->start[id])
+        live->start[id] = at;
+    if (at > live->end[id])
+        live->end[id] = at;
+}
+
+// Quads each variable is referenced at, and block-local use and def sets
+static void summarize(CFG *cfg, Ranges *r, int count) {
+    // 1 + block when read first in the block, -(1 + block) when assigned first
+    int *state = (int*)calloc(varSlots(count), sizeof(int));
+    for (int b = 0; b < cfg->blockCount; b++) {
+        BasicBlock *block = &cfg->blocks[b];
+        uint64_t *use = r->use ? r->use + (size_t)b * r->words : NULL;
+        uint64_t *def = r->def ? r->def + (size_t)b * r->words : NULL;
+        for (int i = block->first; i <= block->last; i++) {
+            Quad *q = quadAt(i);
+            for (int slot = 1; slot <= 3; slot++) {
+                Operand *o = operandOf(q, slot);
+                int id = isVariable(*o) ? o->sym->id : -1;
+                if (id < 0)
+                    continue;
+                extend(r->live, id, i);
+                if (!readsOperand(q, slot) || state[id] == b + 1 || state[id] == -(b + 1))
+                    continue;
+                state[id] = b + 1;
+                if (id < r->shared && use)
+                    setBit(use, id);
+                else if (b == 0 && cfg->blocks[0].loop < 0 && id >= r->shared)
+                    r->live->flags[id] |= LIVE_ON_ENTRY;
+                else
+                    r->live->flags[id] |= LIVE_UNTRACKED;
+            }
+            int id = definesResult(q->op) && isVariable(q->result) ? q->result.sym->id : -1;
+            if (id >= 0 && state[id] != b + 1 && state[id] != -(b + 1)) {
+                state[id] = -(b + 1);
+                if (id < r->shared && def)
+                    setBit(def, id);
+            }
+        }
+    }
+    free(state);
+}
+
+// Extend the intervals over the block boundaries each variable is live at
+static void liveRanges(CFG *cfg, Ranges *r) {
+    int w = r->words;
+    for (int changed = 1; changed; ) {
+        changed = 0;
+        for (int k = cfg->orderCount - 1; k >= 0; k--) {
+            int b = cfg->order[k];
+            BasicBlock *block = &cfg->blocks[b];
+            uint64_t *out = r->liveOut + (size_t)b * w;
+            for (int s = 0; s < block->succCount; s++) {
+                int succ = block->succ[s];
+                const uint64_t *use = r->use + (size_t)succ * w;
+                const uint64_t *def = r->def + (size_t)succ * w;
+                const uint64_t *succOut = r->liveOut + (size_t)succ * w;
+                for (int j = 0; j < w; j++) {
+                    uint64_t bits = out[j] | use[j] | (succOut[j] & ~def[j]);
+                    if (bits != out[j]) {
+                        out[j] = bits;
+                        changed = 1;
+                    }
+                }
+            }
+        }
+    }
+
+    for (int b = 0; b < cfg->blockCount; b++) {
+        BasicBlock *block = &cfg->blocks[b];
+        const uint64_t *use = r->use + (size_t)b * w;
+        const uint64_t *def = r->def + (size_t)b * w;
+        const uint64_t *out = r->liveOut + (size_t)b * w;
+        for (int j = 0; j < w; j++) {
+            uint64_t in = use[j] | (out[j] & ~def[j]);
+            for (uint64_t bits = in | out[j]; bits; bits &= bits - 1) {
+                int id = j * 64 + __builtin_ctzll(bits);
+                if ((in >> (id & 63)) & 1) {
+                    extend(r->live, id, block->first);
+                    if (b == 0)
+                        r->live->flags[id] |= LIVE_ON_ENTRY;
+                }
+                if ((out[j] >> (id & 63)) & 1)
+                    extend(r->live, id, block->last);
+            }
+        }
+    }
+}
+
+void liveIntervals(CFG *cfg, int count, int shared, LiveIntervals *live) {
+    size_t n = varSlots(count);
+    live->start = (int*)malloc(n * sizeof(int));
+    live->end = (int*)malloc(n * sizeof(int));
+    live->flags = (char*)calloc(n, 1);
+    for (int v = 0; v < count; v++) {
+        live->start[v] = INT_MAX;
+        live->end[v] = -1;
+    }
+
+    Ranges r;
+    r.shared = shared;
+    r.words = (shared + 63) / 64;
+    r.live = live;
+    r.use = r.def = r.liveOut = NULL;
+    if (shared > 0 && (long long)shared * cfg->blockCount <= LIVENESS_MAX_GLOBAL_CELLS) {
+        size_t bits = (size_t)r.words * cfg->blockCount;
+        r.use = (uint64_t*)calloc(bits, sizeof(uint64_t));
+        r.def = (uint64_t*)calloc(bits, sizeof(uint64_t));
+        r.liveOut = (uint64_t*)calloc(bits, sizeof(uint64_t));
+    }
+    summarize(cfg, &r, count);
+    if (r.use) {
+        liveRanges(cfg, &r);
+    } else {
+        for (int v = 0; v < shared; v++)
+            live->flags[v] |= LIVE_UNTRACKED;
+    }
+    free(r.use);
+    free(r.def);
+    free(r.liveOut);
+}
+
+void freeLiveIntervals(LiveIntervals *live) {
+    free(live->start);
+    free(live->end);
+    free(live->flags);
+}
@@ -0,0 +1,276 @@
+// Generator of synthetic microC programs for benchmarking the compiler.
+// Programs are deterministic for a given seed, parse with a9_220101107 and
+// terminate when run: loops have small constant trip counts, array indices
+// are loop counters, divisors are non-zero constants, and functions only
+// call functions defined before them.
+//
+//   make mcgen && ./mcgen -s 10M > big.mc
+//
+// Options:
+//   -s SIZE   approximate output size, with K, M or G suffix (default 1M)
+//   -f N      number of functions instead of a size
+//   -d N      maximum nesting depth of if/while/for (default 2)
+//   -e N      operators per expression (default 4)
+//   -l PCT    percentage of statements that are loops (default 20)
+//   -a PCT    percentage of operands and assignments using arrays (default 20)
+//   -n N      statements per function body (default 12)
+//   -r SEED   random seed (default 1)
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOCALS     6     // Scalar locals v0..v5 in every function
+#define PARAMS     3     // Parameters p0..p2
+#define ARRAY_SIZE 16    // Length of every local array; also the largest trip count
+
+typedef struct GenOptions {
+    long long size;
+    long functions;
+    int depth;
+    int exprOps;
+    int loopPercent;
+    int arrayPercent;
+    int statements;
+    unsigned long long seed;
+} GenOptions;
+
+static GenOptions opt = { 1 << 20, 0, 2, 4, 20, 20, 12, 1 };
+static unsigned long long rngState;
+static long long written;     // Bytes written so far
+static long currentFunction;  // Index of the function being generated
+static int loopDepth;         // Loop counters i0..i(loopDepth-1) are live
+static int callMade;          // One call per function keeps call chains short
+
+static unsigned next() {
+    // xorshift64*
+    rngState ^= rngState >> 12;
+    rngState ^= rngState << 25;
+    rngState ^= rngState >> 27;
+    return (unsigned)((rngState * 2685821657736338717ULL) >> 32);
+}
+
+static int chance(int percent) {
+    return (int)(next() % 100) < percent;
+}
+
+static void emit(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int n = vprintf(format, args);
+    va_end(args);
+    if (n > 0)
+        written += n;
+}
+
+static void indent(int level) {
+    for (int i = 0; i < level; i++)
+        emit("    ");
+}
+
+// An operand: a local, a parameter, a constant or an array element
+static void leaf() {
+    int r = next() % 100;
+    if (loopDepth > 0 && r < opt.arrayPercent)
+        emit("arr[i%d]", (int)(next() % loopDepth));
+    else if (r < 50)
+        emit("v%d", (int)(next() % LOCALS));
+    else if (r < 70)
+        emit("p%d", (int)(next() % PARAMS));
+    else if (loopDepth > 0 && r < 80)
+        emit("i%d", (int)(next() % loopDepth));
+    else
+        emit("%d", (int)(next() % 100));
+}
+
+// Arithmetic expression with ops operators
+static void expression(int ops) {
+    if (ops == 0) {
+        leaf();
+        return;
+    }
+    int left = next() % ops;
+    int op = next() % 5;
+    if (op == 3) {
+        // Division only by non-zero constants
+        emit("(");
+        expression(ops - 1);
+        emit(" / %d)", (int)(next() % 9) + 1);
+        return;
+    }
+    if (op == 4) {
+        emit("(");
+        expression(ops - 1);
+        emit(" %% %d)", (int)(next() % 9) + 2);
+        return;
+    }
+    static const char *ops3[] = { "+", "-", "*" };
+    emit("(");
+    expression(left);
+    emit(" %s ", ops3[op]);
+    expression(ops - 1 - left);
+    emit(")");
+}
+
+static void condition() {
+    static const char *relops[] = { "<", ">", "<=", ">=", "==", "!=" };
+    expression(opt.exprOps / 2);
+    emit(" %s ", relops[next() % 6]);
+    expression(opt.exprOps / 2);
+    if (chance(20)) {
+        emit(next() % 2 ? " && " : " || ");
+        leaf();
+        emit(" %s ", relops[next() % 6]);
+        leaf();
+    }
+}
+
+static void statement(int level, int depth);
+
+static void block(int level, int depth, int count) {
+    indent(level);
+    emit("begin\n");
+    for (int i = 0; i < count; i++)
+        statement(level + 1, depth);
+    indent(level);
+    emit("end\n");
+}
+
+static void assignment(int level) {
+    indent(level);
+    if (loopDepth > 0 && chance(opt.arrayPercent))
+        emit("arr[i%d] = ", (int)(next() % loopDepth));
+    else
+        emit("v%d = ", (int)(next() % LOCALS));
+    expression(opt.exprOps);
+    emit(";\n");
+}
+
+static void statement(int level, int depth) {
+    int r = next() % 100;
+    int nested = depth < opt.depth;
+
+    if (nested && r < opt.loopPercent) {
+        // Counted loop over the array; the counter is fresh at this depth
+        int i = loopDepth;
+        int trips = (int)(next() % ARRAY_SIZE) + 1;
+        indent(level);
+        if (next() % 2) {
+            emit("for (i%d = 0; i%d < %d; i%d = i%d + 1)\n", i, i, trips, i, i);
+            loopDepth++;
+            block(level, depth + 1, 2 + next() % 3);
+            loopDepth--;
+        } else {
+            emit("i%d = 0;\n", i);
+            indent(level);
+            emit("while (i%d < %d)\n", i, trips);
+            loopDepth++;
+            indent(level);
+            emit("begin\n");
+            int count = 1 + next() % 3;
+            for (int k = 0; k < count; k++)
+                statement(level + 1, depth + 1);
+            indent(level + 1);
+            emit("i%d = i%d + 1;\n", i, i);
+            indent(level);
+            emit("end\n");
+            loopDepth--;
+        }
+    } else if (nested && r < opt.loopPercent + 20) {
+        indent(level);
+        emit("if (");
+        condition();
+        emit(")\n");
+        block(level, depth + 1, 1 + next() % 3);
+        if (next() % 2) {
+            indent(level);
+            emit("else\n");
+            block(level, depth + 1, 1 + next() % 3);
+        }
+    } else if (currentFunction > 0 && !callMade && loopDepth == 0 && r < opt.loopPercent + 28) {
+        // Calls stay outside loops so running time stays linear in size
+        callMade = 1;
+        indent(level);
+        emit("v%d = f%ld(", (int)(next() % LOCALS), (long)(next() % currentFunction));
+        for (int k = 0; k < PARAMS; k++) {
+            if (k) emit(", ");
+            expression(1);
+        }
+        emit(");\n");
+    } else if (r < opt.loopPercent + 33) {
+        indent(level);
+        emit("fl = fl * 0.5 + ");
+        leaf();
+        emit(";\n");
+    } else {
+        assignment(level);
+    }
+}
+
+static void function(long index) {
+    currentFunction = index;
+    callMade = 0;
+    emit("int f%ld(int p0, int p1, int p2)\nbegin\n", index);
+    for (int i = 0; i < LOCALS; i++)
+        emit("    int v%d = %d;\n", i, (int)(next() % 10));
+    for (int i = 0; i < opt.depth; i++)
+        emit("    int i%d;\n", i);
+    emit("    int arr[%d];\n", ARRAY_SIZE);
+    emit("    float fl = 1.5;\n");
+    for (int i = 0; i < opt.statements; i++)
+        statement(1, 0);
+    emit("    return v0 + v1 + v2 + v3 + v4 + v5 + fl;\nend\n\n");
+}
+
+static long long parseSize(const char *s) {
+    char *end;
+    double n = strtod(s, &end);
+    switch (*end) {
+        case 'k': case 'K': n *= 1024; break;
+        case 'm': case 'M': n *= 1024 * 1024; break;
+        case 'g': case 'G': n *= 1024.0 * 1024 * 1024; break;
+        default: break;
+    }
+    return (long long)n;
+}
+
+int main(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i++) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (!value || argv[i][0] != '-' || strlen(argv[i]) != 2) {
+            fprintf(stderr, "Usage: %s [-s size] [-f functions] [-d depth] [-e ops] "
+                            "[-l loop%%] [-a array%%] [-n statements] [-r seed]\n", argv[0]);
+            return 1;
+        }
+        switch (argv[i][1]) {
+            case 's': opt.size = parseSize(value); break;
+            case 'f': opt.functions = atol(value); break;
+            case 'd': opt.depth = atoi(value); break;
+            case 'e': opt.exprOps = atoi(value); break;
+            case 'l': opt.loopPercent = atoi(value); break;
+            case 'a': opt.arrayPercent = atoi(value); break;
+            case 'n': opt.statements = atoi(value); break;
+            case 'r': opt.seed = strtoull(value, NULL, 10); break;
+            default:
+                fprintf(stderr, "Error: unknown option %s\n", argv[i]);
+                return 1;
+        }
+        i++;
+    }
+    rngState = opt.seed * 0x9E3779B97F4A7C15ULL + 1;
+
+    static char buffer[1 << 20];
+    setvbuf(stdout, buffer, _IOFBF, sizeof(buffer));
+
+    // Leave room for main, which calls the last few functions
+    long count = 0;
+    while (opt.functions ? count < opt.functions : written < opt.size - 512 || count == 0)
+        function(count++);
+
+    emit("int main()\nbegin\n    int s = 0;\n");
+    for (long i = count > 4 ? count - 4 : 0; i < count; i++)
+        emit("    s = s + f%ld(%ld, %ld, %ld);\n", i, i % 7, i % 5, i % 3);
+    emit("    return s;\nend\n");
+    return 0;
+}
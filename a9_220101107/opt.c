@@ -0,0 +1,321 @@
+#include "opt.h"
+
+static void noteBlock(Operand o, int block, int *firstBlock, char *shared) {
+    if (!isVariable(o) || o.sym->id < 0)
+        return;
+    int id = o.sym->id;
+    if (firstBlock[id] < 0)
+        firstBlock[id] = block;
+    else if (firstBlock[id] != block)
+        shared[id] = 1;
+}
+
+// Number the variables a pass can track through SymbolEntry.id: scalar
+// locals and temporaries of the function whose address is never taken, so
+// stores through pointers and calls cannot change them unseen. Those
+// referenced from more than one block come first; only they need dataflow
+// facts at block boundaries. Returns the number tracked, and that of the
+// shared ones in *sharedCount.
+int numberVariables(CFG *cfg, int *sharedCount) {
+    for (int i = cfg->begin + 1; i < cfg->end; i++) {
+        Quad *q = quadAt(i);
+        if (q->op == OP_ADDR && isVariable(q->arg1))
+            q->arg1.sym->id = -2;
+    }
+    int count = 0;
+    SymbolTable *table = cfg->function->nestedTable;
+    for (SymbolEntry *e = table ? table->entries : NULL; e; e = e->next) {
+        Type t = e->type;
+        if (e->id == -1 && (t == INT_T || t == CHAR_T || t == BOOL_T || t == FLOAT_T))
+            e->id = count++;
+    }
+
+    int *firstBlock = (int*)malloc(varSlots(count) * sizeof(int));
+    char *shared = (char*)calloc(varSlots(count), 1);
+    for (int v = 0; v < count; v++)
+        firstBlock[v] = -1;
+    for (int i = cfg->begin + 1; i < cfg->end; i++) {
+        Quad *q = quadAt(i);
+        int b = blockOfQuad(cfg, i);
+        noteBlock(q->arg1, b, firstBlock, shared);
+        noteBlock(q->arg2, b, firstBlock, shared);
+        noteBlock(q->result, b, firstBlock, shared);
+    }
+
+    // Stable partition of the numbers, shared variables first
+    int *renumber = firstBlock;
+    int next = 0;
+    for (int v = 0; v < count; v++)
+        if (shared[v])
+            renumber[v] = next++;
+    *sharedCount = next;
+    for (int v = 0; v < count; v++)
+        if (!shared[v])
+            renumber[v] = next++;
+    for (SymbolEntry *e = table ? table->entries : NULL; e; e = e->next)
+        if (e->id >= 0)
+            e->id = renumber[e->id];
+
+    free(firstBlock);
+    free(shared);
+    return count;
+}
+
+void resetVariables(CFG *cfg) {
+    for (int i = cfg->begin + 1; i < cfg->end; i++) {
+        Quad *q = quadAt(i);
+        if (q->op == OP_ADDR && isVariable(q->arg1))
+            q->arg1.sym->id = -1;
+    }
+    SymbolTable *table = cfg->function->nestedTable;
+    for (SymbolEntry *e = table ? table->entries : NULL; e; e = e->next)
+        e->id = -1;
+}
+
+// Whether a preheader placed before the loop header could be entered by
+// falling through from a block inside the loop
+int fallsIntoHeader(const CFG *cfg, int loop) {
+    int first = cfg->blocks[cfg->loops[loop].header].first;
+    for (int i = first - 1; i > cfg->begin; i--) {
+        Quad *q = quadAt(i);
+        if (q->op == OP_NOP)
+            continue;
+        return q->op != OP_GOTO && q->op != OP_RETURN && blockInLoop(cfg, blockOfQuad(cfg, i), loop);
+    }
+    return 0;
+}
+
+// Blocks of each loop, nested loops included, in dominator tree preorder:
+// those of loop l are blocks[start[l]] up to blocks[start[l + 1]]
+int* loopBlocks(const CFG *cfg, int **start) {
+    // Preorder and postorder numbers share one counter
+    int slots = 2 * cfg->blockCount;
+    int *byDom = (int*)malloc((slots ? slots : 1) * sizeof(int));
+    for (int p = 0; p < slots; p++)
+        byDom[p] = -1;
+    for (int b = 0; b < cfg->blockCount; b++)
+        if (cfg->blocks[b].rpo >= 0)
+            byDom[cfg->blocks[b].domPre] = b;
+
+    *start = (int*)malloc((cfg->loopCount + 1) * sizeof(int));
+    int total = 0;
+    for (int l = 0; l < cfg->loopCount; l++) {
+        (*start)[l] = total;
+        total += cfg->loops[l].blockCount;
+    }
+    (*start)[cfg->loopCount] = total;
+    int *fill = (int*)malloc((cfg->loopCount + 1) * sizeof(int));
+    memcpy(fill, *start, (cfg->loopCount + 1) * sizeof(int));
+    int *blocks = (int*)malloc((total ? total : 1) * sizeof(int));
+    for (int p = 0; p < slots; p++) {
+        int b = byDom[p];
+        if (b < 0)
+            continue;
+        for (int l = cfg->blocks[b].loop; l >= 0; l = cfg->loops[l].parent)
+            blocks[fill[l]++] = b;
+    }
+    free(fill);
+    free(byDom);
+    return blocks;
+}
+
+// Lay the function out again with the insertions in place; before may be
+// anything from begin + 1 to end. The room comes
+// from dropping its nops, and what is left over is padded with nops before
+// func_end, so no other function moves. Returns 0 and changes nothing when
+// there are not enough nops.
+int rewriteFunction(CFG *cfg, const Insertion *insertions, int count) {
+    int begin = cfg->begin, end = cfg->end;
+    int n = end - begin - 1;
+    int kept = 0;
+    for (int i = begin + 1; i < end; i++)
+        if (quadAt(i)->op != OP_NOP)
+            kept++;
+    if (kept + count > n)
+        return 0;
+
+    // Insertions by position: those after the previous quad come first,
+    // then those of a preheader, each in the order given
+    int *first = (int*)calloc(n + 2, sizeof(int));
+    int *order = (int*)malloc((count ? count : 1) * sizeof(int));
+    for (int j = 0; j < count; j++)
+        first[insertions[j].before - begin]++;
+    for (int p = 0; p <= n; p++)
+        first[p + 1] += first[p];
+    int *fill = (int*)malloc((n + 1) * sizeof(int));
+    memcpy(fill, first, (n + 1) * sizeof(int));
+    for (int pass = 0; pass < 2; pass++)
+        for (int j = 0; j < count; j++)
+            if ((insertions[j].loop >= 0) == pass)
+                order[fill[insertions[j].before - begin - 1]++] = j;
+
+    Quad *out = (Quad*)malloc(n * sizeof(Quad));
+    int *source = (int*)malloc(n * sizeof(int));    // Old index, -1 if inserted
+    int *self = (int*)malloc((n + 1) * sizeof(int));    // Where jumps to p land
+    int *entry = (int*)malloc((n + 1) * sizeof(int));   // Where jumps from outside the loop land
+    int k = 0;
+    for (int p = 0; p <= n; p++) {
+        int j = first[p];
+        for (; j < first[p + 1] && insertions[order[j]].loop < 0; j++) {
+            source[k] = -1;
+            out[k++] = insertions[order[j]].quad;
+        }
+        entry[p] = j < first[p + 1] ? k : -1;
+        for (; j < first[p + 1]; j++) {
+            source[k] = -1;
+            out[k++] = insertions[order[j]].quad;
+        }
+        self[p] = k;
+        Quad *q = quadAt(begin + 1 + p);
+        if (p < n && q->op != OP_NOP) {
+            source[k] = begin + 1 + p;
+            out[k++] = *q;
+        }
+    }
+    for (; k < n; k++) {
+        source[k] = -1;
+        out[k].op = OP_NOP;
+        out[k].arg1 = out[k].arg2 = out[k].result = noOperand();
+    }
+
+    for (k = 0; k < n; k++) {
+        Quad *q = &out[k];
+        int t = q->result.target;
+        if (source[k] >= 0 && q->result.kind == OPD_TARGET && t > begin && t < end) {
+            int p = t - begin - 1;
+            int header = entry[p] >= 0 ? insertions[order[first[p + 1] - 1]].loop : -1;
+            if (header >= 0 && !blockInLoop(cfg, blockOfQuad(cfg, source[k]), header))
+                q->result.target = begin + 1 + entry[p];
+            else
+                q->result.target = begin + 1 + self[p];
+        }
+        *quadAt(begin + 1 + k) = *q;
+    }
+
+    free(first);
+    free(order);
+    free(fill);
+    free(out);
+    free(source);
+    free(self);
+    free(entry);
+    return 1;
+}
+
+// Rounds of the pass pipeline per function; a pass that changes the CFG,
+// such as folding a branch, can expose more work for the next round
+#define OPT_MAX_ROUNDS 4
+
+typedef int (*Pass)(CFG *cfg);
+
+static const Pass passes[] = {
+    propagateConstants,
+    eliminateCommonSubexpressions,
+    propagateCopies,
+    eliminateDeadCode,
+    hoistInvariants,
+    reduceStrength,
+    optimizeJumps,
+};
+
+static void optimizeFunction(int begin) {
+    for (int round = 0; round < OPT_MAX_ROUNDS; round++) {
+        CFG *cfg = buildCFG(begin);
+        if (!cfg)
+            return;
+        int again = 0;
+        for (size_t p = 0; p < sizeof(passes) / sizeof(passes[0]); p++) {
+            if (passes[p](cfg) & OPT_CFG_CHANGED) {
+                freeCFG(cfg);
+                cfg = buildCFG(begin);
+                again = 1;
+            }
+        }
+        freeCFG(cfg);
+        if (!again)
+            break;
+    }
+}
+
+static int isUsedOrNamed(const SymbolEntry *entry) {
+    return !entry->isTemp || entry->id == 0;
+}
+
+// Drop the temporaries no quad refers to any more, shrinking the frames
+static void removeUnusedTemps() {
+    for (int i = 0; i < quadIndex; i++) {
+        Quad *q = quadAt(i);
+        if (q->arg1.kind == OPD_TEMP) q->arg1.sym->id = 0;
+        if (q->arg2.kind == OPD_TEMP) q->arg2.sym->id = 0;
+        if (q->result.kind == OPD_TEMP) q->result.sym->id = 0;
+    }
+    removeSymbols(globalTable, isUsedOrNamed);
+    for (SymbolEntry *e = globalTable->entries; e; e = e->next) {
+        e->id = -1;
+        if (!e->nestedTable)
+            continue;
+        removeSymbols(e->nestedTable, isUsedOrNamed);
+        for (SymbolEntry *local = e->nestedTable->entries; local; local = local->next)
+            local->id = -1;
+    }
+}
+
+// Pack the frame of every function
+static void coalesceFrames() {
+    for (int i = 0; i < quadIndex; i++) {
+        if (quadAt(i)->op != OP_FUNC_BEGIN)
+            continue;
+        CFG *cfg = buildCFG(i);
+        if (!cfg)
+            continue;
+        coalesceTemps(cfg);
+        i = cfg->end;
+        freeCFG(cfg);
+    }
+}
+
+// Optimize every function, then drop the quads and temporaries the
+// passes deleted and share frame slots between the temporaries left
+void optimizeQuads() {
+    if (inlineLimit > 0)
+        inlineCalls(inlineLimit);
+    for (int i = 0; i < quadIndex; i++) {
+        if (quadAt(i)->op != OP_FUNC_BEGIN)
+            continue;
+        int end = functionEnd(i);
+        if (end < 0)
+            continue;
+        optimizeFunction(i);
+        i = end;
+    }
+    compactQuads();
+    removeUnusedTemps();
+    coalesceFrames();
+}
+
+// Squeeze nops out of the quad store. Jump targets are renumbered, and a
+// target that was a nop moves to the next quad that survives.
+void compactQuads() {
+    int *newIndex = (int*)malloc((quadIndex + 1) * sizeof(int));
+    int kept = 0;
+    for (int i = 0; i < quadIndex; i++) {
+        newIndex[i] = kept;
+        if (quadAt(i)->op != OP_NOP)
+            kept++;
+    }
+    newIndex[quadIndex] = kept;
+
+    if (kept < quadIndex) {
+        int j = 0;
+        for (int i = 0; i < quadIndex; i++) {
+            Quad *q = quadAt(i);
+            if (q->op == OP_NOP)
+                continue;
+            if (q->result.kind == OPD_TARGET && q->result.target >= 0 && q->result.target <= quadIndex)
+                q->result.target = newIndex[q->result.target];
+            *quadAt(j++) = *q;
+        }
+        quadIndex = kept;
+    }
+    free(newIndex);
+}
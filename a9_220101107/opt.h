@@ -0,0 +1,129 @@
+#ifndef OPT_H
+#define OPT_H
+
+#include <stdint.h>
+#include "cfg.h"
+
+// Machine independent optimizations over the quads of each function.
+// Passes work on one function's CFG and delete quads without moving the
+// others: a deleted quad becomes a nop, and compactQuads() squeezes the
+// nops out afterwards, renumbering jump targets. Passes that add quads
+// use rewriteFunction(), which lays the function out again within its
+// own range of quads.
+
+void optimizeQuads();
+void compactQuads();
+
+// Calls of functions that call nothing and have at most inlineLimit quads
+// are inlined before the other passes run (inline.c); 0 turns it off.
+// Returns the number of calls inlined.
+#define INLINE_LIMIT 32
+extern int inlineLimit;
+int inlineCalls(int limit);
+
+// Let temporaries whose lifetimes do not overlap share frame slots
+void coalesceTemps(CFG *cfg);
+
+// What a pass did, as returned by the passes; the CFG must be rebuilt
+// before the next pass when edges changed
+#define OPT_CHANGED     1
+#define OPT_CFG_CHANGED 2
+
+int propagateConstants(CFG *cfg);
+int eliminateCommonSubexpressions(CFG *cfg);
+int propagateCopies(CFG *cfg);
+int eliminateDeadCode(CFG *cfg);
+int hoistInvariants(CFG *cfg);
+int reduceStrength(CFG *cfg);
+int optimizeJumps(CFG *cfg);
+
+// A quad for rewriteFunction() to insert in front of the quad at index
+// before. Jumps to that quad from outside the loop land on the inserted
+// quad and those from inside go past it, which makes it part of the loop's
+// preheader when before starts the header. With loop -1 the quad belongs
+// after the one preceding before, and every jump goes past it. Inserted
+// quads must not jump.
+typedef struct Insertion {
+    int before;
+    int loop;
+    Quad quad;
+} Insertion;
+
+int rewriteFunction(CFG *cfg, const Insertion *insertions, int count);
+int fallsIntoHeader(const CFG *cfg, int loop);
+int* loopBlocks(const CFG *cfg, int **start);
+
+int numberVariables(CFG *cfg, int *sharedCount);
+void resetVariables(CFG *cfg);
+
+// Quads each variable numbered by numberVariables() is live at, as an
+// interval from the first to the last; end is -1 for variables never
+// referenced. Flags mark the variables whose interval needs care:
+#define LIVE_ON_ENTRY  1    // Read before any assignment, so the value on entry matters
+#define LIVE_UNTRACKED 2    // Liveness was not tracked across blocks; the interval is unsafe
+
+typedef struct LiveIntervals {
+    int *start, *end;
+    char *flags;
+} LiveIntervals;
+
+void liveIntervals(CFG *cfg, int count, int shared, LiveIntervals *live);
+void freeLiveIntervals(LiveIntervals *live);
+
+// Whether the quad writes its result operand, as opposed to jumping to it
+// or storing through it
+static inline int definesResult(OpCode op) {
+    return op != OP_NOP && !(op >= OP_GOTO && op <= OP_IFNE) &&
+           op != OP_ARRAY_STORE && op != OP_PTR_STORE && op != OP_PARAM &&
+           op != OP_RETURN && op != OP_FUNC_BEGIN && op != OP_FUNC_END;
+}
+
+// Whether operand 1 (arg1), 2 (arg2) or 3 (result) of the quad is read;
+// stores read the array or pointer they store through
+static inline int readsOperand(const Quad *q, int slot) {
+    switch (slot) {
+        case 1:  return q->op != OP_FUNC_BEGIN;
+        case 2:  return 1;
+        default: return q->op == OP_ARRAY_STORE || q->op == OP_PTR_STORE;
+    }
+}
+
+static inline Operand* operandOf(Quad *q, int slot) {
+    return slot == 1 ? &q->arg1 : slot == 2 ? &q->arg2 : &q->result;
+}
+
+static inline int isVariable(Operand o) {
+    return o.kind == OPD_SYM || o.kind == OPD_TEMP;
+}
+
+// Whether the quad can fail at run time: a division or remainder whose
+// divisor is not a nonzero constant. Such a quad must stay even when its
+// result is unused.
+static inline int mayTrap(const Quad *q) {
+    if (q->op != OP_DIV && q->op != OP_MOD)
+        return 0;
+    return !((q->arg2.kind == OPD_INT && q->arg2.ival != 0) ||
+             (q->arg2.kind == OPD_FLOAT && q->arg2.fval != 0));
+}
+
+// Slots to allocate for count numbered variables; never zero, so the
+// allocation succeeds and can be freed for a function without any
+static inline size_t varSlots(int count) {
+    return count > 0 ? (size_t)count : 1;
+}
+
+static inline void deleteQuad(Quad *q) {
+    q->op = OP_NOP;
+    q->arg1 = q->arg2 = q->result = noOperand();
+}
+
+// Bit vectors of 64-bit words, as used by the dataflow analyses
+static inline int testBit(const uint64_t *bits, int v) {
+    return (bits[v >> 6] >> (v & 63)) & 1;
+}
+
+static inline void setBit(uint64_t *bits, int v) {
+    bits[v >> 6] |= 1ULL << (v & 63);
+}
+
+#endif
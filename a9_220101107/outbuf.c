@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "outbuf.h"
+
+#define OUTBUF_SIZE (1 << 20)
+
+OutBuf stdoutBuf = { 1, NULL, 0, 0, 0 };
+
+void outOpen(OutBuf *out, int fd) {
+    out->fd = fd;
+    out->data = NULL;
+    out->len = 0;
+    out->cap = 0;
+    out->failed = 0;
+}
+
+// A failed write is reported once and the rest of the output dropped;
+// outClose() tells the caller
+void outFlush(OutBuf *out) {
+    // Anything already written through stdio must come out first
+    if (out->fd == 1)
+        fflush(stdout);
+
+    size_t done = 0;
+    while (done < out->len && !out->failed) {
+        ssize_t n = write(out->fd, out->data + done, out->len - done);
+        if (n <= 0) {
+            perror("write");
+            out->failed = 1;
+            break;
+        }
+        done += n;
+    }
+    out->len = 0;
+}
+
+// Flush and release the buffer; returns -1 if any write failed
+int outClose(OutBuf *out) {
+    outFlush(out);
+    free(out->data);
+    out->data = NULL;
+    out->cap = 0;
+    return out->failed ? -1 : 0;
+}
+
+// Make room for at least n more bytes
+static void reserve(OutBuf *out, size_t n) {
+    if (!out->data) {
+        out->cap = OUTBUF_SIZE;
+        out->data = (char*)malloc(out->cap);
+        if (!out->data) {
+            fprintf(stderr, "Error: out of memory for output buffer\n");
+            exit(1);
+        }
+    }
+    if (out->len + n > out->cap)
+        outFlush(out);
+}
+
+void outWrite(OutBuf *out, const char *s, size_t len) {
+    if (len >= OUTBUF_SIZE) {
+        // Large blocks go straight through
+        outFlush(out);
+        OutBuf direct = { out->fd, (char*)s, len, len, out->failed };
+        outFlush(&direct);
+        out->failed = direct.failed;
+        return;
+    }
+    reserve(out, len);
+    memcpy(out->data + out->len, s, len);
+    out->len += len;
+}
+
+void outPuts(OutBuf *out, const char *s) {
+    outWrite(out, s, strlen(s));
+}
+
+void outChar(OutBuf *out, char c) {
+    reserve(out, 1);
+    out->data[out->len++] = c;
+}
+
+// Digits of value, most significant first; returns the length
+static int formatInt(long value, char *buf) {
+    char digits[24];
+    int n = 0;
+    unsigned long v = value < 0 ? -(unsigned long)value : (unsigned long)value;
+    do {
+        digits[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+
+    int len = 0;
+    if (value < 0)
+        buf[len++] = '-';
+    while (n)
+        buf[len++] = digits[--n];
+    return len;
+}
+
+void outInt(OutBuf *out, long value) {
+    reserve(out, 24);
+    out->len += formatInt(value, out->data + out->len);
+}
+
+// Floats are rare in listings, so they still go through snprintf
+void outFloat(OutBuf *out, const char *format, double value) {
+    char buf[64];
+    int len = snprintf(buf, sizeof(buf), format, value);
+    outWrite(out, buf, len);
+}
+
+// Left-justified string in a field of at least width characters
+void outPadString(OutBuf *out, const char *s, int width) {
+    size_t len = strlen(s);
+    outWrite(out, s, len);
+    for (int i = (int)len; i < width; i++)
+        outChar(out, ' ');
+}
+
+// Left-justified integer in a field of at least width characters
+void outPadInt(OutBuf *out, long value, int width) {
+    reserve(out, 24 + (width > 0 ? width : 0));
+    int len = formatInt(value, out->data + out->len);
+    out->len += len;
+    for (int i = len; i < width; i++)
+        out->data[out->len++] = ' ';
+}
@@ -0,0 +1,29 @@
+#ifndef OUTBUF_H
+#define OUTBUF_H
+
+#include <stddef.h>
+
+// Buffered writer for listings and generated files. Text is formatted into
+// a large reusable buffer and handed to write(2) only when the buffer fills.
+typedef struct OutBuf {
+    int fd;          // Destination file descriptor
+    char *data;      // Pending bytes
+    size_t len;      // Bytes pending in data
+    size_t cap;      // Size of data
+    int failed;      // A write failed; later output is dropped
+} OutBuf;
+
+extern OutBuf stdoutBuf;  // Buffer for standard output
+
+void outOpen(OutBuf *out, int fd);
+void outFlush(OutBuf *out);
+int outClose(OutBuf *out);
+void outWrite(OutBuf *out, const char *s, size_t len);
+void outPuts(OutBuf *out, const char *s);
+void outChar(OutBuf *out, char c);
+void outInt(OutBuf *out, long value);
+void outFloat(OutBuf *out, const char *format, double value);
+void outPadString(OutBuf *out, const char *s, int width);
+void outPadInt(OutBuf *out, long value, int width);
+
+#endif
@@ -0,0 +1,125 @@
+#include "opt.h"
+
+// Jump peephole optimizations over one function's quads:
+//   - a jump to a goto is threaded to that goto's final destination
+//   - a jump to the quad that follows it anyway is deleted
+//   - if c goto L1; goto L2; L1: becomes ifNot c goto L2
+// Deleted jumps become nops, so jump targets stay valid until
+// compactQuads() renumbers them.
+
+// Longest goto chain followed; also stops threading around goto cycles
+#define MAX_THREAD_HOPS 64
+
+static int isBranch(OpCode op) {
+    return op == OP_GOTO || isConditionalJump(op);
+}
+
+// First quad at or after i that is not a nop; func_end always qualifies
+static int skipNops(int i, int end) {
+    while (i < end && quadAt(i)->op == OP_NOP)
+        i++;
+    return i;
+}
+
+static int isFloatOperand(Operand o) {
+    return o.kind == OPD_FLOAT || (isVariable(o) && o.sym->type == FLOAT_T);
+}
+
+// The jump taken exactly when q is not taken, or OP_NOP if there is none.
+// Float comparisons are not inverted: with a NaN both a < b and a >= b are false.
+static OpCode invertJump(const Quad *q) {
+    if (q->op == OP_IF)
+        return OP_IFFALSE;
+    if (q->op == OP_IFFALSE)
+        return OP_IF;
+    if (isFloatOperand(q->arg1) || isFloatOperand(q->arg2))
+        return q->op == OP_IFEQ ? OP_IFNE : q->op == OP_IFNE ? OP_IFEQ : OP_NOP;
+    switch (q->op) {
+        case OP_IFLT: return OP_IFGE;
+        case OP_IFGE: return OP_IFLT;
+        case OP_IFGT: return OP_IFLE;
+        case OP_IFLE: return OP_IFGT;
+        case OP_IFEQ: return OP_IFNE;
+        case OP_IFNE: return OP_IFEQ;
+        default:      return OP_NOP;
+    }
+}
+
+// Send jumps to the end of goto chains; returns whether any target moved
+static int threadJumps(int begin, int end) {
+    int changed = 0;
+    for (int i = begin + 1; i < end; i++) {
+        Quad *q = quadAt(i);
+        if (!isBranch(q->op) || q->result.kind != OPD_TARGET)
+            continue;
+        int target = q->result.target;
+        if (target <= begin || target > end)
+            continue;
+        target = skipNops(target, end);
+        for (int hops = 0; hops < MAX_THREAD_HOPS; hops++) {
+            Quad *t = quadAt(target);
+            if (t->op != OP_GOTO || t->result.kind != OPD_TARGET)
+                break;
+            int next = t->result.target;
+            if (next <= begin || next > end || skipNops(next, end) == target)
+                break;
+            target = skipNops(next, end);
+        }
+        if (target != q->result.target) {
+            q->result.target = target;
+            changed = 1;
+        }
+    }
+    return changed;
+}
+
+int optimizeJumps(CFG *cfg) {
+    int begin = cfg->begin, end = cfg->end;
+    char *isTarget = (char*)malloc(end - begin + 1);
+    int changed = 0;
+
+    for (int again = 1; again; ) {
+        again = threadJumps(begin, end);
+
+        memset(isTarget, 0, end - begin + 1);
+        for (int i = begin + 1; i < end; i++) {
+            Quad *q = quadAt(i);
+            if (isBranch(q->op) && q->result.kind == OPD_TARGET &&
+                q->result.target > begin && q->result.target <= end)
+                isTarget[q->result.target - begin] = 1;
+        }
+
+        for (int i = begin + 1; i < end; i++) {
+            Quad *q = quadAt(i);
+            if (!isBranch(q->op))
+                continue;
+            int next = skipNops(i + 1, end);
+            int target = q->result.kind == OPD_TARGET ? q->result.target : next;
+            if (target == next) {
+                // Unpatched jumps fall through as well
+                deleteQuad(q);
+                again = 1;
+                continue;
+            }
+
+            // A conditional jump over a goto that nothing else jumps to
+            Quad *jump = quadAt(next);
+            if (!isConditionalJump(q->op) || next == end || jump->op != OP_GOTO ||
+                isTarget[next - begin] || target != skipNops(next + 1, end))
+                continue;
+            OpCode inverse = invertJump(q);
+            if (inverse == OP_NOP)
+                continue;
+            q->op = inverse;
+            q->result = jump->result;
+            if (q->result.kind == OPD_TARGET && q->result.target > begin && q->result.target <= end)
+                isTarget[q->result.target - begin] = 1;
+            deleteQuad(jump);
+            again = 1;
+        }
+        changed |= again;
+    }
+
+    free(isTarget);
+    return changed ? OPT_CHANGED | OPT_CFG_CHANGED : 0;
+}
@@ -3,44 +3,85 @@
 // Global variables
 SymbolTable *currentTable = NULL;
 SymbolTable *globalTable = NULL;
-Quad quads[1000];  // Array to store quads
+Quad *quadChunks[QUAD_MAX_CHUNKS];  // Chunked quad store, see quadAt()
 int quadIndex = 0;
+static int quadCapacity = 0;        // Quads available in allocated chunks
+static Arena listPool;              // Backpatch lists and their nodes
 int tempVarCount = 0;
 int labelCount = 0;
 
 // Symbol table functions
-SymbolTable* createSymbolTable(char *name, SymbolTable *parent) {
+SymbolTable* createSymbolTable(const char *name, SymbolTable *parent) {
     SymbolTable *table = (SymbolTable*)malloc(sizeof(SymbolTable));
-    table->name = strdup(name);
+    table->name = intern(name);
     table->tempCount = 0;
     table->entries = NULL;
     table->parent = parent;
+    table->index = NULL;
+    table->indexCapacity = 0;
+    table->count = 0;
+    table->tail = NULL;
+    table->frameSize = 0;
+    table->id = -1;
     return table;
 }
 
-SymbolEntry* lookup(SymbolTable *table, char *name) {
-    // First search in current scope
-    SymbolEntry *entry = lookupInCurrentScope(table, name);
-    if (entry) return entry;
-    
-    // If not found and there's a parent scope, search there
-    if (table->parent) 
-        return lookup(table->parent, name);
-    
+// Add an entry to the table's hash index, growing it at half load
+static void indexEntry(SymbolTable *table, SymbolEntry *entry) {
+    if ((table->count + 1) * 2 > table->indexCapacity) {
+        int capacity = table->indexCapacity ? table->indexCapacity * 2 : 16;
+        SymbolEntry **index = (SymbolEntry**)calloc(capacity, sizeof(SymbolEntry*));
+        for (int i = 0; i < table->indexCapacity; i++) {
+            SymbolEntry *e = table->index[i];
+            if (!e) continue;
+            unsigned j = internHash(e->name) & (capacity - 1);
+            while (index[j])
+                j = (j + 1) & (capacity - 1);
+            index[j] = e;
+        }
+        free(table->index);
+        table->index = index;
+        table->indexCapacity = capacity;
+    }
+
+    unsigned j = internHash(entry->name) & (table->indexCapacity - 1);
+    while (table->index[j])
+        j = (j + 1) & (table->indexCapacity - 1);
+    table->index[j] = entry;
+    table->count++;
+}
+
+// Probe one table's index for an interned name
+static SymbolEntry* findInTable(SymbolTable *table, const char *atom) {
+    if (!table->index)
+        return NULL;
+    unsigned j = internHash(atom) & (table->indexCapacity - 1);
+    while (table->index[j]) {
+        // Names are interned, so equal names are the same pointer
+        if (table->index[j]->name == atom)
+            return table->index[j];
+        j = (j + 1) & (table->indexCapacity - 1);
+    }
     return NULL;
 }
 
-SymbolEntry* lookupInCurrentScope(SymbolTable *table, char *name) {
-    SymbolEntry *entry = table->entries;
-    while (entry) {
-        if (strcmp(entry->name, name) == 0)
-            return entry;
-        entry = entry->next;
+SymbolEntry* lookup(SymbolTable *table, const char *name) {
+    const char *atom = intern(name);
+    
+    // Search the current scope first, then each enclosing scope
+    for (; table; table = table->parent) {
+        SymbolEntry *entry = findInTable(table, atom);
+        if (entry) return entry;
     }
+    
     return NULL;
 }
 
-SymbolEntry* insert(SymbolTable *table, char *name, Type type) {
+SymbolEntry* lookupInCurrentScope(SymbolTable *table, const char *name) {
+    return findInTable(table, intern(name));
+}
+
+SymbolEntry* insert(SymbolTable *table, const char *name, Type type) {
     // Check if already exists in current scope
     SymbolEntry *existingEntry = lookupInCurrentScope(table, name);
     if (existingEntry) {
@@ -49,7 +90,7 @@ SymbolEntry* insert(SymbolTable *table, char *name, Type type) {
     
     // Create new entry
     SymbolEntry *entry = (SymbolEntry*)malloc(sizeof(SymbolEntry));
-    entry->name = strdup(name);
+    entry->name = intern(name);
     entry->type = type;
     entry->eleType = VOID_T;
     entry->size = sizeOfType(type);
@@ -58,24 +99,22 @@ SymbolEntry* insert(SymbolTable *table, char *name, Type type) {
     entry->initialValue = NULL;
     entry->nestedTable = NULL;
     entry->paramCount = 0;
-        // Compute offset
-        int cumulativeOffset = 0;
-        SymbolEntry *temp = table->entries;
-       // SymbolEntry *prev = temp;
-        while (temp) {
-            cumulativeOffset += temp->size;
-         //   prev=temp;
-            temp = temp->next;
-        }
-        entry->offset = cumulativeOffset;
-     //if(table->entries==NULL){
-        entry->next = table->entries;
+    entry->isTemp = 0;
+    entry->table = table;
+    entry->id = -1;
+    entry->next = NULL;
+    
+    // Place the entry at the end of the frame in O(1)
+    entry->offset = table->frameSize;
+    table->frameSize += entry->size;
+    
+    // Append so entries stay in declaration order
+    if (table->tail)
+        table->tail->next = entry;
+    else
         table->entries = entry;
-     //}else{
-    // Add to the beginning of the list
-    //prev->next = entry;
-    // }
-    // table->entries = entry;
+    table->tail = entry;
+    indexEntry(table, entry);
     
     return entry;
 }
@@ -87,17 +126,60 @@ SymbolEntry* gentemp(SymbolTable *table, Type type) {
     
     // Insert into symbol table
     SymbolEntry *entry = insert(table, tempName, type);
+    entry->isTemp = 1;
     
     return entry;
 }
 
+// Change an entry's size and keep the frame layout packed. Every caller
+// resizes the entry it has just inserted (the tail), which costs O(1); a
+// resize of an older entry would shift all the entries after it.
+static void resizeSymbol(SymbolEntry *entry, int size) {
+    int delta = size - entry->size;
+    entry->size = size;
+    if (delta == 0 || !entry->table)
+        return;
+    
+    for (SymbolEntry *e = entry->next; e; e = e->next)
+        e->offset += delta;
+    entry->table->frameSize += delta;
+}
+
+// Remove the entries keep() rejects, packing the frame again and
+// rebuilding the hash index
+void removeSymbols(SymbolTable *table, int (*keep)(const SymbolEntry *entry)) {
+    SymbolEntry *entry = table->entries;
+    table->entries = table->tail = NULL;
+    table->count = 0;
+    table->frameSize = 0;
+    if (table->index)
+        memset(table->index, 0, table->indexCapacity * sizeof(SymbolEntry*));
+    while (entry) {
+        SymbolEntry *next = entry->next;
+        if (keep(entry)) {
+            entry->next = NULL;
+            entry->offset = table->frameSize;
+            table->frameSize += entry->size;
+            if (table->tail)
+                table->tail->next = entry;
+            else
+                table->entries = entry;
+            table->tail = entry;
+            indexEntry(table, entry);
+        } else {
+            free(entry);
+        }
+        entry = next;
+    }
+}
+
 void updateSymbolType(SymbolEntry *entry, Type type) {
     entry->type = type;
-    entry->size = sizeOfType(type);
+    resizeSymbol(entry, sizeOfType(type));
 }
 
 void updateSymbolSize(SymbolEntry *entry, int size) {
-    entry->size = size;
+    resizeSymbol(entry, size);
 }
 
 void updateSymbolOffset(SymbolEntry *entry, int offset) {
@@ -158,167 +240,319 @@ void updateSymbolElementType(SymbolEntry *entry, Type type) {
 //     printf("\n");
 // }
 void printSymbolTable(SymbolTable *table) {
-    printf("\n### Symbol Table: %s\n", table->name);
-    printf("| Name     | Type        | Initial Value | Size | Offset | Nested Table   |\n");
-    printf("|----------|-------------|---------------|------|--------|----------------|\n");
+    OutBuf *out = &stdoutBuf;
+    outPuts(out, "\n### Symbol Table: ");
+    outPuts(out, table->name);
+    outPuts(out, "\n| Name     | Type        | Initial Value | Size | Offset | Nested Table   |\n");
+    outPuts(out, "|----------|-------------|---------------|------|--------|----------------|\n");
     
     SymbolEntry *entry = table->entries;
     while (entry) {
-        printf("| %-8s | %-11s | ", entry->name, typeToString(entry->type));
+        outPuts(out, "| ");
+        outPadString(out, entry->name, 8);
+        outPuts(out, " | ");
+        outPadString(out, typeToString(entry->type), 11);
+        outPuts(out, " | ");
         
         // Print initial value based on type
         if (entry->initialValue) {
             switch (entry->type) {
                 case INT_T:
-                    printf("%-13d | ", *(int*)entry->initialValue);
+                    outPadInt(out, *(int*)entry->initialValue, 13);
                     break;
                 case FLOAT_T:
-                    printf("%-13.1f | ", *(float*)entry->initialValue);
+                    outFloat(out, "%-13.1f", *(float*)entry->initialValue);
                     break;
                 case CHAR_T:
-                    printf("'%-12c | ", *(char*)entry->initialValue);
+                    outChar(out, '\'');
+                    outChar(out, *(char*)entry->initialValue);
+                    outPadString(out, "", 11);
                     break;
                 default:
-                    printf("%-13s | ", "-");
+                    outPadString(out, "-", 13);
             }
         } else {
-            printf("%-13s | ", "-");
+            outPadString(out, "-", 13);
         }
+        outPuts(out, " | ");
         
         // Print size and offset
-        printf("%-4d | %-6d | ", entry->size, entry->offset);
-        
+        outPadInt(out, entry->size, 4);
+        outPuts(out, " | ");
+        outPadInt(out, entry->offset, 6);
+        outPuts(out, " | ");
         
         // Print nested table info
         if (entry->nestedTable) {
-            printf("ST(%-10s) |", entry->nestedTable->name);
+            outPuts(out, "ST(");
+            outPadString(out, entry->nestedTable->name, 10);
+            outPuts(out, ") |");
         } else {
-            printf("%-15s |", "null");
+            outPadString(out, "null", 15);
+            outPuts(out, " |");
         }
-
-        
         
-        printf("\n");
+        outChar(out, '\n');
         entry = entry->next;
     }
     
-    printf("\n");
+    outChar(out, '\n');
 }
 
 // Quad functions
-void emitQuad(char *op, char *arg1, char *arg2, char *result) {
-    quads[quadIndex].op = op ? strdup(op) : NULL;
-    quads[quadIndex].arg1 = arg1 ? strdup(arg1) : NULL;
-    quads[quadIndex].arg2 = arg2 ? strdup(arg2) : NULL;
-    quads[quadIndex].result = result ? strdup(result) : NULL;
+static void growQuads() {
+    // Next chunk is twice the size of the previous one
+    int chunk = 0;
+    while (quadChunks[chunk])
+        chunk++;
+    if (chunk == QUAD_MAX_CHUNKS) {
+        fprintf(stderr, "Error: too many quads\n");
+        exit(1);
+    }
+
+    size_t count = (size_t)1 << (QUAD_CHUNK_BITS + chunk);
+    quadChunks[chunk] = (Quad*)malloc(count * sizeof(Quad));
+    if (!quadChunks[chunk]) {
+        fprintf(stderr, "Error: out of memory for quads\n");
+        exit(1);
+    }
+    quadCapacity += count;
+}
+
+void emitQuad(OpCode op, Operand arg1, Operand arg2, Operand result) {
+    if (quadIndex == quadCapacity)
+        growQuads();
+
+    Quad *q = quadAt(quadIndex);
+    q->op = op;
+    q->arg1 = arg1;
+    q->arg2 = arg2;
+    q->result = result;
     quadIndex++;
 }
 
+// Release every quad of the program at once
+void freeQuads() {
+    for (int c = 0; c < QUAD_MAX_CHUNKS && quadChunks[c]; c++) {
+        free(quadChunks[c]);
+        quadChunks[c] = NULL;
+    }
+    quadIndex = 0;
+    quadCapacity = 0;
+}
+
+// Bytes currently held by the quad store
+size_t quadStoreBytes() {
+    return (size_t)quadCapacity * sizeof(Quad);
+}
+
+// Name, listing symbol and listing format of every opcode
+const OpInfo opInfo[OP_COUNT] = {
+    [OP_NOP]         = { "nop",        "nop",        FMT_NOP },
+    [OP_ASSIGN]      = { "=",          "=",          FMT_COPY },
+    [OP_ADD]         = { "+",          "+",          FMT_BINARY },
+    [OP_SUB]         = { "-",          "-",          FMT_BINARY },
+    [OP_MUL]         = { "*",          "*",          FMT_BINARY },
+    [OP_DIV]         = { "/",          "/",          FMT_BINARY },
+    [OP_MOD]         = { "%",          "%",          FMT_BINARY },
+    [OP_BITAND]      = { "&",          "&",          FMT_BINARY },
+    [OP_BITOR]       = { "|",          "|",          FMT_BINARY },
+    [OP_BITXOR]      = { "^",          "^",          FMT_BINARY },
+    [OP_SHL]         = { "<<",         "<<",         FMT_BINARY },
+    [OP_SHR]         = { ">>",         ">>",         FMT_BINARY },
+    [OP_LT]          = { "<",          "<",          FMT_BINARY },
+    [OP_GT]          = { ">",          ">",          FMT_BINARY },
+    [OP_LE]          = { "<=",         "<=",         FMT_BINARY },
+    [OP_GE]          = { ">=",         ">=",         FMT_BINARY },
+    [OP_EQ]          = { "==",         "==",         FMT_BINARY },
+    [OP_NE]          = { "!=",         "!=",         FMT_BINARY },
+    [OP_LOGAND]      = { "&&",         "&&",         FMT_BINARY },
+    [OP_LOGOR]       = { "||",         "||",         FMT_BINARY },
+    [OP_UMINUS]      = { "uminus",     "-",          FMT_UNARY },
+    [OP_NOT]         = { "!",          "!",          FMT_UNARY },
+    [OP_ADDR]        = { "&",          "&",          FMT_UNARY },
+    [OP_DEREF]       = { "*",          "*",          FMT_UNARY },
+    [OP_ARRAY_LOAD]  = { "=[]",        "=[]",        FMT_ARRAY_LOAD },
+    [OP_ARRAY_STORE] = { "[]=",        "[]=",        FMT_ARRAY_STORE },
+    [OP_PTR_STORE]   = { "*=",         "*=",         FMT_PTR_STORE },
+    [OP_GOTO]        = { "goto",       "goto",       FMT_GOTO },
+    [OP_IF]          = { "if",         "if",         FMT_IF },
+    [OP_IFFALSE]     = { "ifFalse",    "ifFalse",    FMT_IF },
+    [OP_IFLT]        = { "if<",        "<",          FMT_IFREL },
+    [OP_IFGT]        = { "if>",        ">",          FMT_IFREL },
+    [OP_IFLE]        = { "if<=",       "<=",         FMT_IFREL },
+    [OP_IFGE]        = { "if>=",       ">=",         FMT_IFREL },
+    [OP_IFEQ]        = { "if==",       "==",         FMT_IFREL },
+    [OP_IFNE]        = { "if!=",       "!=",         FMT_IFREL },
+    [OP_PARAM]       = { "param",      "param",      FMT_PARAM },
+    [OP_CALL]        = { "call",       "call",       FMT_CALL },
+    [OP_RETURN]      = { "return",     "return",     FMT_RETURN },
+    [OP_FUNC_BEGIN]  = { "func_begin", "func_begin", FMT_FUNC_BEGIN },
+    [OP_FUNC_END]    = { "func_end",   "func_end",   FMT_FUNC_END },
+    [OP_INT2REAL]    = { "=inttoreal", "int2float",  FMT_CONV },
+    [OP_REAL2INT]    = { "=realtoint", "float2int",  FMT_CONV },
+    [OP_CHAR2INT]    = { "=chartoint", "char2int",   FMT_CONV },
+    [OP_INT2CHAR]    = { "=inttochar", "int2char",   FMT_CONV },
+    [OP_BOOL2INT]    = { "=booltoint", "bool2int",   FMT_CONV },
+    [OP_INT2BOOL]    = { "=inttobool", "int2bool",   FMT_CONV },
+};
+
+// Write an operand; absent operands print as missing (NULL in the quad array)
+static void printOperand(OutBuf *out, Operand o, const char *missing) {
+    switch (o.kind) {
+        case OPD_SYM:
+        case OPD_TEMP:   outPuts(out, o.sym->name); break;
+        case OPD_INT:    outInt(out, o.ival); break;
+        case OPD_FLOAT:  outFloat(out, "%f", o.fval); break;
+        case OPD_TARGET: outInt(out, o.target); break;
+        case OPD_STR:    outPuts(out, o.str); break;
+        default:         outPuts(out, missing); break;
+    }
+}
+
 void printQuads() {
-    printf("\nQuad Array:\n");
-    printf("Index\tOperator\tArg1\tArg2\tResult\n");
-    printf("----------------------------------------\n");
+    OutBuf *out = &stdoutBuf;
+    outPuts(out, "\nQuad Array:\n");
+    outPuts(out, "Index\tOperator\tArg1\tArg2\tResult\n");
+    outPuts(out, "----------------------------------------\n");
     
     for (int i = 0; i < quadIndex; i++) {
-        printf("%d\t%s\t\t%s\t%s\t%s\n", i, 
-               quads[i].op ? quads[i].op : "NULL",
-               quads[i].arg1 ? quads[i].arg1 : "NULL",
-               quads[i].arg2 ? quads[i].arg2 : "NULL",
-               quads[i].result ? quads[i].result : "NULL");
+        Quad *q = quadAt(i);
+        outInt(out, i);
+        outChar(out, '\t');
+        outPuts(out, opInfo[q->op].name);
+        outPuts(out, "\t\t");
+        printOperand(out, q->arg1, "NULL");
+        outChar(out, '\t');
+        printOperand(out, q->arg2, "NULL");
+        outChar(out, '\t');
+        printOperand(out, q->result, "NULL");
+        outChar(out, '\n');
     }
     
-    printf("\n");
+    outChar(out, '\n');
 }
+
 void printQuadsinstruction() {
-    printf("\n## Generated 3-Address Code:\n\n");
-    printf("```\n");
+    OutBuf *out = &stdoutBuf;
+    outPuts(out, "\n## Generated 3-Address Code:\n\n");
+    outPuts(out, "```\n");
     
-    char currentFunc[50] = "";
     for (int i = 0; i < quadIndex; i++) {
-        // If we're seeing a function label (LABEL followed by func:), print Function header
-        if (strcmp(quads[i].op, "LABEL") == 0 && strstr(quads[i].result, "func_") != NULL) {
-            char funcName[50];
-            sscanf(quads[i].result, "func_%s", funcName);
-            printf("Function: %s\n", funcName);
-            strcpy(currentFunc, funcName);
-            continue;
-        }
+        Quad *q = quadAt(i);
+        const OpInfo *info = &opInfo[q->op];
         
         // Print normal instruction with L prefix for labels
-        printf("L%-3d: ", i);
+        outChar(out, 'L');
+        outPadInt(out, i, 3);
+        outPuts(out, ": ");
         
-        // Handle different quad formats based on operation
-        if (strcmp(quads[i].op, "=") == 0) {
-            printf("%s = %s\n", quads[i].result, quads[i].arg1);
-        }
-        else if (strcmp(quads[i].op, "+") == 0 || 
-                 strcmp(quads[i].op, "-") == 0 ||
-                 strcmp(quads[i].op, "*") == 0 ||
-                 strcmp(quads[i].op, "/") == 0 ||
-                 strcmp(quads[i].op, "%") == 0 ||
-                 strcmp(quads[i].op, "&") == 0 ||
-                 strcmp(quads[i].op, "|") == 0 ||
-                 strcmp(quads[i].op, "^") == 0 ||
-                 strcmp(quads[i].op, "<<") == 0 ||
-                 strcmp(quads[i].op, ">>") == 0) {
-            printf("%s = %s %s %s\n", quads[i].result, quads[i].arg1, quads[i].op, quads[i].arg2);
-        }
-        else if (strcmp(quads[i].op, "=[]") == 0) {
-            printf("%s = %s[%s]\n", quads[i].result, quads[i].arg1, quads[i].arg2);
-        }
-        else if (strcmp(quads[i].op, "[]=") == 0) {
-            printf("%s[%s] = %s\n", quads[i].result, quads[i].arg1, quads[i].arg2);
-        }
-        else if (strcmp(quads[i].op, "goto") == 0) {
-            printf("goto L%s\n", quads[i].result);
-        }
-        else if (strcmp(quads[i].op, "if") == 0) {
-            printf("if %s goto L%s\n", quads[i].arg1, quads[i].result);
-        }
-        else if (strcmp(quads[i].op, "ifFalse") == 0) {
-            printf("ifFalse %s goto L%s\n", quads[i].arg1, quads[i].result);
-        }
-        else if (strstr(quads[i].op, "if") != NULL && strstr(quads[i].op, "goto") != NULL) {
-            // Handle relational operations (if x relop y goto L)
-            char relop[5];
-            sscanf(quads[i].op, "if%s", relop);
-            printf("if %s %s %s goto L%s\n", quads[i].arg1, relop, quads[i].arg2, quads[i].result);
-        }
-        else if (strcmp(quads[i].op, "param") == 0) {
-            printf("param %s\n", quads[i].arg1);
-        }
-        else if (strcmp(quads[i].op, "call") == 0) {
-            printf("%s = call %s, %s\n", quads[i].result, quads[i].arg1, quads[i].arg2);
-        }
-        else if (strcmp(quads[i].op, "return") == 0) {
-            if (quads[i].arg1)
-                printf("return %s\n", quads[i].arg1);
-            else
-                printf("return\n");
-        }
-        else if (strstr(quads[i].op, "=") == 0) {
-            // Handle unary operations
-            char unaryOp[20];
-            sscanf(quads[i].op, "%s", unaryOp);
-            printf("%s = %s %s\n", quads[i].result, unaryOp, quads[i].arg1);
-        }
-        else if (strcmp(quads[i].op, "=inttoreal") == 0) {
-            printf("%s = float2int(%s)\n", quads[i].result, quads[i].arg1);
-        }
-        else if (strcmp(quads[i].op, "=realtoint") == 0) {
-            printf("%s = int2float(%s)\n", quads[i].result, quads[i].arg1);
-        }
-        else {
-            // Generic format for other operations
-            printf("%s %s %s %s\n", 
-                   quads[i].op ? quads[i].op : "", 
-                   quads[i].arg1 ? quads[i].arg1 : "", 
-                   quads[i].arg2 ? quads[i].arg2 : "", 
-                   quads[i].result ? quads[i].result : "");
+        // Dispatch on the opcode's format (a dense switch, compiled to a jump table)
+        switch (info->format) {
+            case FMT_NOP:
+                outPuts(out, "nop");
+                break;
+            case FMT_COPY:
+                printOperand(out, q->result, "");
+                outPuts(out, " = ");
+                printOperand(out, q->arg1, "");
+                break;
+            case FMT_BINARY:
+                printOperand(out, q->result, "");
+                outPuts(out, " = ");
+                printOperand(out, q->arg1, "");
+                outChar(out, ' ');
+                outPuts(out, info->symbol);
+                outChar(out, ' ');
+                printOperand(out, q->arg2, "");
+                break;
+            case FMT_UNARY:
+                printOperand(out, q->result, "");
+                outPuts(out, " = ");
+                outPuts(out, info->symbol);
+                outChar(out, ' ');
+                printOperand(out, q->arg1, "");
+                break;
+            case FMT_ARRAY_LOAD:
+                printOperand(out, q->result, "");
+                outPuts(out, " = ");
+                printOperand(out, q->arg1, "");
+                outChar(out, '[');
+                printOperand(out, q->arg2, "");
+                outChar(out, ']');
+                break;
+            case FMT_ARRAY_STORE:
+                printOperand(out, q->result, "");
+                outChar(out, '[');
+                printOperand(out, q->arg1, "");
+                outPuts(out, "] = ");
+                printOperand(out, q->arg2, "");
+                break;
+            case FMT_PTR_STORE:
+                outChar(out, '*');
+                printOperand(out, q->result, "");
+                outPuts(out, " = ");
+                printOperand(out, q->arg1, "");
+                break;
+            case FMT_GOTO:
+                outPuts(out, "goto L");
+                printOperand(out, q->result, "");
+                break;
+            case FMT_IF:
+                outPuts(out, info->symbol);
+                outChar(out, ' ');
+                printOperand(out, q->arg1, "");
+                outPuts(out, " goto L");
+                printOperand(out, q->result, "");
+                break;
+            case FMT_IFREL:
+                outPuts(out, "if ");
+                printOperand(out, q->arg1, "");
+                outChar(out, ' ');
+                outPuts(out, info->symbol);
+                outChar(out, ' ');
+                printOperand(out, q->arg2, "");
+                outPuts(out, " goto L");
+                printOperand(out, q->result, "");
+                break;
+            case FMT_PARAM:
+                outPuts(out, "param ");
+                printOperand(out, q->arg1, "");
+                break;
+            case FMT_CALL:
+                printOperand(out, q->result, "");
+                outPuts(out, " = call ");
+                printOperand(out, q->arg1, "");
+                outPuts(out, ", ");
+                printOperand(out, q->arg2, "");
+                break;
+            case FMT_RETURN:
+                outPuts(out, "return");
+                if (q->arg1.kind != OPD_NONE) {
+                    outChar(out, ' ');
+                    printOperand(out, q->arg1, "");
+                }
+                break;
+            case FMT_FUNC_BEGIN:
+                outPuts(out, "func_begin ");
+                printOperand(out, q->arg1, "");
+                break;
+            case FMT_FUNC_END:
+                outPuts(out, "func_end");
+                break;
+            case FMT_CONV:
+                printOperand(out, q->result, "");
+                outPuts(out, " = ");
+                outPuts(out, info->symbol);
+                outChar(out, '(');
+                printOperand(out, q->arg1, "");
+                outChar(out, ')');
+                break;
         }
+        outChar(out, '\n');
     }
     
-    printf("```\n");
+    outPuts(out, "```\n");
 }
 
 int nextquad() {
@@ -326,93 +560,120 @@ int nextquad() {
 }
 
 QuadList* makelist(int i) {
-    QuadList *list = (QuadList*)malloc(sizeof(QuadList));
-    list->index = i;
-    list->next = NULL;
+    QuadListNode *node = (QuadListNode*)arenaAlloc(&listPool, sizeof(QuadListNode));
+    node->index = i;
+    node->next = NULL;
+    
+    QuadList *list = (QuadList*)arenaAlloc(&listPool, sizeof(QuadList));
+    list->head = node;
+    list->tail = node;
     return list;
 }
 
+// Append p2 to p1 in place
 QuadList* merge(QuadList *p1, QuadList *p2) {
     if (!p1) return p2;
     if (!p2) return p1;
     
-    QuadList *temp = p1;
-    while (temp->next) {
-        temp = temp->next;
-    }
-    temp->next = p2;
+    p1->tail->next = p2->head;
+    p1->tail = p2->tail;
     
     return p1;
 }
 
 void backpatch(QuadList *p, int i) {
-    QuadList *temp = p;
-    char index_str[10];
-    sprintf(index_str, "%d", i);
+    if (!p) return;
     
-    while (temp) {
-        if (quads[temp->index].result == NULL) {
-            quads[temp->index].result = strdup(index_str);
+    for (QuadListNode *node = p->head; node; node = node->next) {
+        Quad *q = quadAt(node->index);
+        if (q->result.kind == OPD_NONE) {
+            q->result = targetOperand(i);
         }
-        temp = temp->next;
     }
 }
 
+// Release every backpatch list at once (after parsing)
+void freeQuadLists() {
+    arenaFree(&listPool);
+}
+
 // Type checking and conversion functions
+static int isArithmetic(Type type) {
+    return type == CHAR_T || type == INT_T || type == BOOL_T || type == FLOAT_T;
+}
+
+// Result type of a binary operation, or VOID_T if the operands don't mix
 Type typecheck(Type type1, Type type2) {
     if (type1 == type2) 
         return type1;
     
-    // Handle type conversions based on rules
-    if ((type1 == INT_T && type2 == FLOAT_T) || (type1 == FLOAT_T && type2 == INT_T))
-        return FLOAT_T;  // Promote to float
+    // Promote char and bool to int, and anything mixed with float to float
+    if (isArithmetic(type1) && isArithmetic(type2))
+        return type1 == FLOAT_T || type2 == FLOAT_T ? FLOAT_T : INT_T;
     
-    if ((type1 == CHAR_T && type2 == INT_T) || (type1 == INT_T && type2 == CHAR_T))
-        return INT_T;    // Promote to int
-    
-    if (type1 == PTR_T || type2 == PTR_T)
-        return PTR_T;    // Pointer-related operations
-    
-    if (type1 == BOOL_T || type2 == BOOL_T)
-        return BOOL_T;   // Logical operations
+    // Pointer arithmetic takes an integer offset
+    if ((type1 == PTR_T && isArithmetic(type2) && type2 != FLOAT_T) ||
+        (type2 == PTR_T && isArithmetic(type1) && type1 != FLOAT_T))
+        return PTR_T;
     
     return VOID_T;  // Incompatible types
 }
 
-char* convInt2Float(char *s) {
+SymbolEntry* convInt2Float(SymbolEntry *s) {
     SymbolEntry *temp = gentemp(currentTable, FLOAT_T);
-    emitQuad("=inttoreal", s, NULL, temp->name);
-    return temp->name;
+    emitQuad(OP_INT2REAL, symOperand(s), noOperand(), symOperand(temp));
+    return temp;
 }
 
-char* convFloat2Int(char *s) {
+SymbolEntry* convFloat2Int(SymbolEntry *s) {
     SymbolEntry *temp = gentemp(currentTable, INT_T);
-    emitQuad("=realtoint", s, NULL, temp->name);
-    return temp->name;
+    emitQuad(OP_REAL2INT, symOperand(s), noOperand(), symOperand(temp));
+    return temp;
 }
 
-char* convChar2Int(char *s) {
+SymbolEntry* convChar2Int(SymbolEntry *s) {
     SymbolEntry *temp = gentemp(currentTable, INT_T);
-    emitQuad("=chartoint", s, NULL, temp->name);
-    return temp->name;
+    emitQuad(OP_CHAR2INT, symOperand(s), noOperand(), symOperand(temp));
+    return temp;
 }
 
-char* convInt2Char(char *s) {
+SymbolEntry* convInt2Char(SymbolEntry *s) {
     SymbolEntry *temp = gentemp(currentTable, CHAR_T);
-    emitQuad("=inttochar", s, NULL, temp->name);
-    return temp->name;
+    emitQuad(OP_INT2CHAR, symOperand(s), noOperand(), symOperand(temp));
+    return temp;
 }
 
-char* convBool2Int(char *s) {
+SymbolEntry* convBool2Int(SymbolEntry *s) {
     SymbolEntry *temp = gentemp(currentTable, INT_T);
-    emitQuad("=booltoint", s, NULL, temp->name);
-    return temp->name;
+    emitQuad(OP_BOOL2INT, symOperand(s), noOperand(), symOperand(temp));
+    return temp;
 }
 
-char* convInt2Bool(char *s) {
+SymbolEntry* convInt2Bool(SymbolEntry *s) {
     SymbolEntry *temp = gentemp(currentTable, BOOL_T);
-    emitQuad("=inttobool", s, NULL, temp->name);
-    return temp->name;
+    emitQuad(OP_INT2BOOL, symOperand(s), noOperand(), symOperand(temp));
+    return temp;
+}
+
+// Convert a value for storing into a location of type `to`, emitting a
+// conversion quad when the representations differ
+SymbolEntry* convertType(SymbolEntry *s, Type to) {
+    Type from = s->type;
+    if (from == to)
+        return s;
+    if (to == FLOAT_T && (from == INT_T || from == CHAR_T || from == BOOL_T))
+        return convInt2Float(s);
+    if (from == FLOAT_T && (to == INT_T || to == CHAR_T || to == BOOL_T))
+        return convFloat2Int(s);
+    if (to == INT_T && from == CHAR_T)
+        return convChar2Int(s);
+    if (to == CHAR_T && from == INT_T)
+        return convInt2Char(s);
+    if (to == INT_T && from == BOOL_T)
+        return convBool2Int(s);
+    if (to == BOOL_T && from == INT_T)
+        return convInt2Bool(s);
+    return s;
 }
 
 // Helper functions
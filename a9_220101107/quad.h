@@ -4,6 +4,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "arena.h"
+#include "intern.h"
+#include "outbuf.h"
 
 // Type definition for type checking and conversions
 typedef enum Type {
@@ -19,7 +22,7 @@ typedef enum Type {
 
 // Symbol table entry structure
 typedef struct SymbolEntry {
-    char *name;           // Name of the symbol
+    const char *name;     // Name of the symbol (interned)
     Type type;            // Type of the symbol
     Type eleType;         // Element type for arrays and pointer targets
     int size;             // Size of the symbol in bytes
@@ -29,14 +32,23 @@ typedef struct SymbolEntry {
     struct SymbolTable *nestedTable; // Nested symbol table (for functions)
     struct SymbolEntry *next;  // Next entry in the table
     int paramCount;
+    int isTemp;           // Whether this is a compiler generated temporary
+    struct SymbolTable *table; // Table that owns this entry
+    int id;               // Scratch number used while serializing (-1 otherwise)
 } SymbolEntry;
 
 // Symbol table structure
 typedef struct SymbolTable {
-    char *name;          // Name of the table (function name or "global")
+    const char *name;    // Name of the table (function name or "global")
     int tempCount;       // Counter for temporaries
     struct SymbolEntry *entries; // Entries in the table
     struct SymbolTable *parent;  // Parent table (for nested scopes)
+    struct SymbolEntry **index;  // Open addressing hash index over entries
+    int indexCapacity;   // Slots in index (a power of two)
+    int count;           // Number of entries
+    struct SymbolEntry *tail;    // Last entry (entries are kept in insertion order)
+    int frameSize;       // Total size of all entries; offset of the next one
+    int id;              // Scratch number used while serializing (-1 otherwise)
 } SymbolTable;
 
 // Expression attributes structure
@@ -52,26 +64,104 @@ typedef struct ExprAttr {
     int isPtr;             // Whether this is a pointer
 } ExprAttr;
 
+// Three-address code operations
+typedef enum __attribute__((packed)) OpCode {
+    OP_NOP,
+    OP_ASSIGN,             // result = arg1
+    OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_MOD,
+    OP_BITAND, OP_BITOR, OP_BITXOR, OP_SHL, OP_SHR,
+    OP_LT, OP_GT, OP_LE, OP_GE, OP_EQ, OP_NE,
+    OP_LOGAND, OP_LOGOR,
+    OP_UMINUS, OP_NOT, OP_ADDR, OP_DEREF,   // result = op arg1
+    OP_ARRAY_LOAD,         // result = arg1[arg2]
+    OP_ARRAY_STORE,        // result[arg1] = arg2
+    OP_PTR_STORE,          // *result = arg1
+    OP_GOTO,               // goto result
+    OP_IF,                 // if arg1 goto result
+    OP_IFFALSE,            // ifFalse arg1 goto result
+    OP_IFLT, OP_IFGT, OP_IFLE, OP_IFGE, OP_IFEQ, OP_IFNE,  // if arg1 relop arg2 goto result
+    OP_PARAM,              // param arg1
+    OP_CALL,               // result = call arg1, arg2
+    OP_RETURN,             // return [arg1]
+    OP_FUNC_BEGIN,         // func_begin arg1
+    OP_FUNC_END,
+    OP_INT2REAL, OP_REAL2INT, OP_CHAR2INT, OP_INT2CHAR, OP_BOOL2INT, OP_INT2BOOL,
+    OP_COUNT
+} OpCode;
+
+// How a quad is laid out in the 3-address listing
+typedef enum OpFormat {
+    FMT_NOP, FMT_COPY, FMT_BINARY, FMT_UNARY, FMT_ARRAY_LOAD, FMT_ARRAY_STORE,
+    FMT_PTR_STORE, FMT_GOTO, FMT_IF, FMT_IFREL, FMT_PARAM, FMT_CALL, FMT_RETURN,
+    FMT_FUNC_BEGIN, FMT_FUNC_END, FMT_CONV
+} OpFormat;
+
+typedef struct OpInfo {
+    const char *name;      // Name in the quad array ("+", "=[]", "=inttoreal", ...)
+    const char *symbol;    // Operator as written in the listing
+    OpFormat format;
+} OpInfo;
+
+extern const OpInfo opInfo[OP_COUNT];
+
+// Kinds of quad operands
+typedef enum __attribute__((packed)) OperandKind {
+    OPD_NONE,              // Unused operand (or a jump not yet backpatched)
+    OPD_SYM,               // Program variable
+    OPD_TEMP,              // Compiler temporary
+    OPD_INT,               // Integer immediate
+    OPD_FLOAT,             // Floating point immediate
+    OPD_TARGET,            // Quad index of a jump target
+    OPD_STR                // String literal
+} OperandKind;
+
+// Operands and quads are byte packed: an operand is a 1-byte kind and an
+// 8-byte payload, so a quad takes 28 bytes. Payloads are read
+// unaligned, which x86-64 does at full speed.
+typedef struct __attribute__((packed)) Operand {
+    OperandKind kind;
+    union {
+        SymbolEntry *sym;  // OPD_SYM, OPD_TEMP
+        int ival;          // OPD_INT
+        double fval;       // OPD_FLOAT
+        int target;        // OPD_TARGET
+        const char *str;   // OPD_STR
+    };
+} Operand;
+
 // Quad structure (for 3-address code)
 typedef struct Quad {
-    char *op;              // Operator
-    char *arg1;            // Argument 1
-    char *arg2;            // Argument 2
-    char *result;          // Result
+    OpCode op;             // Operator
+    Operand arg1;          // Argument 1
+    Operand arg2;          // Argument 2
+    Operand result;        // Result
 } Quad;
 
-// List structure for backpatching
+// Quads live in chunks that double in size; a quad never moves once emitted,
+// so indices (and pointers from quadAt) stay valid for backpatching
+#define QUAD_CHUNK_BITS 10   // First chunk holds 1024 quads
+#define QUAD_MAX_CHUNKS 21   // Enough chunks to address INT_MAX quads
+
+// Node of a backpatch list
+typedef struct QuadListNode {
+    int index;                 // Index of quad
+    struct QuadListNode *next; // Next list item
+} QuadListNode;
+
+// List structure for backpatching; head and tail make merge O(1).
+// Lists are allocated from a pool and released by freeQuadLists().
 typedef struct QuadList {
-    int index;             // Index of quad
-    struct QuadList *next; // Next list item
+    QuadListNode *head;
+    QuadListNode *tail;
 } QuadList;
 
 // Function declarations for symbol table
-SymbolTable* createSymbolTable(char *name, SymbolTable *parent);
-SymbolEntry* lookup(SymbolTable *table, char *name);
-SymbolEntry* lookupInCurrentScope(SymbolTable *table, char *name);
-SymbolEntry* insert(SymbolTable *table, char *name, Type type);
+SymbolTable* createSymbolTable(const char *name, SymbolTable *parent);
+SymbolEntry* lookup(SymbolTable *table, const char *name);
+SymbolEntry* lookupInCurrentScope(SymbolTable *table, const char *name);
+SymbolEntry* insert(SymbolTable *table, const char *name, Type type);
 SymbolEntry* gentemp(SymbolTable *table, Type type);
+void removeSymbols(SymbolTable *table, int (*keep)(const SymbolEntry *entry));
 void updateSymbolType(SymbolEntry *entry, Type type);
 void updateSymbolSize(SymbolEntry *entry, int size);
 void updateSymbolOffset(SymbolEntry *entry, int offset);
@@ -81,26 +171,31 @@ void updateSymbolElementType(SymbolEntry *entry, Type type);
 void printSymbolTable(SymbolTable *table);
 
 // Function declarations for quads
-void emitQuad(char *op, char *arg1, char *arg2, char *result);
+void emitQuad(OpCode op, Operand arg1, Operand arg2, Operand result);
 void printQuads();
+void printQuadsinstruction();
+void freeQuads();
+size_t quadStoreBytes();
 int nextquad();
 QuadList* makelist(int i);
 QuadList* merge(QuadList *p1, QuadList *p2);
 void backpatch(QuadList *p, int i);
+void freeQuadLists();
 
 // Type conversion functions
 Type typecheck(Type type1, Type type2);
-char* convInt2Float(char *s);
-char* convFloat2Int(char *s);
-char* convChar2Int(char *s);
-char* convInt2Char(char *s);
-char* convBool2Int(char *s);
-char* convInt2Bool(char *s);
+SymbolEntry* convInt2Float(SymbolEntry *s);
+SymbolEntry* convFloat2Int(SymbolEntry *s);
+SymbolEntry* convChar2Int(SymbolEntry *s);
+SymbolEntry* convInt2Char(SymbolEntry *s);
+SymbolEntry* convBool2Int(SymbolEntry *s);
+SymbolEntry* convInt2Bool(SymbolEntry *s);
+SymbolEntry* convertType(SymbolEntry *s, Type to);
 
 // Global variables
 extern SymbolTable *currentTable;
 extern SymbolTable *globalTable;
-extern Quad quads[1000];  // Assuming a maximum of 1000 quads
+extern Quad *quadChunks[QUAD_MAX_CHUNKS];
 extern int quadIndex;
 extern int tempVarCount;
 extern int labelCount;
@@ -111,4 +206,41 @@ char* newTemp();
 int sizeOfType(Type type);
 char* typeToString(Type type);
 
+// Operand constructors
+static inline Operand noOperand() {
+    Operand o = { .kind = OPD_NONE };
+    return o;
+}
+
+static inline Operand symOperand(SymbolEntry *entry) {
+    Operand o = { .kind = entry->isTemp ? OPD_TEMP : OPD_SYM, .sym = entry };
+    return o;
+}
+
+static inline Operand intOperand(int value) {
+    Operand o = { .kind = OPD_INT, .ival = value };
+    return o;
+}
+
+static inline Operand floatOperand(double value) {
+    Operand o = { .kind = OPD_FLOAT, .fval = value };
+    return o;
+}
+
+static inline Operand targetOperand(int quad) {
+    Operand o = { .kind = OPD_TARGET, .target = quad };
+    return o;
+}
+
+static inline Operand strOperand(const char *s) {
+    Operand o = { .kind = OPD_STR, .str = s };
+    return o;
+}
+
+// Map a quad index to its slot: chunk c starts at index (2^c - 1) * 1024
+static inline Quad* quadAt(int i) {
+    unsigned chunk = 31 - __builtin_clz(((unsigned)i >> QUAD_CHUNK_BITS) + 1);
+    return &quadChunks[chunk][i - (((1u << chunk) - 1) << QUAD_CHUNK_BITS)];
+}
+
 #endif
\ No newline at end of file
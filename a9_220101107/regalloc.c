@@ -0,0 +1,150 @@
+#include "regalloc.h"
+
+typedef struct Interval {
+    int start, end;
+    int var;
+    int spansCall;
+} Interval;
+
+static int byStart(const void *a, const void *b) {
+    const Interval *x = (const Interval*)a, *y = (const Interval*)b;
+    return x->start != y->start ? (x->start > y->start) - (x->start < y->start)
+                                : (x->end > y->end) - (x->end < y->end);
+}
+
+// Whether a call lies strictly inside start..end; calls are in quad order.
+// The result of a call is stored after it returns, and arguments are read
+// before it, so intervals that only touch the call are not affected.
+static int spansCall(const int *calls, int callCount, int start, int end) {
+    int lo = 0, hi = callCount;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (calls[mid] <= start)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo < callCount && calls[lo] < end;
+}
+
+// Free register of the class for the interval, or -1. Intervals that do
+// not span a call take caller-saved registers first, leaving the others
+// for those that do.
+static int freeRegister(const RegisterFile *file, const int *owner, int first, int last,
+                        int needsCalleeSaved) {
+    int fallback = -1;
+    for (int r = first; r < last; r++) {
+        if (owner[r] >= 0)
+            continue;
+        int calleeSaved = (file->calleeSaved >> r) & 1;
+        if (calleeSaved && fallback < 0)
+            fallback = r;
+        if (!calleeSaved && !needsCalleeSaved)
+            return r;
+    }
+    return fallback;
+}
+
+Allocation allocateRegisters(CFG *cfg, const RegisterFile *file) {
+    Allocation a;
+    memset(&a, 0, sizeof(a));
+    int shared;
+    int count = numberVariables(cfg, &shared);
+    LiveIntervals live;
+    liveIntervals(cfg, count, shared, &live);
+
+    size_t n = varSlots(count);
+    SymbolEntry **vars = (SymbolEntry**)malloc(n * sizeof(SymbolEntry*));
+    for (SymbolEntry *e = cfg->function->nestedTable->entries; e; e = e->next)
+        if (e->id >= 0)
+            vars[e->id] = e;
+
+    int callCount = 0;
+    for (int i = cfg->begin + 1; i < cfg->end; i++)
+        if (quadAt(i)->op == OP_CALL)
+            callCount++;
+    int *calls = (int*)malloc((callCount ? callCount : 1) * sizeof(int));
+    callCount = 0;
+    for (int i = cfg->begin + 1; i < cfg->end; i++)
+        if (quadAt(i)->op == OP_CALL)
+            calls[callCount++] = i;
+
+    // Variables live on entry are loaded from the frame before the first
+    // quad; those whose interval is not known stay in memory
+    Interval *intervals = (Interval*)malloc(n * sizeof(Interval));
+    int *reg = (int*)malloc(n * sizeof(int));
+    int candidates = 0;
+    for (int v = 0; v < count; v++) {
+        reg[v] = -1;
+        if (live.end[v] < 0)
+            continue;
+        a.candidates++;
+        if (live.flags[v] & LIVE_UNTRACKED) {
+            a.spilled++;
+            continue;
+        }
+        Interval *in = &intervals[candidates++];
+        in->start = live.flags[v] & LIVE_ON_ENTRY ? cfg->begin : live.start[v];
+        in->end = live.end[v];
+        in->var = v;
+        in->spansCall = spansCall(calls, callCount, in->start, in->end);
+    }
+    qsort(intervals, candidates, sizeof(Interval), byStart);
+
+    // Interval holding each register, -1 when free. Operands of a quad are
+    // read before its result is written, so an interval ending at a quad
+    // frees its register for one starting there.
+    int owner[REGALLOC_MAX_REGISTERS];
+    int total = file->intCount + file->floatCount;
+    for (int r = 0; r < total; r++)
+        owner[r] = -1;
+    for (int i = 0; i < candidates; i++) {
+        Interval *in = &intervals[i];
+        for (int r = 0; r < total; r++)
+            if (owner[r] >= 0 && intervals[owner[r]].end <= in->start)
+                owner[r] = -1;
+
+        int isFloat = vars[in->var]->type == FLOAT_T;
+        int first = isFloat ? file->intCount : 0;
+        int last = isFloat ? total : file->intCount;
+        int r = freeRegister(file, owner, first, last, in->spansCall);
+        if (r < 0) {
+            // Spill whichever usable interval ends last
+            int victim = -1;
+            for (int k = first; k < last; k++) {
+                if (in->spansCall && !((file->calleeSaved >> k) & 1))
+                    continue;
+                if (victim < 0 || intervals[owner[k]].end > intervals[owner[victim]].end)
+                    victim = k;
+            }
+            a.spilled++;
+            if (victim < 0 || intervals[owner[victim]].end <= in->end)
+                continue;
+            reg[intervals[owner[victim]].var] = -1;
+            r = victim;
+        }
+        owner[r] = i;
+        reg[in->var] = r;
+    }
+
+    a.onEntry = (SymbolEntry**)malloc(n * sizeof(SymbolEntry*));
+    for (int v = 0; v < count; v++) {
+        vars[v]->id = reg[v];
+        if (reg[v] < 0)
+            continue;
+        a.used |= 1ULL << reg[v];
+        if (live.flags[v] & LIVE_ON_ENTRY)
+            a.onEntry[a.onEntryCount++] = vars[v];
+    }
+
+    free(vars);
+    free(calls);
+    free(intervals);
+    free(reg);
+    freeLiveIntervals(&live);
+    return a;
+}
+
+void freeAllocation(Allocation *a) {
+    free(a->onEntry);
+}
@@ -0,0 +1,38 @@
+#ifndef REGALLOC_H
+#define REGALLOC_H
+
+#include "opt.h"
+
+// Linear-scan register allocation (Poletto and Sarkar) for the native
+// backends. The variables numberVariables() tracks get live intervals over
+// the function's quads, and a scan over the intervals in order of their
+// start hands out registers, spilling the interval that ends last when
+// none is free. A spilled variable stays in its own frame slot, which
+// coalesceTemps() already shares between temporaries whose lifetimes do
+// not overlap, so spills need no slots of their own.
+//
+// Calls preserve only the callee-saved registers, so intervals that span
+// a call are given one of those or spilled.
+
+#define REGALLOC_MAX_REGISTERS 64
+
+typedef struct RegisterFile {
+    int intCount;           // Registers 0..intCount-1 hold integers,
+    int floatCount;         // the next floatCount ones floats
+    uint64_t calleeSaved;   // Registers a call preserves, by bit
+} RegisterFile;
+
+typedef struct Allocation {
+    int candidates;         // Variables that could live in a register
+    int spilled;            // Of those, left in their frame slots
+    uint64_t used;          // Registers handed out, by bit
+    SymbolEntry **onEntry;  // Variables in registers whose value on entry is read,
+    int onEntryCount;       // such as parameters: load them from the frame first
+} Allocation;
+
+// Each variable given a register has it as its id, and every other id is
+// negative; resetVariables() clears them
+Allocation allocateRegisters(CFG *cfg, const RegisterFile *file);
+void freeAllocation(Allocation *a);
+
+#endif
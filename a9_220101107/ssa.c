@@ -0,0 +1,344 @@
+#include "opt.h"
+#include "ssa.h"
+
+// Dominance frontiers by Cooper, Harvey and Kennedy: walking up from each
+// predecessor of a join to the join's immediate dominator passes exactly
+// the blocks with the join in their frontier. Those of block b are
+// frontier[start[b]] up to frontier[start[b + 1]].
+static int* dominanceFrontiers(const CFG *cfg, int **start) {
+    int n = cfg->blockCount;
+    int *last = (int*)malloc(n * sizeof(int));   // Join last added to each frontier
+    *start = (int*)calloc(n + 1, sizeof(int));
+    int *frontier = NULL;
+    int *fill = NULL;
+
+    // Count, then fill
+    for (int pass = 0; pass < 2; pass++) {
+        for (int b = 0; b < n; b++)
+            last[b] = -1;
+        for (int b = 0; b < n; b++) {
+            const BasicBlock *block = &cfg->blocks[b];
+            if (block->rpo < 0 || block->predCount < 2)
+                continue;
+            for (int k = 0; k < block->predCount; k++) {
+                int runner = block->pred[k];
+                if (cfg->blocks[runner].rpo < 0)
+                    continue;
+                for (; runner != block->idom && runner >= 0; runner = cfg->blocks[runner].idom) {
+                    if (last[runner] == b)
+                        break;
+                    last[runner] = b;
+                    if (pass == 0)
+                        (*start)[runner + 1]++;
+                    else
+                        frontier[fill[runner]++] = b;
+                }
+            }
+        }
+        if (pass == 0) {
+            for (int b = 0; b < n; b++)
+                (*start)[b + 1] += (*start)[b];
+            frontier = (int*)malloc(((*start)[n] ? (*start)[n] : 1) * sizeof(int));
+            fill = (int*)malloc(n * sizeof(int));
+            memcpy(fill, *start, n * sizeof(int));
+        }
+    }
+    free(fill);
+    free(last);
+    return frontier;
+}
+
+static int isTracked(Operand o) {
+    return isVariable(o) && o.sym->id >= 0;
+}
+
+// Place a phi for each variable some block reads before assigning, at the
+// iterated dominance frontier of the blocks assigning it. The exit block
+// reads no variable and gets none.
+static void placePhis(SSA *ssa) {
+    CFG *cfg = ssa->cfg;
+    int n = cfg->blockCount, count = ssa->varCount;
+    size_t vars = varSlots(count);
+
+    // Blocks assigning each variable, and whether any block reads it first
+    int *assignedIn = (int*)calloc(vars, sizeof(int));    // Block + 1 it was last assigned in
+    int *defStart = (int*)calloc(vars + 1, sizeof(int));
+    char *exposed = (char*)calloc(vars, 1);
+    int *defBlocks = NULL, *fill = NULL;
+    for (int pass = 0; pass < 2; pass++) {
+        memset(assignedIn, 0, vars * sizeof(int));
+        for (int b = 0; b < n; b++) {
+            if (cfg->blocks[b].rpo < 0)
+                continue;
+            for (int i = cfg->blocks[b].first; i <= cfg->blocks[b].last && i < cfg->end; i++) {
+                Quad *q = quadAt(i);
+                for (int slot = 1; slot <= 3; slot++) {
+                    Operand *o = operandOf(q, slot);
+                    if (readsOperand(q, slot) && isTracked(*o) && assignedIn[o->sym->id] != b + 1)
+                        exposed[o->sym->id] = 1;
+                }
+                if (!definesResult(q->op) || !isTracked(q->result))
+                    continue;
+                int id = q->result.sym->id;
+                if (assignedIn[id] != b + 1) {
+                    assignedIn[id] = b + 1;
+                    if (pass == 0)
+                        defStart[id + 1]++;
+                    else
+                        defBlocks[fill[id]++] = b;
+                }
+            }
+        }
+        if (pass == 0) {
+            for (int v = 0; v < count; v++)
+                defStart[v + 1] += defStart[v];
+            defBlocks = (int*)malloc((defStart[count] ? defStart[count] : 1) * sizeof(int));
+            fill = (int*)malloc(vars * sizeof(int));
+            memcpy(fill, defStart, vars * sizeof(int));
+        }
+    }
+
+    int *frontierStart;
+    int *frontier = dominanceFrontiers(cfg, &frontierStart);
+    int *hasPhi = (int*)malloc(n * sizeof(int));    // Variable + 1 last given a phi here
+    int *queued = (int*)malloc(n * sizeof(int));    // Variable + 1 last queued here
+    int *work = (int*)malloc(n * sizeof(int));
+    for (int b = 0; b < n; b++)
+        hasPhi[b] = queued[b] = 0;
+    int capacity = 16, args = 0;
+    ssa->phis = (Phi*)malloc(capacity * sizeof(Phi));
+    ssa->phiCount = 0;
+    ssa->phiHead = (int*)malloc(n * sizeof(int));
+    int *phiTail = (int*)malloc(n * sizeof(int));
+    for (int b = 0; b < n; b++)
+        ssa->phiHead[b] = phiTail[b] = -1;
+
+    for (int v = 0; v < count; v++) {
+        if (!exposed[v])
+            continue;
+        int top = 0;
+        for (int d = defStart[v]; d < defStart[v + 1]; d++) {
+            queued[defBlocks[d]] = v + 1;
+            work[top++] = defBlocks[d];
+        }
+        while (top > 0) {
+            int x = work[--top];
+            for (int f = frontierStart[x]; f < frontierStart[x + 1]; f++) {
+                int y = frontier[f];
+                if (hasPhi[y] == v + 1 || y == n - 1)
+                    continue;
+                hasPhi[y] = v + 1;
+                if (ssa->phiCount == capacity) {
+                    capacity *= 2;
+                    ssa->phis = (Phi*)realloc(ssa->phis, capacity * sizeof(Phi));
+                }
+                int p = ssa->phiCount++;
+                Phi *phi = &ssa->phis[p];
+                phi->block = y;
+                phi->var = v;
+                phi->value = -1;
+                phi->args = NULL;
+                phi->next = -1;
+                if (phiTail[y] < 0)
+                    ssa->phiHead[y] = p;
+                else
+                    ssa->phis[phiTail[y]].next = p;
+                phiTail[y] = p;
+                args += cfg->blocks[y].predCount;
+                if (queued[y] != v + 1) {
+                    queued[y] = v + 1;
+                    work[top++] = y;
+                }
+            }
+        }
+    }
+
+    ssa->argPool = (int*)malloc((args ? args : 1) * sizeof(int));
+    int *arg = ssa->argPool;
+    for (int p = 0; p < ssa->phiCount; p++) {
+        Phi *phi = &ssa->phis[p];
+        phi->args = arg;
+        for (int k = 0; k < cfg->blocks[phi->block].predCount; k++)
+            *arg++ = -1;
+    }
+
+    free(assignedIn);
+    free(defStart);
+    free(exposed);
+    free(defBlocks);
+    free(fill);
+    free(frontierStart);
+    free(frontier);
+    free(hasPhi);
+    free(queued);
+    free(work);
+    free(phiTail);
+}
+
+static int newValue(SSA *ssa, int var, int def) {
+    int v = ssa->valueCount++;
+    ssa->var[v] = var;
+    ssa->def[v] = def;
+    return v;
+}
+
+// Name the values in dominator tree preorder, keeping the value each
+// variable holds in current[] and undoing a block's assignments on
+// leaving its subtree
+static void renameValues(SSA *ssa) {
+    CFG *cfg = ssa->cfg;
+    int n = cfg->blockCount, count = ssa->varCount;
+    int quads = cfg->end - cfg->begin - 1;
+
+    int limit = count + ssa->phiCount + quads;
+    ssa->var = (int*)malloc(varSlots(limit) * sizeof(int));
+    ssa->def = (int*)malloc(varSlots(limit) * sizeof(int));
+    ssa->valueCount = 0;
+    for (int v = 0; v < count; v++)
+        newValue(ssa, v, -1);
+    ssa->quadValue = (int*)malloc((quads ? quads : 1) * sizeof(int));
+    ssa->uses = (int*)malloc((quads ? 3 * quads : 1) * sizeof(int));
+    for (int k = 0; k < quads; k++)
+        ssa->quadValue[k] = -1;
+    for (int k = 0; k < 3 * quads; k++)
+        ssa->uses[k] = -1;
+
+    // Index of each edge in its target's predecessors, by 2 * block + succ
+    // slot; predecessor lists are built in block order
+    int *predSlot = (int*)malloc(2 * n * sizeof(int));
+    int *cursor = (int*)calloc(n, sizeof(int));
+    for (int b = 0; b < n; b++)
+        for (int k = 0; k < cfg->blocks[b].succCount; k++)
+            predSlot[2 * b + k] = cursor[cfg->blocks[b].succ[k]]++;
+
+    int *childStart = (int*)calloc(n + 1, sizeof(int));
+    int *children = (int*)malloc(n * sizeof(int));
+    for (int b = 0; b < n; b++)
+        if (cfg->blocks[b].idom >= 0)
+            childStart[cfg->blocks[b].idom + 1]++;
+    for (int b = 0; b < n; b++)
+        childStart[b + 1] += childStart[b];
+    memcpy(cursor, childStart, n * sizeof(int));
+    for (int b = 0; b < n; b++)
+        if (cfg->blocks[b].idom >= 0)
+            children[cursor[cfg->blocks[b].idom]++] = b;
+
+    int *current = (int*)malloc(varSlots(count) * sizeof(int));
+    for (int v = 0; v < count; v++)
+        current[v] = v;
+    int *undoVar = (int*)malloc(varSlots(limit) * sizeof(int));
+    int *undoValue = (int*)malloc(varSlots(limit) * sizeof(int));
+    int *mark = cursor;     // Reused: undo log length on entering each block
+    int *stack = (int*)malloc(2 * n * sizeof(int));     // Block, or ~block to leave it
+    int top = 0, logged = 0;
+
+    stack[top++] = 0;
+    while (top > 0) {
+        int b = stack[--top];
+        if (b < 0) {
+            for (; logged > mark[~b]; logged--)
+                current[undoVar[logged - 1]] = undoValue[logged - 1];
+            continue;
+        }
+        BasicBlock *block = &cfg->blocks[b];
+        mark[b] = logged;
+        for (int p = ssa->phiHead[b]; p >= 0; p = ssa->phis[p].next) {
+            Phi *phi = &ssa->phis[p];
+            phi->value = newValue(ssa, phi->var, -2 - p);
+            undoVar[logged] = phi->var;
+            undoValue[logged++] = current[phi->var];
+            current[phi->var] = phi->value;
+        }
+        for (int i = block->first; i <= block->last && i < cfg->end; i++) {
+            Quad *q = quadAt(i);
+            int k = i - cfg->begin - 1;
+            for (int slot = 1; slot <= 3; slot++) {
+                Operand *o = operandOf(q, slot);
+                if (readsOperand(q, slot) && isTracked(*o))
+                    ssa->uses[3 * k + slot - 1] = current[o->sym->id];
+            }
+            if (definesResult(q->op) && isTracked(q->result)) {
+                int id = q->result.sym->id;
+                ssa->quadValue[k] = newValue(ssa, id, i);
+                undoVar[logged] = id;
+                undoValue[logged++] = current[id];
+                current[id] = ssa->quadValue[k];
+            }
+        }
+        for (int k = 0; k < block->succCount; k++) {
+            int s = block->succ[k];
+            for (int p = ssa->phiHead[s]; p >= 0; p = ssa->phis[p].next)
+                ssa->phis[p].args[predSlot[2 * b + k]] = current[ssa->phis[p].var];
+        }
+        stack[top++] = ~b;
+        for (int c = childStart[b]; c < childStart[b + 1]; c++)
+            stack[top++] = children[c];
+    }
+
+    free(predSlot);
+    free(cursor);
+    free(childStart);
+    free(children);
+    free(current);
+    free(undoVar);
+    free(undoValue);
+    free(stack);
+}
+
+// Def-use chains: the quads and phis reading each value
+static void linkUsers(SSA *ssa) {
+    int values = ssa->valueCount;
+    int quads = ssa->cfg->end - ssa->cfg->begin - 1;
+    ssa->userStart = (int*)calloc(values + 1, sizeof(int));
+    for (int k = 0; k < 3 * quads; k++)
+        if (ssa->uses[k] >= 0)
+            ssa->userStart[ssa->uses[k] + 1]++;
+    for (int p = 0; p < ssa->phiCount; p++) {
+        Phi *phi = &ssa->phis[p];
+        for (int k = 0; k < ssa->cfg->blocks[phi->block].predCount; k++)
+            if (phi->args[k] >= 0)
+                ssa->userStart[phi->args[k] + 1]++;
+    }
+    for (int v = 0; v < values; v++)
+        ssa->userStart[v + 1] += ssa->userStart[v];
+
+    ssa->users = (int*)malloc((ssa->userStart[values] ? ssa->userStart[values] : 1) * sizeof(int));
+    int *fill = (int*)malloc((values ? values : 1) * sizeof(int));
+    memcpy(fill, ssa->userStart, values * sizeof(int));
+    for (int k = 0; k < 3 * quads; k++)
+        if (ssa->uses[k] >= 0)
+            ssa->users[fill[ssa->uses[k]]++] = ssa->cfg->begin + 1 + k / 3;
+    for (int p = 0; p < ssa->phiCount; p++) {
+        Phi *phi = &ssa->phis[p];
+        for (int k = 0; k < ssa->cfg->blocks[phi->block].predCount; k++)
+            if (phi->args[k] >= 0)
+                ssa->users[fill[phi->args[k]]++] = -1 - p;
+    }
+    free(fill);
+}
+
+// Build the SSA form of the function over the varCount variables that
+// numberVariables() numbered
+SSA* buildSSA(CFG *cfg, int varCount) {
+    SSA *ssa = (SSA*)calloc(1, sizeof(SSA));
+    ssa->cfg = cfg;
+    ssa->varCount = varCount;
+    placePhis(ssa);
+    renameValues(ssa);
+    linkUsers(ssa);
+    return ssa;
+}
+
+void freeSSA(SSA *ssa) {
+    if (!ssa) return;
+    free(ssa->var);
+    free(ssa->def);
+    free(ssa->quadValue);
+    free(ssa->uses);
+    free(ssa->phis);
+    free(ssa->phiHead);
+    free(ssa->argPool);
+    free(ssa->userStart);
+    free(ssa->users);
+    free(ssa);
+}
@@ -0,0 +1,53 @@
+#ifndef SSA_H
+#define SSA_H
+
+#include "cfg.h"
+
+// Static single assignment form of one function, kept beside its quads.
+// Every assignment to a tracked variable (see numberVariables()) defines a
+// value of its own, and a phi at the start of a block merges the values
+// of a variable that reach the block along its different edges.
+//
+// The quads are not renamed: each operand that reads a tracked variable
+// records the value it reads instead. Going back out of SSA then only
+// needs the variable behind each value, which is sound as long as no two
+// values of one variable are live at once; passes that substitute
+// constants and fold branches keep it so.
+//
+// Phis are placed on the iterated dominance frontiers of the blocks that
+// assign a variable, for the variables some block reads before assigning
+// (semi-pruned SSA), and values are named by a walk of the dominator tree.
+
+typedef struct Phi {
+    int block;
+    int var;                // Tracked variable merged
+    int value;              // Value the phi defines
+    int *args;              // Value along each edge, in block->pred order; -1 from unreachable blocks
+    int next;               // Next phi of the block, -1 after the last
+} Phi;
+
+typedef struct SSA {
+    CFG *cfg;
+    int varCount;           // Values 0..varCount-1 are the variables on entry
+    int valueCount;
+    int *var;               // Variable of each value
+    int *def;               // Defining quad of each value; -1 on entry, -2 - phi for phis
+    int *quadValue;         // Value each quad defines, -1 if none, by quad - begin - 1
+    int *uses;              // Value each operand reads, -1 if none, by 3 * (quad - begin - 1) + slot - 1
+    Phi *phis;              // Phis in the entry block also merge the values on entry
+    int phiCount;
+    int *phiHead;           // First phi of each block, -1 if none
+    int *argPool;
+    int *userStart;         // Readers of value v are users[userStart[v]] up to userStart[v + 1]:
+    int *users;             // quads by index, phi p as -1 - p
+} SSA;
+
+SSA* buildSSA(CFG *cfg, int varCount);
+void freeSSA(SSA *ssa);
+
+// Value read by operand 1, 2 or 3 of a quad, -1 if not a tracked variable
+static inline int ssaUse(const SSA *ssa, int quad, int slot) {
+    return ssa->uses[3 * (quad - ssa->cfg->begin - 1) + slot - 1];
+}
+
+#endif
@@ -0,0 +1,184 @@
+#include "opt.h"
+
+// Strength reduction. An int variable whose only assignment in a loop is
+// i = i + c or i = i - c, with c constant, is a basic induction variable
+// of the loop. A quad t = i * k in the loop with k constant, as array
+// indexing produces for a[i], then becomes a copy of a new temporary that
+// is set to i * k in the loop's preheader and advanced by c * k right
+// after each increment of i, so the loop adds instead of multiplying.
+//
+// Multiplications of ints by a power of two left over, the new preheader
+// ones included, become shifts.
+
+// A temporary tracking i * k in the loop being reduced
+typedef struct Derived {
+    SymbolEntry *iv;
+    int factor;
+    SymbolEntry *temp;
+} Derived;
+
+static int log2Exact(long long v) {
+    if (v < 2 || (v & (v - 1)))
+        return -1;
+    int s = 0;
+    while (v > 1) {
+        v >>= 1;
+        s++;
+    }
+    return s;
+}
+
+// x * 2^s as x << s; the VM wraps both to the result type the same way
+static int toShift(Quad *q) {
+    if (q->op != OP_MUL || !isVariable(q->result) || q->result.sym->type == FLOAT_T)
+        return 0;
+    if (q->arg1.kind == OPD_INT && log2Exact(q->arg1.ival) > 0 && q->arg2.kind != OPD_FLOAT) {
+        Operand x = q->arg2;
+        q->arg2 = intOperand(log2Exact(q->arg1.ival));
+        q->arg1 = x;
+    } else if (q->arg2.kind == OPD_INT && log2Exact(q->arg2.ival) > 0 && q->arg1.kind != OPD_FLOAT) {
+        q->arg2 = intOperand(log2Exact(q->arg2.ival));
+    } else {
+        return 0;
+    }
+    q->op = OP_SHL;
+    return 1;
+}
+
+// The step of i = i + c or i = i - c, in *step; 0 if q is not one
+static int inductionStep(const Quad *q, int *step) {
+    SymbolEntry *i = q->result.sym;
+    if (i->type != INT_T)
+        return 0;
+    if (q->op == OP_ADD && isVariable(q->arg1) && q->arg1.sym == i && q->arg2.kind == OPD_INT)
+        *step = q->arg2.ival;
+    else if (q->op == OP_ADD && isVariable(q->arg2) && q->arg2.sym == i && q->arg1.kind == OPD_INT)
+        *step = q->arg1.ival;
+    else if (q->op == OP_SUB && isVariable(q->arg1) && q->arg1.sym == i && q->arg2.kind == OPD_INT)
+        *step = (int)(0u - (unsigned)q->arg2.ival);
+    else
+        return 0;
+    return 1;
+}
+
+// The basic induction variable of the loop that q multiplies by a constant
+static SymbolEntry* scaledInduction(const Quad *q, int loop, const int *defLoop,
+                                    const int *defCount, int *factor) {
+    if (q->op != OP_MUL || !isVariable(q->result) || q->result.sym->type != INT_T)
+        return NULL;
+    Operand i = q->arg1, k = q->arg2;
+    if (i.kind == OPD_INT) {
+        i = q->arg2;
+        k = q->arg1;
+    }
+    if (k.kind != OPD_INT || !isVariable(i) || i.sym->id < 0 || i.sym->type != INT_T)
+        return NULL;
+    int id = i.sym->id;
+    if (defLoop[id] != loop || defCount[id] != 1)
+        return NULL;
+    *factor = k.ival;
+    return i.sym;
+}
+
+int reduceStrength(CFG *cfg) {
+    int shared;
+    int count = numberVariables(cfg, &shared);
+    size_t n = varSlots(count);
+    int *defLoop = (int*)malloc(n * sizeof(int));   // Loop the counts below are for
+    int *defCount = (int*)malloc(n * sizeof(int));
+    int *defQuad = (int*)malloc(n * sizeof(int));
+    for (int v = 0; v < count; v++)
+        defLoop[v] = -1;
+
+    int room = 0;
+    for (int i = cfg->begin + 1; i < cfg->end; i++)
+        if (quadAt(i)->op == OP_NOP)
+            room++;
+    Insertion *insertions = (Insertion*)malloc((room ? room : 1) * sizeof(Insertion));
+    Derived *derived = (Derived*)malloc((room / 2 + 1) * sizeof(Derived));
+    int inserted = 0, changed = 0;
+
+    int *start;
+    int *blocks = loopBlocks(cfg, &start);
+    for (int l = 0; l < cfg->loopCount && room - inserted >= 2; l++) {
+        if (fallsIntoHeader(cfg, l))
+            continue;
+        for (int b = start[l]; b < start[l + 1]; b++) {
+            BasicBlock *block = &cfg->blocks[blocks[b]];
+            for (int i = block->first; i <= block->last; i++) {
+                Quad *q = quadAt(i);
+                if (!definesResult(q->op) || !isVariable(q->result) || q->result.sym->id < 0)
+                    continue;
+                int id = q->result.sym->id;
+                if (defLoop[id] != l) {
+                    defLoop[id] = l;
+                    defCount[id] = 0;
+                }
+                defCount[id]++;
+                defQuad[id] = i;
+            }
+        }
+
+        int derivedCount = 0;
+        for (int b = start[l]; b < start[l + 1]; b++) {
+            BasicBlock *block = &cfg->blocks[blocks[b]];
+            for (int i = block->first; i <= block->last; i++) {
+                Quad *q = quadAt(i);
+                int factor, step;
+                SymbolEntry *iv = scaledInduction(q, l, defLoop, defCount, &factor);
+                if (!iv || !inductionStep(quadAt(defQuad[iv->id]), &step))
+                    continue;
+
+                int d = 0;
+                while (d < derivedCount && (derived[d].iv != iv || derived[d].factor != factor))
+                    d++;
+                if (d == derivedCount) {
+                    if (room - inserted < 2)
+                        continue;
+                    SymbolEntry *temp = gentemp(cfg->function->nestedTable, INT_T);
+                    derived[derivedCount++] = (Derived){ iv, factor, temp };
+
+                    Insertion *init = &insertions[inserted++];
+                    init->before = cfg->blocks[cfg->loops[l].header].first;
+                    init->loop = l;
+                    init->quad.op = OP_MUL;
+                    init->quad.arg1 = symOperand(iv);
+                    init->quad.arg2 = intOperand(factor);
+                    init->quad.result = symOperand(temp);
+                    toShift(&init->quad);
+
+                    Insertion *advance = &insertions[inserted++];
+                    advance->before = defQuad[iv->id] + 1;
+                    advance->loop = -1;
+                    advance->quad.op = OP_ADD;
+                    advance->quad.arg1 = symOperand(temp);
+                    advance->quad.arg2 = intOperand((int)((unsigned)step * (unsigned)factor));
+                    advance->quad.result = symOperand(temp);
+                }
+                q->op = OP_ASSIGN;
+                q->arg1 = symOperand(derived[d].temp);
+                q->arg2 = noOperand();
+                changed = 1;
+            }
+        }
+    }
+    free(blocks);
+    free(start);
+    resetVariables(cfg);
+
+    // The nops counted make room for every insertion
+    if (inserted)
+        rewriteFunction(cfg, insertions, inserted);
+    int shifted = 0;
+    for (int i = cfg->begin + 1; i < cfg->end; i++)
+        shifted |= toShift(quadAt(i));
+
+    free(insertions);
+    free(derived);
+    free(defLoop);
+    free(defCount);
+    free(defQuad);
+    if (changed)
+        return OPT_CHANGED | OPT_CFG_CHANGED;
+    return shifted ? OPT_CHANGED : 0;
+}
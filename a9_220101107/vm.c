@@ -0,0 +1,682 @@
+#include <math.h>
+#include "vm.h"
+
+// Build with -DVM_SWITCH_DISPATCH to compare against a plain switch loop
+#if defined(__GNUC__) && !defined(VM_SWITCH_DISPATCH)
+#define VM_THREADED 1   // Dispatch through label addresses (computed goto)
+#endif
+
+#define VM_NULL_BYTES 16    // Low addresses are never valid objects
+#define VM_RESULT_ADDR 8    // Where the entry function's result is stored
+
+// Operand resolved at decode time: a byte offset from the start of memory
+// (globals and constants) or from the current frame
+typedef struct VMOperand {
+    int32_t offset;
+    uint8_t frame;      // 1 for frame relative
+    uint8_t type;       // Type of the value stored there
+} VMOperand;
+
+// Instruction kinds. Suffixes select the operand representation:
+// _W all operands are 4-byte ints, _I any integer types, _F float.
+#define VM_OPS(X) \
+    X(NOP) X(MOV) X(MOV_W) \
+    X(ADD_W) X(SUB_W) X(MUL_W) \
+    X(ADD_I) X(SUB_I) X(MUL_I) X(DIV_I) X(MOD_I) \
+    X(AND_I) X(OR_I) X(XOR_I) X(SHL_I) X(SHR_I) \
+    X(ADD_F) X(SUB_F) X(MUL_F) X(DIV_F) X(MOD_F) \
+    X(LT_W) X(GT_W) X(LE_W) X(GE_W) X(EQ_W) X(NE_W) \
+    X(LT_I) X(GT_I) X(LE_I) X(GE_I) X(EQ_I) X(NE_I) \
+    X(LT_F) X(GT_F) X(LE_F) X(GE_F) X(EQ_F) X(NE_F) \
+    X(LOGAND) X(LOGOR) X(NEG_I) X(NEG_F) X(NOT) \
+    X(ADDR) X(DEREF) X(ALOAD) X(ASTORE) X(PSTORE) \
+    X(GOTO) X(IF) X(IFFALSE) \
+    X(IFLT_W) X(IFGT_W) X(IFLE_W) X(IFGE_W) X(IFEQ_W) X(IFNE_W) \
+    X(IFLT_I) X(IFGT_I) X(IFLE_I) X(IFGE_I) X(IFEQ_I) X(IFNE_I) \
+    X(IFLT_F) X(IFGT_F) X(IFLE_F) X(IFGE_F) X(IFEQ_F) X(IFNE_F) \
+    X(PARAM) X(CALL) X(RETURN) X(RETURN_VOID) X(SKIP) X(HALT)
+
+#define VM_ENUM(op) VM_##op,
+typedef enum VMOp { VM_OPS(VM_ENUM) VM_COUNT } VMOp;
+
+// Pre-decoded instruction; code[i] is quad i, so jump targets carry over
+typedef struct VMInstr {
+    const void *handler;    // Handler label (threaded dispatch)
+    int op;                 // VMOp (switch dispatch)
+    int target;             // Jump target or function index
+    VMOperand a, b, r;
+    int aux;                // Argument count, or element type for memory access
+} VMInstr;
+
+typedef struct VMFunction {
+    int start;              // First instruction of the body
+    int frameSize;
+    int paramCount;
+    VMOperand *params;      // Frame slots of the parameters, in order
+} VMFunction;
+
+typedef struct VMFrame {
+    VMInstr *call;          // Call instruction to return to
+    size_t fp;              // Caller's frame
+} VMFrame;
+
+typedef struct VM {
+    uint8_t *mem;
+    size_t memSize;
+    size_t globalBase;      // Address of the global table's frame
+    size_t poolBase;        // Address of the constant pool
+    size_t sp;              // First free byte of the stack
+    uint8_t *pool;          // Constant pool under construction
+    size_t poolLen, poolCap;
+    VMInstr *code;
+    int codeCount;
+    VMFunction *functions;
+    int functionCount;
+    VMValue *params;        // Values passed by param, consumed by call
+    int paramCount, paramCapacity;
+    VMFrame *frames;
+    int frameCount;
+} VM;
+
+static const void **vmHandlers;
+
+static inline int32_t ld32(const uint8_t *p) {
+    int32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline void st32(uint8_t *p, int32_t v) {
+    memcpy(p, &v, 4);
+}
+
+static inline long long loadInt(const uint8_t *p, int type) {
+    switch (type) {
+        case CHAR_T: return (signed char)*p;
+        case BOOL_T: return *p;
+        case FLOAT_T: { double d; memcpy(&d, p, 8); return (long long)d; }
+        default: return ld32(p);
+    }
+}
+
+static inline double loadFloat(const uint8_t *p, int type) {
+    if (type == FLOAT_T) {
+        double d;
+        memcpy(&d, p, 8);
+        return d;
+    }
+    return (double)loadInt(p, type);
+}
+
+static inline void storeInt(uint8_t *p, int type, long long v) {
+    switch (type) {
+        case CHAR_T: *p = (uint8_t)v; break;
+        case BOOL_T: *p = v != 0; break;
+        case FLOAT_T: { double d = (double)v; memcpy(p, &d, 8); break; }
+        case VOID_T: case ARRAY_T: case FUNC_T: break;
+        default: st32(p, (int32_t)v); break;
+    }
+}
+
+static inline void storeFloat(uint8_t *p, int type, double v) {
+    if (type == FLOAT_T)
+        memcpy(p, &v, 8);
+    else if (type == BOOL_T)
+        *p = v != 0;
+    else
+        storeInt(p, type, (long long)v);
+}
+
+static inline VMValue loadValue(const uint8_t *p, int type) {
+    VMValue v;
+    v.type = (Type)type;
+    if (type == FLOAT_T)
+        v.fval = loadFloat(p, type);
+    else
+        v.ival = loadInt(p, type);
+    return v;
+}
+
+static inline void storeValue(uint8_t *p, int type, VMValue v) {
+    if (v.type == FLOAT_T)
+        storeFloat(p, type, v.fval);
+    else
+        storeInt(p, type, v.ival);
+}
+
+static inline int truth(const uint8_t *p, int type) {
+    return type == FLOAT_T ? loadFloat(p, type) != 0 : loadInt(p, type) != 0;
+}
+
+#ifdef VM_THREADED
+#define CASE(op)   L_##op:
+#define DISPATCH() goto *ip->handler
+#else
+#define CASE(op)   case VM_##op:
+#define DISPATCH() goto dispatch
+#endif
+#define NEXT()     do { ip++; DISPATCH(); } while (0)
+#define JUMP()     do { ip = code + ip->target; DISPATCH(); } while (0)
+#define FAIL(msg)  do { error = msg; goto fail; } while (0)
+
+#define A (bases[ip->a.frame] + ip->a.offset)
+#define B (bases[ip->b.frame] + ip->b.offset)
+#define R (bases[ip->r.frame] + ip->r.offset)
+
+#define BINOP_W(op, expr) CASE(op) { \
+    int32_t x = ld32(A), y = ld32(B); \
+    st32(R, (int32_t)(expr)); NEXT(); }
+#define BINOP_I(op, expr) CASE(op) { \
+    long long x = loadInt(A, ip->a.type), y = loadInt(B, ip->b.type); \
+    storeInt(R, ip->r.type, expr); NEXT(); }
+#define BINOP_F(op, expr) CASE(op) { \
+    double x = loadFloat(A, ip->a.type), y = loadFloat(B, ip->b.type); \
+    storeFloat(R, ip->r.type, expr); NEXT(); }
+#define CMP_W(op, rel) CASE(op) { st32(R, ld32(A) rel ld32(B)); NEXT(); }
+#define CMP_I(op, rel) CASE(op) { \
+    storeInt(R, ip->r.type, loadInt(A, ip->a.type) rel loadInt(B, ip->b.type)); NEXT(); }
+#define CMP_F(op, rel) CASE(op) { \
+    storeInt(R, ip->r.type, loadFloat(A, ip->a.type) rel loadFloat(B, ip->b.type)); NEXT(); }
+#define IF_W(op, rel) CASE(op) { \
+    if (ld32(A) rel ld32(B)) \
+        JUMP(); \
+    NEXT(); }
+#define IF_I(op, rel) CASE(op) { \
+    if (loadInt(A, ip->a.type) rel loadInt(B, ip->b.type)) \
+        JUMP(); \
+    NEXT(); }
+#define IF_F(op, rel) CASE(op) { \
+    if (loadFloat(A, ip->a.type) rel loadFloat(B, ip->b.type)) \
+        JUMP(); \
+    NEXT(); }
+
+// Address check for loads and stores through pointers and arrays
+#define CHECK_ADDR(addr) \
+    if ((addr) < VM_NULL_BYTES || (size_t)(addr) + 8 > vm->memSize) \
+        FAIL("invalid memory access")
+
+// Run from ip until HALT. Called with vm == NULL once to publish the
+// handler addresses for the decoder.
+static int execute(VM *vm, VMInstr *ip) {
+#ifdef VM_THREADED
+#define VM_LABEL(op) &&L_##op,
+    static const void *labels[VM_COUNT] = { VM_OPS(VM_LABEL) };
+    if (!vm) {
+        vmHandlers = labels;
+        return 0;
+    }
+#else
+    if (!vm)
+        return 0;
+#endif
+
+    uint8_t *mem = vm->mem;
+    VMInstr *code = vm->code;
+    uint8_t *bases[2] = { mem, mem + vm->sp };  // Globals, current frame
+    const char *error = NULL;
+    VMValue retValue;
+
+#ifdef VM_THREADED
+    DISPATCH();
+#else
+dispatch:
+    switch (ip->op) {
+#endif
+
+    CASE(NOP) NEXT();
+    CASE(MOV) { storeValue(R, ip->r.type, loadValue(A, ip->a.type)); NEXT(); }
+    CASE(MOV_W) { st32(R, ld32(A)); NEXT(); }
+
+    BINOP_W(ADD_W, (uint32_t)x + (uint32_t)y)
+    BINOP_W(SUB_W, (uint32_t)x - (uint32_t)y)
+    BINOP_W(MUL_W, (uint32_t)x * (uint32_t)y)
+
+    BINOP_I(ADD_I, x + y)
+    BINOP_I(SUB_I, x - y)
+    BINOP_I(MUL_I, x * y)
+    CASE(DIV_I) {
+        long long x = loadInt(A, ip->a.type), y = loadInt(B, ip->b.type);
+        if (y == 0) FAIL("division by zero");
+        storeInt(R, ip->r.type, y == -1 ? -x : x / y);
+        NEXT();
+    }
+    CASE(MOD_I) {
+        long long x = loadInt(A, ip->a.type), y = loadInt(B, ip->b.type);
+        if (y == 0) FAIL("division by zero");
+        storeInt(R, ip->r.type, y == -1 ? 0 : x % y);
+        NEXT();
+    }
+    BINOP_I(AND_I, x & y)
+    BINOP_I(OR_I, x | y)
+    BINOP_I(XOR_I, x ^ y)
+    BINOP_I(SHL_I, (long long)((unsigned long long)x << (y & 31)))
+    BINOP_I(SHR_I, (int32_t)x >> (y & 31))
+
+    BINOP_F(ADD_F, x + y)
+    BINOP_F(SUB_F, x - y)
+    BINOP_F(MUL_F, x * y)
+    BINOP_F(DIV_F, x / y)
+    BINOP_F(MOD_F, fmod(x, y))
+
+    CMP_W(LT_W, <) CMP_W(GT_W, >) CMP_W(LE_W, <=)
+    CMP_W(GE_W, >=) CMP_W(EQ_W, ==) CMP_W(NE_W, !=)
+    CMP_I(LT_I, <) CMP_I(GT_I, >) CMP_I(LE_I, <=)
+    CMP_I(GE_I, >=) CMP_I(EQ_I, ==) CMP_I(NE_I, !=)
+    CMP_F(LT_F, <) CMP_F(GT_F, >) CMP_F(LE_F, <=)
+    CMP_F(GE_F, >=) CMP_F(EQ_F, ==) CMP_F(NE_F, !=)
+
+    CASE(LOGAND) { storeInt(R, ip->r.type, truth(A, ip->a.type) && truth(B, ip->b.type)); NEXT(); }
+    CASE(LOGOR) { storeInt(R, ip->r.type, truth(A, ip->a.type) || truth(B, ip->b.type)); NEXT(); }
+    CASE(NEG_I) { storeInt(R, ip->r.type, -loadInt(A, ip->a.type)); NEXT(); }
+    CASE(NEG_F) { storeFloat(R, ip->r.type, -loadFloat(A, ip->a.type)); NEXT(); }
+    CASE(NOT) { storeInt(R, ip->r.type, !truth(A, ip->a.type)); NEXT(); }
+
+    CASE(ADDR) { storeInt(R, ip->r.type, A - mem); NEXT(); }
+    CASE(DEREF) {
+        long long addr = loadInt(A, ip->a.type);
+        CHECK_ADDR(addr);
+        storeValue(R, ip->r.type, loadValue(mem + addr, ip->aux));
+        NEXT();
+    }
+    CASE(ALOAD) {
+        long long addr = ip->a.type == ARRAY_T ? A - mem : loadInt(A, ip->a.type);
+        addr += loadInt(B, ip->b.type);
+        CHECK_ADDR(addr);
+        storeValue(R, ip->r.type, loadValue(mem + addr, ip->aux));
+        NEXT();
+    }
+    CASE(ASTORE) {
+        long long addr = ip->r.type == ARRAY_T ? R - mem : loadInt(R, ip->r.type);
+        addr += loadInt(A, ip->a.type);
+        CHECK_ADDR(addr);
+        storeValue(mem + addr, ip->aux, loadValue(B, ip->b.type));
+        NEXT();
+    }
+    CASE(PSTORE) {
+        long long addr = loadInt(R, ip->r.type);
+        CHECK_ADDR(addr);
+        storeValue(mem + addr, ip->aux, loadValue(A, ip->a.type));
+        NEXT();
+    }
+
+    CASE(GOTO) JUMP();
+    CASE(IF) {
+        if (truth(A, ip->a.type))
+            JUMP();
+        NEXT();
+    }
+    CASE(IFFALSE) {
+        if (!truth(A, ip->a.type))
+            JUMP();
+        NEXT();
+    }
+    IF_W(IFLT_W, <) IF_W(IFGT_W, >) IF_W(IFLE_W, <=)
+    IF_W(IFGE_W, >=) IF_W(IFEQ_W, ==) IF_W(IFNE_W, !=)
+    IF_I(IFLT_I, <) IF_I(IFGT_I, >) IF_I(IFLE_I, <=)
+    IF_I(IFGE_I, >=) IF_I(IFEQ_I, ==) IF_I(IFNE_I, !=)
+    IF_F(IFLT_F, <) IF_F(IFGT_F, >) IF_F(IFLE_F, <=)
+    IF_F(IFGE_F, >=) IF_F(IFEQ_F, ==) IF_F(IFNE_F, !=)
+
+    CASE(PARAM) {
+        if (vm->paramCount == vm->paramCapacity) {
+            vm->paramCapacity = vm->paramCapacity ? vm->paramCapacity * 2 : 64;
+            vm->params = (VMValue*)realloc(vm->params, vm->paramCapacity * sizeof(VMValue));
+        }
+        vm->params[vm->paramCount++] = loadValue(A, ip->a.type);
+        NEXT();
+    }
+    CASE(CALL) {
+        VMFunction *f = &vm->functions[ip->target];
+        size_t fp = vm->sp;
+        if (vm->frameCount == VM_MAX_DEPTH || fp + f->frameSize + 8 > vm->memSize)
+            FAIL("call stack overflow");
+        memset(mem + fp, 0, f->frameSize);
+
+        // Arguments are the last ip->aux values passed
+        int argc = ip->aux < vm->paramCount ? ip->aux : vm->paramCount;
+        int first = vm->paramCount - argc;
+        for (int i = 0; i < argc && i < f->paramCount; i++)
+            storeValue(mem + fp + f->params[i].offset, f->params[i].type, vm->params[first + i]);
+        vm->paramCount = first;
+
+        VMFrame *frame = &vm->frames[vm->frameCount++];
+        frame->call = ip;
+        frame->fp = bases[1] - mem;
+        vm->sp = (fp + f->frameSize + 7) & ~(size_t)7;
+        bases[1] = mem + fp;
+        ip = code + f->start;
+        DISPATCH();
+    }
+    CASE(RETURN) {
+        retValue = loadValue(A, ip->a.type);
+        goto leave;
+    }
+    CASE(RETURN_VOID) {
+        retValue.type = INT_T;
+        retValue.ival = 0;
+        goto leave;
+    }
+    CASE(SKIP) JUMP();
+    CASE(HALT) return 0;
+
+#ifndef VM_THREADED
+    default:
+        FAIL("bad instruction");
+    }
+#endif
+
+leave:
+    // A return outside any function ends the program
+    if (vm->frameCount == 0)
+        return 0;
+    {
+        VMFrame *frame = &vm->frames[--vm->frameCount];
+        vm->sp = bases[1] - mem;
+        bases[1] = mem + frame->fp;
+        ip = frame->call;
+        storeValue(R, ip->r.type, retValue);
+        NEXT();
+    }
+
+fail:
+    fprintf(stderr, "Error: %s at quad %d\n", error, (int)(ip - code));
+    return -1;
+}
+
+// Decoding
+
+static size_t addConstant(VM *vm, const void *bytes, size_t len) {
+    size_t offset = (vm->poolLen + 7) & ~(size_t)7;
+    while (offset + len > vm->poolCap) {
+        vm->poolCap = vm->poolCap ? vm->poolCap * 2 : 4096;
+        vm->pool = (uint8_t*)realloc(vm->pool, vm->poolCap);
+    }
+    memcpy(vm->pool + offset, bytes, len);
+    vm->poolLen = offset + len;
+    return vm->poolBase + offset;
+}
+
+static VMOperand decodeOperand(VM *vm, Operand o) {
+    VMOperand d;
+    memset(&d, 0, sizeof(d));
+    switch (o.kind) {
+        case OPD_SYM:
+        case OPD_TEMP:
+            d.type = o.sym->type;
+            if (o.sym->table == globalTable) {
+                d.offset = (int32_t)(vm->globalBase + o.sym->offset);
+            } else {
+                d.offset = o.sym->offset;
+                d.frame = 1;
+            }
+            break;
+        case OPD_INT: {
+            int32_t v = (int32_t)o.ival;
+            d.type = INT_T;
+            d.offset = (int32_t)addConstant(vm, &v, sizeof(v));
+            break;
+        }
+        case OPD_FLOAT:
+            d.type = FLOAT_T;
+            d.offset = (int32_t)addConstant(vm, &o.fval, sizeof(o.fval));
+            break;
+        case OPD_STR: {
+            // The literal keeps its quotes; the pointer refers to the bytes between them
+            size_t len = strlen(o.str);
+            const char *s = o.str;
+            if (len >= 2 && s[0] == '"') {
+                s++;
+                len -= 2;
+            }
+            char *bytes = (char*)malloc(len + 1);
+            memcpy(bytes, s, len);
+            bytes[len] = '\0';
+            int32_t addr = (int32_t)addConstant(vm, bytes, len + 1);
+            free(bytes);
+            d.type = PTR_T;
+            d.offset = (int32_t)addConstant(vm, &addr, sizeof(addr));
+            break;
+        }
+        default:
+            d.type = VOID_T;
+            break;
+    }
+    return d;
+}
+
+static int isWord(int type) {
+    return type == INT_T || type == PTR_T;
+}
+
+static int isFloat(int type) {
+    return type == FLOAT_T;
+}
+
+// Map a quad to its instruction kind from the operand types
+static VMOp selectOp(OpCode op, const VMInstr *in) {
+    int a = in->a.type, b = in->b.type, r = in->r.type;
+    int words = isWord(a) && isWord(b) && isWord(r);
+    int floatResult = isFloat(r);
+    int floatArgs = isFloat(a) || isFloat(b);
+
+    switch (op) {
+        case OP_NOP: return VM_NOP;
+        case OP_ASSIGN:
+        case OP_INT2REAL:
+        case OP_REAL2INT:
+        case OP_CHAR2INT:
+        case OP_INT2CHAR:
+        case OP_BOOL2INT:
+        case OP_INT2BOOL:
+            return isWord(a) && isWord(r) ? VM_MOV_W : VM_MOV;
+
+        case OP_ADD: return floatResult ? VM_ADD_F : words ? VM_ADD_W : VM_ADD_I;
+        case OP_SUB: return floatResult ? VM_SUB_F : words ? VM_SUB_W : VM_SUB_I;
+        case OP_MUL: return floatResult ? VM_MUL_F : words ? VM_MUL_W : VM_MUL_I;
+        case OP_DIV: return floatResult ? VM_DIV_F : VM_DIV_I;
+        case OP_MOD: return floatResult ? VM_MOD_F : VM_MOD_I;
+        case OP_BITAND: return VM_AND_I;
+        case OP_BITOR:  return VM_OR_I;
+        case OP_BITXOR: return VM_XOR_I;
+        case OP_SHL:    return VM_SHL_I;
+        case OP_SHR:    return VM_SHR_I;
+
+        case OP_LT: return floatArgs ? VM_LT_F : words ? VM_LT_W : VM_LT_I;
+        case OP_GT: return floatArgs ? VM_GT_F : words ? VM_GT_W : VM_GT_I;
+        case OP_LE: return floatArgs ? VM_LE_F : words ? VM_LE_W : VM_LE_I;
+        case OP_GE: return floatArgs ? VM_GE_F : words ? VM_GE_W : VM_GE_I;
+        case OP_EQ: return floatArgs ? VM_EQ_F : words ? VM_EQ_W : VM_EQ_I;
+        case OP_NE: return floatArgs ? VM_NE_F : words ? VM_NE_W : VM_NE_I;
+
+        case OP_LOGAND: return VM_LOGAND;
+        case OP_LOGOR:  return VM_LOGOR;
+        case OP_UMINUS: return floatResult ? VM_NEG_F : VM_NEG_I;
+        case OP_NOT:    return VM_NOT;
+        case OP_ADDR:   return VM_ADDR;
+        case OP_DEREF:  return VM_DEREF;
+        case OP_ARRAY_LOAD:  return VM_ALOAD;
+        case OP_ARRAY_STORE: return VM_ASTORE;
+        case OP_PTR_STORE:   return VM_PSTORE;
+
+        case OP_GOTO:    return VM_GOTO;
+        case OP_IF:      return VM_IF;
+        case OP_IFFALSE: return VM_IFFALSE;
+        // Conditional jumps have no result, so only the arguments decide
+        case OP_IFLT: return floatArgs ? VM_IFLT_F : isWord(a) && isWord(b) ? VM_IFLT_W : VM_IFLT_I;
+        case OP_IFGT: return floatArgs ? VM_IFGT_F : isWord(a) && isWord(b) ? VM_IFGT_W : VM_IFGT_I;
+        case OP_IFLE: return floatArgs ? VM_IFLE_F : isWord(a) && isWord(b) ? VM_IFLE_W : VM_IFLE_I;
+        case OP_IFGE: return floatArgs ? VM_IFGE_F : isWord(a) && isWord(b) ? VM_IFGE_W : VM_IFGE_I;
+        case OP_IFEQ: return floatArgs ? VM_IFEQ_F : isWord(a) && isWord(b) ? VM_IFEQ_W : VM_IFEQ_I;
+        case OP_IFNE: return floatArgs ? VM_IFNE_F : isWord(a) && isWord(b) ? VM_IFNE_W : VM_IFNE_I;
+
+        case OP_PARAM:  return VM_PARAM;
+        case OP_CALL:   return VM_CALL;
+        case OP_RETURN: return in->a.type == VOID_T ? VM_RETURN_VOID : VM_RETURN;
+        case OP_FUNC_BEGIN: return VM_SKIP;
+        case OP_FUNC_END:   return VM_RETURN_VOID;
+        default: return VM_NOP;
+    }
+}
+
+// Index of the function called through entry, or -1 if it has no body
+static int functionIndex(Operand o) {
+    if (o.kind != OPD_SYM || !o.sym->nestedTable)
+        return -1;
+    return o.sym->id;
+}
+
+static Type returnTypeOf(SymbolEntry *func) {
+    SymbolEntry *retVal = lookupInCurrentScope(func->nestedTable, "retVal");
+    return retVal ? retVal->type : INT_T;
+}
+
+static void freeVM(VM *vm) {
+    for (int i = 0; i < vm->functionCount; i++)
+        free(vm->functions[i].params);
+    free(vm->functions);
+    free(vm->code);
+    free(vm->pool);
+    free(vm->params);
+    free(vm->frames);
+    free(vm->mem);
+}
+
+static int decode(VM *vm, SymbolEntry *entry) {
+    int n = quadIndex;
+    int status = 0;
+
+    vm->globalBase = VM_NULL_BYTES;
+    vm->poolBase = (vm->globalBase + globalTable->frameSize + 7) & ~(size_t)7;
+
+    // Functions are numbered through the scratch id of their entries
+    int capacity = 0;
+    for (int i = 0; i < n; i++) {
+        Quad *q = quadAt(i);
+        if (q->op != OP_FUNC_BEGIN || q->arg1.kind != OPD_SYM)
+            continue;
+        SymbolEntry *func = q->arg1.sym;
+        SymbolTable *table = func->nestedTable;
+        if (!table)
+            continue;
+        if (vm->functionCount == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            vm->functions = (VMFunction*)realloc(vm->functions, capacity * sizeof(VMFunction));
+        }
+        VMFunction *f = &vm->functions[vm->functionCount];
+        f->start = i + 1;
+        f->frameSize = table->frameSize;
+        f->paramCount = func->paramCount < table->count ? func->paramCount : table->count;
+        f->params = (VMOperand*)malloc((f->paramCount + 1) * sizeof(VMOperand));
+        SymbolEntry *p = table->entries;
+        for (int k = 0; k < f->paramCount; k++, p = p->next) {
+            f->params[k].offset = p->offset;
+            f->params[k].frame = 1;
+            f->params[k].type = p->type;
+        }
+        func->id = vm->functionCount++;
+    }
+
+    // One instruction per quad, then a call of the entry function and a halt
+    vm->codeCount = n + 2;
+    vm->code = (VMInstr*)calloc(vm->codeCount, sizeof(VMInstr));
+    int openFunction = -1;
+    for (int i = 0; i < n && status == 0; i++) {
+        Quad *q = quadAt(i);
+        VMInstr *in = &vm->code[i];
+        in->a = decodeOperand(vm, q->arg1);
+        in->b = decodeOperand(vm, q->arg2);
+        in->r = q->result.kind == OPD_TARGET ? decodeOperand(vm, noOperand())
+                                              : decodeOperand(vm, q->result);
+        // Jumps that were never patched fall through
+        in->target = q->result.kind == OPD_TARGET ? q->result.target : i + 1;
+        in->op = selectOp(q->op, in);
+
+        switch (q->op) {
+            case OP_DEREF:
+            case OP_ARRAY_LOAD:
+                in->aux = in->r.type;
+                break;
+            case OP_ARRAY_STORE:
+            case OP_PTR_STORE:
+                in->aux = (q->result.kind == OPD_SYM || q->result.kind == OPD_TEMP) &&
+                          q->result.sym->eleType != VOID_T ? q->result.sym->eleType : INT_T;
+                break;
+            case OP_CALL:
+                in->target = functionIndex(q->arg1);
+                in->aux = q->arg2.kind == OPD_INT ? (int)q->arg2.ival : 0;
+                if (in->target < 0) {
+                    fprintf(stderr, "Error: %s is called but never defined\n",
+                            q->arg1.kind == OPD_SYM ? q->arg1.sym->name : "?");
+                    status = -1;
+                }
+                break;
+            case OP_FUNC_BEGIN:
+                // Reached in straight-line code: jump over the body
+                openFunction = i;
+                break;
+            case OP_FUNC_END:
+                if (openFunction >= 0)
+                    vm->code[openFunction].target = i + 1;
+                openFunction = -1;
+                break;
+            default:
+                break;
+        }
+    }
+
+    VMInstr *call = &vm->code[n];
+    call->op = VM_CALL;
+    call->target = entry->id;
+    call->r.offset = VM_RESULT_ADDR;
+    call->r.type = returnTypeOf(entry);
+    vm->code[n + 1].op = VM_HALT;
+    if (entry->id < 0) {
+        fprintf(stderr, "Error: %s is declared but never defined\n", entry->name);
+        status = -1;
+    }
+
+    // Scratch numbers are only needed while decoding calls
+    for (SymbolEntry *e = globalTable->entries; e; e = e->next)
+        e->id = -1;
+    if (status != 0)
+        return status;
+
+#ifdef VM_THREADED
+    for (int i = 0; i < vm->codeCount; i++)
+        vm->code[i].handler = vmHandlers[vm->code[i].op];
+#endif
+
+    // Lay out memory and copy the constants in
+    size_t stackBase = (vm->poolBase + vm->poolLen + 7) & ~(size_t)7;
+    vm->memSize = stackBase + VM_STACK_BYTES;
+    vm->mem = (uint8_t*)calloc(1, vm->memSize);
+    if (!vm->mem) {
+        fprintf(stderr, "Error: out of memory for the VM\n");
+        return -1;
+    }
+    if (vm->poolLen)
+        memcpy(vm->mem + vm->poolBase, vm->pool, vm->poolLen);
+    vm->sp = stackBase;
+    vm->frames = (VMFrame*)malloc(VM_MAX_DEPTH * sizeof(VMFrame));
+    return 0;
+}
+
+int vmRun(const char *entryName, VMValue *result) {
+    SymbolEntry *entry = lookupInCurrentScope(globalTable, entryName);
+    if (!entry || !entry->nestedTable) {
+        fprintf(stderr, "Error: no function %s to run\n", entryName);
+        return -1;
+    }
+
+    execute(NULL, NULL);
+
+    VM vm;
+    memset(&vm, 0, sizeof(vm));
+    int status = decode(&vm, entry);
+    if (status == 0)
+        status = execute(&vm, vm.code);
+    if (status == 0 && result)
+        *result = loadValue(vm.mem + VM_RESULT_ADDR, vm.code[quadIndex].r.type);
+    freeVM(&vm);
+    return status;
+}
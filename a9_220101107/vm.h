@@ -0,0 +1,35 @@
+#ifndef VM_H
+#define VM_H
+
+#include <stdint.h>
+#include "quad.h"
+
+// Virtual machine for the generated quads. The quad array is decoded once
+// into fixed-width instructions whose operands are resolved to memory
+// addresses; the interpreter then dispatches on a handler address stored
+// in each instruction (direct threading with GCC computed goto, or a
+// switch on other compilers).
+//
+// Memory is one byte array: a reserved null area, the globals (laid out
+// as in the global table), the constant pool, and the call stack, where
+// every call gets a frame laid out as its function's table. Pointers are
+// byte addresses into that array.
+
+#define VM_STACK_BYTES (64 << 20)   // Size of the call stack
+#define VM_MAX_DEPTH   100000       // Deepest call nesting allowed
+
+// A value passed between functions
+typedef struct VMValue {
+    Type type;
+    union {
+        long long ival;     // Integer, char, bool and pointer values
+        double fval;        // Float values
+    };
+} VMValue;
+
+// Decode the current quads and run them: global initialisers first, then
+// the function named entry. Returns 0 and the function's return value in
+// result, or -1 after reporting a decode or run time error.
+int vmRun(const char *entry, VMValue *result);
+
+#endif
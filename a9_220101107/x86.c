@@ -0,0 +1,1113 @@
+#include <fcntl.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include "x86.h"
+#include "opt.h"
+#include "outbuf.h"
+#include "regalloc.h"
+#include "vm.h"
+
+// Each quad is lowered on its own: operands are loaded from their frame
+// or global slots into scratch registers, converted exactly as the VM's
+// loadInt/loadFloat would, combined, and stored back with the VM's
+// narrowing to the result type. Integer arithmetic is done in 64 bits.
+//
+// A call zeroes the callee's frame right above the caller's, copies the
+// arguments passed by param (pushed on the machine stack) into the
+// callee's parameter slots and calls it with %rbx at its frame. Results
+// come back in %rax, or in %xmm0 from functions returning float.
+//
+// Scalar locals and temporaries whose address is never taken are given
+// registers by regalloc.c where it can: integers sign-extended to 64 bits
+// in %r8, %r9, %r12-%r15 or %rbp, floats in %xmm2-%xmm14. A function
+// saves the callee-saved ones it uses, and loads the variables whose value
+// on entry it reads, such as its parameters, from its frame.
+
+// Largest frame zeroed with unrolled stores rather than rep stosq
+#define X86_UNROLLED_ZEROING 128
+
+// Registers by their 64, 32 and 8-bit names: scratch registers, then
+// those that hold variables
+typedef enum Reg { RAX, RCX, RDX, RSI, R10, R11, R8, R9, R12, R13, R14, R15, RBP } Reg;
+static const char *const reg64[] = { "%rax", "%rcx", "%rdx", "%rsi", "%r10", "%r11",
+                                     "%r8", "%r9", "%r12", "%r13", "%r14", "%r15", "%rbp" };
+static const char *const reg32[] = { "%eax", "%ecx", "%edx", "%esi", "%r10d", "%r11d",
+                                     "%r8d", "%r9d", "%r12d", "%r13d", "%r14d", "%r15d", "%ebp" };
+static const char *const reg8[]  = { "%al", "%cl", "%dl", "%sil", "%r10b", "%r11b",
+                                     "%r8b", "%r9b", "%r12b", "%r13b", "%r14b", "%r15b", "%bpl" };
+
+// Registers handed to regalloc.c: integer ones from %r8 up, the callee-saved
+// %r12-%rbp among them, then %xmm2-%xmm14
+static const RegisterFile registerFile = { 7, 13, 0x7c };
+static const char *const xmmNames[] = { "%xmm2", "%xmm3", "%xmm4", "%xmm5", "%xmm6", "%xmm7",
+                                        "%xmm8", "%xmm9", "%xmm10", "%xmm11", "%xmm12",
+                                        "%xmm13", "%xmm14" };
+
+// An addressing mode, as text
+typedef struct Mem {
+    char text[48];
+} Mem;
+
+typedef struct Emitter {
+    OutBuf out;
+    const AsmSink *sink;    // Where lines go instead of out, when lowering for the JIT
+    int begin, end;         // func_begin and func_end being lowered; begin is -1 for the global code
+    Type returnType;
+    int frameBytes;         // Frame size rounded up to 8: callee frames start there
+    int *beginOf;           // func_begin of the function each quad is in, -1 outside
+    char *isTarget;         // Quads that need a label
+    char *pushedFloat;      // Class of each value passed by param and not yet consumed
+    int pushed, pushedCapacity;
+    int strings;            // String literals emitted so far
+    Allocation alloc;       // Registers of the function being lowered
+    int stats;              // Report the allocation of each function
+} Emitter;
+
+// One line of output, without its newline
+static void put(Emitter *e, const char *line) {
+    if (e->sink) {
+        e->sink->line(e->sink->context, line);
+    } else {
+        outPuts(&e->out, line);
+        outChar(&e->out, '\n');
+    }
+}
+
+// Blank line between the parts of the file
+static void blank(Emitter *e) {
+    if (!e->sink)
+        outChar(&e->out, '\n');
+}
+
+static void emit(Emitter *e, const char *format, ...) {
+    char line[256] = "    ";
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line + 4, sizeof(line) - 4, format, args);
+    va_end(args);
+    put(e, line);
+}
+
+static void label(Emitter *e, const char *format, ...) {
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(line, sizeof(line) - 1, format, args);
+    va_end(args);
+    if (n > (int)sizeof(line) - 2)
+        n = (int)sizeof(line) - 2;
+    line[n] = ':';
+    line[n + 1] = '\0';
+    put(e, line);
+}
+
+static Mem memOf(const SymbolEntry *sym) {
+    Mem m;
+    if (sym->table == globalTable)
+        snprintf(m.text, sizeof(m.text), "__mc_globals+%d(%%rip)", sym->offset);
+    else
+        snprintf(m.text, sizeof(m.text), "%d(%%rbx)", sym->offset);
+    return m;
+}
+
+static Mem memAt(Reg base, int offset) {
+    Mem m;
+    snprintf(m.text, sizeof(m.text), "%d(%s)", offset, reg64[base]);
+    return m;
+}
+
+static Type typeOf(Operand o) {
+    switch (o.kind) {
+        case OPD_SYM:
+        case OPD_TEMP:  return o.sym->type;
+        case OPD_INT:   return INT_T;
+        case OPD_FLOAT: return FLOAT_T;
+        case OPD_STR:   return PTR_T;
+        default:        return VOID_T;
+    }
+}
+
+static int isFloatValue(Operand o) {
+    return typeOf(o) == FLOAT_T;
+}
+
+// Register a variable operand lives in, as allocated for the function
+// being lowered; -1 for operands in memory
+static int regOf(Operand o) {
+    if (!isVariable(o) || o.sym->table == globalTable)
+        return -1;
+    return o.sym->id >= 0 ? o.sym->id : -1;
+}
+
+static Reg intRegister(int reg) {
+    return (Reg)(R8 + reg);
+}
+
+static const char *floatRegister(int reg) {
+    return xmmNames[reg - registerFile.intCount];
+}
+
+static int isFloatRegister(int reg) {
+    return reg >= registerFile.intCount;
+}
+
+static Type returnTypeOf(const SymbolEntry *func) {
+    SymbolEntry *retVal = lookupInCurrentScope(func->nestedTable, "retVal");
+    return retVal ? retVal->type : INT_T;
+}
+
+static void loadIntFrom(Emitter *e, Mem m, Type type, Reg r) {
+    switch (type) {
+        case CHAR_T:  emit(e, "movsbq %s, %s", m.text, reg64[r]); break;
+        case BOOL_T:  emit(e, "movzbq %s, %s", m.text, reg64[r]); break;
+        case FLOAT_T: emit(e, "cvttsd2siq %s, %s", m.text, reg64[r]); break;
+        default:      emit(e, "movslq %s, %s", m.text, reg64[r]); break;
+    }
+}
+
+// The string's bytes between its quotes, in read-only data; returns its label number
+static int emitString(Emitter *e, const char *s) {
+    size_t len = strlen(s);
+    if (len >= 2 && s[0] == '"') {
+        s++;
+        len -= 2;
+    }
+    int n = e->strings++;
+    char *line = (char*)malloc(4 * len + 16);
+    int at = sprintf(line, "    .byte ");
+    for (size_t k = 0; k < len; k++)
+        at += sprintf(line + at, "%d,", (unsigned char)s[k]);
+    strcpy(line + at, "0");
+    emit(e, ".section .rodata");
+    label(e, ".LS%d", n);
+    put(e, line);
+    emit(e, ".text");
+    free(line);
+    return n;
+}
+
+// Operand o as the VM's loadInt gives it, in r
+static void loadInt(Emitter *e, Operand o, Reg r) {
+    int reg = regOf(o);
+    if (reg >= 0) {
+        if (isFloatRegister(reg))
+            emit(e, "cvttsd2siq %s, %s", floatRegister(reg), reg64[r]);
+        else if (intRegister(reg) != r)
+            emit(e, "movq %s, %s", reg64[intRegister(reg)], reg64[r]);
+        return;
+    }
+    switch (o.kind) {
+        case OPD_SYM:
+        case OPD_TEMP:
+            loadIntFrom(e, memOf(o.sym), o.sym->type, r);
+            break;
+        case OPD_INT:
+            emit(e, "movq $%d, %s", o.ival, reg64[r]);
+            break;
+        case OPD_FLOAT:
+            emit(e, "movabsq $%lld, %s", (long long)o.fval, reg64[r]);
+            break;
+        case OPD_STR:
+            emit(e, "movl $.LS%d, %s", emitString(e, o.str), reg32[r]);
+            break;
+        default:
+            emit(e, "xorl %s, %s", reg32[r], reg32[r]);
+            break;
+    }
+}
+
+static void loadDouble(Emitter *e, double d, const char *xmm) {
+    long long bits;
+    memcpy(&bits, &d, sizeof(bits));
+    emit(e, "movabsq $%lld, %%r11", bits);
+    emit(e, "movq %%r11, %s", xmm);
+}
+
+// Operand o as the VM's loadFloat gives it, in xmm; uses %r11
+static void loadFloat(Emitter *e, Operand o, const char *xmm) {
+    int reg = regOf(o);
+    if (reg >= 0 && isFloatRegister(reg)) {
+        emit(e, "movapd %s, %s", floatRegister(reg), xmm);
+    } else if (reg >= 0) {
+        emit(e, "cvtsi2sdq %s, %s", reg64[intRegister(reg)], xmm);
+    } else if (o.kind == OPD_FLOAT) {
+        loadDouble(e, o.fval, xmm);
+    } else if (o.kind == OPD_INT) {
+        loadDouble(e, (double)o.ival, xmm);
+    } else if (isFloatValue(o)) {
+        emit(e, "movsd %s, %s", memOf(o.sym).text, xmm);
+    } else {
+        loadInt(e, o, R11);
+        emit(e, "cvtsi2sdq %%r11, %s", xmm);
+    }
+}
+
+// Store the integer in r to m as the VM's storeInt does; uses %xmm15
+static void storeIntTo(Emitter *e, Mem m, Type type, Reg r) {
+    switch (type) {
+        case CHAR_T:
+            emit(e, "movb %s, %s", reg8[r], m.text);
+            break;
+        case BOOL_T:
+            emit(e, "testq %s, %s", reg64[r], reg64[r]);
+            emit(e, "setne %s", m.text);
+            break;
+        case FLOAT_T:
+            emit(e, "cvtsi2sdq %s, %%xmm15", reg64[r]);
+            emit(e, "movsd %%xmm15, %s", m.text);
+            break;
+        case VOID_T: case ARRAY_T: case FUNC_T:
+            break;
+        default:
+            emit(e, "movl %s, %s", reg32[r], m.text);
+            break;
+    }
+}
+
+// Set reg8 of r to whether xmm is nonzero; NaN is. Uses %xmm15 and %r10.
+static void floatTruth(Emitter *e, const char *xmm, Reg r) {
+    emit(e, "xorpd %%xmm15, %%xmm15");
+    emit(e, "ucomisd %%xmm15, %s", xmm);
+    emit(e, "setne %s", reg8[r]);
+    emit(e, "setp %%r10b");
+    emit(e, "orb %%r10b, %s", reg8[r]);
+}
+
+// Store the double in xmm to m as the VM's storeFloat does; uses %r10, %r11
+static void storeFloatTo(Emitter *e, Mem m, Type type, const char *xmm) {
+    if (type == FLOAT_T) {
+        emit(e, "movsd %s, %s", xmm, m.text);
+    } else if (type == BOOL_T) {
+        floatTruth(e, xmm, R11);
+        emit(e, "movb %%r11b, %s", m.text);
+    } else {
+        emit(e, "cvttsd2siq %s, %%r11", xmm);
+        storeIntTo(e, m, type, R11);
+    }
+}
+
+// m = o, converting as the VM's storeValue does; m may be based on %rsi
+static void move(Emitter *e, Operand o, Mem m, Type type) {
+    if (isFloatValue(o)) {
+        loadFloat(e, o, "%xmm0");
+        storeFloatTo(e, m, type, "%xmm0");
+    } else {
+        loadInt(e, o, RAX);
+        storeIntTo(e, m, type, RAX);
+    }
+}
+
+// Store the integer in r to the result operand, in memory or a register
+static void storeInt(Emitter *e, Operand result, Reg r) {
+    int reg = regOf(result);
+    if (reg < 0) {
+        if (isVariable(result))
+            storeIntTo(e, memOf(result.sym), result.sym->type, r);
+        return;
+    }
+    if (isFloatRegister(reg)) {
+        emit(e, "cvtsi2sdq %s, %s", reg64[r], floatRegister(reg));
+        return;
+    }
+    Reg to = intRegister(reg);
+    switch (result.sym->type) {
+        case CHAR_T:
+            emit(e, "movsbq %s, %s", reg8[r], reg64[to]);
+            break;
+        case BOOL_T:
+            emit(e, "testq %s, %s", reg64[r], reg64[r]);
+            emit(e, "setne %s", reg8[to]);
+            emit(e, "movzbl %s, %s", reg8[to], reg32[to]);
+            break;
+        default:
+            emit(e, "movslq %s, %s", reg32[r], reg64[to]);
+            break;
+    }
+}
+
+// Store the double in xmm to the result operand; uses %r10 and %r11
+static void storeFloat(Emitter *e, Operand result, const char *xmm) {
+    int reg = regOf(result);
+    if (reg < 0) {
+        if (isVariable(result))
+            storeFloatTo(e, memOf(result.sym), result.sym->type, xmm);
+    } else if (isFloatRegister(reg)) {
+        if (strcmp(floatRegister(reg), xmm) != 0)
+            emit(e, "movapd %s, %s", xmm, floatRegister(reg));
+    } else if (result.sym->type == BOOL_T) {
+        floatTruth(e, xmm, intRegister(reg));
+        emit(e, "movzbl %s, %s", reg8[intRegister(reg)], reg32[intRegister(reg)]);
+    } else {
+        emit(e, "cvttsd2siq %s, %%r11", xmm);
+        storeInt(e, result, R11);
+    }
+}
+
+// result = o, converting as the VM's storeValue does
+static void assign(Emitter *e, Operand result, Operand o) {
+    // Integer registers take constants and same-typed registers directly
+    int to = regOf(result), from = regOf(o);
+    if (to >= 0 && !isFloatRegister(to)) {
+        Type type = result.sym->type;
+        if (o.kind == OPD_INT) {
+            long long v = type == CHAR_T ? (signed char)o.ival : type == BOOL_T ? o.ival != 0 : o.ival;
+            emit(e, "movq $%lld, %s", v, reg64[intRegister(to)]);
+            return;
+        }
+        if (from >= 0 && !isFloatRegister(from) && o.sym->type == type) {
+            if (from != to)
+                emit(e, "movq %s, %s", reg64[intRegister(from)], reg64[intRegister(to)]);
+            return;
+        }
+    }
+    if (isFloatValue(o)) {
+        loadFloat(e, o, "%xmm0");
+        storeFloat(e, result, "%xmm0");
+    } else {
+        loadInt(e, o, RAX);
+        storeInt(e, result, RAX);
+    }
+}
+
+// Store the value of the given type at src into the result operand
+static void copyTo(Emitter *e, Mem src, Type srcType, Operand result) {
+    if (!isVariable(result))
+        return;
+    if (srcType == FLOAT_T) {
+        emit(e, "movsd %s, %%xmm0", src.text);
+        storeFloat(e, result, "%xmm0");
+    } else {
+        loadIntFrom(e, src, srcType, RAX);
+        storeInt(e, result, RAX);
+    }
+}
+
+// Text of o as the source operand of a 64-bit integer instruction, when it
+// needs no loading: a register or an immediate
+static int intSource(Operand o, char *text, size_t size) {
+    int reg = regOf(o);
+    if (reg >= 0 && !isFloatRegister(reg))
+        snprintf(text, size, "%s", reg64[intRegister(reg)]);
+    else if (o.kind == OPD_INT)
+        snprintf(text, size, "$%d", o.ival);
+    else
+        return 0;
+    return 1;
+}
+
+// a in %rax and b in %rcx, or b as an operand in its register or as an immediate
+static void loadIntPair(Emitter *e, Operand a, Operand b, char *bText, size_t size) {
+    loadInt(e, a, RAX);
+    if (!intSource(b, bText, size)) {
+        loadInt(e, b, RCX);
+        snprintf(bText, size, "%%rcx");
+    }
+}
+
+// Whether o is nonzero, as 0 or 1 in r
+static void truthOf(Emitter *e, Operand o, Reg r) {
+    if (isFloatValue(o)) {
+        loadFloat(e, o, "%xmm0");
+        floatTruth(e, "%xmm0", r);
+    } else {
+        loadInt(e, o, r);
+        emit(e, "testq %s, %s", reg64[r], reg64[r]);
+        emit(e, "setne %s", reg8[r]);
+    }
+    emit(e, "movzbl %s, %s", reg8[r], reg32[r]);
+}
+
+// Base address of an array operand, or the value of a pointer, in %rsi
+static void loadBase(Emitter *e, Operand o) {
+    if (isVariable(o) && o.sym->type == ARRAY_T)
+        emit(e, "leaq %s, %%rsi", memOf(o.sym).text);
+    else
+        loadInt(e, o, RSI);
+}
+
+// Type a store through result writes, as the VM decodes it
+static Type storedType(Operand result) {
+    return isVariable(result) && result.sym->eleType != VOID_T ? result.sym->eleType : INT_T;
+}
+
+// Label a jump from quad i goes to: unpatched jumps fall through, and
+// targets outside the code being lowered go to its end
+static int targetOf(const Emitter *e, int i) {
+    const Quad *q = quadAt(i);
+    int t = q->result.kind == OPD_TARGET ? q->result.target : i + 1;
+    if (e->begin >= 0)
+        return t <= e->begin || t > e->end ? e->end : t;
+    if (t < 0 || t > quadIndex)
+        return quadIndex;
+    return e->beginOf[t] >= 0 ? e->beginOf[t] : t;
+}
+
+// a op b for op from OP_LT to OP_NE, with a and b in %xmm0 and %xmm1;
+// jump to the label when it holds, or set %al to it without a label
+static void compareFloats(Emitter *e, OpCode op, const char *jump) {
+    // a < b is tested as b > a, which is false for NaN as it should be
+    int swap = op == OP_LT || op == OP_LE;
+    emit(e, "ucomisd %s, %s", swap ? "%xmm0" : "%xmm1", swap ? "%xmm1" : "%xmm0");
+    const char *cc = op == OP_LT || op == OP_GT ? "a" :
+                     op == OP_LE || op == OP_GE ? "ae" : NULL;
+    if (jump) {
+        if (cc) {
+            emit(e, "j%s %s", cc, jump);
+        } else if (op == OP_EQ) {
+            emit(e, "jp 1f");
+            emit(e, "je %s", jump);
+            label(e, "1");
+        } else {
+            emit(e, "jp %s", jump);
+            emit(e, "jne %s", jump);
+        }
+    } else if (cc) {
+        emit(e, "set%s %%al", cc);
+    } else if (op == OP_EQ) {
+        emit(e, "sete %%al");
+        emit(e, "setnp %%cl");
+        emit(e, "andb %%cl, %%al");
+    } else {
+        emit(e, "setne %%al");
+        emit(e, "setp %%cl");
+        emit(e, "orb %%cl, %%al");
+    }
+}
+
+static const char *const intConditions[] = { "l", "g", "le", "ge", "e", "ne" };
+
+// Note a value pushed for the next call, of the float class or not
+static void notePush(Emitter *e, int isFloat) {
+    if (e->pushed == e->pushedCapacity) {
+        e->pushedCapacity = e->pushedCapacity ? e->pushedCapacity * 2 : 16;
+        e->pushedFloat = (char*)realloc(e->pushedFloat, e->pushedCapacity);
+    }
+    e->pushedFloat[e->pushed++] = isFloat;
+}
+
+static void pushParam(Emitter *e, Operand o) {
+    notePush(e, isFloatValue(o));
+    if (isFloatValue(o)) {
+        loadFloat(e, o, "%xmm0");
+        emit(e, "subq $8, %%rsp");
+        emit(e, "movsd %%xmm0, (%%rsp)");
+    } else {
+        loadInt(e, o, RAX);
+        emit(e, "pushq %%rax");
+    }
+}
+
+// Call func with the last argc values passed by param as its arguments;
+// the result is left in %rax or %xmm0
+static void emitCall(Emitter *e, SymbolEntry *func, int argc) {
+    SymbolTable *table = func->nestedTable;
+    int size = (table->frameSize + 7) & ~7;
+
+    emit(e, "leaq %d(%%rbx), %%rsi", e->frameBytes);
+    emit(e, "leaq %d(%%rsi), %%rax", size);
+    emit(e, "cmpq $__mc_stack_end, %%rax");
+    emit(e, "ja __mc_stack_overflow");
+    emit(e, "cmpl $%d, __mc_depth(%%rip)", VM_MAX_DEPTH);
+    emit(e, "jae __mc_stack_overflow");
+    if (size <= X86_UNROLLED_ZEROING) {
+        for (int k = 0; k < size; k += 8)
+            emit(e, "movq $0, %d(%%rsi)", k);
+    } else {
+        emit(e, "movq %%rsi, %%rdi");
+        emit(e, "xorl %%eax, %%eax");
+        emit(e, "movl $%d, %%ecx", size / 8);
+        emit(e, "rep stosq");
+    }
+
+    // Arguments are the last argc values passed, in order
+    if (argc > e->pushed)
+        argc = e->pushed;
+    int params = func->paramCount < table->count ? func->paramCount : table->count;
+    SymbolEntry *p = table->entries;
+    for (int k = 0; k < argc && k < params; k++, p = p->next) {
+        Mem arg = memAt(RSI, p->offset);
+        int slot = 8 * (argc - 1 - k);
+        if (e->pushedFloat[e->pushed - argc + k]) {
+            emit(e, "movsd %d(%%rsp), %%xmm0", slot);
+            storeFloatTo(e, arg, p->type, "%xmm0");
+        } else {
+            emit(e, "movq %d(%%rsp), %%rax", slot);
+            storeIntTo(e, arg, p->type, RAX);
+        }
+    }
+    if (argc > 0)
+        emit(e, "addq $%d, %%rsp", 8 * argc);
+    e->pushed -= argc;
+
+    emit(e, "pushq %%rbx");
+    emit(e, "movq %%rsi, %%rbx");
+    emit(e, "incl __mc_depth(%%rip)");
+    emit(e, "call mc_%s", func->name);
+    emit(e, "decl __mc_depth(%%rip)");
+    emit(e, "popq %%rbx");
+}
+
+// Leave the function with the value of o, or zero without one
+static void emitReturn(Emitter *e, Operand o) {
+    if (e->pushed > 0)
+        emit(e, "addq $%d, %%rsp", 8 * e->pushed);
+    if (e->begin < 0) {
+        // A return outside any function ends the program
+        emit(e, "movl $1, %%eax");
+    } else if (e->returnType == FLOAT_T) {
+        if (o.kind == OPD_NONE)
+            emit(e, "xorpd %%xmm0, %%xmm0");
+        else
+            loadFloat(e, o, "%xmm0");
+    } else {
+        loadInt(e, o, RAX);
+    }
+    for (int reg = registerFile.intCount - 1; reg >= 0; reg--)
+        if ((e->alloc.used & registerFile.calleeSaved) >> reg & 1)
+            emit(e, "popq %s", reg64[intRegister(reg)]);
+    emit(e, "ret");
+}
+
+// Lower quad i; returns 0 after reporting an error
+static int lowerQuad(Emitter *e, int i) {
+    Quad *q = quadAt(i);
+    char jump[24], source[16];
+    snprintf(jump, sizeof(jump), ".L%d", targetOf(e, i));
+
+    switch (q->op) {
+        case OP_NOP:
+        case OP_FUNC_BEGIN:
+            break;
+        case OP_ASSIGN:
+        case OP_INT2REAL: case OP_REAL2INT:
+        case OP_CHAR2INT: case OP_INT2CHAR:
+        case OP_BOOL2INT: case OP_INT2BOOL:
+            assign(e, q->result, q->arg1);
+            break;
+
+        case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_MOD:
+            if (typeOf(q->result) == FLOAT_T) {
+                loadFloat(e, q->arg1, "%xmm0");
+                loadFloat(e, q->arg2, "%xmm1");
+                if (q->op == OP_MOD) {
+                    // fprem leaves the remainder fmod() returns
+                    emit(e, "movsd %%xmm1, -16(%%rsp)");
+                    emit(e, "fldl -16(%%rsp)");
+                    emit(e, "movsd %%xmm0, -8(%%rsp)");
+                    emit(e, "fldl -8(%%rsp)");
+                    label(e, "1");
+                    emit(e, "fprem");
+                    emit(e, "fnstsw %%ax");
+                    emit(e, "testb $4, %%ah");
+                    emit(e, "jnz 1b");
+                    emit(e, "fstp %%st(1)");
+                    emit(e, "fstpl -8(%%rsp)");
+                    emit(e, "movsd -8(%%rsp), %%xmm0");
+                } else {
+                    static const char *const ops[] = { "addsd", "subsd", "mulsd", "divsd" };
+                    emit(e, "%s %%xmm1, %%xmm0", ops[q->op - OP_ADD]);
+                }
+                storeFloat(e, q->result, "%xmm0");
+                break;
+            }
+            if (q->op == OP_ADD || q->op == OP_SUB || q->op == OP_MUL) {
+                static const char *const ops[] = { "addq", "subq", "imulq" };
+                loadIntPair(e, q->arg1, q->arg2, source, sizeof(source));
+                emit(e, "%s %s, %%rax", ops[q->op - OP_ADD], source);
+            } else {
+                loadInt(e, q->arg1, RAX);
+                loadInt(e, q->arg2, RCX);
+                emit(e, "testq %%rcx, %%rcx");
+                emit(e, "je __mc_divide_by_zero");
+                // x / -1 is -x and x % -1 is 0, which idivq may trap on
+                emit(e, "cmpq $-1, %%rcx");
+                emit(e, "jne 1f");
+                emit(e, q->op == OP_DIV ? "negq %%rax" : "xorl %%eax, %%eax");
+                emit(e, "jmp 2f");
+                label(e, "1");
+                emit(e, "cqto");
+                emit(e, "idivq %%rcx");
+                if (q->op == OP_MOD)
+                    emit(e, "movq %%rdx, %%rax");
+                label(e, "2");
+            }
+            storeInt(e, q->result, RAX);
+            break;
+
+        case OP_BITAND: case OP_BITOR: case OP_BITXOR: case OP_SHL: case OP_SHR:
+            if (q->op == OP_BITAND || q->op == OP_BITOR || q->op == OP_BITXOR) {
+                static const char *const ops[] = { "andq", "orq", "xorq" };
+                loadIntPair(e, q->arg1, q->arg2, source, sizeof(source));
+                emit(e, "%s %s, %%rax", ops[q->op - OP_BITAND], source);
+            } else {
+                loadInt(e, q->arg1, RAX);
+                loadInt(e, q->arg2, RCX);
+                if (q->op == OP_SHL) {
+                    emit(e, "andl $31, %%ecx");
+                    emit(e, "shlq %%cl, %%rax");
+                } else {
+                    emit(e, "sarl %%cl, %%eax");
+                    emit(e, "movslq %%eax, %%rax");
+                }
+            }
+            storeInt(e, q->result, RAX);
+            break;
+
+        case OP_LT: case OP_GT: case OP_LE: case OP_GE: case OP_EQ: case OP_NE:
+            if (isFloatValue(q->arg1) || isFloatValue(q->arg2)) {
+                loadFloat(e, q->arg1, "%xmm0");
+                loadFloat(e, q->arg2, "%xmm1");
+                compareFloats(e, q->op, NULL);
+            } else {
+                loadIntPair(e, q->arg1, q->arg2, source, sizeof(source));
+                emit(e, "cmpq %s, %%rax", source);
+                emit(e, "set%s %%al", intConditions[q->op - OP_LT]);
+            }
+            emit(e, "movzbl %%al, %%eax");
+            storeInt(e, q->result, RAX);
+            break;
+
+        case OP_LOGAND:
+        case OP_LOGOR:
+            truthOf(e, q->arg1, RAX);
+            truthOf(e, q->arg2, RCX);
+            emit(e, q->op == OP_LOGAND ? "andl %%ecx, %%eax" : "orl %%ecx, %%eax");
+            storeInt(e, q->result, RAX);
+            break;
+        case OP_NOT:
+            truthOf(e, q->arg1, RAX);
+            emit(e, "xorl $1, %%eax");
+            storeInt(e, q->result, RAX);
+            break;
+        case OP_UMINUS:
+            if (typeOf(q->result) == FLOAT_T) {
+                loadFloat(e, q->arg1, "%xmm0");
+                emit(e, "movabsq $%lld, %%r11", (long long)(1ULL << 63));
+                emit(e, "movq %%r11, %%xmm1");
+                emit(e, "xorpd %%xmm1, %%xmm0");
+                storeFloat(e, q->result, "%xmm0");
+            } else {
+                loadInt(e, q->arg1, RAX);
+                emit(e, "negq %%rax");
+                storeInt(e, q->result, RAX);
+            }
+            break;
+
+        case OP_ADDR:
+            if (isVariable(q->arg1))
+                emit(e, "leaq %s, %%rax", memOf(q->arg1.sym).text);
+            else
+                emit(e, "xorl %%eax, %%eax");
+            storeInt(e, q->result, RAX);
+            break;
+        case OP_DEREF:
+            loadInt(e, q->arg1, RSI);
+            copyTo(e, memAt(RSI, 0), typeOf(q->result), q->result);
+            break;
+        case OP_ARRAY_LOAD:
+            loadBase(e, q->arg1);
+            loadInt(e, q->arg2, RCX);
+            emit(e, "addq %%rcx, %%rsi");
+            copyTo(e, memAt(RSI, 0), typeOf(q->result), q->result);
+            break;
+        case OP_ARRAY_STORE:
+            loadBase(e, q->result);
+            loadInt(e, q->arg1, RCX);
+            emit(e, "addq %%rcx, %%rsi");
+            move(e, q->arg2, memAt(RSI, 0), storedType(q->result));
+            break;
+        case OP_PTR_STORE:
+            loadInt(e, q->result, RSI);
+            move(e, q->arg1, memAt(RSI, 0), storedType(q->result));
+            break;
+
+        case OP_GOTO:
+            emit(e, "jmp %s", jump);
+            break;
+        case OP_IF:
+        case OP_IFFALSE:
+            if (isFloatValue(q->arg1)) {
+                loadFloat(e, q->arg1, "%xmm0");
+                floatTruth(e, "%xmm0", RAX);
+                emit(e, "testb %%al, %%al");
+            } else {
+                loadInt(e, q->arg1, RAX);
+                emit(e, "testq %%rax, %%rax");
+            }
+            emit(e, "%s %s", q->op == OP_IF ? "jne" : "je", jump);
+            break;
+        case OP_IFLT: case OP_IFGT: case OP_IFLE: case OP_IFGE: case OP_IFEQ: case OP_IFNE:
+            if (isFloatValue(q->arg1) || isFloatValue(q->arg2)) {
+                loadFloat(e, q->arg1, "%xmm0");
+                loadFloat(e, q->arg2, "%xmm1");
+                compareFloats(e, (OpCode)(q->op - OP_IFLT + OP_LT), jump);
+            } else {
+                loadIntPair(e, q->arg1, q->arg2, source, sizeof(source));
+                emit(e, "cmpq %s, %%rax", source);
+                emit(e, "j%s %s", intConditions[q->op - OP_IFLT], jump);
+            }
+            break;
+
+        case OP_PARAM:
+            pushParam(e, q->arg1);
+            break;
+        case OP_CALL:
+            // Defined functions carry a scratch id while lowering
+            if (q->arg1.kind != OPD_SYM || !q->arg1.sym->nestedTable || q->arg1.sym->id < 0) {
+                fprintf(stderr, "Error: %s is called but never defined\n",
+                        q->arg1.kind == OPD_SYM ? q->arg1.sym->name : "?");
+                return 0;
+            }
+            emitCall(e, q->arg1.sym, q->arg2.kind == OPD_INT ? q->arg2.ival : 0);
+            if (returnTypeOf(q->arg1.sym) == FLOAT_T)
+                storeFloat(e, q->result, "%xmm0");
+            else
+                storeInt(e, q->result, RAX);
+            break;
+        case OP_RETURN:
+            emitReturn(e, q->arg1);
+            break;
+        case OP_FUNC_END:
+            emitReturn(e, noOperand());
+            break;
+        default:
+            break;
+    }
+    return 1;
+}
+
+static int emitRange(Emitter *e, int from, int to) {
+    for (int i = from; i <= to; i++) {
+        if (e->isTarget[i])
+            label(e, ".L%d", i);
+        if (i < quadIndex && !lowerQuad(e, i))
+            return 0;
+    }
+    return 1;
+}
+
+static int emitFunction(Emitter *e, int begin, int end) {
+    SymbolEntry *func = quadAt(begin)->arg1.sym;
+    e->begin = begin;
+    e->end = end;
+    e->returnType = returnTypeOf(func);
+    e->frameBytes = (func->nestedTable->frameSize + 7) & ~7;
+    e->pushed = 0;
+    CFG *cfg = buildCFG(begin);
+    memset(&e->alloc, 0, sizeof(e->alloc));
+    if (cfg)
+        e->alloc = allocateRegisters(cfg, &registerFile);
+    if (e->stats)
+        fprintf(stderr, "regalloc   : %s: %d of %d variables in registers, %d spilled\n",
+                func->name, e->alloc.candidates - e->alloc.spilled, e->alloc.candidates,
+                e->alloc.spilled);
+
+    blank(e);
+    label(e, "mc_%s", func->name);
+    for (int reg = 0; reg < registerFile.intCount; reg++)
+        if ((e->alloc.used & registerFile.calleeSaved) >> reg & 1)
+            emit(e, "pushq %s", reg64[intRegister(reg)]);
+    for (int k = 0; k < e->alloc.onEntryCount; k++) {
+        SymbolEntry *var = e->alloc.onEntry[k];
+        if (isFloatRegister(var->id))
+            emit(e, "movsd %s, %s", memOf(var).text, floatRegister(var->id));
+        else
+            loadIntFrom(e, memOf(var), var->type, intRegister(var->id));
+    }
+    int ok = emitRange(e, begin + 1, end);
+
+    if (cfg) {
+        resetVariables(cfg);
+        freeCFG(cfg);
+    }
+    freeAllocation(&e->alloc);
+    memset(&e->alloc, 0, sizeof(e->alloc));
+    return ok;
+}
+
+// The quads outside functions, which initialise the globals; returns 1
+// if they end the program with a return
+static int emitGlobalCode(Emitter *e) {
+    e->begin = e->end = -1;
+    e->returnType = INT_T;
+    e->frameBytes = 0;
+    e->pushed = 0;
+    blank(e);
+    label(e, "__mc_init");
+    for (int i = 0; i < quadIndex; i++) {
+        Quad *q = quadAt(i);
+        if (e->isTarget[i])
+            label(e, ".L%d", i);
+        if (q->op == OP_FUNC_BEGIN && e->beginOf[i + 1] == i) {
+            i = functionEnd(i);
+            continue;
+        }
+        if (!lowerQuad(e, i))
+            return 0;
+    }
+    if (e->isTarget[quadIndex])
+        label(e, ".L%d", quadIndex);
+    emit(e, "xorl %%eax, %%eax");
+    emit(e, "ret");
+    return 1;
+}
+
+// main: run the global code, call the microC main and print its result
+static void emitMain(Emitter *e, SymbolEntry *entry) {
+    Type type = returnTypeOf(entry);
+    Mem result;
+    snprintf(result.text, sizeof(result.text), "__mc_result(%%rip)");
+
+    blank(e);
+    emit(e, ".globl main");
+    label(e, "main");
+    emit(e, "pushq %%rbx");
+    emit(e, "movl $__mc_stack, %%ebx");
+    emit(e, "call __mc_init");
+    emit(e, "testl %%eax, %%eax");
+    emit(e, "jnz 1f");
+    e->begin = e->end = -1;
+    e->frameBytes = 0;
+    e->pushed = 0;
+    emitCall(e, entry, 0);
+    if (type == FLOAT_T)
+        storeFloatTo(e, result, type, "%xmm0");
+    else
+        storeIntTo(e, result, type, RAX);
+    label(e, "1");
+    if (type == FLOAT_T) {
+        emit(e, "movsd %s, %%xmm0", result.text);
+        emit(e, "leaq .Lfloat_result(%%rip), %%rdi");
+        emit(e, "movl $1, %%eax");
+    } else {
+        loadIntFrom(e, result, type, RSI);
+        emit(e, "leaq .Lint_result(%%rip), %%rdi");
+        emit(e, "xorl %%eax, %%eax");
+    }
+    emit(e, "call printf");
+    emit(e, "popq %%rbx");
+    emit(e, "xorl %%eax, %%eax");
+    emit(e, "ret");
+}
+
+// System V entry points for the JIT: mc_<name>_entry takes the function's
+// parameters as C arguments and returns its value converted to its return
+// type, and __mc_init_entry runs the global code
+static void emitEntries(Emitter *e) {
+    static const char *const args32[] = { "%edi", "%esi", "%edx", "%ecx", "%r8d", "%r9d" };
+    static const char *const args8[]  = { "%dil", "%sil", "%dl", "%cl", "%r8b", "%r9b" };
+    Mem result;
+    snprintf(result.text, sizeof(result.text), "__mc_result(%%rip)");
+
+    e->begin = e->end = -1;
+    e->frameBytes = 0;
+    for (int i = 0; i < quadIndex; i++) {
+        if (e->beginOf[i + 1] != i || quadAt(i)->op != OP_FUNC_BEGIN)
+            continue;
+        SymbolEntry *func = quadAt(i)->arg1.sym;
+        SymbolTable *table = func->nestedTable;
+        int params = func->paramCount < table->count ? func->paramCount : table->count;
+        label(e, "mc_%s_entry", func->name);
+        emit(e, "pushq %%rbx");
+        emit(e, "movl $__mc_stack, %%ebx");
+
+        // Pass each argument as param would, from its register or the stack
+        e->pushed = 0;
+        int ints = 0, floats = 0, stacked = 0;
+        SymbolEntry *p = table->entries;
+        for (int k = 0; k < params; k++, p = p->next) {
+            if (p->type == FLOAT_T) {
+                if (floats < 8)
+                    emit(e, "movapd %%xmm%d, %%xmm15", floats++);
+                else
+                    emit(e, "movsd %d(%%rsp), %%xmm15", 8 * (2 + e->pushed + stacked++));
+                emit(e, "subq $8, %%rsp");
+                emit(e, "movsd %%xmm15, (%%rsp)");
+            } else {
+                if (ints < 6) {
+                    if (p->type == CHAR_T)
+                        emit(e, "movsbq %s, %%rax", args8[ints]);
+                    else if (p->type == BOOL_T)
+                        emit(e, "movzbl %s, %%eax", args8[ints]);
+                    else
+                        emit(e, "movslq %s, %%rax", args32[ints]);
+                    ints++;
+                } else {
+                    Mem arg;
+                    snprintf(arg.text, sizeof(arg.text), "%d(%%rsp)", 8 * (2 + e->pushed + stacked++));
+                    loadIntFrom(e, arg, p->type, RAX);
+                }
+                emit(e, "pushq %%rax");
+            }
+            notePush(e, p->type == FLOAT_T);
+        }
+        emitCall(e, func, params);
+
+        Type type = returnTypeOf(func);
+        if (type == VOID_T) {
+            emit(e, "xorl %%eax, %%eax");
+        } else if (type != FLOAT_T) {
+            storeIntTo(e, result, type, RAX);
+            loadIntFrom(e, result, type, RAX);
+        }
+        emit(e, "popq %%rbx");
+        emit(e, "ret");
+    }
+
+    label(e, "__mc_init_entry");
+    emit(e, "pushq %%rbx");
+    emit(e, "movl $__mc_stack, %%ebx");
+    emit(e, "call __mc_init");
+    emit(e, "popq %%rbx");
+    emit(e, "ret");
+}
+
+// Run time errors report their message and end the program, or go to the
+// JIT's handler
+static void emitFailures(Emitter *e) {
+    blank(e);
+    label(e, "__mc_divide_by_zero");
+    emit(e, "leaq .Ldivide_by_zero(%%rip), %%rdi");
+    emit(e, "jmp __mc_fail");
+    label(e, "__mc_stack_overflow");
+    emit(e, "leaq .Lstack_overflow(%%rip), %%rdi");
+    label(e, "__mc_fail");
+    emit(e, "andq $-16, %%rsp");
+    if (e->sink) {
+        emit(e, "movabsq $%lld, %%rax", (long long)(intptr_t)e->sink->fail);
+        emit(e, "call *%%rax");
+    } else {
+        emit(e, "movq stderr(%%rip), %%rsi");
+        emit(e, "call fputs");
+        emit(e, "movl $1, %%edi");
+        emit(e, "call exit");
+    }
+}
+
+static void emitData(Emitter *e) {
+    blank(e);
+    emit(e, ".section .rodata");
+    if (!e->sink) {
+        label(e, ".Lint_result");
+        emit(e, ".string \"main returned %%lld\\n\"");
+        label(e, ".Lfloat_result");
+        emit(e, ".string \"main returned %%f\\n\"");
+    }
+    label(e, ".Ldivide_by_zero");
+    emit(e, ".string \"Error: division by zero\\n\"");
+    label(e, ".Lstack_overflow");
+    emit(e, ".string \"Error: call stack overflow\\n\"");
+
+    blank(e);
+    emit(e, ".bss");
+    emit(e, ".align 16");
+    label(e, "__mc_globals");
+    emit(e, ".zero %d", globalTable->frameSize > 0 ? globalTable->frameSize : 8);
+    emit(e, ".align 8");
+    label(e, "__mc_result");
+    emit(e, ".zero 8");
+    label(e, "__mc_depth");
+    emit(e, ".zero 8");
+    emit(e, ".align 16");
+    label(e, "__mc_stack");
+    emit(e, ".zero %d", VM_STACK_BYTES);
+    label(e, "__mc_stack_end");
+    if (!e->sink) {
+        blank(e);
+        emit(e, ".section .note.GNU-stack,\"\",@progbits");
+    }
+}
+
+// Lower the whole program, with the C main that runs entry when writing a
+// file and the entry points of every function for the JIT; returns 1, or
+// 0 after reporting an error
+static int lowerProgram(Emitter *e, SymbolEntry *entry) {
+    e->beginOf = (int*)malloc((quadIndex + 1) * sizeof(int));
+    e->isTarget = (char*)calloc(quadIndex + 1, 1);
+    for (int i = 0; i <= quadIndex; i++)
+        e->beginOf[i] = -1;
+    for (int i = 0; i < quadIndex; i++) {
+        int end = quadAt(i)->op == OP_FUNC_BEGIN && quadAt(i)->arg1.kind == OPD_SYM &&
+                  quadAt(i)->arg1.sym->nestedTable ? functionEnd(i) : -1;
+        if (end < 0)
+            continue;
+        for (int k = i + 1; k <= end; k++)
+            e->beginOf[k] = i;
+        quadAt(i)->arg1.sym->id = 0;
+        i = end;
+    }
+
+    // Mark the labels jumps need, each in the code it belongs to
+    for (int i = 0; i < quadIndex; i++) {
+        OpCode op = quadAt(i)->op;
+        if (op != OP_GOTO && !isConditionalJump(op))
+            continue;
+        e->begin = e->beginOf[i];
+        e->end = e->begin >= 0 ? functionEnd(e->begin) : -1;
+        e->isTarget[targetOf(e, i)] = 1;
+    }
+
+    emit(e, ".text");
+    int ok = emitGlobalCode(e);
+    for (int i = 0; i < quadIndex && ok; i++) {
+        if (e->beginOf[i + 1] == i && quadAt(i)->op == OP_FUNC_BEGIN) {
+            int end = functionEnd(i);
+            ok = emitFunction(e, i, end);
+            i = end;
+        }
+    }
+    if (ok && entry && entry->id < 0) {
+        fprintf(stderr, "Error: %s is declared but never defined\n", entry->name);
+        ok = 0;
+    }
+    if (ok) {
+        if (e->sink)
+            emitEntries(e);
+        else
+            emitMain(e, entry);
+        emitFailures(e);
+        emitData(e);
+    }
+
+    free(e->beginOf);
+    free(e->isTarget);
+    free(e->pushedFloat);
+    for (SymbolEntry *sym = globalTable->entries; sym; sym = sym->next)
+        sym->id = -1;
+    return ok;
+}
+
+// Write the program as x86-64 assembly; returns 0, or -1 after an error
+int writeAssembly(const char *path, int stats) {
+    SymbolEntry *entry = lookupInCurrentScope(globalTable, "main");
+    if (!entry || !entry->nestedTable) {
+        fprintf(stderr, "Error: no function main to compile\n");
+        return -1;
+    }
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+
+    Emitter e;
+    memset(&e, 0, sizeof(e));
+    outOpen(&e.out, fd);
+    e.stats = stats;
+    int ok = lowerProgram(&e, entry);
+    if (outClose(&e.out) != 0)
+        ok = 0;
+    if (close(fd) != 0) {
+        perror(path);
+        ok = 0;
+    }
+    return ok ? 0 : -1;
+}
+
+int lowerToSink(const AsmSink *sink, int stats) {
+    Emitter e;
+    memset(&e, 0, sizeof(e));
+    e.sink = sink;
+    e.stats = stats;
+    return lowerProgram(&e, NULL) ? 0 : -1;
+}
@@ -0,0 +1,33 @@
+#ifndef X86_H
+#define X86_H
+
+#include "quad.h"
+
+// x86-64 assembly for the quads, in GNU as syntax for the System V ABI.
+// The program keeps the VM's memory model: globals live in one block laid
+// out as in the global table, and every call gets a frame laid out as its
+// function's table on a stack of its own, with %rbx pointing at the
+// current frame. Pointers are 4 bytes as in the tables, so the data must
+// sit in the low 4 GB: link the output with gcc -no-pie.
+//
+// The generated main runs the global initialisers, calls the microC main
+// and prints its result as --run does. With stats, the registers given to
+// the variables of each function are reported on stderr.
+
+int writeAssembly(const char *path, int stats);
+
+// Lowering for the JIT (jit.c): each line of assembly goes to line()
+// instead of a file, with its indentation. There is no C main; instead
+// every function gets a System V entry point mc_<name>_entry that takes
+// its parameters as C arguments, __mc_init_entry runs the global code and
+// returns nonzero if it ended the program, and run time errors call fail()
+// with their message, which must not return.
+typedef struct AsmSink {
+    void (*line)(void *context, const char *text);
+    void *context;
+    void (*fail)(const char *message);
+} AsmSink;
+
+int lowerToSink(const AsmSink *sink, int stats);
+
+#endif